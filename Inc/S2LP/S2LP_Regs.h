@@ -1209,7 +1209,7 @@
 #define PA_CONFIG1_ADDR			((uint8_t)0x63)
 
 #define LIN_NLOG_REGMASK			((uint8_t)0x10)
-#define FIR_CFG_REGMASK			((uint8_t)0xC0)
+#define FIR_CFG_REGMASK			((uint8_t)0x0C)
 #define FIR_EN_REGMASK			((uint8_t)0x02)
 
 
@@ -1246,7 +1246,7 @@
 #define VCO_CONFIG_ADDR			((uint8_t)0x68)
 
 #define VCO_CALAMP_EXT_SEL_REGMASK			((uint8_t)0x20)
-#define VCO_CALFREQ_EXT_SEL_REGMASK			((uint8_t)0x20)
+#define VCO_CALFREQ_EXT_SEL_REGMASK			((uint8_t)0x10)
 
 
 /**
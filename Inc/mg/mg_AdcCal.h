@@ -0,0 +1,116 @@
+/** ***************************************************************************
+*   \file        mg_AdcCal.h
+*   \brief       ADC calibration and light sensor self-test, cached in the data
+*                EEPROM so that calibration only reruns on drift or age.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+#ifndef MG_ADCCAL_H
+#define MG_ADCCAL_H
+/*****************************************************************************/
+// standard libraries first
+#include <stdint.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "stm32l0xx_hal.h"
+
+// user headers from other components
+#include "mg_LightSensor.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+// enumerations
+
+/**
+* @brief Light sensor self-test outcome
+*/
+typedef enum {
+  ADC_SELFTEST_NOT_RUN = 0,     /*!< No self-test result available */
+  ADC_SELFTEST_PASS,            /*!< Output near zero when unpowered and responds when powered */
+  ADC_SELFTEST_DARK,            /*!< Output near zero when unpowered, no light to prove the response */
+  ADC_SELFTEST_FAIL             /*!< Output present with the sensor unpowered, or ADC error */
+} AdcSelfTest;
+
+/**
+* @brief Why the calibration was (or was not) redone
+*/
+typedef enum {
+  ADCCAL_CACHED = 0,            /*!< Cached factor still valid and applied */
+  ADCCAL_NO_RECORD,             /*!< No valid record in EEPROM */
+  ADCCAL_VDD_DRIFT,             /*!< Supply moved more than ADCCAL_VDD_DRIFT_MV */
+  ADCCAL_TEMP_DRIFT,            /*!< Temperature moved more than ADCCAL_TEMP_DRIFT_C */
+  ADCCAL_AGED,                  /*!< Record older than ADCCAL_MAX_AGE_S */
+  ADCCAL_ERROR                  /*!< Calibration could not be run */
+} AdcCalReason;
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/**
+* @brief Calibration record as stored in the data EEPROM, word aligned
+*/
+typedef struct {
+  uint32_t lTag;                /*!< ADCCAL_TAG when the record is valid */
+  uint32_t lCalFactor;          /*!< ADC CALFACT value */
+  uint32_t lCalTimeS;           /*!< RTC time of the calibration, seconds since 01/01/00 */
+  uint16_t nVddMv;              /*!< VDDA at calibration */
+  int16_t  iTempC;              /*!< Die temperature at calibration */
+  uint16_t nDarkRaw;            /*!< Self-test reading, sensor unpowered */
+  uint16_t nLightRaw;           /*!< Self-test reading, sensor powered */
+  uint32_t lSelfTest;           /*!< AdcSelfTest result */
+  uint32_t lCheck;              /*!< Complement of the sum of the previous words */
+} SAdcCalRecord;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* Record location and validity tag, bump the tag when the layout changes */
+#define ADCCAL_EEPROM_ADDR          DATA_EEPROM_BASE
+#define ADCCAL_TAG                  0x32F3
+
+/* Recalibration triggers */
+#define ADCCAL_VDD_DRIFT_MV         100
+#define ADCCAL_TEMP_DRIFT_C         10
+#define ADCCAL_MAX_AGE_S            (7UL*24UL*3600UL)
+
+/* Self-test limits, raw counts */
+#define ADCCAL_SELFTEST_DARK_MAX    40      // unpowered output must stay below this
+#define ADCCAL_SELFTEST_MIN_DELTA   20      // powered minus unpowered to prove a response
+
+/*****************************************************************************/
+// function declarations
+AdcCalReason AdcCalBoot(void);
+AdcCalReason AdcCalService(const SLightSample *pxSample);
+void AdcCalGetRecord(SAdcCalRecord *pxRecord);
+
+/*****************************************************************************/
+// variables
+
+/*****************************************************************************/
+// functions
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MG_ADCCAL_H
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
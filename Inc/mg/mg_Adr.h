@@ -0,0 +1,135 @@
+/** ***************************************************************************
+*   \file        mg_Adr.h
+*   \brief       Adaptive data rate. The node picks among a few modem
+*                profiles the fastest one its link margin at full power
+*                allows, from the link quality answers, and announces it
+*                after each report. The modem registers of every profile are
+*                computed once, a switch is a couple of SPI bursts. A
+*                profile may add the radio's convolutional coding.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+#ifndef MG_ADR_H
+#define MG_ADR_H
+/*****************************************************************************/
+// standard libraries first
+#include <stdint.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "S2LP_Config.h"
+#include "stm32l0xx_hal.h"
+
+// user headers from other components
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/* Profiles in a table */
+#define ADR_MAX                     4
+
+/**
+* @brief Modem profile, as given to S2LPRadioInit()
+*/
+typedef struct {
+  uint32_t lDatarate;           /*!< bit/s, the PA filter follows it */
+  ModulationSelect xModulation; /*!< FSK family, the Gaussian BT included */
+  uint32_t lFreqDev;            /*!< Hz */
+  uint32_t lBandwidth;          /*!< Channel filter, Hz */
+  int8_t cSensitivityDbm;       /*!< Receiver sensitivity at this rate */
+  SFunctionalState xFec;        /*!< Rate 1/2 convolutional coding after the sync word */
+} SAdrProfile;
+
+/**
+* @brief Profile table and selection margins
+*/
+typedef struct {
+  const SAdrProfile *pxProfiles;  /*!< Slowest first, the first one is the fallback */
+  uint8_t cProfiles;            /*!< Profiles, up to ADR_MAX */
+  uint32_t lFrequencyBase;      /*!< Hz, for S2LPRadioInit() */
+  uint32_t lPreambleUs;         /*!< Preamble kept at this duration, 0 to leave it */
+  uint16_t nOverheadBits;       /*!< Packet bits beyond payload and preamble */
+  uint8_t cMarginDb;            /*!< Margin above sensitivity at full power */
+  uint8_t cHystDb;              /*!< Extra margin to move to a faster profile */
+  uint8_t cSyncBits;            /*!< Sync word, never coded */
+} SAdrConfig;
+
+/**
+* @brief Selection state and counters since AdrInit()
+*/
+typedef struct {
+  uint8_t cProfile;             /*!< Profile tuned */
+  uint8_t cWanted;              /*!< Profile the link margin allows */
+  uint32_t lSwitches;           /*!< Profile changes */
+  uint32_t lStepsUp;            /*!< Faster profile wanted */
+  uint32_t lStepsDown;          /*!< Slower profile wanted */
+  uint32_t lReports[ADR_MAX];   /*!< Reports per profile */
+  uint32_t lReadings[ADR_MAX];  /*!< Readings per profile */
+  uint64_t llAirUs[ADR_MAX];    /*!< Report air time per profile, us */
+  uint32_t lAttempts[ADR_MAX];  /*!< Reports sent, retransmissions included */
+  uint32_t lDelivered[ADR_MAX]; /*!< Reports acked */
+  uint32_t lDeliveredBytes[ADR_MAX];  /*!< Payload bytes of the reports acked */
+  uint64_t llChargeNc[ADR_MAX]; /*!< TX charge of all attempts, nC */
+} SAdrStats;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* Profile used before one is agreed, and after the link went silent */
+#define ADR_FALLBACK                0
+
+/* Profile wanted for the next report, right after a report */
+#define ADR_TRAILER_BYTES           1
+
+/*****************************************************************************/
+// function declarations
+void AdrInit(const SAdrConfig *pxConfig);
+void AdrConfigure(void);
+void AdrApply(uint8_t cProfile);
+uint8_t AdrCurrent(void);
+uint8_t AdrProfiles(void);
+const SAdrProfile *AdrGetProfile(uint8_t cProfile);
+uint8_t AdrFeedback(int8_t cRssiDbm, uint8_t cSyncErrors, uint8_t cSyncErrorsMax, float fHeadroomDb);
+uint8_t AdrWanted(void);
+void AdrSetWanted(uint8_t cProfile);
+uint8_t AdrTrailerBuild(uint8_t *pcBuffer);
+HAL_StatusTypeDef AdrTrailerParse(const uint8_t *pcFrame, uint8_t cLen, uint8_t *pcProfile);
+uint32_t AdrAirUs(uint8_t cProfile, uint8_t cLen);
+void AdrLogReport(uint8_t cProfile, uint8_t cReadings, uint8_t cLen);
+void AdrLogDelivery(uint8_t cProfile, uint8_t cLen, uint8_t cAttempts, uint8_t cDelivered, uint32_t lTxNa);
+void AdrGetStats(SAdrStats *pxStats);
+
+/*****************************************************************************/
+// variables
+
+/*****************************************************************************/
+// functions
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MG_ADR_H
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -0,0 +1,147 @@
+/** ***************************************************************************
+*   \file        mg_Aggregate.h
+*   \brief       Reading aggregation. Timestamped light readings are queued
+*                and packed into one variable length report, sent when the
+*                byte budget is reached or the oldest reading is due, so the
+*                preamble, sync and CRC are paid once for several readings.
+*                Readings are delta coded with mg_Codec as they are queued.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+#ifndef MG_AGGREGATE_H
+#define MG_AGGREGATE_H
+/*****************************************************************************/
+// standard libraries first
+#include <stdint.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "stm32l0xx_hal.h"
+
+// user headers from other components
+#include "mg_Codec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+// enumerations
+
+/**
+* @brief Why a report is sent
+*/
+typedef enum {
+  AGG_FLUSH_NONE = 0,           /*!< Keep queuing */
+  AGG_FLUSH_BUDGET,             /*!< No room for another reading within the byte budget */
+  AGG_FLUSH_DEADLINE,           /*!< Oldest reading waited the deadline */
+  AGG_FLUSH_FORCED,             /*!< Sent on request, e.g. with a heartbeat */
+  AGG_FLUSH_NB_REASONS
+} AggFlushReason;
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/**
+* @brief Aggregation configuration
+*/
+typedef struct {
+  uint8_t cBudgetBytes;         /*!< Largest report payload, at most AGG_FRAME_MAX */
+  uint32_t lDeadlineMs;         /*!< Longest a reading is held back */
+  uint16_t nOverheadBits;       /*!< Preamble, sync, length and CRC bits per packet */
+  uint32_t lDatarate;           /*!< bit/s, for the air time */
+  uint8_t cReadingsMax;         /*!< Readings per report, 0 for no limit but the budget */
+} SAggConfig;
+
+/**
+* @brief One reading, as queued and as unpacked by the receiver
+*/
+typedef struct {
+  uint32_t lTimestamp;          /*!< TimestampNow() when taken, 1/16 s resolution on air */
+  uint32_t lLux;                /*!< Filtered reading */
+  uint8_t cReason;              /*!< RbeReason that made it significant */
+} SAggReading;
+
+/**
+* @brief Report header, as unpacked by the receiver
+*/
+typedef struct {
+  uint16_t nSeq;                /*!< Report sequence number */
+  uint8_t cCount;               /*!< Readings carried */
+  uint32_t lBaseTs;             /*!< Timestamp of the first reading */
+} SAggHeader;
+
+/**
+* @brief Counters since AggInit()
+*/
+typedef struct {
+  uint32_t lReadings;           /*!< Readings sent */
+  uint32_t lPackets;            /*!< Reports sent */
+  uint32_t lPayloadBytes;       /*!< Report payload bytes sent */
+  uint32_t lRawBytes;           /*!< Payload bytes with AGG_RAW_READING_BYTES per reading */
+  uint64_t llAirUs;             /*!< Report air time, us */
+  uint64_t llAirSavedUs;        /*!< Air time saved by the codec, us */
+  uint32_t lEncodeCycles;       /*!< Core cycles spent coding readings */
+  uint16_t nEncodeCyclesMax;    /*!< Longest reading coding, cycles */
+  uint32_t lFlushes[AGG_FLUSH_NB_REASONS];  /*!< Reports per flush reason */
+} SAggStats;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* Report: marker, sequence number and reading count, base timestamp, all
+   little endian, then the readings coded by CodecEncode(), times as offsets
+   from the base in 1/16 s */
+#define AGG_FRAME_MARKER            0xE7
+#define AGG_HEADER_BYTES            8
+#define AGG_FRAME_MAX               96          // within the 128 byte FIFO, no refill while sending
+
+/* Fixed size reading the codec is compared with: 16 bit offset, 24 bit lux
+   and reason */
+#define AGG_RAW_READING_BYTES       6
+
+/* Reading offsets are kept below 2^16 of 1/16 s by the deadline, which
+   bounds a coded reading to CODEC_READING_MAX_BYTES */
+#define AGG_OFFSET_SHIFT            4
+#define AGG_DEADLINE_MAX_MS         4000000UL
+
+/*****************************************************************************/
+// function declarations
+void AggInit(const SAggConfig *pxConfig);
+void AggSetDeadline(uint32_t lDeadlineMs);
+AggFlushReason AggAdd(uint32_t lTimestamp, uint32_t lLux, uint8_t cReason, uint32_t lNowMs);
+AggFlushReason AggDue(uint32_t lNowMs);
+uint32_t AggMsToDeadline(uint32_t lNowMs);
+uint8_t AggPending(void);
+uint8_t AggBuild(uint8_t *pcBuffer, uint8_t cSize, uint16_t nSeq, AggFlushReason xReason);
+void AggGetStats(SAggStats *pxStats);
+HAL_StatusTypeDef AggParse(const uint8_t *pcFrame, uint8_t cLen, SAggHeader *pxHeader);
+HAL_StatusTypeDef AggGetReading(const uint8_t *pcFrame, uint8_t cLen, uint8_t cIndex, SAggReading *pxReading);
+
+/*****************************************************************************/
+// variables
+
+/*****************************************************************************/
+// functions
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MG_AGGREGATE_H
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
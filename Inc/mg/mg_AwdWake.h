@@ -0,0 +1,87 @@
+/** ***************************************************************************
+*   \file        mg_AwdWake.h
+*   \brief       Wake-on-light-change. The ADC analog watchdog checks timer
+*                triggered light conversions against a window while the core
+*                sleeps, and only wakes it when the light leaves the window.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+#ifndef MG_AWDWAKE_H
+#define MG_AWDWAKE_H
+/*****************************************************************************/
+// standard libraries first
+#include <stdint.h>
+
+// user headers directly related to this component, ensures no dependency
+
+// user headers from other components
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+// enumerations
+
+/**
+* @brief What ended a watchdog sleep
+*/
+typedef enum {
+  AWD_WAKE_ERROR = 0,           /*!< Sleep could not be armed */
+  AWD_WAKE_LIGHT,               /*!< Light conversion outside the window */
+  AWD_WAKE_TIMEOUT              /*!< RTC wake-up timer, no change seen */
+} AwdWakeSource;
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/**
+* @brief Wake-on-light-change statistics since init
+*/
+typedef struct {
+  uint32_t lLightWakes;         /*!< Wakes caused by the analog watchdog */
+  uint32_t lTimeoutWakes;       /*!< Wakes caused by the RTC wake-up timer */
+  uint32_t lAwakeMs;            /*!< Core time spent between two sleeps, ms */
+  uint32_t lAsleepMs;           /*!< Time spent in watchdog sleep, ms */
+} SAwdWakeStats;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* Conversion rate while asleep. Each conversion costs one ADC power-up */
+#define AWD_WAKE_RATE_HZ            10
+
+/*****************************************************************************/
+// function declarations
+void AwdWakeInit(void);
+AwdWakeSource AwdWakeSleep(uint16_t nLow, uint16_t nHigh, uint16_t nMaxS);
+void AwdWakeGetStats(SAwdWakeStats *pxStats);
+
+/*****************************************************************************/
+// variables
+
+/*****************************************************************************/
+// functions
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MG_AWDWAKE_H
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
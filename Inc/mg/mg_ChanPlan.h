@@ -0,0 +1,108 @@
+/** ***************************************************************************
+*   \file        mg_ChanPlan.h
+*   \brief       Channel plan and hopping. Evenly spaced channels whose
+*                synthesizer words are computed once with the radio
+*                configuration, so a hop is a single SPI burst. The hop
+*                sequence is a hash of the node address and an epoch shared
+*                by both ends, over the channels not blacklisted for their
+*                idle RSSI.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+#ifndef MG_CHANPLAN_H
+#define MG_CHANPLAN_H
+/*****************************************************************************/
+// standard libraries first
+#include <stdint.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "S2LP_Config.h"
+#include "stm32l0xx_hal.h"
+
+// user headers from other components
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/* Channels in a plan, one bit each in a mask */
+#define CHAN_MAX                    16
+
+/**
+* @brief Channel plan
+*/
+typedef struct {
+  uint32_t lBaseHz;             /*!< Centre of channel 0, the home channel */
+  uint32_t lSpacingHz;          /*!< Channel spacing */
+  uint8_t cChannels;            /*!< Channels, up to CHAN_MAX */
+  int8_t cBlacklistDbm;         /*!< Idle RSSI from which a channel is avoided */
+} SChanPlanConfig;
+
+/**
+* @brief Counters and channel state since ChanPlanInit()
+*/
+typedef struct {
+  uint32_t lHops;               /*!< Channel changes */
+  uint32_t lSurveys;            /*!< Idle RSSI surveys */
+  uint32_t lUse[CHAN_MAX];      /*!< Tunings per channel */
+  int8_t cNoiseDbm[CHAN_MAX];   /*!< Averaged idle RSSI per channel */
+  uint16_t nMask;               /*!< Channels not blacklisted, bit per channel */
+} SChanPlanStats;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* Channel used before the hop sequence is agreed, never blacklisted */
+#define CHAN_HOME                   0
+
+/* Channel mask on air, little endian */
+#define CHAN_MASK_BYTES             2
+
+/*****************************************************************************/
+// function declarations
+void ChanPlanInit(const SChanPlanConfig *pxConfig);
+void ChanPlanConfigure(void);
+void ChanPlanTune(uint8_t cChannel);
+uint8_t ChanPlanCurrent(void);
+uint8_t ChanPlanHop(uint8_t cNode, uint16_t nEpoch, uint16_t nMask);
+uint16_t ChanPlanAllMask(void);
+uint16_t ChanPlanGetMask(void);
+void ChanPlanSurvey(uint32_t lDwellMs);
+uint8_t ChanPlanMaskBuild(uint8_t *pcBuffer, uint16_t nMask);
+HAL_StatusTypeDef ChanPlanMaskParse(const uint8_t *pcBuffer, uint8_t cLen, uint16_t *pnMask);
+void ChanPlanGetStats(SChanPlanStats *pxStats);
+
+/*****************************************************************************/
+// variables
+
+/*****************************************************************************/
+// functions
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MG_CHANPLAN_H
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -0,0 +1,93 @@
+/** ***************************************************************************
+*   \file        mg_ClockGov.h
+*   \brief       MCU clock governor. Idles and samples on a low MSI range at
+*                voltage scale 3 and bursts to HSI16 for SPI transfers and DSP,
+*                keeping the USART1 and SPI1 timings valid across switches.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+#ifndef MG_CLOCKGOV_H
+#define MG_CLOCKGOV_H
+/*****************************************************************************/
+// standard libraries first
+#include <stdint.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "stm32l0xx_hal.h"
+
+// user headers from other components
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+// enumerations
+
+/**
+* @brief MCU operating point
+*/
+typedef enum {
+  CLOCK_LOW = 0,                /*!< MSI CLOCKGOV_MSI_RANGE_LOW, voltage scale 3, no wait state */
+  CLOCK_HIGH,                   /*!< HSI16, voltage scale 2, one wait state */
+  CLOCK_NB_POINTS
+} ClockPoint;
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/**
+* @brief Time accounting since ClockGovInit()
+*/
+typedef struct {
+  uint32_t lPointMs[CLOCK_NB_POINTS];   /*!< Time spent at each operating point */
+  uint32_t lSwitches;                   /*!< Operating point changes */
+  uint32_t lRefused;                    /*!< Changes refused during a UART or SPI transfer */
+} SClockGovStats;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+#define CLOCKGOV_MSI_RANGE_LOW      RCC_MSIRANGE_4      // 1.048 MHz
+
+/* S2LP SPI clock limit is 10 MHz */
+#define CLOCKGOV_SPI_MAX_HZ         8000000UL
+
+/* ADC clock below which its low frequency mode (LFMEN) is required */
+#define CLOCKGOV_ADC_LFM_HZ         3500000UL
+
+/*****************************************************************************/
+// function declarations
+void ClockGovInit(void);
+ClockPoint ClockGovSet(ClockPoint xPoint);
+ClockPoint ClockGovGet(void);
+void ClockGovGetStats(SClockGovStats *pxStats);
+
+/*****************************************************************************/
+// variables
+
+/*****************************************************************************/
+// functions
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MG_CLOCKGOV_H
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -0,0 +1,87 @@
+/** ***************************************************************************
+*   \file        mg_Codec.h
+*   \brief       Reading codec. Timestamps are coded as delta of delta and
+*                lux as deltas, zig-zag mapped to unsigned and written as
+*                variable length integers, 7 bits per byte. No allocation,
+*                and a bounded number of steps per reading.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+#ifndef MG_CODEC_H
+#define MG_CODEC_H
+/*****************************************************************************/
+// standard libraries first
+#include <stdint.h>
+
+// user headers directly related to this component, ensures no dependency
+
+// user headers from other components
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/**
+* @brief Coder state, one per stream, the same on both ends
+*/
+typedef struct {
+  uint32_t lPrevTime;           /*!< Time of the previous reading */
+  uint32_t lPrevDelta;          /*!< Time step to the previous reading */
+  uint32_t lPrevLux;            /*!< Lux of the previous reading */
+  uint8_t cCount;               /*!< Readings coded */
+} SCodecState;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* Reason in the low bits of the lux word */
+#define CODEC_REASON_BITS           3
+#define CODEC_REASON_MASK           ((1U << CODEC_REASON_BITS) - 1)
+
+/* Longest varint of a 32 bit value */
+#define CODEC_VARINT_MAX_BYTES      5
+
+/* Longest reading with times below 2^16 and lux below 2^24: 3 bytes of time
+   step, 4 bytes of lux word */
+#define CODEC_READING_MAX_BYTES     7
+
+/*****************************************************************************/
+// function declarations
+void CodecInit(SCodecState *pxState);
+uint8_t CodecEncode(SCodecState *pxState, uint8_t *pcBuffer, uint8_t cSize, uint32_t lTime, uint32_t lLux, uint8_t cReason);
+uint8_t CodecDecode(SCodecState *pxState, const uint8_t *pcBuffer, uint8_t cLen, uint32_t *plTime, uint32_t *plLux, uint8_t *pcReason);
+
+/*****************************************************************************/
+// variables
+
+/*****************************************************************************/
+// functions
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MG_CODEC_H
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
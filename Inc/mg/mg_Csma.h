@@ -0,0 +1,100 @@
+/** ***************************************************************************
+*   \file        mg_Csma.h
+*   \brief       Channel access with the S2LP CSMA/CA engine. The radio
+*                listens before each transmission and backs off on its own
+*                while the channel is busy; when it gives up the packet is
+*                rescheduled with a random, growing delay. The back-off
+*                sequence is seeded from the MCU unique ID so that nodes
+*                sharing the channel do not back off in step.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+#ifndef MG_CSMA_H
+#define MG_CSMA_H
+/*****************************************************************************/
+// standard libraries first
+#include <stdint.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "S2LP_Config.h"
+
+// user headers from other components
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/**
+* @brief Channel access configuration
+*/
+typedef struct {
+  float fRssiThreshDbm;         /*!< Channel busy at or above this level */
+  SCsmaPeriod xCcaPeriod;       /*!< Clear channel assessment period, in bit times */
+  uint8_t cCcaLength;           /*!< CCA periods per listen, 1 to 15 */
+  uint8_t cMaxBackoffs;         /*!< Back-offs before IRQ_MAX_BO_CCA_REACH, up to 7 */
+  uint8_t cBuPrescaler;         /*!< Back-off unit prescaler, up to 63 */
+  uint32_t lRescheduleMs;       /*!< First reschedule delay, doubled for each further one */
+  uint8_t cMaxReschedules;      /*!< Reschedules before a packet is dropped */
+} SCsmaConfig;
+
+/**
+* @brief Counters since CsmaInit()
+*/
+typedef struct {
+  uint32_t lAttempts;           /*!< Transmissions started */
+  uint32_t lBusy;               /*!< Of which given up by the radio, channel busy */
+  uint32_t lBackoffs;           /*!< Back-offs of the given up ones */
+  uint32_t lReschedules;        /*!< Packets retried later */
+  uint32_t lDropped;            /*!< Packets given up after every reschedule */
+  uint32_t lCollisions;         /*!< Sent on a clear channel but not delivered */
+} SCsmaStats;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/*****************************************************************************/
+// function declarations
+void CsmaInit(const SCsmaConfig *pxConfig);
+void CsmaConfigure(void);
+void CsmaTxStart(void);
+uint8_t CsmaIrq(const S2LPIrqs *pxIrqStatus);
+uint8_t CsmaTxBusy(void);
+void CsmaTxDelivered(uint8_t cDelivered);
+uint32_t CsmaRescheduleMs(uint8_t cRetry);
+uint16_t CsmaGetSeed(void);
+void CsmaGetStats(SCsmaStats *pxStats);
+
+/*****************************************************************************/
+// variables
+
+/*****************************************************************************/
+// functions
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MG_CSMA_H
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
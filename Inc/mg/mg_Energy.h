@@ -0,0 +1,154 @@
+/** ***************************************************************************
+*   \file        mg_Energy.h
+*   \brief       Energy accounting. On-time counters for the MCU power modes,
+*                each radio state with TX split by PA level, and the ADC,
+*                exported over the radio and UART and turned into an average
+*                current with a datasheet current table.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+#ifndef MG_ENERGY_H
+#define MG_ENERGY_H
+/*****************************************************************************/
+// standard libraries first
+#include <stdint.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "stm32l0xx_hal.h"
+
+// user headers from other components
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+// enumerations
+
+/**
+* @brief MCU power mode, taken from the scheduler and clock governor
+*/
+typedef enum {
+  ENERGY_MCU_RUN_HIGH = 0,      /*!< Run mode at CLOCK_HIGH */
+  ENERGY_MCU_RUN_LOW,           /*!< Run mode at CLOCK_LOW */
+  ENERGY_MCU_SLEEP,             /*!< Sleep mode */
+  ENERGY_MCU_STOP,              /*!< STOP mode */
+  ENERGY_MCU_NB_STATES
+} EnergyMcuState;
+
+/**
+* @brief Radio state, followed from the commands sent to the S2LP
+*/
+typedef enum {
+  ENERGY_RADIO_SHUTDOWN = 0,    /*!< SDN pin high */
+  ENERGY_RADIO_STANDBY,         /*!< STANDBY */
+  ENERGY_RADIO_SLEEP,           /*!< SLEEP */
+  ENERGY_RADIO_READY,           /*!< READY or LOCK */
+  ENERGY_RADIO_RX,              /*!< RX, continuous */
+  ENERGY_RADIO_LDC,             /*!< RX in low duty cycle mode, mostly asleep */
+  ENERGY_RADIO_TX,              /*!< TX, all PA levels */
+  ENERGY_RADIO_NB_STATES
+} EnergyRadioState;
+
+/**
+* @brief ADC state
+*/
+typedef enum {
+  ENERGY_ADC_OFF = 0,           /*!< Disabled */
+  ENERGY_ADC_ON,                /*!< Converting, software or timer triggered */
+  ENERGY_ADC_WATCH,             /*!< Analog watchdog, powered only per conversion */
+  ENERGY_ADC_NB_STATES
+} EnergyAdcState;
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/* PA levels told apart, later levels are added to the last slot */
+#define ENERGY_PA_SLOTS             4
+
+/**
+* @brief On-time counters since EnergyInit()
+*/
+typedef struct {
+  uint32_t lElapsedMs;                          /*!< Time since EnergyInit() */
+  uint32_t lMcuMs[ENERGY_MCU_NB_STATES];        /*!< Time in each MCU power mode */
+  uint32_t lRadioMs[ENERGY_RADIO_NB_STATES];    /*!< Time in each radio state */
+  uint32_t lTxMs[ENERGY_PA_SLOTS];              /*!< TX time per PA level, see cTxDbm */
+  int8_t cTxDbm[ENERGY_PA_SLOTS];               /*!< PA level of each TX slot, dBm */
+  uint8_t cTxSlots;                             /*!< TX slots in use */
+  uint32_t lAdcMs[ENERGY_ADC_NB_STATES];        /*!< Time in each ADC state */
+} SEnergyStats;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* MCU supply current, nA. Run from flash at HSI16 and voltage scale 2, and
+   at MSI 1 MHz and voltage scale 3; STOP with the RTC on the LSE */
+#define ENERGY_I_RUN_HIGH_NA        2200000
+#define ENERGY_I_RUN_LOW_NA         140000
+#define ENERGY_I_SLEEP_NA           45000
+#define ENERGY_I_STOP_NA            800
+
+/* Low duty cycle reception, 2 ms window every 40 ms */
+#define ENERGY_I_LDC_NA             350000
+
+/* ADC with VREFINT and the sensor powered, and the triggered watchdog */
+#define ENERGY_I_ADC_ON_NA          250000
+#define ENERGY_I_ADC_WATCH_NA       5000
+
+/* Export frame: marker, frame index and count in the two nibbles, then
+   ENERGY_FRAME_ENTRIES of one byte counter id and a 32 bit little endian
+   value. Id 0 is the elapsed time, then the MCU, radio and ADC states in
+   enum order; TX slots are 0x80 | the PA level in dBm as 7 bit two's
+   complement. Values are ms */
+#define ENERGY_FRAME_MARKER         0xE5
+#define ENERGY_FRAME_ENTRIES        3
+#define ENERGY_FRAME_BYTES          (2 + ENERGY_FRAME_ENTRIES * 5)
+#define ENERGY_ID_ELAPSED           0
+#define ENERGY_ID_MCU               1
+#define ENERGY_ID_RADIO             (ENERGY_ID_MCU + ENERGY_MCU_NB_STATES)
+#define ENERGY_ID_ADC               (ENERGY_ID_RADIO + ENERGY_RADIO_NB_STATES)
+#define ENERGY_ID_TX                0x80
+
+/*****************************************************************************/
+// function declarations
+void EnergyInit(void);
+void EnergyRadioSet(EnergyRadioState xState);
+void EnergyRadioCommand(uint8_t cCommandCode);
+void EnergyTxPower(float fDbm);
+uint32_t EnergyTxNa(int8_t cDbm);
+void EnergyAdcSet(EnergyAdcState xState);
+void EnergyGetStats(SEnergyStats *pxStats);
+uint32_t EnergyAverageNa(const SEnergyStats *pxStats);
+uint8_t EnergyFrameCount(void);
+uint8_t EnergyExportFrame(uint8_t cFrame, uint8_t *pcBuffer, uint8_t cSize);
+int EnergyFormatFrame(const uint8_t *pcFrame, uint8_t cLen, char *pcText, uint16_t nSize);
+
+/*****************************************************************************/
+// variables
+
+/*****************************************************************************/
+// functions
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MG_ENERGY_H
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
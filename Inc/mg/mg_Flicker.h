@@ -0,0 +1,104 @@
+/** ***************************************************************************
+*   \file        mg_Flicker.h
+*   \brief       Mains flicker detection and rejection for the light front end.
+*                Timer triggered ADC bursts over whole ripple periods, with an
+*                integer Goertzel detector at 100 Hz and 120 Hz.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+#ifndef MG_FLICKER_H
+#define MG_FLICKER_H
+/*****************************************************************************/
+// standard libraries first
+#include <stdint.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "stm32l0xx_hal.h"
+
+// user headers from other components
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+// enumerations
+
+/**
+* @brief Mains frequency seen by the sensor
+*/
+typedef enum {
+  FLICKER_MAINS_UNKNOWN = 0,    /*!< No ripple detected yet, or below threshold */
+  FLICKER_MAINS_50HZ,           /*!< 100 Hz ripple */
+  FLICKER_MAINS_60HZ            /*!< 120 Hz ripple */
+} FlickerMains;
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/**
+* @brief Result of one burst acquisition
+*/
+typedef struct {
+  uint16_t nMean;               /*!< Ripple free mean of ADC_IN10, raw counts */
+  uint16_t nAmplitude;          /*!< Peak ripple amplitude, raw counts (detect bursts only) */
+  uint8_t  cRippleHz;           /*!< Ripple frequency: 100, 120 or 0 if none */
+  uint8_t  cNbConversions;      /*!< Conversions used for this result */
+  uint32_t lTimestamp;          /*!< Middle of the acquisition window, see mg_Timestamp.h */
+} SFlickerResult;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* Detection burst: 120 samples at 2400 Hz = 50 ms, a whole number of both
+   100 Hz (5 periods) and 120 Hz (6 periods) ripple cycles */
+#define FLICKER_DETECT_RATE_HZ      2400
+#define FLICKER_DETECT_SAMPLES      120
+
+/* Conversions per ripple period in the mean-only burst. M evenly spaced
+   samples over one period cancel ripple harmonics 1..M-1 */
+#define FLICKER_MEAN_SAMPLES        8
+
+/* Mean-only burst with unknown mains: 24 samples over 50 ms */
+#define FLICKER_UNKNOWN_SAMPLES     24
+#define FLICKER_UNKNOWN_RATE_HZ     480
+
+/* Minimum peak ripple (raw counts) to lock on to a mains frequency */
+#define FLICKER_MIN_AMPLITUDE       8
+
+/*****************************************************************************/
+// function declarations
+void FlickerInit(void);
+HAL_StatusTypeDef FlickerDetect(SFlickerResult *pxResult);
+HAL_StatusTypeDef FlickerMean(SFlickerResult *pxResult);
+FlickerMains FlickerGetMains(void);
+void FlickerDmaIrqHandler(void);
+
+/*****************************************************************************/
+// variables
+
+/*****************************************************************************/
+// functions
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MG_FLICKER_H
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -0,0 +1,102 @@
+/** ***************************************************************************
+*   \file        mg_LdcRx.h
+*   \brief       S2LP low duty cycle receiver. The radio wakes itself on its
+*                LDC timer, sniffs for a short window and sleeps again, so the
+*                MCU is only interrupted when a packet arrives.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+#ifndef MG_LDCRX_H
+#define MG_LDCRX_H
+/*****************************************************************************/
+// standard libraries first
+#include <stdint.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "S2LP_Config.h"
+
+// user headers from other components
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/**
+* @brief Low duty cycle receiver configuration
+*/
+typedef struct {
+  float fPeriodMs;              /*!< LDC wake-up period, 1.89 s maximum */
+  float fWindowMs;              /*!< Sniff window, extended while a preamble is being received */
+  float fPacketMs;              /*!< Air time of one packet, for the current estimate */
+  uint8_t cPqiLevel;            /*!< Preamble quality that keeps the receiver on, 4 bits per step */
+  SFunctionalState xWakeIrq;    /*!< Also interrupt on every wake-up and empty sniff, for measurement */
+} SLdcRxConfig;
+
+/**
+* @brief Low duty cycle receiver statistics since the last reset
+*/
+typedef struct {
+  uint32_t lElapsedMs;          /*!< Time in LDC mode */
+  uint32_t lPackets;            /*!< Packets received */
+  uint32_t lDiscarded;          /*!< Packets discarded by the packet handler */
+  uint32_t lMissed;             /*!< Gaps in the transmitter sequence numbers */
+  uint32_t lWakes;              /*!< LDC wake-ups, counted or derived from the period */
+  uint32_t lEmptySniffs;        /*!< Windows that ended without a preamble, when counted */
+  uint32_t lAvgCurrentUa;       /*!< Estimated average radio current */
+  uint16_t nDetectPermille;     /*!< Packets received out of packets sent */
+} SLdcRxStats;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* Radio currents used for the average current estimate */
+#define LDCRX_I_RX_UA               7000    // RX at 868 MHz
+#define LDCRX_I_SLEEP_UA            1       // SLEEP_B, FIFO retained, RCO running
+
+/*****************************************************************************/
+// function declarations
+void LdcRxStart(const SLdcRxConfig *pxConfig);
+void LdcRxStop(void);
+void LdcRxSuspend(void);
+void LdcRxResume(void);
+uint8_t LdcRxIsSuspended(void);
+uint8_t LdcRxIsActive(void);
+void LdcRxIrq(const S2LPIrqs *pxIrqStatus);
+void LdcRxLogSequence(uint16_t nSeq);
+void LdcRxResetStats(void);
+void LdcRxGetStats(SLdcRxStats *pxStats);
+
+/*****************************************************************************/
+// variables
+
+/*****************************************************************************/
+// functions
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MG_LDCRX_H
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
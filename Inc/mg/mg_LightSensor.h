@@ -0,0 +1,97 @@
+/** ***************************************************************************
+*   \file        mg_LightSensor.h
+*   \brief       Light sensor front end: ADC acquisition of ADC_IN10, the
+*                temperature sensor and VREFINT, plus conversion to lux. Also
+*                owns the TIM2 conversion trigger used by timed acquisitions.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+#ifndef MG_LIGHTSENSOR_H
+#define MG_LIGHTSENSOR_H
+/*****************************************************************************/
+// standard libraries first
+#include <stdint.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "stm32l0xx_hal.h"
+
+// user headers from other components
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/**
+* @brief One raw acquisition of the regular channel sequence
+*/
+typedef struct {
+  uint16_t nLight;      /*!< ADC_IN10, light sensor output */
+  uint16_t nVrefint;    /*!< Internal reference, used to derive VDDA */
+  uint16_t nTemp;       /*!< Internal temperature sensor */
+} SLightSample;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* Light sensor scaling: lux = counts * LIGHT_LUX_SCALE_NUM / LIGHT_LUX_SCALE_DEN */
+#define LIGHT_LUX_SCALE_NUM         1
+#define LIGHT_LUX_SCALE_DEN         1
+
+/* Time allowed for the sensor output to settle after SENSE_EN is asserted */
+#define LIGHT_SETTLE_MS             1
+
+/* Factory calibration values, measured at VDDA = 3.0 V */
+#define LIGHT_VREFINT_CAL           (*(const uint16_t *)0x1FF80078U)
+#define LIGHT_TS_CAL1               (*(const uint16_t *)0x1FF8007AU)    // 30 degC
+#define LIGHT_TS_CAL2               (*(const uint16_t *)0x1FF8007EU)    // 130 degC
+#define LIGHT_CAL_VDD_MV            3000
+
+/*****************************************************************************/
+// function declarations
+void LightSensorInit(void);
+HAL_StatusTypeDef LightSensorSample(SLightSample *pxSample);
+HAL_StatusTypeDef LightSensorSampleDark(SLightSample *pxSample);
+uint32_t LightSensorToLux(uint16_t nRaw);
+uint16_t LightSensorFromLux(uint32_t lLux);
+uint16_t LightSensorVddMv(uint16_t nVrefint);
+int16_t LightSensorTempC(uint16_t nTemp, uint16_t nVddMv);
+
+void LightSensorTriggeredEnter(FunctionalState xAutoOff);
+void LightSensorTriggeredExit(void);
+void LightSensorTriggerStart(uint32_t lRateHz);
+void LightSensorTriggerStop(void);
+
+/*****************************************************************************/
+// variables
+
+/*****************************************************************************/
+// functions
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MG_LIGHTSENSOR_H
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -0,0 +1,130 @@
+/** ***************************************************************************
+*   \file        mg_Link.h
+*   \brief       Reliable link on the S2LP STack packet format. The radio
+*                requests, sends and waits for acks and retransmits on its
+*                own, the MCU only hears the outcome. Delivery counters are
+*                kept per peer address.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+#ifndef MG_LINK_H
+#define MG_LINK_H
+/*****************************************************************************/
+// standard libraries first
+#include <stdint.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "S2LP_Config.h"
+
+// user headers from other components
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+// enumerations
+
+/**
+* @brief Outcome of a transmission with an ack request
+*/
+typedef enum {
+  LINK_TX_PENDING = 0,          /*!< Sending, or waiting for the ack */
+  LINK_TX_ACKED,                /*!< Ack received, possibly after retransmissions */
+  LINK_TX_FAILED                /*!< IRQ_MAX_RE_TX_REACH, no ack after every retransmission */
+} LinkTxResult;
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/**
+* @brief Link configuration, the sender requests acks, the receiver sends them
+*/
+typedef struct {
+  uint8_t cMyAddress;           /*!< Source address of transmitted packets */
+  uint8_t cPeerAddress;         /*!< Destination address of transmitted packets */
+  uint8_t cMaxRetx;             /*!< Retransmissions before giving up, up to LINK_MAX_RETX */
+  SFunctionalState xAckRequest; /*!< Ask for an ack with each transmitted packet */
+  SFunctionalState xAutoAck;    /*!< Ack received packets that ask for it */
+  SFunctionalState xPiggyback;  /*!< Acks carry the TX FIFO, see LinkSetAckPayload() */
+  uint16_t nRetxWindowMs;       /*!< Longest from a packet to its last retransmission */
+} SLinkConfig;
+
+/**
+* @brief Counters of one peer since LinkInit()
+*/
+typedef struct {
+  uint8_t cAddress;             /*!< Peer address */
+  uint32_t lSent;               /*!< Packets sent to the peer with an ack request */
+  uint32_t lAcked;              /*!< Of which acked */
+  uint32_t lFailed;             /*!< Of which given up */
+  uint32_t lRetx;               /*!< Retransmissions, acked or not */
+  uint8_t cRetxMax;             /*!< Most retransmissions of one packet */
+  uint32_t lReceived;           /*!< Packets received from the peer */
+  uint32_t lDuplicates;         /*!< Of which retransmissions whose ack was lost */
+} SLinkStats;
+
+/**
+* @brief Reception seen by the link, for the interrupt handler
+*/
+typedef struct {
+  uint8_t cSource;              /*!< Source address */
+  uint8_t cSeq;                 /*!< 2 bit sequence number */
+  uint8_t cDuplicate;           /*!< Already received, its ack was lost */
+  uint8_t cAcked;               /*!< The radio is sending an ack */
+} SLinkRx;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* Address and control byte added by the STack format */
+#define LINK_HEADER_BYTES           2
+
+/* NMAX_RETX field width */
+#define LINK_MAX_RETX               15
+
+/* Peers with their own counters and duplicate filtering, as many as the
+   gateway node table; further ones are neither counted nor filtered */
+#define LINK_MAX_PEERS              16
+
+/*****************************************************************************/
+// function declarations
+void LinkInit(const SLinkConfig *pxConfig);
+void LinkConfigure(PktStackInit *pxPktInit);
+void LinkSetPayloadLength(uint8_t cLen);
+void LinkSetAckPayload(const uint8_t *pcPayload, uint8_t cLen);
+void LinkTxStart(void);
+void LinkTxAbort(void);
+LinkTxResult LinkTxIrq(const S2LPIrqs *pxIrqStatus);
+LinkTxResult LinkTxGetResult(void);
+void LinkRxIrq(SLinkRx *pxRx);
+uint8_t LinkGetStats(uint8_t cIndex, SLinkStats *pxStats);
+
+/*****************************************************************************/
+// variables
+
+/*****************************************************************************/
+// functions
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MG_LINK_H
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -0,0 +1,148 @@
+/** ***************************************************************************
+*   \file        mg_NodeTable.h
+*   \brief       Gateway receive state per node. A fixed open addressing
+*                table keyed by node address keeps the report sequence, the
+*                gaps and duplicates, and RSSI and sync quality histograms,
+*                updated from the RX interrupt. Received frames go out as
+*                compact records through a queue drained by a task, so the
+*                UART never holds up reception.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+#ifndef MG_NODETABLE_H
+#define MG_NODETABLE_H
+/*****************************************************************************/
+// standard libraries first
+#include <stdint.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "stm32l0xx_hal.h"
+
+// user headers from other components
+#include "mg_Aggregate.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+// enumerations
+
+/**
+* @brief What a received frame was to its node
+*/
+typedef enum {
+  NODE_RX_NEW = 0,              /*!< Next report, or the first after a gap */
+  NODE_RX_LATE,                 /*!< Older than the last report, not seen before */
+  NODE_RX_DUPLICATE,            /*!< Already received, its ack was lost */
+  NODE_RX_RESTART,              /*!< Sequence far behind the last one, the node restarted */
+  NODE_RX_OTHER,                /*!< Not a report, no sequence */
+  NODE_RX_FULL                  /*!< No room for another node */
+} NodeRxResult;
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/* Table slots, a power of two, and histogram bins */
+#define NODE_TABLE_SIZE             16
+#define NODE_RSSI_BINS              8
+#define NODE_SQI_BINS               5
+
+/* Largest frame kept in a record, a report and its trailer */
+#define NODE_FRAME_MAX              (AGG_FRAME_MAX + 4)
+
+/**
+* @brief Counters of one node since NodeTableInit()
+*/
+typedef struct {
+  uint8_t cAddress;             /*!< Node address */
+  uint32_t lFrames;             /*!< Frames received, duplicates included */
+  uint32_t lReports;            /*!< Reports passed on */
+  uint32_t lDuplicates;         /*!< Frames already received */
+  uint32_t lMissed;             /*!< Reports never received, from the sequence gaps */
+  uint32_t lLate;               /*!< Reports received after a later one */
+  uint32_t lRestarts;           /*!< Sequence restarts */
+  uint16_t nLastSeq;            /*!< Latest report sequence number */
+  int8_t cLastRssiDbm;          /*!< RSSI of the latest frame */
+  uint32_t lLastMs;             /*!< HAL tick of the latest frame */
+  uint16_t nRssiHist[NODE_RSSI_BINS];   /*!< Frames per RSSI bin, see NODE_RSSI_FLOOR_DBM */
+  uint16_t nSqiHist[NODE_SQI_BINS];     /*!< Frames per count of sync word bits in error, the last bin and more */
+} SNodeStats;
+
+/**
+* @brief Table and queue counters since NodeTableInit()
+*/
+typedef struct {
+  uint8_t cNodes;               /*!< Nodes in the table */
+  uint32_t lTableFull;          /*!< Frames from nodes without room in the table */
+  uint32_t lQueued;             /*!< Records queued */
+  uint32_t lQueueFull;          /*!< Records dropped, the output fell behind */
+  uint8_t cQueueMax;            /*!< Most records waiting at once */
+} SNodeTableStats;
+
+/**
+* @brief Received frame waiting to be output
+*/
+typedef struct {
+  uint8_t cSource;              /*!< Node address */
+  int8_t cRssiDbm;              /*!< RSSI at the sync word */
+  uint8_t cSyncErrors;          /*!< Sync word bits in error */
+  NodeRxResult xResult;         /*!< From NodeTableRx() */
+  uint16_t nMissed;             /*!< Reports missed just before this one */
+  uint8_t cLen;                 /*!< Frame length */
+  uint8_t cFrame[NODE_FRAME_MAX];   /*!< Frame */
+} SNodeRecord;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* RSSI histogram: first bin below the floor plus a step, last one above */
+#define NODE_RSSI_FLOOR_DBM         (-120)
+#define NODE_RSSI_STEP_DB           8
+
+/* Records waiting for the output, a power of two */
+#define NODE_QUEUE_RECORDS          4
+
+/* Reports behind the latest one told apart from duplicates */
+#define NODE_SEQ_WINDOW             32
+
+/*****************************************************************************/
+// function declarations
+void NodeTableInit(void);
+NodeRxResult NodeTableRx(uint8_t cAddress, const uint16_t *pnSeq, uint8_t cDuplicate, int8_t cRssiDbm, uint8_t cSyncErrors, uint32_t lNowMs, uint16_t *pnMissed);
+uint8_t NodeTableGet(uint8_t cIndex, SNodeStats *pxStats);
+void NodeTableGetStats(SNodeTableStats *pxStats);
+SNodeRecord *NodeRecordSlot(void);
+void NodeRecordCommit(void);
+const SNodeRecord *NodeRecordPeek(void);
+void NodeRecordRelease(void);
+int NodeRecordFormat(const SNodeRecord *pxRecord, uint8_t cLine, char *pcText, uint16_t nSize);
+
+/*****************************************************************************/
+// variables
+
+/*****************************************************************************/
+// functions
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MG_NODETABLE_H
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -0,0 +1,88 @@
+/** ***************************************************************************
+*   \file        mg_PaProfile.h
+*   \brief       S2LP PA profile. Programs the eight PA_POWER slots and the
+*                ramping mode once, so that changing the output power only
+*                rewrites the slot index in PA_POWER0.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+#ifndef MG_PAPROFILE_H
+#define MG_PAPROFILE_H
+/*****************************************************************************/
+// standard libraries first
+#include <stdint.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "S2LP_Config.h"
+
+// user headers from other components
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+// enumerations
+
+/**
+* @brief PA ramping at the start and end of a transmission
+*/
+typedef enum {
+  PA_RAMP_NONE = 0,             /*!< Selected slot applied at once */
+  PA_RAMP_AUTO,                 /*!< FIR ramping */
+  PA_RAMP_MANUAL                /*!< Steps through the slots from 0 up to the selected one */
+} PaRampMode;
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+#define PA_PROFILE_SLOTS            8
+
+/**
+* @brief PA profile. Levels ascend with the slot index, as manual ramping
+*        walks through them
+*/
+typedef struct {
+  float fLevelDbm[PA_PROFILE_SLOTS];    /*!< Output power of each slot, dBm */
+  PaRampMode xRamp;                     /*!< Ramping mode */
+  uint8_t cStepLen;                     /*!< Manual ramp step, 0 to 3, in 1/8 bit periods */
+} SPaProfile;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/*****************************************************************************/
+// function declarations
+uint8_t PaProfileApply(const SPaProfile *pxProfile, float fDbm);
+void PaProfileSelect(uint8_t cIndex);
+uint8_t PaProfileIndexFor(float fDbm);
+float PaProfileLevel(uint8_t cIndex);
+
+/*****************************************************************************/
+// variables
+
+/*****************************************************************************/
+// functions
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MG_PAPROFILE_H
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -0,0 +1,138 @@
+/** ***************************************************************************
+*   \file        mg_RadioPower.h
+*   \brief       S2LP power state manager. Parks the radio in SHUTDOWN, SLEEP
+*                or STANDBY between transmissions, whichever costs the least
+*                charge over the expected idle time including the wake-up.
+*                SHUTDOWN is left through a warm restore of a captured
+*                register image and VCO calibration.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+#ifndef MG_RADIOPOWER_H
+#define MG_RADIOPOWER_H
+/*****************************************************************************/
+// standard libraries first
+#include <stdint.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "S2LP_Config.h"
+#include "stm32l0xx_hal.h"
+
+// user headers from other components
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+// enumerations
+
+/**
+* @brief Radio power state, in order of decreasing leakage
+*/
+typedef enum {
+  RADIO_PS_READY = 0,           /*!< READY, XO running, also covers TX */
+  RADIO_PS_SLEEP,               /*!< SLEEP, configuration retained, FIFO too with SLEEP_B */
+  RADIO_PS_STANDBY,             /*!< STANDBY, configuration retained */
+  RADIO_PS_SHUTDOWN,            /*!< SDN pin high, everything lost */
+  RADIO_PS_NB_STATES
+} RadioPowerState;
+
+/*****************************************************************************/
+// typedefs
+
+/**
+* @brief Full radio configuration, re-applied after SHUTDOWN
+*/
+typedef void (*RadioPowerConfigFn)(void);
+
+/*****************************************************************************/
+// structures
+
+/**
+* @brief Power state accounting since RadioPowerInit()
+*/
+typedef struct {
+  uint32_t lStateMs[RADIO_PS_NB_STATES];    /*!< Time spent in each state */
+  uint32_t lEntries[RADIO_PS_NB_STATES];    /*!< Number of times each state was chosen */
+  uint32_t lColdConfigs;                    /*!< Full configurations after SHUTDOWN */
+  uint32_t lWarmRestores;                   /*!< Register image restores after SHUTDOWN */
+  uint32_t lVcoSkips;                       /*!< Restores that reused the VCO calibration */
+  uint32_t lPorUs;                          /*!< Last SDN release to POR */
+  uint32_t lColdUs;                         /*!< Last full configuration */
+  uint32_t lWarmUs;                         /*!< Last register image restore */
+  uint32_t lWakeToTxUs[RADIO_PS_NB_STATES]; /*!< Last wake-up to TX strobe, per state left */
+  uint32_t lIdleAvgMs;                      /*!< Learned average idle period */
+} SRadioPowerStats;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* Radio leakage per state, nA */
+#define RADIO_PS_I_READY_NA         350000
+#define RADIO_PS_I_SLEEP_NA         750         // SLEEP_B, RCO running
+#define RADIO_PS_I_STANDBY_NA       500
+#define RADIO_PS_I_SHUTDOWN_NA      3
+
+/* Current drawn while waking up: MCU in Run mode and the radio XO starting */
+#define RADIO_PS_I_WAKE_NA          1000000
+
+/* Wake-up latency to READY, us. SHUTDOWN uses the measured POR and restore
+   times, the figures below are initial guesses */
+#define RADIO_PS_WAKE_SLEEP_US      500
+#define RADIO_PS_WAKE_STANDBY_US    500
+#define RADIO_PS_POR_US             1000
+#define RADIO_PS_COLD_US            4000
+#define RADIO_PS_WARM_US            1000
+
+/* Longest wait for IRQ_POR after SDN release, the former fixed boot delay */
+#define RADIO_PS_POR_TIMEOUT_MS     10
+
+/* Warm restores that reuse the VCO calibration words before a TX calibrates again */
+#define RADIO_PS_VCO_REUSE          16
+
+/* SPI status polls allowed for the radio to reach READY */
+#define RADIO_PS_READY_POLLS        100
+
+/* Learned idle period filter, alpha = 1/4 */
+#define RADIO_PS_IDLE_SHIFT         2
+
+/*****************************************************************************/
+// function declarations
+void RadioPowerInit(RadioPowerConfigFn pfConfig);
+RadioPowerState RadioPowerIdle(uint32_t lMinIdleMs, SFunctionalState xRetainFifo);
+HAL_StatusTypeDef RadioPowerWake(void);
+HAL_StatusTypeDef RadioPowerWaitPor(void);
+void RadioPowerConfigChanged(void);
+void RadioPowerTxStart(void);
+void RadioPowerTxDone(void);
+void RadioPowerRxStart(void);
+void RadioPowerRetuned(void);
+RadioPowerState RadioPowerGetState(void);
+void RadioPowerGetStats(SRadioPowerStats *pxStats);
+
+/*****************************************************************************/
+// variables
+
+/*****************************************************************************/
+// functions
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MG_RADIOPOWER_H
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
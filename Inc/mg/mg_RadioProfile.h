@@ -0,0 +1,109 @@
+/** ***************************************************************************
+*   \file        mg_RadioProfile.h
+*   \brief       S2LP board power profiles. Reference clock, digital divider
+*                and SMPS voltage and switching frequency applied as one
+*                preset with the rest of the radio configuration.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+#ifndef MG_RADIOPROFILE_H
+#define MG_RADIOPROFILE_H
+/*****************************************************************************/
+// standard libraries first
+#include <stdint.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "S2LP_Config.h"
+
+// user headers from other components
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+// enumerations
+
+/**
+* @brief SMPS output voltage, PM_CONF0 SET_SMPS_LVL
+*/
+typedef enum {
+  RADIO_SMPS_1V1 = 0,
+  RADIO_SMPS_1V2,
+  RADIO_SMPS_1V3,
+  RADIO_SMPS_1V4,
+  RADIO_SMPS_1V5,               /*!< Reset value */
+  RADIO_SMPS_1V6,
+  RADIO_SMPS_1V7,
+  RADIO_SMPS_1V8
+} RadioSmpsLevel;
+
+/**
+* @brief Benchmark step, the radio state held for the dwell time
+*/
+typedef enum {
+  RADIO_BENCH_TX = 0,           /*!< Continuous PN9 transmission */
+  RADIO_BENCH_RX,               /*!< Reception without timeout */
+  RADIO_BENCH_NB_MODES
+} RadioBenchMode;
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/**
+* @brief Board power profile. The reference and external SMPS settings must
+*        match the board fitting, the radio stops otherwise
+*/
+typedef struct {
+  uint32_t lXtalHz;             /*!< Reference frequency, the digital domain is divided by 2 above DIG_DOMAIN_XTAL_THRESH */
+  ModeExtRef xRef;              /*!< Crystal on XO, or clock (TCXO) on XIN */
+  SFunctionalState xExtSmps;    /*!< S_ENABLE: internal SMPS off, core supplied from outside */
+  RadioSmpsLevel xSmpsLevel;    /*!< Internal SMPS output voltage */
+  uint32_t lSmpsTxHz;           /*!< SMPS switching frequency in TX, 0 for the library default */
+  uint32_t lSmpsRxHz;           /*!< SMPS switching frequency in RX, 0 for the library default */
+} SRadioProfile;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* SMPS rate multiplier words written by S2LPCmdStrobeTx() and S2LPCmdStrobeRx() */
+#define RADIO_SMPS_KRM_TX           0x1C00
+#define RADIO_SMPS_KRM_RX           0x1000
+
+/*****************************************************************************/
+// function declarations
+void RadioProfileApply(const SRadioProfile *pxProfile);
+void RadioProfileCommand(uint8_t cCommand);
+uint32_t RadioProfileSmpsHz(uint8_t cCommand);
+uint8_t RadioProfileDigDiv(void);
+void RadioProfileBench(RadioBenchMode xMode, uint32_t lDwellMs);
+uint32_t RadioProfileAirTimeUs(uint32_t lDatarate, uint16_t nBits);
+
+/*****************************************************************************/
+// variables
+
+/*****************************************************************************/
+// functions
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MG_RADIOPROFILE_H
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -0,0 +1,111 @@
+/** ***************************************************************************
+*   \file        mg_Rbe.h
+*   \brief       Report-by-exception engine. Filters the light readings and
+*                decides when a change is worth a radio transmission.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+#ifndef MG_RBE_H
+#define MG_RBE_H
+/*****************************************************************************/
+// standard libraries first
+#include <stdint.h>
+
+// user headers directly related to this component, ensures no dependency
+
+// user headers from other components
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+// enumerations
+
+/**
+* @brief Reason a reading was (or was not) reported
+*/
+typedef enum {
+  RBE_NONE = 0,         /*!< Suppressed, nothing to report */
+  RBE_FIRST,            /*!< First reading after init */
+  RBE_DEADBAND,         /*!< Filtered value left the deadband around the last report */
+  RBE_THRESHOLD,        /*!< Filtered value crossed a configured threshold */
+  RBE_HEARTBEAT,        /*!< Maximum interval without a report elapsed */
+  RBE_NB_REASONS
+} RbeReason;
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/**
+* @brief Report-by-exception configuration
+*/
+typedef struct {
+  uint8_t  cFilterShift;            /*!< EMA filter weight, alpha = 1/2^cFilterShift. 0 disables filtering */
+  uint32_t lAbsDeadband;            /*!< Absolute deadband in lux. 0 disables */
+  uint16_t nRelDeadbandPermille;    /*!< Relative deadband in 1/1000 of the last report. 0 disables */
+  const uint32_t *plThresholds;     /*!< Ascending list of lux thresholds, may be NULL */
+  uint8_t  cNbThresholds;           /*!< Number of entries in plThresholds */
+  uint32_t lThresholdHyst;          /*!< Hysteresis applied around each threshold, in lux */
+  uint32_t lMinIntervalMs;          /*!< Minimum time between two reports */
+  uint32_t lHeartbeatMs;            /*!< Maximum time between two reports */
+} SRbeConfig;
+
+/**
+* @brief Report-by-exception statistics. Daily figures roll over every 24 h
+*        of uptime.
+*/
+typedef struct {
+  uint32_t lSamplesToday;           /*!< Readings evaluated in the current day */
+  uint32_t lTxToday;                /*!< Transmissions in the current day */
+  uint32_t lRadioOnMsToday;         /*!< Radio on-time in the current day, ms */
+  uint32_t lTxYesterday;            /*!< Transmissions in the last complete day */
+  uint32_t lRadioOnMsYesterday;     /*!< Radio on-time in the last complete day, ms */
+  uint32_t lTxTotal;                /*!< Transmissions since init */
+  uint32_t lRadioOnMsTotal;         /*!< Radio on-time since init, ms */
+  uint32_t lReasons[RBE_NB_REASONS];/*!< Count of decisions per reason since init */
+} SRbeStats;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+#define RBE_DAY_MS                  86400000UL
+
+/*****************************************************************************/
+// function declarations
+void RbeInit(const SRbeConfig *pxConfig);
+RbeReason RbeProcess(uint32_t lLux, uint32_t lNowMs);
+uint32_t RbeGetFiltered(void);
+void RbeGetWindow(uint32_t *plLow, uint32_t *plHigh);
+void RbeSetIntervals(uint32_t lMinIntervalMs, uint32_t lHeartbeatMs);
+void RbeLogTx(uint32_t lRadioOnMs);
+void RbeGetStats(SRbeStats *pxStats);
+
+/*****************************************************************************/
+// variables
+
+/*****************************************************************************/
+// functions
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MG_RBE_H
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
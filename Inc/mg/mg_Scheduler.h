@@ -0,0 +1,113 @@
+/** ***************************************************************************
+*   \file        mg_Scheduler.h
+*   \brief       Tickless cooperative scheduler. Runs due tasks, then stops the
+*                core until the next one on the RTC wake-up timer, keeping the
+*                HAL tick consistent across the low power periods.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+#ifndef MG_SCHEDULER_H
+#define MG_SCHEDULER_H
+/*****************************************************************************/
+// standard libraries first
+#include <stdint.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "stm32l0xx_hal.h"
+
+// user headers from other components
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+// enumerations
+
+/**
+* @brief Core power state, for the time accounting
+*/
+typedef enum {
+  SCHED_RUN = 0,                /*!< Core running */
+  SCHED_SLEEP,                  /*!< Sleep mode, peripherals clocked */
+  SCHED_STOP                    /*!< STOP mode, only LSE domain running */
+} SchedPower;
+
+/*****************************************************************************/
+// typedefs
+
+/**
+* @brief Task body. Tasks run to completion and must not block for long
+*/
+typedef void (*SchedTaskFn)(void);
+
+/*****************************************************************************/
+// structures
+
+/**
+* @brief Time accounting since SchedInit()
+*/
+typedef struct {
+  uint32_t lRunMs;              /*!< Time in Run mode */
+  uint32_t lSleepMs;            /*!< Time in Sleep mode */
+  uint32_t lStopMs;             /*!< Time in STOP mode */
+  uint32_t lStopEntries;        /*!< Number of STOP periods */
+  uint32_t lTaskRuns;           /*!< Number of task executions */
+} SSchedStats;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* Gateway: LDC report, channel, beacon and RX output tasks, with room for more */
+#define SCHED_MAX_TASKS             6
+#define SCHED_NO_TASK               0xFF
+
+/* Shorter idle periods are spent in Sleep mode, STOP entry and exit cost more */
+#define SCHED_MIN_STOP_MS           4
+
+/* Longest wake-up timer period with the 2048 Hz clock, above it 1 s steps are used */
+#define SCHED_WUT_FINE_MAX_MS       30000UL
+
+/*****************************************************************************/
+// function declarations
+void SchedInit(void);
+uint8_t SchedAdd(SchedTaskFn pfTask, uint32_t lFirstDelayMs, uint32_t lPeriodMs);
+void SchedSetNext(uint8_t cTask, uint32_t lDelayMs);
+void SchedTrigger(uint8_t cTask);
+uint32_t SchedGetNextRun(uint8_t cTask);
+uint32_t SchedMsToNext(uint8_t cTask);
+uint32_t SchedMsToOthers(uint8_t cTask);
+void SchedRun(void);
+void SchedGetStats(SSchedStats *pxStats);
+
+HAL_StatusTypeDef SchedWakeupStart(uint32_t lMs);
+void SchedWakeupStop(void);
+uint8_t SchedWakeupFired(void);
+uint32_t SchedTickSuspend(void);
+uint32_t SchedTickResume(uint32_t lStamp, SchedPower xMode);
+
+/*****************************************************************************/
+// variables
+
+/*****************************************************************************/
+// functions
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MG_SCHEDULER_H
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
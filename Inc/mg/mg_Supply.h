@@ -0,0 +1,117 @@
+/** ***************************************************************************
+*   \file        mg_Supply.h
+*   \brief       Supply monitoring. Derives VDD from VREFINT, tracks the
+*                battery discharge and grades the supply so the application
+*                can stretch its intervals and lower the PA power as it sags.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+#ifndef MG_SUPPLY_H
+#define MG_SUPPLY_H
+/*****************************************************************************/
+// standard libraries first
+#include <stdint.h>
+
+// user headers directly related to this component, ensures no dependency
+
+// user headers from other components
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+// enumerations
+
+/**
+* @brief Supply grade, from healthy to about to brown out
+*/
+typedef enum {
+  SUPPLY_NORMAL = 0,            /*!< Full duty cycle */
+  SUPPLY_LOW,                   /*!< Battery sagging, save energy */
+  SUPPLY_CRITICAL,              /*!< Close to brown-out, minimum activity */
+  SUPPLY_NB_LEVELS
+} SupplyLevel;
+
+/**
+* @brief Conditions of a VDD measurement
+*/
+typedef enum {
+  SUPPLY_IDLE = 0,              /*!< Taken with the radio off */
+  SUPPLY_LOADED                 /*!< Taken while the radio transmits */
+} SupplyLoad;
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/**
+* @brief Supply state
+*/
+typedef struct {
+  SupplyLevel xLevel;           /*!< Current grade */
+  uint16_t nIdleMv;             /*!< Filtered VDD with the radio off */
+  uint16_t nLoadedMv;           /*!< Filtered VDD during transmissions, 0 until measured */
+  uint16_t nMinMv;              /*!< Lowest single VDD reading since init */
+  int16_t  iSlopeMvPerDay;      /*!< Idle VDD trend, negative when discharging */
+  uint32_t lHoursLeft;          /*!< Estimated time to SUPPLY_CRITICAL_MV, 0xFFFFFFFF if unknown */
+  uint16_t nLowBattIrqs;        /*!< S2LP battery level detector events */
+  uint16_t nBorIrqs;            /*!< S2LP brown-out events */
+} SSupplyStatus;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* Grading thresholds on the worst of idle and loaded VDD, with hysteresis */
+#define SUPPLY_LOW_MV               2600
+#define SUPPLY_CRITICAL_MV          2300
+#define SUPPLY_HYST_MV              50
+
+/* Discharge curve: one idle point every period, slope over the whole history */
+#define SUPPLY_CURVE_POINTS         8
+#define SUPPLY_CURVE_PERIOD_MS      (3UL*3600UL*1000UL)
+
+/* S2LP battery level detector thresholds, PM_CONF1 SET_BLD_TH */
+#define SUPPLY_BLD_2V7              0x00
+#define SUPPLY_BLD_2V5              0x10
+#define SUPPLY_BLD_2V3              0x20
+#define SUPPLY_BLD_2V1              0x30
+
+#define SUPPLY_HOURS_UNKNOWN        0xFFFFFFFFUL
+
+/*****************************************************************************/
+// function declarations
+void SupplyInit(void);
+void SupplyRadioBldInit(uint8_t cThreshold);
+SupplyLevel SupplyUpdate(uint16_t nVrefint, SupplyLoad xLoad, uint32_t lNowMs);
+void SupplyRadioEvent(uint8_t cLowBatt, uint8_t cBor);
+SupplyLevel SupplyGetLevel(void);
+void SupplyGetStatus(SSupplyStatus *pxStatus);
+
+/*****************************************************************************/
+// variables
+
+/*****************************************************************************/
+// functions
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MG_SUPPLY_H
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
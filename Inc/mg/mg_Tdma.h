@@ -0,0 +1,120 @@
+/** ***************************************************************************
+*   \file        mg_Tdma.h
+*   \brief       Time slotted uplink. The gateway beacons its time at the
+*                start of each frame, each node transmits once per frame in
+*                the slot of its address. Nodes only listen to the beacons
+*                they need: the guard around the slot grows with the clock
+*                drift measured at each beacon, a beacon is caught before it
+*                outgrows the slot layout.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+#ifndef MG_TDMA_H
+#define MG_TDMA_H
+/*****************************************************************************/
+// standard libraries first
+#include <stdint.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "stm32l0xx_hal.h"
+
+// user headers from other components
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/**
+* @brief Frame layout, the same on the gateway and the nodes
+*/
+typedef struct {
+  uint32_t lFrameMs;            /*!< Frame, starts with the beacon in slot 0 */
+  uint32_t lSlotMs;             /*!< Slot, a report and its retransmissions between two guards */
+  uint16_t nGuardMinMs;         /*!< Guard right after a beacon, covers the timestamp resolution */
+  uint16_t nGuardMaxMs;         /*!< Guard the slots are laid out for, sync is lost beyond */
+  uint16_t nDriftPpm;           /*!< Clock drift assumed until measured */
+  uint32_t lBeaconAirUs;        /*!< Beacon TX strobe to RX_DATA_READY */
+} STdmaConfig;
+
+/**
+* @brief Synchronisation state and counters since TdmaInit()
+*/
+typedef struct {
+  uint8_t cSynced;              /*!< Network time known well enough to use the slot */
+  uint32_t lBeacons;            /*!< Beacons received */
+  uint32_t lMissed;             /*!< Beacon windows without a beacon */
+  uint32_t lLost;               /*!< Synchronisation losses */
+  uint32_t lSlots;              /*!< Slots transmitted in */
+  int32_t iLastErrorMs;         /*!< Clock error found at the last beacon, positive if ahead */
+  uint16_t nDriftPpm;           /*!< Drift estimate the guard grows with */
+  uint16_t nGuardMs;            /*!< Guard at the last slot */
+} STdmaStats;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* Beacon: marker, frame number and network timestamp, little endian */
+#define TDMA_BEACON_MARKER          0xE8
+#define TDMA_BEACON_BYTES           7
+
+/* Slot 0 carries the beacon */
+#define TDMA_BEACON_SLOT            0
+
+/* End of a frame past its last slot */
+#define TDMA_NO_SLOT                0xFFFF
+
+/*****************************************************************************/
+// function declarations
+void TdmaInit(const STdmaConfig *pxConfig, uint8_t cAddress);
+uint16_t TdmaSlots(void);
+uint16_t TdmaSlot(void);
+uint16_t TdmaSlotOf(uint8_t cAddress);
+uint16_t TdmaSlotAt(uint32_t lTs, uint16_t *pnFrame);
+uint32_t TdmaNextSlotStart(uint32_t lNowTs);
+uint8_t TdmaBeaconBuild(uint8_t *pcBuffer, uint32_t lNowTs);
+HAL_StatusTypeDef TdmaBeaconParse(const uint8_t *pcBuffer, uint8_t cLen, uint32_t *plNetworkTs);
+void TdmaBeaconReceived(uint32_t lNetworkTs, uint32_t lLocalTs);
+void TdmaBeaconMissed(uint32_t lNowTs);
+uint8_t TdmaIsSynced(void);
+uint32_t TdmaFrameStart(uint32_t lNowTs);
+uint32_t TdmaNextBeacon(uint32_t lNowTs);
+uint32_t TdmaNextSlot(uint32_t lNowTs);
+uint16_t TdmaGuardMs(uint32_t lAtTs);
+uint8_t TdmaSlotTx(uint32_t lNowTs);
+uint32_t TdmaMsUntil(uint32_t lTs, uint32_t lNowTs);
+void TdmaGetStats(STdmaStats *pxStats);
+
+/*****************************************************************************/
+// variables
+
+/*****************************************************************************/
+// functions
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MG_TDMA_H
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -0,0 +1,94 @@
+/** ***************************************************************************
+*   \file        mg_Timestamp.h
+*   \brief       RTC timestamps. Atomic calendar and sub-second reads packed
+*                into 32 bits, with an offset and a frequency trim learned
+*                from network time beacons.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+#ifndef MG_TIMESTAMP_H
+#define MG_TIMESTAMP_H
+/*****************************************************************************/
+// standard libraries first
+#include <stdint.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "stm32l0xx_hal.h"
+
+// user headers from other components
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/**
+* @brief Network time correction state
+*/
+typedef struct {
+  uint8_t cSynced;              /*!< A beacon was received, TimestampNow() is network time */
+  uint32_t lSyncs;              /*!< Beacons applied */
+  uint32_t lOffset;             /*!< Network minus local time, timestamp units */
+  int32_t iLastStep;            /*!< Offset change at the last beacon, timestamp units */
+  int16_t iTrimPulses;          /*!< RTC smooth calibration, RTCCLK pulses per 2^20, positive speeds up */
+} STimestampStatus;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/*  A timestamp is seconds in the upper 24 bits and 1/256 s in the lower 8,
+    matching SynchPrediv = 255. It wraps after 194 days, receivers resolve
+    it against their own clock. */
+#define TIMESTAMP_FRAC_BITS         8
+#define TIMESTAMP_ONE_S             (1UL << TIMESTAMP_FRAC_BITS)
+
+/* Shortest beacon interval the frequency trim is learned over */
+#define TIMESTAMP_TRIM_MIN_S        600
+
+/* RTC smooth calibration range, RTCCLK pulses per 2^20 */
+#define TIMESTAMP_TRIM_MIN          (-511)
+#define TIMESTAMP_TRIM_MAX          512
+
+/*****************************************************************************/
+// function declarations
+void TimestampInit(void);
+uint32_t TimestampRaw(void);
+uint32_t TimestampNow(void);
+uint32_t TimestampRawSeconds(void);
+uint32_t TimestampToMs(uint32_t lDelta);
+void TimestampSync(uint32_t lNetworkTs, uint32_t lLocalTs);
+void TimestampGetStatus(STimestampStatus *pxStatus);
+
+/*****************************************************************************/
+// variables
+
+/*****************************************************************************/
+// functions
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MG_TIMESTAMP_H
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -0,0 +1,117 @@
+/** ***************************************************************************
+*   \file        mg_Tpc.h
+*   \brief       Closed-loop transmit power control. The receiver answers each
+*                report with the RSSI and sync word quality it saw, and the PA
+*                level is stepped to the lowest one keeping a target margin,
+*                backing off quickly when the answer is lost.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+#ifndef MG_TPC_H
+#define MG_TPC_H
+/*****************************************************************************/
+// standard libraries first
+#include <stdint.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "stm32l0xx_hal.h"
+
+// user headers from other components
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/**
+* @brief Link feedback, as carried in the answer frame
+*/
+typedef struct {
+  uint16_t nSeq;                /*!< Sequence number of the report answered */
+  int8_t cRssiDbm;              /*!< RSSI at the end of the sync word */
+  uint8_t cSyncErrors;          /*!< Sync word bits received in error */
+} STpcFeedback;
+
+/**
+* @brief Controller state and counters since TpcInit()
+*/
+typedef struct {
+  float fDbm;                   /*!< PA level for the next report */
+  float fCeilingDbm;            /*!< Highest level allowed */
+  int8_t cTargetRssiDbm;        /*!< RSSI aimed for at the receiver */
+  int8_t cLastRssiDbm;          /*!< RSSI of the last answer */
+  uint8_t cLastSyncErrors;      /*!< Sync errors of the last answer */
+  uint8_t cLosses;              /*!< Consecutive lost answers */
+  uint32_t lFeedbacks;          /*!< Answers received */
+  uint32_t lLost;               /*!< Answers lost */
+  uint32_t lStepsUp;            /*!< Level increases */
+  uint32_t lStepsDown;          /*!< Level decreases */
+} STpcStatus;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* RSSI aimed for at the receiver: about -110 dBm sensitivity at 38.4 kbps
+   plus a fade margin */
+#define TPC_TARGET_RSSI_DBM         -95
+#define TPC_HYST_DB                 3           // margin kept above the target before stepping down
+#define TPC_STEP_DOWN_DB            2           // largest decrease per answer
+#define TPC_BACKOFF_DB              6           // increase per lost answer
+#define TPC_LOSSES_TO_MAX           2           // consecutive losses that return to the ceiling
+#define TPC_SYNC_ERRORS_MAX         2           // more sync bit errors count as a weak link
+#define TPC_MIN_DBM                 (-10.0f)
+
+/* Answer frame: marker, sequence number little endian, RSSI, sync errors */
+#define TPC_FEEDBACK_MARKER         0xE6
+#define TPC_FEEDBACK_BYTES          5
+
+/* Listen window for the answer after each report, the receiver turns around
+   and sends a short preamble */
+#define TPC_FEEDBACK_WINDOW_MS      30.0
+#define TPC_FEEDBACK_PREAMBLE_BYTES 8
+
+/*****************************************************************************/
+// function declarations
+void TpcInit(float fCeilingDbm);
+void TpcSetCeiling(float fCeilingDbm);
+void TpcSetTarget(int8_t cTargetRssiDbm);
+float TpcGetDbm(void);
+void TpcFeedback(const STpcFeedback *pxFeedback);
+void TpcLoss(void);
+void TpcGetStatus(STpcStatus *pxStatus);
+uint8_t TpcFeedbackBuild(uint8_t *pcBuffer, const STpcFeedback *pxFeedback);
+HAL_StatusTypeDef TpcFeedbackParse(const uint8_t *pcFrame, uint8_t cLen, STpcFeedback *pxFeedback);
+
+/*****************************************************************************/
+// variables
+
+/*****************************************************************************/
+// functions
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MG_TPC_H
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
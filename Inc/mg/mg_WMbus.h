@@ -0,0 +1,116 @@
+/** ***************************************************************************
+*   \file        mg_WMbus.h
+*   \brief       Wireless M-Bus telegrams for meter collectors, T1 or C1
+*                meter to other. The radio does the preamble, sync word,
+*                3 out of 6 coding and postamble, the telegram is built here
+*                with its block CRCs: link layer header, short application
+*                header and one lux and age record per reading.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+#ifndef MG_WMBUS_H
+#define MG_WMBUS_H
+/*****************************************************************************/
+// standard libraries first
+#include <stdint.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "stm32l0xx_hal.h"
+
+// user headers from other components
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+// enumerations
+
+/**
+* @brief Transmit mode, 100 kchip/s on 868.95 MHz both
+*/
+typedef enum {
+  WMBUS_T1 = 0,                 /*!< 3 out of 6 coded, frame format A */
+  WMBUS_C1                      /*!< NRZ, frame format B, a third shorter on air */
+} WMbusTxMode;
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/**
+* @brief Meter identity and header lengths
+*/
+typedef struct {
+  WMbusTxMode xMode;            /*!< T1 or C1 */
+  uint16_t nManufacturer;       /*!< FLAG code, see WMBUS_FLAG() */
+  uint32_t lId;                 /*!< Identification number, 8 BCD digits */
+  uint8_t cVersion;             /*!< Version of the node */
+  uint8_t cDeviceType;          /*!< Device type code */
+  uint8_t cPreamble;            /*!< Bit pairs beyond the minimum preamble */
+  uint8_t cPostamble;           /*!< Postamble bit pairs */
+} SWMbusConfig;
+
+/**
+* @brief Counters since WMbusInit()
+*/
+typedef struct {
+  uint32_t lTelegrams;          /*!< Telegrams built */
+  uint32_t lReadings;           /*!< Readings carried */
+  uint32_t lDropped;            /*!< Readings without room in their telegram */
+  uint32_t lBytes;              /*!< Telegram bytes, CRCs included */
+  uint64_t llAirUs;             /*!< Telegram air time, us */
+} SWMbusStats;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* Manufacturer FLAG code from its three capital letters */
+#define WMBUS_FLAG(a, b, c)         ((uint16_t)(((((a) - 64) & 0x1F) << 10) | ((((b) - 64) & 0x1F) << 5) | (((c) - 64) & 0x1F)))
+
+/* Device type: other */
+#define WMBUS_DEVICE_OTHER          0x00
+
+/* Telegram within the 128 byte FIFO, no refill while sending */
+#define WMBUS_FRAME_MAX             128
+
+/* Readings a telegram always has room for, newest first */
+#define WMBUS_READINGS_MAX          6
+
+/*****************************************************************************/
+// function declarations
+void WMbusInit(const SWMbusConfig *pxConfig);
+void WMbusConfigure(void);
+void WMbusSetPayloadLength(uint8_t cLen);
+uint8_t WMbusBuild(uint8_t *pcBuffer, uint8_t cSize, const uint8_t *pcReport, uint8_t cReportLen, uint32_t lNowTs);
+uint16_t WMbusCrc(const uint8_t *pcData, uint8_t cLen);
+uint32_t WMbusAirUs(uint8_t cLen);
+void WMbusGetStats(SWMbusStats *pxStats);
+
+/*****************************************************************************/
+// variables
+
+/*****************************************************************************/
+// functions
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MG_WMBUS_H
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -0,0 +1,277 @@
+/** ***************************************************************************
+*   \file        mg_AdcCal.c
+*   \brief       ADC calibration and light sensor self-test, cached in the data
+*                EEPROM so that calibration only reruns on drift or age.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+/*****************************************************************************/
+// standard libraries
+#include <string.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "mg_AdcCal.h"
+#include "stm32l0xx_hal.h"
+
+// user headers from other components
+#include "mg_LightSensor.h"
+#include "mg_Timestamp.h"
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+#define ADCCAL_RECORD_WORDS         (sizeof(SAdcCalRecord) / sizeof(uint32_t))
+#define ADCCAL_ADRDY_TIMEOUT_MS     2
+
+/*****************************************************************************/
+// static function declarations
+static AdcCalReason AdcCalCheck(const SLightSample *pxSample);
+static HAL_StatusTypeDef AdcCalRun(const SLightSample *pxSample);
+static HAL_StatusTypeDef AdcCalApply(uint32_t lFactor);
+static AdcSelfTest AdcCalSelfTest(void);
+static uint32_t AdcCalChecksum(const SAdcCalRecord *pxRecord);
+static void AdcCalStore(void);
+
+/*****************************************************************************/
+// static variable declarations
+extern ADC_HandleTypeDef hadc;
+
+static SAdcCalRecord xAdcCalRecord;
+
+/*****************************************************************************/
+// functions
+
+/** ***************************************************************************
+*   \brief      Boot time calibration.
+*   \details    Loads the EEPROM record and takes one reading of VDDA and the die
+*               temperature. If the record is valid, recent and was taken under
+*               similar conditions its factor is applied directly. Otherwise the
+*               ADC is calibrated, the sensor self-test is run and the record is
+*               rewritten.
+*   \return     reason for the outcome, ADCCAL_CACHED when nothing was redone
+******************************************************************************/
+AdcCalReason AdcCalBoot(void)
+{
+	SLightSample xSample;
+	AdcCalReason xReason;
+
+	memcpy(&xAdcCalRecord, (const void *)ADCCAL_EEPROM_ADDR, sizeof(xAdcCalRecord));
+
+	/* Reading with the uncalibrated ADC is accurate enough to check drift */
+	if(LightSensorSample(&xSample) != HAL_OK)
+		return ADCCAL_ERROR;
+
+	xReason = AdcCalCheck(&xSample);
+
+	if(xReason == ADCCAL_CACHED)
+	{
+		if(AdcCalApply(xAdcCalRecord.lCalFactor) != HAL_OK)
+			return ADCCAL_ERROR;
+	}
+	else
+	{
+		if(AdcCalRun(&xSample) != HAL_OK)
+			return ADCCAL_ERROR;
+
+		xAdcCalRecord.lSelfTest = AdcCalSelfTest();
+		AdcCalStore();
+	}
+
+	return xReason;
+}
+
+/** ***************************************************************************
+*   \brief      Runtime drift check.
+*   \details    Call with any recent acquisition. The ADC is recalibrated when
+*               the supply or temperature moved too far from the calibration
+*               conditions, or the calibration is too old. The cached self-test
+*               result is kept.
+*   \param      pxSample     recent acquisition including VREFINT and TEMP
+*   \return     reason for the outcome, ADCCAL_CACHED when nothing was redone
+******************************************************************************/
+AdcCalReason AdcCalService(const SLightSample *pxSample)
+{
+	AdcCalReason xReason = AdcCalCheck(pxSample);
+
+	if(xReason != ADCCAL_CACHED)
+	{
+		if(AdcCalRun(pxSample) != HAL_OK)
+			return ADCCAL_ERROR;
+
+		AdcCalStore();
+	}
+
+	return xReason;
+}
+
+/** ***************************************************************************
+*   \brief      Copy out the current calibration record.
+*   \param      pxRecord     destination
+******************************************************************************/
+void AdcCalGetRecord(SAdcCalRecord *pxRecord)
+{
+	*pxRecord = xAdcCalRecord;
+}
+
+/** ***************************************************************************
+*   \brief      Decide whether the calibration must be redone.
+*   \param      pxSample     acquisition giving the current conditions
+*   \return     ADCCAL_CACHED if the record is still good, else the reason
+******************************************************************************/
+static AdcCalReason AdcCalCheck(const SLightSample *pxSample)
+{
+	uint16_t nVddMv = LightSensorVddMv(pxSample->nVrefint);
+	int16_t iTempC = LightSensorTempC(pxSample->nTemp, nVddMv);
+	int32_t lDiff;
+
+	if((xAdcCalRecord.lTag != ADCCAL_TAG) || (xAdcCalRecord.lCheck != AdcCalChecksum(&xAdcCalRecord)))
+		return ADCCAL_NO_RECORD;
+
+	lDiff = (int32_t)nVddMv - (int32_t)xAdcCalRecord.nVddMv;
+	if((lDiff > ADCCAL_VDD_DRIFT_MV) || (lDiff < -ADCCAL_VDD_DRIFT_MV))
+		return ADCCAL_VDD_DRIFT;
+
+	lDiff = (int32_t)iTempC - (int32_t)xAdcCalRecord.iTempC;
+	if((lDiff > ADCCAL_TEMP_DRIFT_C) || (lDiff < -ADCCAL_TEMP_DRIFT_C))
+		return ADCCAL_TEMP_DRIFT;
+
+	if((TimestampRawSeconds() - xAdcCalRecord.lCalTimeS) > ADCCAL_MAX_AGE_S)
+		return ADCCAL_AGED;
+
+	return ADCCAL_CACHED;
+}
+
+/** ***************************************************************************
+*   \brief      Run the ADC calibration and update the record conditions.
+*   \param      pxSample     acquisition giving the current conditions
+*   \return     HAL status of the calibration
+******************************************************************************/
+static HAL_StatusTypeDef AdcCalRun(const SLightSample *pxSample)
+{
+	if(HAL_ADCEx_Calibration_Start(&hadc, ADC_SINGLE_ENDED) != HAL_OK)
+		return HAL_ERROR;
+
+	xAdcCalRecord.lTag = ADCCAL_TAG;
+	xAdcCalRecord.lCalFactor = HAL_ADCEx_Calibration_GetValue(&hadc, ADC_SINGLE_ENDED);
+	xAdcCalRecord.lCalTimeS = TimestampRawSeconds();
+	xAdcCalRecord.nVddMv = LightSensorVddMv(pxSample->nVrefint);
+	xAdcCalRecord.iTempC = LightSensorTempC(pxSample->nTemp, xAdcCalRecord.nVddMv);
+
+	return HAL_OK;
+}
+
+/** ***************************************************************************
+*   \brief      Load a cached calibration factor.
+*   \details    CALFACT can only be written with the ADC enabled, and is kept
+*               when the ADC is disabled again by HAL_ADC_Stop().
+*   \param      lFactor     calibration factor
+*   \return     HAL status
+******************************************************************************/
+static HAL_StatusTypeDef AdcCalApply(uint32_t lFactor)
+{
+	HAL_StatusTypeDef xStatus;
+	uint32_t lStartMs;
+
+	__HAL_ADC_ENABLE(&hadc);
+	lStartMs = HAL_GetTick();
+	while(__HAL_ADC_GET_FLAG(&hadc, ADC_FLAG_RDY) == RESET)
+	{
+		if((HAL_GetTick() - lStartMs) > ADCCAL_ADRDY_TIMEOUT_MS)
+			return HAL_TIMEOUT;
+	}
+
+	xStatus = HAL_ADCEx_Calibration_SetValue(&hadc, ADC_SINGLE_ENDED, lFactor);
+	HAL_ADC_Stop(&hadc);
+
+	return xStatus;
+}
+
+/** ***************************************************************************
+*   \brief      Light sensor self-test.
+*   \details    With SENSE_EN low the output must be near zero. With SENSE_EN
+*               high it must rise by at least ADCCAL_SELFTEST_MIN_DELTA; if it
+*               does not, the scene may simply be dark, which is reported
+*               separately from a failure.
+*   \return     self-test result
+******************************************************************************/
+static AdcSelfTest AdcCalSelfTest(void)
+{
+	SLightSample xDark, xLight;
+
+	if((LightSensorSampleDark(&xDark) != HAL_OK) || (LightSensorSample(&xLight) != HAL_OK))
+		return ADC_SELFTEST_FAIL;
+
+	xAdcCalRecord.nDarkRaw = xDark.nLight;
+	xAdcCalRecord.nLightRaw = xLight.nLight;
+
+	if(xDark.nLight > ADCCAL_SELFTEST_DARK_MAX)
+		return ADC_SELFTEST_FAIL;
+
+	if(xLight.nLight < xDark.nLight + ADCCAL_SELFTEST_MIN_DELTA)
+		return ADC_SELFTEST_DARK;
+
+	return ADC_SELFTEST_PASS;
+}
+
+/** ***************************************************************************
+*   \brief      Record checksum.
+*   \param      pxRecord     record
+*   \return     complement of the sum of all words but the last
+******************************************************************************/
+static uint32_t AdcCalChecksum(const SAdcCalRecord *pxRecord)
+{
+	const uint32_t *plWords = (const uint32_t *)pxRecord;
+	uint32_t lSum = 0;
+
+	for(uint32_t i = 0; i < ADCCAL_RECORD_WORDS - 1; i++)
+	{
+		lSum += plWords[i];
+	}
+
+	return ~lSum;
+}
+
+/** ***************************************************************************
+*   \brief      Write the record to the data EEPROM.
+*   \details    Only words that changed are programmed, to save time and wear.
+******************************************************************************/
+static void AdcCalStore(void)
+{
+	const uint32_t *plWords = (const uint32_t *)&xAdcCalRecord;
+	const volatile uint32_t *plStored = (const volatile uint32_t *)ADCCAL_EEPROM_ADDR;
+
+	xAdcCalRecord.lCheck = AdcCalChecksum(&xAdcCalRecord);
+
+	HAL_FLASHEx_DATAEEPROM_Unlock();
+	for(uint32_t i = 0; i < ADCCAL_RECORD_WORDS; i++)
+	{
+		if(plStored[i] != plWords[i])
+		{
+			HAL_FLASHEx_DATAEEPROM_Program(FLASH_TYPEPROGRAMDATA_WORD, ADCCAL_EEPROM_ADDR + 4 * i, plWords[i]);
+		}
+	}
+	HAL_FLASHEx_DATAEEPROM_Lock();
+}
+
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -0,0 +1,369 @@
+/** ***************************************************************************
+*   \file        mg_Adr.c
+*   \brief       Adaptive data rate. The node picks among a few modem
+*                profiles the fastest one its link margin at full power
+*                allows, from the link quality answers, and announces it
+*                after each report. The modem registers of every profile are
+*                computed once, a switch is a couple of SPI bursts. A
+*                profile may add the radio's convolutional coding.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+/*****************************************************************************/
+// standard libraries
+#include <string.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "mg_Adr.h"
+
+// user headers from other components
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/**
+* @brief Registers of a profile, as left by S2LPRadioInit()
+*/
+typedef struct {
+  uint8_t cModem[6];            /*!< MOD4 to CHFLT: datarate, modulation, deviation, filter */
+  uint8_t cPaConfig0;           /*!< PA FIR cutoff, follows the datarate */
+  uint16_t nPreamble;           /*!< Preamble bit pairs */
+} SAdrImage;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* MOD4 to CHFLT, written in one burst */
+#define ADR_MODEM_BYTES             6
+
+/* PA_CONFIG0, missing from the register header: bits 1:0 are the PA FIR
+   cutoff S2LPRadioInit() picks from the datarate */
+#define ADR_PA_CONFIG0_ADDR         ((uint8_t)0x64)
+
+/* Longest preamble the 10 bit field holds, in bit pairs */
+#define ADR_PREAMBLE_MAX            1023
+
+/*****************************************************************************/
+// static function declarations
+static void AdrPreamble(uint16_t nPairs);
+
+/*****************************************************************************/
+// static variable declarations
+static SAdrConfig xAdrConfig;
+static SAdrStats xAdrStats;
+static SAdrImage xAdrImages[ADR_MAX];
+static uint8_t cAdrImagesReady;
+
+/*****************************************************************************/
+// functions
+
+/** ***************************************************************************
+*   \brief      Keep the profile table and clear the counters.
+*   \details    Starts on the fallback profile.
+*   \param      pxConfig     profiles and margins
+******************************************************************************/
+void AdrInit(const SAdrConfig *pxConfig)
+{
+	xAdrConfig = *pxConfig;
+	if(xAdrConfig.cProfiles > ADR_MAX)
+		xAdrConfig.cProfiles = ADR_MAX;
+	if(xAdrConfig.cProfiles == 0)
+		xAdrConfig.cProfiles = 1;
+
+	memset(&xAdrStats, 0, sizeof(xAdrStats));
+	xAdrStats.cProfile = ADR_FALLBACK;
+	xAdrStats.cWanted = ADR_FALLBACK;
+	cAdrImagesReady = 0;
+}
+
+/** ***************************************************************************
+*   \brief      Compute the register images once, after S2LPRadioInit(), and
+*               tune the current profile.
+*   \details    Each profile goes through S2LPRadioInit() and its registers
+*               are read back, the images only depend on the crystal. The
+*               frequency is rewritten meanwhile, the synthesizer words must
+*               be set after. Called again after SHUTDOWN, only the current
+*               image is then written; the preamble is written by
+*               AdrApply(), once the packet format is set.
+******************************************************************************/
+void AdrConfigure(void)
+{
+	SRadioInit xInit;
+	uint32_t lPairs;
+	uint8_t i;
+
+	if(!cAdrImagesReady)
+	{
+		for(i = 0; i < xAdrConfig.cProfiles; i++)
+		{
+			xInit.lFrequencyBase = xAdrConfig.lFrequencyBase;
+			xInit.xModulationSelect = xAdrConfig.pxProfiles[i].xModulation;
+			xInit.lDatarate = xAdrConfig.pxProfiles[i].lDatarate;
+			xInit.lFreqDev = xAdrConfig.pxProfiles[i].lFreqDev;
+			xInit.lBandwidth = xAdrConfig.pxProfiles[i].lBandwidth;
+			S2LPRadioInit(&xInit);
+
+			S2LPSpiReadRegisters(MOD4_ADDR, ADR_MODEM_BYTES, xAdrImages[i].cModem);
+			S2LPSpiReadRegisters(ADR_PA_CONFIG0_ADDR, 1, &xAdrImages[i].cPaConfig0);
+
+			/* two bits per pair, rounded up so the duration is kept */
+			lPairs = (uint32_t)(((uint64_t)xAdrConfig.lPreambleUs * xInit.lDatarate + 1999999UL) / 2000000UL);
+			xAdrImages[i].nPreamble = (lPairs > ADR_PREAMBLE_MAX) ? ADR_PREAMBLE_MAX : (uint16_t)lPairs;
+		}
+		cAdrImagesReady = 1;
+	}
+
+	S2LPSpiWriteRegisters(MOD4_ADDR, ADR_MODEM_BYTES, xAdrImages[xAdrStats.cProfile].cModem);
+	S2LPSpiWriteRegisters(ADR_PA_CONFIG0_ADDR, 1, &xAdrImages[xAdrStats.cProfile].cPaConfig0);
+}
+
+/** ***************************************************************************
+*   \brief      Tune a profile, the radio must not be in TX or RX.
+*   \details    The image is always written, a register image restored
+*               after SHUTDOWN may hold another profile.
+*   \param      cProfile     profile index
+******************************************************************************/
+void AdrApply(uint8_t cProfile)
+{
+	if(cProfile >= xAdrConfig.cProfiles)
+		cProfile = ADR_FALLBACK;
+
+	S2LPSpiWriteRegisters(MOD4_ADDR, ADR_MODEM_BYTES, xAdrImages[cProfile].cModem);
+	S2LPSpiWriteRegisters(ADR_PA_CONFIG0_ADDR, 1, &xAdrImages[cProfile].cPaConfig0);
+	if(xAdrConfig.lPreambleUs > 0)
+		AdrPreamble(xAdrImages[cProfile].nPreamble);
+	S2LPPacketHandlerFec(xAdrConfig.pxProfiles[cProfile].xFec);
+
+	if(cProfile != xAdrStats.cProfile)
+		xAdrStats.lSwitches++;
+	xAdrStats.cProfile = cProfile;
+}
+
+/** ***************************************************************************
+*   \brief      Profile tuned.
+*   \return     profile index
+******************************************************************************/
+uint8_t AdrCurrent(void)
+{
+	return xAdrStats.cProfile;
+}
+
+/** ***************************************************************************
+*   \brief      Profiles in the table.
+*   \return     count
+******************************************************************************/
+uint8_t AdrProfiles(void)
+{
+	return xAdrConfig.cProfiles;
+}
+
+/** ***************************************************************************
+*   \brief      Profile settings.
+*   \param      cProfile     profile index
+*   \return     profile, the fallback if out of range
+******************************************************************************/
+const SAdrProfile *AdrGetProfile(uint8_t cProfile)
+{
+	if(cProfile >= xAdrConfig.cProfiles)
+		cProfile = ADR_FALLBACK;
+
+	return &xAdrConfig.pxProfiles[cProfile];
+}
+
+/** ***************************************************************************
+*   \brief      Pick the profile for the reports to come from an answer.
+*   \details    The RSSI the receiver saw plus the PA headroom left by the
+*               transmit power control is the RSSI at full power; the
+*               fastest profile keeping cMarginDb above its sensitivity
+*               there is wanted, moving up one profile at a time and only
+*               with cHystDb to spare. Sync bit errors beyond the limit
+*               point to interference and move one profile down.
+*   \param      cRssiDbm          RSSI of the answered report
+*   \param      cSyncErrors       sync word bits received in error
+*   \param      cSyncErrorsMax    sync bit errors still counted as a clean link
+*   \param      fHeadroomDb       PA ceiling less the level of that report
+*   \return     profile wanted
+******************************************************************************/
+uint8_t AdrFeedback(int8_t cRssiDbm, uint8_t cSyncErrors, uint8_t cSyncErrorsMax, float fHeadroomDb)
+{
+	int16_t nFullDbm = (int16_t)cRssiDbm + (int16_t)fHeadroomDb;
+	uint8_t cWanted = ADR_FALLBACK;
+	uint8_t i;
+
+	for(i = 0; i < xAdrConfig.cProfiles; i++)
+	{
+		if((nFullDbm - xAdrConfig.pxProfiles[i].cSensitivityDbm) >= xAdrConfig.cMarginDb)
+			cWanted = i;
+	}
+
+	if(cWanted > xAdrStats.cWanted)
+	{
+		cWanted = xAdrStats.cWanted + 1;
+		if((nFullDbm - xAdrConfig.pxProfiles[cWanted].cSensitivityDbm) < (xAdrConfig.cMarginDb + xAdrConfig.cHystDb))
+			cWanted = xAdrStats.cWanted;
+	}
+	if((cSyncErrors > cSyncErrorsMax) && (xAdrStats.cWanted > ADR_FALLBACK) && (cWanted >= xAdrStats.cWanted))
+		cWanted = xAdrStats.cWanted - 1;
+
+	if(cWanted > xAdrStats.cWanted)
+		xAdrStats.lStepsUp++;
+	else if(cWanted < xAdrStats.cWanted)
+		xAdrStats.lStepsDown++;
+	xAdrStats.cWanted = cWanted;
+
+	return cWanted;
+}
+
+/** ***************************************************************************
+*   \brief      Profile the link margin allows.
+*   \return     profile index
+******************************************************************************/
+uint8_t AdrWanted(void)
+{
+	return xAdrStats.cWanted;
+}
+
+/** ***************************************************************************
+*   \brief      Override the profile wanted, e.g. to compare two profiles.
+*   \details    The next answer picks again from the one set here.
+*   \param      cProfile     profile index
+******************************************************************************/
+void AdrSetWanted(uint8_t cProfile)
+{
+	if(cProfile < xAdrConfig.cProfiles)
+		xAdrStats.cWanted = cProfile;
+}
+
+/** ***************************************************************************
+*   \brief      Write the profile wanted after a report.
+*   \param      pcBuffer     destination, ADR_TRAILER_BYTES
+*   \return     bytes written
+******************************************************************************/
+uint8_t AdrTrailerBuild(uint8_t *pcBuffer)
+{
+	pcBuffer[0] = xAdrStats.cWanted;
+
+	return ADR_TRAILER_BYTES;
+}
+
+/** ***************************************************************************
+*   \brief      Read the profile wanted, the last byte of a report.
+*   \param      pcFrame       received payload
+*   \param      cLen          payload length
+*   \param      pcProfile     destination
+*   \return     HAL_OK, or HAL_ERROR if not a profile of the table
+******************************************************************************/
+HAL_StatusTypeDef AdrTrailerParse(const uint8_t *pcFrame, uint8_t cLen, uint8_t *pcProfile)
+{
+	if((cLen < ADR_TRAILER_BYTES) || (pcFrame[cLen - 1] >= xAdrConfig.cProfiles))
+		return HAL_ERROR;
+
+	*pcProfile = pcFrame[cLen - 1];
+
+	return HAL_OK;
+}
+
+/** ***************************************************************************
+*   \brief      Air time of a packet with a profile.
+*   \param      cProfile     profile index
+*   \param      cLen         payload bytes
+*   \return     us
+******************************************************************************/
+uint32_t AdrAirUs(uint8_t cProfile, uint8_t cLen)
+{
+	uint32_t lBits;
+
+	if(cProfile >= xAdrConfig.cProfiles)
+		cProfile = ADR_FALLBACK;
+
+	/* the coder doubles the bits after the sync word */
+	lBits = xAdrConfig.nOverheadBits - xAdrConfig.cSyncBits + 8UL * cLen;
+	if(xAdrConfig.pxProfiles[cProfile].xFec == S_ENABLE)
+		lBits *= 2;
+	lBits += 2UL * xAdrImages[cProfile].nPreamble + xAdrConfig.cSyncBits;
+
+	return (uint32_t)(((uint64_t)lBits * 1000000UL) / xAdrConfig.pxProfiles[cProfile].lDatarate);
+}
+
+/** ***************************************************************************
+*   \brief      Count a report against its profile.
+*   \param      cProfile      profile index
+*   \param      cReadings     readings carried
+*   \param      cLen          payload bytes
+******************************************************************************/
+void AdrLogReport(uint8_t cProfile, uint8_t cReadings, uint8_t cLen)
+{
+	if(cProfile >= xAdrConfig.cProfiles)
+		return;
+
+	xAdrStats.lReports[cProfile]++;
+	xAdrStats.lReadings[cProfile] += cReadings;
+	xAdrStats.llAirUs[cProfile] += AdrAirUs(cProfile, cLen);
+}
+
+/** ***************************************************************************
+*   \brief      Count the outcome of a report against its profile.
+*   \details    Every attempt costs the report air time at the TX current,
+*               the charge per delivered byte compares the profiles.
+*   \param      cProfile       profile index
+*   \param      cLen           payload bytes
+*   \param      cAttempts      transmissions, the first one included
+*   \param      cDelivered     1 if acked
+*   \param      lTxNa          TX current at the PA level used
+******************************************************************************/
+void AdrLogDelivery(uint8_t cProfile, uint8_t cLen, uint8_t cAttempts, uint8_t cDelivered, uint32_t lTxNa)
+{
+	if(cProfile >= xAdrConfig.cProfiles)
+		return;
+
+	xAdrStats.lAttempts[cProfile] += cAttempts;
+	if(cDelivered)
+	{
+		xAdrStats.lDelivered[cProfile]++;
+		xAdrStats.lDeliveredBytes[cProfile] += cLen;
+	}
+	xAdrStats.llChargeNc[cProfile] += ((uint64_t)AdrAirUs(cProfile, cLen) * cAttempts * lTxNa) / 1000000UL;
+}
+
+/** ***************************************************************************
+*   \brief      Copy out the state and counters.
+*   \param      pxStats     destination
+******************************************************************************/
+void AdrGetStats(SAdrStats *pxStats)
+{
+	*pxStats = xAdrStats;
+}
+
+/** ***************************************************************************
+*   \brief      Write the preamble length, keeping the sync length beside it.
+*   \param      nPairs     bit pairs
+******************************************************************************/
+static void AdrPreamble(uint16_t nPairs)
+{
+	uint8_t cRegs[2];
+
+	S2LPSpiReadRegisters(PCKTCTRL6_ADDR, 1, &cRegs[0]);
+	cRegs[0] = (cRegs[0] & ~PREAMBLE_LEN_9_8_REGMASK) | ((nPairs >> 8) & PREAMBLE_LEN_9_8_REGMASK);
+	cRegs[1] = (uint8_t)nPairs;
+	S2LPSpiWriteRegisters(PCKTCTRL6_ADDR, 2, cRegs);
+}
+
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
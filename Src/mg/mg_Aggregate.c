@@ -0,0 +1,317 @@
+/** ***************************************************************************
+*   \file        mg_Aggregate.c
+*   \brief       Reading aggregation. Timestamped light readings are queued
+*                and packed into one variable length report, sent when the
+*                byte budget is reached or the oldest reading is due, so the
+*                preamble, sync and CRC are paid once for several readings.
+*                Readings are delta coded with mg_Codec as they are queued.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+/*****************************************************************************/
+// standard libraries
+#include <string.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "mg_Aggregate.h"
+
+// user headers from other components
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+#define AGG_LUX_MAX                 0xFFFFFFUL
+#define AGG_OFFSET_MAX              0xFFFFUL
+
+/*****************************************************************************/
+// static function declarations
+static uint32_t AggCycles(void);
+
+/*****************************************************************************/
+// static variable declarations
+static SAggConfig xAggConfig;
+static SAggStats xAggStats;
+static SCodecState xAggCodec;
+static uint8_t cAggCoded[AGG_FRAME_MAX - AGG_HEADER_BYTES];
+static uint8_t cAggCodedLen;
+static uint8_t cAggCount;
+static uint32_t lAggBaseTs;                   // timestamp of the oldest queued reading
+static uint32_t lAggFirstMs;                  // HAL tick when the oldest queued reading was added
+
+/*****************************************************************************/
+// functions
+
+/** ***************************************************************************
+*   \brief      Empty the queue and clear the counters.
+*   \param      pxConfig     budget, deadline and air time parameters
+******************************************************************************/
+void AggInit(const SAggConfig *pxConfig)
+{
+	xAggConfig = *pxConfig;
+	if(xAggConfig.cBudgetBytes > AGG_FRAME_MAX)
+		xAggConfig.cBudgetBytes = AGG_FRAME_MAX;
+	if(xAggConfig.cBudgetBytes < AGG_HEADER_BYTES + CODEC_READING_MAX_BYTES)
+		xAggConfig.cBudgetBytes = AGG_HEADER_BYTES + CODEC_READING_MAX_BYTES;
+	if(xAggConfig.cReadingsMax == 0)
+		xAggConfig.cReadingsMax = 0xFF;
+	AggSetDeadline(pxConfig->lDeadlineMs);
+
+	memset(&xAggStats, 0, sizeof(xAggStats));
+	cAggCount = 0;
+}
+
+/** ***************************************************************************
+*   \brief      Change the deadline, e.g. with the supply grade.
+*   \details    Applies to the readings already queued as well. Clamped to
+*               AGG_DEADLINE_MAX_MS, beyond which the reading offsets would
+*               not fit in a report.
+*   \param      lDeadlineMs     longest a reading is held back
+******************************************************************************/
+void AggSetDeadline(uint32_t lDeadlineMs)
+{
+	xAggConfig.lDeadlineMs = (lDeadlineMs > AGG_DEADLINE_MAX_MS) ? AGG_DEADLINE_MAX_MS : lDeadlineMs;
+}
+
+/** ***************************************************************************
+*   \brief      Queue a reading, coding it at once.
+*   \details    There is always room, as a report is due as soon as a worst
+*               case reading would not fit in the budget. The coding time is
+*               measured in core cycles with SysTick, the M0+ has no cycle
+*               counter.
+*   \param      lTimestamp     TimestampNow() when the reading was taken
+*   \param      lLux           reading
+*   \param      cReason        RbeReason
+*   \param      lNowMs         HAL tick
+*   \return     whether a report is due, see AggDue()
+******************************************************************************/
+AggFlushReason AggAdd(uint32_t lTimestamp, uint32_t lLux, uint8_t cReason, uint32_t lNowMs)
+{
+	uint32_t lOffset, lCycles;
+	uint8_t cLen;
+
+	if(cAggCount == 0)
+	{
+		lAggFirstMs = lNowMs;
+		lAggBaseTs = lTimestamp;
+		cAggCodedLen = 0;
+		CodecInit(&xAggCodec);
+	}
+
+	lOffset = (lTimestamp - lAggBaseTs) >> AGG_OFFSET_SHIFT;
+	if(lOffset > AGG_OFFSET_MAX)
+		lOffset = AGG_OFFSET_MAX;
+	if(lLux > AGG_LUX_MAX)
+		lLux = AGG_LUX_MAX;
+
+	lCycles = AggCycles();
+	cLen = CodecEncode(&xAggCodec, &cAggCoded[cAggCodedLen], (uint8_t)(sizeof(cAggCoded) - cAggCodedLen), lOffset, lLux, cReason);
+	lCycles = AggCycles() - lCycles;
+
+	if(cLen == 0)
+		return AGG_FLUSH_BUDGET;
+
+	xAggStats.lEncodeCycles += lCycles;
+	if(lCycles > xAggStats.nEncodeCyclesMax)
+		xAggStats.nEncodeCyclesMax = (lCycles > 0xFFFF) ? 0xFFFF : (uint16_t)lCycles;
+
+	cAggCodedLen += cLen;
+	cAggCount++;
+
+	return AggDue(lNowMs);
+}
+
+/** ***************************************************************************
+*   \brief      Whether the queued readings should be sent.
+*   \param      lNowMs     HAL tick
+*   \return     flush reason, AGG_FLUSH_NONE to keep queuing
+******************************************************************************/
+AggFlushReason AggDue(uint32_t lNowMs)
+{
+	if(cAggCount == 0)
+		return AGG_FLUSH_NONE;
+
+	if((AGG_HEADER_BYTES + cAggCodedLen + CODEC_READING_MAX_BYTES > xAggConfig.cBudgetBytes) || (cAggCount >= xAggConfig.cReadingsMax))
+		return AGG_FLUSH_BUDGET;
+
+	if((lNowMs - lAggFirstMs) >= xAggConfig.lDeadlineMs)
+		return AGG_FLUSH_DEADLINE;
+
+	return AGG_FLUSH_NONE;
+}
+
+/** ***************************************************************************
+*   \brief      Time left until the oldest reading is due, to bound sleeps.
+*   \param      lNowMs     HAL tick
+*   \return     ms, 0 if due, 0xFFFFFFFF if nothing is queued
+******************************************************************************/
+uint32_t AggMsToDeadline(uint32_t lNowMs)
+{
+	uint32_t lWaitedMs;
+
+	if(cAggCount == 0)
+		return 0xFFFFFFFFUL;
+
+	lWaitedMs = lNowMs - lAggFirstMs;
+
+	return (lWaitedMs >= xAggConfig.lDeadlineMs) ? 0 : (xAggConfig.lDeadlineMs - lWaitedMs);
+}
+
+/** ***************************************************************************
+*   \brief      Readings queued.
+*   \return     count
+******************************************************************************/
+uint8_t AggPending(void)
+{
+	return cAggCount;
+}
+
+/** ***************************************************************************
+*   \brief      Pack the queued readings into a report and empty the queue.
+*   \details    The report is counted as sent, with its air time at the
+*               configured data rate and the air time a fixed size reading
+*               format would have added.
+*   \param      pcBuffer     destination
+*   \param      cSize        destination size, at least the byte budget
+*   \param      nSeq         report sequence number
+*   \param      xReason      flush reason, for the counters
+*   \return     payload length, 0 if nothing was queued or cSize is too small
+******************************************************************************/
+uint8_t AggBuild(uint8_t *pcBuffer, uint8_t cSize, uint16_t nSeq, AggFlushReason xReason)
+{
+	uint8_t cLen = AGG_HEADER_BYTES + cAggCodedLen;
+	uint32_t lBaseTs = lAggBaseTs;
+	uint32_t lRawLen = AGG_HEADER_BYTES + (uint32_t)cAggCount * AGG_RAW_READING_BYTES;
+
+	if((cAggCount == 0) || (cLen > cSize))
+		return 0;
+
+	pcBuffer[0] = AGG_FRAME_MARKER;
+	pcBuffer[1] = (uint8_t)nSeq;
+	pcBuffer[2] = (uint8_t)(nSeq >> 8);
+	pcBuffer[3] = cAggCount;
+	pcBuffer[4] = (uint8_t)lBaseTs;
+	pcBuffer[5] = (uint8_t)(lBaseTs >> 8);
+	pcBuffer[6] = (uint8_t)(lBaseTs >> 16);
+	pcBuffer[7] = (uint8_t)(lBaseTs >> 24);
+
+	memcpy(&pcBuffer[AGG_HEADER_BYTES], cAggCoded, cAggCodedLen);
+
+	xAggStats.lReadings += cAggCount;
+	xAggStats.lPackets++;
+	xAggStats.lPayloadBytes += cLen;
+	xAggStats.lRawBytes += lRawLen;
+	xAggStats.llAirUs += (((uint64_t)xAggConfig.nOverheadBits + 8U * cLen) * 1000000UL) / xAggConfig.lDatarate;
+	if(lRawLen > cLen)
+		xAggStats.llAirSavedUs += ((uint64_t)(lRawLen - cLen) * 8U * 1000000UL) / xAggConfig.lDatarate;
+	if(xReason < AGG_FLUSH_NB_REASONS)
+		xAggStats.lFlushes[xReason]++;
+
+	cAggCount = 0;
+
+	return cLen;
+}
+
+/** ***************************************************************************
+*   \brief      Copy out the counters.
+*   \param      pxStats     destination
+******************************************************************************/
+void AggGetStats(SAggStats *pxStats)
+{
+	*pxStats = xAggStats;
+}
+
+/** ***************************************************************************
+*   \brief      Unpack a report header, done by the receiver.
+*   \param      pcFrame      received payload
+*   \param      cLen         payload length
+*   \param      pxHeader     destination
+*   \return     HAL_OK, or HAL_ERROR if the payload is not a complete report
+******************************************************************************/
+HAL_StatusTypeDef AggParse(const uint8_t *pcFrame, uint8_t cLen, SAggHeader *pxHeader)
+{
+	if((cLen < AGG_HEADER_BYTES) || (pcFrame[0] != AGG_FRAME_MARKER))
+		return HAL_ERROR;
+
+	pxHeader->nSeq = (uint16_t)(pcFrame[1] | ((uint16_t)pcFrame[2] << 8));
+	pxHeader->cCount = pcFrame[3];
+	pxHeader->lBaseTs = (uint32_t)pcFrame[4] | ((uint32_t)pcFrame[5] << 8)
+	                  | ((uint32_t)pcFrame[6] << 16) | ((uint32_t)pcFrame[7] << 24);
+
+	return HAL_OK;
+}
+
+/** ***************************************************************************
+*   \brief      Unpack one reading of a report, done by the receiver.
+*   \details    The readings are delta coded, so the ones before are decoded
+*               again, the receiver is not short of cycles.
+*   \param      pcFrame        received payload
+*   \param      cLen           payload length
+*   \param      cIndex         reading, 0 to the header count - 1
+*   \param      pxReading      destination, timestamp to 1/16 s
+*   \return     HAL_OK, or HAL_ERROR if the reading is not in the payload
+******************************************************************************/
+HAL_StatusTypeDef AggGetReading(const uint8_t *pcFrame, uint8_t cLen, uint8_t cIndex, SAggReading *pxReading)
+{
+	SAggHeader xHeader;
+	SCodecState xCodec;
+	uint32_t lOffset, lLux;
+	uint8_t cPos = AGG_HEADER_BYTES, cUsed, cReason, i;
+
+	if((AggParse(pcFrame, cLen, &xHeader) != HAL_OK) || (cIndex >= xHeader.cCount))
+		return HAL_ERROR;
+
+	CodecInit(&xCodec);
+	for(i = 0; i <= cIndex; i++)
+	{
+		cUsed = CodecDecode(&xCodec, &pcFrame[cPos], cLen - cPos, &lOffset, &lLux, &cReason);
+		if(cUsed == 0)
+			return HAL_ERROR;
+		cPos += cUsed;
+	}
+
+	pxReading->lTimestamp = xHeader.lBaseTs + (lOffset << AGG_OFFSET_SHIFT);
+	pxReading->lLux = lLux;
+	pxReading->cReason = cReason;
+
+	return HAL_OK;
+}
+
+/** ***************************************************************************
+*   \brief      Core cycle count from the HAL tick and SysTick.
+*   \return     cycles, wrapping
+******************************************************************************/
+static uint32_t AggCycles(void)
+{
+	uint32_t lMs, lVal;
+
+	do
+	{
+		lMs = HAL_GetTick();
+		lVal = SysTick->VAL;
+	} while(lMs != HAL_GetTick());
+
+	return (lMs * (SysTick->LOAD + 1)) + (SysTick->LOAD - lVal);
+}
+
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -0,0 +1,185 @@
+/** ***************************************************************************
+*   \file        mg_AwdWake.c
+*   \brief       Wake-on-light-change. The ADC analog watchdog checks timer
+*                triggered light conversions against a window while the core
+*                sleeps, and only wakes it when the light leaves the window.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+/*****************************************************************************/
+// standard libraries
+#include <string.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "mg_AwdWake.h"
+#include "stm32l0xx_hal.h"
+#include "main.h"
+
+// user headers from other components
+#include "mg_LightSensor.h"
+#include "mg_Scheduler.h"
+#include "mg_Energy.h"
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+#define AWD_WAKE_ADC_MAX            0xFFF
+
+/*****************************************************************************/
+// static function declarations
+
+/*****************************************************************************/
+// static variable declarations
+extern ADC_HandleTypeDef hadc;
+
+static SAwdWakeStats xAwdWakeStats;
+static uint32_t lAwdWakeTick;                 // HAL tick at the end of the last sleep
+static volatile AwdWakeSource xAwdWakeEvent;
+
+/*****************************************************************************/
+// functions
+
+/** ***************************************************************************
+*   \brief      Initialise the wake sources.
+*   \details    The analog watchdog interrupt shares ADC1_COMP_IRQn. The
+*               scheduler RTC wake-up timer bounds every sleep so heartbeats
+*               are still sent.
+******************************************************************************/
+void AwdWakeInit(void)
+{
+	memset(&xAwdWakeStats, 0, sizeof(xAwdWakeStats));
+	lAwdWakeTick = HAL_GetTick();
+
+	HAL_NVIC_SetPriority(ADC1_COMP_IRQn, 0, 0);
+	HAL_NVIC_EnableIRQ(ADC1_COMP_IRQn);
+}
+
+/** ***************************************************************************
+*   \brief      Sleep until the light leaves a window or a timeout expires.
+*   \details    The sensor stays powered and TIM2 triggers an ADC_IN10
+*               conversion every 1/AWD_WAKE_RATE_HZ s, with the ADC powered
+*               down in between. The analog watchdog compares each conversion
+*               to the window in hardware, so the core stays in Sleep mode with
+*               SysTick stopped until either interrupt fires. STOP mode cannot
+*               be used as the ADC clock is stopped there.
+*               The HAL tick is compensated by the scheduler, and the time is
+*               accounted to Sleep mode there as well.
+*   \param      nLow       lowest raw conversion considered unchanged
+*   \param      nHigh      highest raw conversion considered unchanged
+*   \param      nMaxS      longest sleep, seconds
+*   \return     wake source
+******************************************************************************/
+AwdWakeSource AwdWakeSleep(uint16_t nLow, uint16_t nHigh, uint16_t nMaxS)
+{
+	ADC_AnalogWDGConfTypeDef sAwdConfig;
+	AwdWakeSource xSource;
+	uint32_t lStamp, lSleptMs;
+
+	xAwdWakeStats.lAwakeMs += HAL_GetTick() - lAwdWakeTick;
+
+	if((nMaxS == 0) || (nLow > nHigh))
+		return AWD_WAKE_ERROR;
+
+	/* timeout first, programming it needs the HAL tick */
+	if(SchedWakeupStart((uint32_t)nMaxS * 1000UL) != HAL_OK)
+		return AWD_WAKE_ERROR;
+
+	LightSensorTriggeredEnter(ENABLE);
+
+	sAwdConfig.WatchdogMode = ADC_ANALOGWATCHDOG_SINGLE_REG;
+	sAwdConfig.Channel = ADC_CHANNEL_10;
+	sAwdConfig.ITMode = ENABLE;
+	sAwdConfig.HighThreshold = (nHigh > AWD_WAKE_ADC_MAX) ? AWD_WAKE_ADC_MAX : nHigh;
+	sAwdConfig.LowThreshold = nLow;
+	HAL_ADC_AnalogWDGConfig(&hadc, &sAwdConfig);
+
+	xAwdWakeEvent = AWD_WAKE_ERROR;
+
+	HAL_GPIO_WritePin(SENSE_EN_GPIO_Port, SENSE_EN_Pin, GPIO_PIN_SET);
+	HAL_Delay(LIGHT_SETTLE_MS);
+
+	HAL_ADC_Start(&hadc);
+	EnergyAdcSet(ENERGY_ADC_WATCH);
+	LightSensorTriggerStart(AWD_WAKE_RATE_HZ);
+
+	lStamp = SchedTickSuspend();
+
+	/* other interrupts (radio, UART) wake the core too, go back to sleep */
+	while(xAwdWakeEvent == AWD_WAKE_ERROR)
+	{
+		HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+		if(SchedWakeupFired())
+			xAwdWakeEvent = AWD_WAKE_TIMEOUT;
+	}
+
+	lSleptMs = SchedTickResume(lStamp, SCHED_SLEEP);
+
+	xSource = xAwdWakeEvent;
+
+	LightSensorTriggerStop();
+	HAL_ADC_Stop(&hadc);
+	EnergyAdcSet(ENERGY_ADC_OFF);
+	HAL_GPIO_WritePin(SENSE_EN_GPIO_Port, SENSE_EN_Pin, GPIO_PIN_RESET);
+	SchedWakeupStop();
+
+	sAwdConfig.WatchdogMode = ADC_ANALOGWATCHDOG_NONE;
+	sAwdConfig.ITMode = DISABLE;
+	HAL_ADC_AnalogWDGConfig(&hadc, &sAwdConfig);
+	LightSensorTriggeredExit();
+
+	xAwdWakeStats.lAsleepMs += lSleptMs;
+	if(xSource == AWD_WAKE_LIGHT)
+		xAwdWakeStats.lLightWakes++;
+	else
+		xAwdWakeStats.lTimeoutWakes++;
+
+	lAwdWakeTick = HAL_GetTick();
+
+	return xSource;
+}
+
+/** ***************************************************************************
+*   \brief      Copy out the wake statistics.
+*   \param      pxStats     destination
+******************************************************************************/
+void AwdWakeGetStats(SAwdWakeStats *pxStats)
+{
+	*pxStats = xAwdWakeStats;
+	pxStats->lAwakeMs += HAL_GetTick() - lAwdWakeTick;
+}
+
+/** ***************************************************************************
+*   \brief      Analog watchdog callback, from HAL_ADC_IRQHandler().
+*   \details    The interrupt is masked at once: conversions keep running until
+*               the main loop stops them and would otherwise fire repeatedly.
+*   \param      pxAdc     ADC handle
+******************************************************************************/
+void HAL_ADC_LevelOutOfWindowCallback(ADC_HandleTypeDef* pxAdc)
+{
+	__HAL_ADC_DISABLE_IT(pxAdc, ADC_IT_AWD);
+	if(xAwdWakeEvent == AWD_WAKE_ERROR)
+		xAwdWakeEvent = AWD_WAKE_LIGHT;
+}
+
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
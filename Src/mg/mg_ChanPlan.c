@@ -0,0 +1,325 @@
+/** ***************************************************************************
+*   \file        mg_ChanPlan.c
+*   \brief       Channel plan and hopping. Evenly spaced channels whose
+*                synthesizer words are computed once with the radio
+*                configuration, so a hop is a single SPI burst. The hop
+*                sequence is a hash of the node address and an epoch shared
+*                by both ends, over the channels not blacklisted for their
+*                idle RSSI.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+/*****************************************************************************/
+// standard libraries
+#include <string.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "mg_ChanPlan.h"
+
+// user headers from other components
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* SYNT3 to SYNT0, with the charge pump and band bits of SYNT3 */
+#define CHAN_SYNT_BYTES             4
+
+/* RSSI_LEVEL_RUN register to dBm */
+#define CHAN_RSSI_OFFSET_DBM        146
+
+/* Idle RSSI average, in 1/4 dB with a 1/4 weight per survey */
+#define CHAN_NOISE_SHIFT            2
+#define CHAN_HYST_DB                3
+
+/* Fewer usable channels than this and the blacklist is ignored */
+#define CHAN_MIN_ACTIVE             2
+
+/* Status polls for READY after a survey step */
+#define CHAN_READY_POLLS            20
+
+/*****************************************************************************/
+// static function declarations
+static uint16_t ChanPlanHash(uint8_t cNode, uint16_t nEpoch);
+static void ChanPlanReady(void);
+
+/*****************************************************************************/
+// static variable declarations
+static SChanPlanConfig xChanPlanConfig;
+static SChanPlanStats xChanPlanStats;
+static uint8_t cChanPlanSynt[CHAN_MAX][CHAN_SYNT_BYTES];
+static int16_t nChanPlanNoise[CHAN_MAX];          // idle RSSI, 1/4 dB
+static uint16_t nChanPlanBlacklist;
+static uint8_t cChanPlanCurrent = CHAN_HOME;
+
+/*****************************************************************************/
+// functions
+
+/** ***************************************************************************
+*   \brief      Keep the plan and clear the counters and the blacklist.
+*   \param      pxConfig     base, spacing, channel count and threshold
+******************************************************************************/
+void ChanPlanInit(const SChanPlanConfig *pxConfig)
+{
+	xChanPlanConfig = *pxConfig;
+	if(xChanPlanConfig.cChannels > CHAN_MAX)
+		xChanPlanConfig.cChannels = CHAN_MAX;
+	if(xChanPlanConfig.cChannels == 0)
+		xChanPlanConfig.cChannels = 1;
+
+	memset(&xChanPlanStats, 0, sizeof(xChanPlanStats));
+	memset(nChanPlanNoise, 0, sizeof(nChanPlanNoise));
+	nChanPlanBlacklist = 0;
+	cChanPlanCurrent = CHAN_HOME;
+	xChanPlanStats.nMask = ChanPlanAllMask();
+}
+
+/** ***************************************************************************
+*   \brief      Compute the synthesizer words, after S2LPRadioInit().
+*   \details    Each channel centre is programmed once through the library,
+*               which also picks the charge pump current, and the SYNT
+*               registers are read back. CHNUM stays 0, the centre frequency
+*               is in the words. The current channel is tuned again as the
+*               registers were just rewritten.
+******************************************************************************/
+void ChanPlanConfigure(void)
+{
+	uint8_t i;
+
+	for(i = 0; i < xChanPlanConfig.cChannels; i++)
+	{
+		S2LPRadioSetFrequencyBase(xChanPlanConfig.lBaseHz + (uint32_t)i * xChanPlanConfig.lSpacingHz);
+		S2LPSpiReadRegisters(SYNT3_ADDR, CHAN_SYNT_BYTES, cChanPlanSynt[i]);
+	}
+	S2LPRadioSetChannel(0);
+
+	S2LPSpiWriteRegisters(SYNT3_ADDR, CHAN_SYNT_BYTES, cChanPlanSynt[cChanPlanCurrent]);
+}
+
+/** ***************************************************************************
+*   \brief      Tune a channel, the radio must not be in TX or RX.
+*   \details    The words are always written, a register image restored
+*               after SHUTDOWN may hold another channel.
+*   \param      cChannel     channel index
+******************************************************************************/
+void ChanPlanTune(uint8_t cChannel)
+{
+	if(cChannel >= xChanPlanConfig.cChannels)
+		cChannel = CHAN_HOME;
+
+	S2LPSpiWriteRegisters(SYNT3_ADDR, CHAN_SYNT_BYTES, cChanPlanSynt[cChannel]);
+
+	if(cChannel != cChanPlanCurrent)
+		xChanPlanStats.lHops++;
+	cChanPlanCurrent = cChannel;
+	xChanPlanStats.lUse[cChannel]++;
+}
+
+/** ***************************************************************************
+*   \brief      Channel tuned.
+*   \return     channel index
+******************************************************************************/
+uint8_t ChanPlanCurrent(void)
+{
+	return cChanPlanCurrent;
+}
+
+/** ***************************************************************************
+*   \brief      Channel of a node for an epoch.
+*   \details    Both ends compute it alike from what they share: the node
+*               address, the epoch and the mask in force. The hash picks
+*               one of the channels left in the mask, the home channel is
+*               always in.
+*   \param      cNode      node address
+*   \param      nEpoch     epoch, e.g. the report sequence number
+*   \param      nMask      usable channels
+*   \return     channel index
+******************************************************************************/
+uint8_t ChanPlanHop(uint8_t cNode, uint16_t nEpoch, uint16_t nMask)
+{
+	uint8_t cCount = 0, cPick, i;
+
+	nMask = (nMask & ChanPlanAllMask()) | (1U << CHAN_HOME);
+	for(i = 0; i < xChanPlanConfig.cChannels; i++)
+	{
+		if(nMask & (1U << i))
+			cCount++;
+	}
+
+	cPick = (uint8_t)(ChanPlanHash(cNode, nEpoch) % cCount);
+	for(i = 0; i < xChanPlanConfig.cChannels; i++)
+	{
+		if((nMask & (1U << i)) && (cPick-- == 0))
+			return i;
+	}
+
+	return CHAN_HOME;
+}
+
+/** ***************************************************************************
+*   \brief      Every channel of the plan.
+*   \return     mask, bit per channel
+******************************************************************************/
+uint16_t ChanPlanAllMask(void)
+{
+	return (uint16_t)((1UL << xChanPlanConfig.cChannels) - 1);
+}
+
+/** ***************************************************************************
+*   \brief      Channels not blacklisted by the surveys.
+*   \return     mask, bit per channel
+******************************************************************************/
+uint16_t ChanPlanGetMask(void)
+{
+	return xChanPlanStats.nMask;
+}
+
+/** ***************************************************************************
+*   \brief      Measure the idle RSSI of every channel and update the
+*               blacklist, done by the receiver between packets.
+*   \details    Each channel is received for lDwellMs, the RSSI read while
+*               receiving and averaged. A channel is blacklisted at the
+*               threshold and allowed again CHAN_HYST_DB below it. The
+*               radio must be in READY, it is left in READY on the channel
+*               it was tuned to.
+*   \param      lDwellMs     time per channel, from 1 ms
+******************************************************************************/
+void ChanPlanSurvey(uint32_t lDwellMs)
+{
+	uint8_t cRssi[2];
+	int16_t nSample;
+	uint16_t nMask;
+	uint8_t i, cCount = 0;
+
+	for(i = 0; i < xChanPlanConfig.cChannels; i++)
+	{
+		S2LPSpiWriteRegisters(SYNT3_ADDR, CHAN_SYNT_BYTES, cChanPlanSynt[i]);
+		S2LPCmdStrobeRx();
+		HAL_Delay(lDwellMs);
+
+		/* the first byte is the previous reading */
+		S2LPSpiReadRegisters(RSSI_LEVEL_RUN_ADDR, 2, cRssi);
+		ChanPlanReady();
+
+		nSample = (int16_t)((int16_t)cRssi[1] - CHAN_RSSI_OFFSET_DBM) << CHAN_NOISE_SHIFT;
+		if(xChanPlanStats.lSurveys == 0)
+			nChanPlanNoise[i] = nSample;
+		else
+			nChanPlanNoise[i] += (nSample - nChanPlanNoise[i]) >> CHAN_NOISE_SHIFT;
+		xChanPlanStats.cNoiseDbm[i] = (int8_t)(nChanPlanNoise[i] >> CHAN_NOISE_SHIFT);
+
+		if(i == CHAN_HOME)
+			continue;
+		if(xChanPlanStats.cNoiseDbm[i] >= xChanPlanConfig.cBlacklistDbm)
+			nChanPlanBlacklist |= (1U << i);
+		else if(xChanPlanStats.cNoiseDbm[i] < xChanPlanConfig.cBlacklistDbm - CHAN_HYST_DB)
+			nChanPlanBlacklist &= ~(1U << i);
+	}
+	S2LPSpiWriteRegisters(SYNT3_ADDR, CHAN_SYNT_BYTES, cChanPlanSynt[cChanPlanCurrent]);
+
+	nMask = ChanPlanAllMask() & ~nChanPlanBlacklist;
+	for(i = 0; i < xChanPlanConfig.cChannels; i++)
+	{
+		if(nMask & (1U << i))
+			cCount++;
+	}
+	xChanPlanStats.nMask = (cCount < CHAN_MIN_ACTIVE) ? ChanPlanAllMask() : nMask;
+	xChanPlanStats.lSurveys++;
+}
+
+/** ***************************************************************************
+*   \brief      Write a channel mask, e.g. after a link quality answer.
+*   \param      pcBuffer     destination, CHAN_MASK_BYTES
+*   \param      nMask        mask
+*   \return     bytes written
+******************************************************************************/
+uint8_t ChanPlanMaskBuild(uint8_t *pcBuffer, uint16_t nMask)
+{
+	pcBuffer[0] = (uint8_t)nMask;
+	pcBuffer[1] = (uint8_t)(nMask >> 8);
+
+	return CHAN_MASK_BYTES;
+}
+
+/** ***************************************************************************
+*   \brief      Read a channel mask.
+*   \param      pcBuffer     source
+*   \param      cLen         bytes available
+*   \param      pnMask       destination, with the home channel
+*   \return     HAL_OK, or HAL_ERROR if too short
+******************************************************************************/
+HAL_StatusTypeDef ChanPlanMaskParse(const uint8_t *pcBuffer, uint8_t cLen, uint16_t *pnMask)
+{
+	if(cLen < CHAN_MASK_BYTES)
+		return HAL_ERROR;
+
+	*pnMask = (uint16_t)(pcBuffer[0] | ((uint16_t)pcBuffer[1] << 8)) | (1U << CHAN_HOME);
+
+	return HAL_OK;
+}
+
+/** ***************************************************************************
+*   \brief      Copy out the counters.
+*   \param      pxStats     destination
+******************************************************************************/
+void ChanPlanGetStats(SChanPlanStats *pxStats)
+{
+	*pxStats = xChanPlanStats;
+}
+
+/** ***************************************************************************
+*   \brief      Mix the node address and the epoch, integer only.
+*   \param      cNode      node address
+*   \param      nEpoch     epoch
+*   \return     hash
+******************************************************************************/
+static uint16_t ChanPlanHash(uint8_t cNode, uint16_t nEpoch)
+{
+	uint32_t lHash = ((uint32_t)cNode << 16) | nEpoch;
+
+	lHash ^= lHash >> 16;
+	lHash *= 0x7FEB352DUL;
+	lHash ^= lHash >> 15;
+	lHash *= 0x846CA68BUL;
+	lHash ^= lHash >> 16;
+
+	return (uint16_t)lHash;
+}
+
+/** ***************************************************************************
+*   \brief      Bring the radio to READY from RX.
+******************************************************************************/
+static void ChanPlanReady(void)
+{
+	S2LPCmdStrobeSabort();
+	S2LPCmdStrobeReady();
+
+	for(uint8_t i = 0; i < CHAN_READY_POLLS; i++)
+	{
+		S2LPRefreshStatus();
+		if(g_xStatus.MC_STATE == MC_STATE_READY)
+			break;
+	}
+}
+
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
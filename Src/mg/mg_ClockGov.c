@@ -0,0 +1,275 @@
+/** ***************************************************************************
+*   \file        mg_ClockGov.c
+*   \brief       MCU clock governor. Idles and samples on a low MSI range at
+*                voltage scale 3 and bursts to HSI16 for SPI transfers and DSP,
+*                keeping the USART1, SPI1 and ADC timings valid across
+*                switches.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+/*****************************************************************************/
+// standard libraries
+#include <string.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "mg_ClockGov.h"
+
+// user headers from other components
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/*****************************************************************************/
+// constants
+
+/**
+* @brief SPI1 prescalers, in increasing division
+*/
+static const uint32_t lClockGovSpiPrescalers[] = {
+  SPI_BAUDRATEPRESCALER_2,
+  SPI_BAUDRATEPRESCALER_4,
+  SPI_BAUDRATEPRESCALER_8,
+  SPI_BAUDRATEPRESCALER_16
+};
+
+/*****************************************************************************/
+// macros
+
+/*****************************************************************************/
+// static function declarations
+static void ClockGovLow(void);
+static void ClockGovHigh(void);
+static void ClockGovPeripherals(void);
+static void ClockGovAdc(uint32_t lPclk2);
+static void ClockGovAccount(ClockPoint xNext);
+
+/*****************************************************************************/
+// static variable declarations
+extern UART_HandleTypeDef huart1;
+extern SPI_HandleTypeDef hspi1;
+extern ADC_HandleTypeDef hadc;
+
+static ClockPoint xClockGovPoint;
+static SClockGovStats xClockGovStats;
+static uint32_t lClockGovPointMs;             // HAL tick when the current point was entered
+
+/*****************************************************************************/
+// functions
+
+/** ***************************************************************************
+*   \brief      Leave the boot clock configuration for CLOCK_LOW.
+*   \details    SystemClock_Config() starts on MSI range 5 at voltage scale 1,
+*               which is more than sampling and idling need.
+******************************************************************************/
+void ClockGovInit(void)
+{
+	memset(&xClockGovStats, 0, sizeof(xClockGovStats));
+
+	ClockGovLow();
+	ClockGovPeripherals();
+
+	xClockGovPoint = CLOCK_LOW;
+	lClockGovPointMs = HAL_GetTick();
+}
+
+/** ***************************************************************************
+*   \brief      Move to an operating point.
+*   \details    The energy per cycle is about the same at both points, but an
+*               SPI transfer at 8 MHz instead of 0.5 MHz, or a DSP kernel run
+*               16 times faster, shortens the time the radio sits in READY or
+*               the sensor stays powered, and the core goes back to STOP
+*               sooner. ADC conversions and waits are done at CLOCK_LOW, where
+*               Sleep mode costs the least.
+*               USART1 and SPI1 are clocked from PCLK2: the UART baud rate
+*               register is recomputed, with 8x oversampling when the clock is
+*               below 16 times the baud rate, and the SPI prescaler is chosen
+*               to stay under CLOCKGOV_SPI_MAX_HZ. The ADC, on PCLK2 too, is in
+*               its low frequency mode below CLOCKGOV_ADC_LFM_HZ. The switch is
+*               refused while any of them is busy.
+*               Typical use: xPrevious = ClockGovSet(CLOCK_HIGH); ...;
+*               ClockGovSet(xPrevious). Must not be called from interrupts.
+*   \param      xPoint     operating point
+*   \return     operating point before the call
+******************************************************************************/
+ClockPoint ClockGovSet(ClockPoint xPoint)
+{
+	ClockPoint xPrevious = xClockGovPoint;
+
+	if((xPoint == xClockGovPoint) || (xPoint >= CLOCK_NB_POINTS))
+		return xPrevious;
+
+	if((huart1.gState != HAL_UART_STATE_READY) || (HAL_SPI_GetState(&hspi1) != HAL_SPI_STATE_READY) ||
+	   HAL_IS_BIT_SET(hadc.State, HAL_ADC_STATE_REG_BUSY))
+	{
+		xClockGovStats.lRefused++;
+		return xPrevious;
+	}
+
+	ClockGovAccount(xPoint);
+
+	if(xPoint == CLOCK_HIGH)
+		ClockGovHigh();
+	else
+		ClockGovLow();
+
+	ClockGovPeripherals();
+	xClockGovStats.lSwitches++;
+
+	return xPrevious;
+}
+
+/** ***************************************************************************
+*   \brief      Current operating point.
+*   \return     operating point
+******************************************************************************/
+ClockPoint ClockGovGet(void)
+{
+	return xClockGovPoint;
+}
+
+/** ***************************************************************************
+*   \brief      Copy out the time accounting, including the current period.
+*   \details    Bursts are often shorter than the 1 ms HAL tick, the totals
+*               are still right on average as their phase is random.
+*   \param      pxStats     destination
+******************************************************************************/
+void ClockGovGetStats(SClockGovStats *pxStats)
+{
+	*pxStats = xClockGovStats;
+	pxStats->lPointMs[xClockGovPoint] += HAL_GetTick() - lClockGovPointMs;
+}
+
+/** ***************************************************************************
+*   \brief      Switch to MSI at voltage scale 3.
+*   \details    The MSI is selected before the regulator is lowered, and HSI16
+*               is stopped. The MSI stays the STOP mode wake-up clock.
+******************************************************************************/
+static void ClockGovLow(void)
+{
+	RCC_OscInitTypeDef xOscInit = {0};
+	RCC_ClkInitTypeDef xClkInit = {0};
+
+	xOscInit.OscillatorType = RCC_OSCILLATORTYPE_MSI;
+	xOscInit.MSIState = RCC_MSI_ON;
+	xOscInit.MSICalibrationValue = 0;
+	xOscInit.MSIClockRange = CLOCKGOV_MSI_RANGE_LOW;
+	xOscInit.PLL.PLLState = RCC_PLL_NONE;
+	HAL_RCC_OscConfig(&xOscInit);
+
+	xClkInit.ClockType = RCC_CLOCKTYPE_HCLK|RCC_CLOCKTYPE_SYSCLK|RCC_CLOCKTYPE_PCLK1|RCC_CLOCKTYPE_PCLK2;
+	xClkInit.SYSCLKSource = RCC_SYSCLKSOURCE_MSI;
+	xClkInit.AHBCLKDivider = RCC_SYSCLK_DIV1;
+	xClkInit.APB1CLKDivider = RCC_HCLK_DIV1;
+	xClkInit.APB2CLKDivider = RCC_HCLK_DIV1;
+	HAL_RCC_ClockConfig(&xClkInit, FLASH_LATENCY_0);
+
+	xOscInit.OscillatorType = RCC_OSCILLATORTYPE_HSI;
+	xOscInit.HSIState = RCC_HSI_OFF;
+	HAL_RCC_OscConfig(&xOscInit);
+
+	__HAL_PWR_VOLTAGESCALING_CONFIG(PWR_REGULATOR_VOLTAGE_SCALE3);
+	while(__HAL_PWR_GET_FLAG(PWR_FLAG_VOS) != RESET);
+}
+
+/** ***************************************************************************
+*   \brief      Switch to HSI16 at voltage scale 2.
+*   \details    The regulator is raised before the clock. Scale 2 with one
+*               wait state uses less than scale 1 without.
+******************************************************************************/
+static void ClockGovHigh(void)
+{
+	RCC_OscInitTypeDef xOscInit = {0};
+	RCC_ClkInitTypeDef xClkInit = {0};
+
+	__HAL_PWR_VOLTAGESCALING_CONFIG(PWR_REGULATOR_VOLTAGE_SCALE2);
+	while(__HAL_PWR_GET_FLAG(PWR_FLAG_VOS) != RESET);
+
+	xOscInit.OscillatorType = RCC_OSCILLATORTYPE_HSI;
+	xOscInit.HSIState = RCC_HSI_ON;
+	xOscInit.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
+	xOscInit.PLL.PLLState = RCC_PLL_NONE;
+	HAL_RCC_OscConfig(&xOscInit);
+
+	xClkInit.ClockType = RCC_CLOCKTYPE_HCLK|RCC_CLOCKTYPE_SYSCLK|RCC_CLOCKTYPE_PCLK1|RCC_CLOCKTYPE_PCLK2;
+	xClkInit.SYSCLKSource = RCC_SYSCLKSOURCE_HSI;
+	xClkInit.AHBCLKDivider = RCC_SYSCLK_DIV1;
+	xClkInit.APB1CLKDivider = RCC_HCLK_DIV1;
+	xClkInit.APB2CLKDivider = RCC_HCLK_DIV1;
+	HAL_RCC_ClockConfig(&xClkInit, FLASH_LATENCY_1);
+}
+
+/** ***************************************************************************
+*   \brief      Re-time USART1, SPI1 and the ADC for the new PCLK2.
+******************************************************************************/
+static void ClockGovPeripherals(void)
+{
+	uint32_t lPclk2 = HAL_RCC_GetPCLK2Freq();
+	uint8_t i;
+
+	huart1.Init.OverSampling = (lPclk2 >= 16UL * huart1.Init.BaudRate) ? UART_OVERSAMPLING_16 : UART_OVERSAMPLING_8;
+	HAL_UART_Init(&huart1);
+
+	for(i = 0; i < (sizeof(lClockGovSpiPrescalers) / sizeof(lClockGovSpiPrescalers[0])) - 1; i++)
+	{
+		if((lPclk2 >> (i + 1)) <= CLOCKGOV_SPI_MAX_HZ)
+			break;
+	}
+	hspi1.Init.BaudRatePrescaler = lClockGovSpiPrescalers[i];
+	HAL_SPI_Init(&hspi1);
+
+	ClockGovAdc(lPclk2);
+}
+
+/** ***************************************************************************
+*   \brief      ADC low frequency mode for its synchronous PCLK2 clock.
+*   \details    LFMEN is required below 3.5 MHz, i.e. at CLOCK_LOW, and may
+*               only be changed with the ADC disabled; the next HAL_ADC_Start()
+*               enables it again. The init structure follows, so a later
+*               HAL_ADC_Init() keeps the setting.
+*   \param      lPclk2     PCLK2 frequency, Hz
+******************************************************************************/
+static void ClockGovAdc(uint32_t lPclk2)
+{
+	uint32_t lLfmen = (lPclk2 < CLOCKGOV_ADC_LFM_HZ) ? ADC_CCR_LFMEN : 0;
+
+	hadc.Init.LowPowerFrequencyMode = lLfmen ? ENABLE : DISABLE;
+	if((ADC->CCR & ADC_CCR_LFMEN) == lLfmen)
+		return;
+
+	if(hadc.Instance->CR & ADC_CR_ADEN)
+	{
+		hadc.Instance->CR |= ADC_CR_ADDIS;
+		while(hadc.Instance->CR & ADC_CR_ADEN);
+	}
+	MODIFY_REG(ADC->CCR, ADC_CCR_LFMEN, lLfmen);
+}
+
+/** ***************************************************************************
+*   \brief      Close the time accounting of the current point.
+*   \param      xNext     point being entered
+******************************************************************************/
+static void ClockGovAccount(ClockPoint xNext)
+{
+	uint32_t lNowMs = HAL_GetTick();
+
+	xClockGovStats.lPointMs[xClockGovPoint] += lNowMs - lClockGovPointMs;
+	lClockGovPointMs = lNowMs;
+	xClockGovPoint = xNext;
+}
+
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -0,0 +1,231 @@
+/** ***************************************************************************
+*   \file        mg_Codec.c
+*   \brief       Reading codec. Timestamps are coded as delta of delta and
+*                lux as deltas, zig-zag mapped to unsigned and written as
+*                variable length integers, 7 bits per byte. No allocation,
+*                and a bounded number of steps per reading.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+/*****************************************************************************/
+// standard libraries
+#include <string.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "mg_Codec.h"
+
+// user headers from other components
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+#define CODEC_VARINT_MORE           0x80
+#define CODEC_VARINT_BITS           0x7F
+
+/*****************************************************************************/
+// static function declarations
+static uint32_t CodecZigZag(int32_t iValue);
+static int32_t CodecUnZigZag(uint32_t lValue);
+static uint8_t CodecPutVarint(uint8_t *pcBuffer, uint32_t lValue);
+static uint8_t CodecGetVarint(const uint8_t *pcBuffer, uint8_t cLen, uint32_t *plValue);
+
+/*****************************************************************************/
+// static variable declarations
+
+/*****************************************************************************/
+// functions
+
+/** ***************************************************************************
+*   \brief      Start a stream, e.g. a report.
+*   \param      pxState     coder state
+******************************************************************************/
+void CodecInit(SCodecState *pxState)
+{
+	memset(pxState, 0, sizeof(*pxState));
+}
+
+/** ***************************************************************************
+*   \brief      Append a reading.
+*   \details    The first reading carries no time, it is the stream base, and
+*               its lux in full. The second carries its time step, the
+*               following ones the change of the time step. Lux changes are
+*               zig-zag mapped and shifted left by CODEC_REASON_BITS for the
+*               reason. The reading is first coded on the stack, so nothing
+*               is written and the state is kept when it does not fit.
+*   \param      pxState      coder state
+*   \param      pcBuffer     destination, at the end of the stream so far
+*   \param      cSize        room left in the destination
+*   \param      lTime        reading time, ascending
+*   \param      lLux         reading, below 2^28
+*   \param      cReason      reason, CODEC_REASON_BITS wide
+*   \return     bytes written, 0 if the reading does not fit
+******************************************************************************/
+uint8_t CodecEncode(SCodecState *pxState, uint8_t *pcBuffer, uint8_t cSize, uint32_t lTime, uint32_t lLux, uint8_t cReason)
+{
+	uint8_t cCoded[2 * CODEC_VARINT_MAX_BYTES];
+	uint8_t cLen = 0;
+	uint32_t lDelta = lTime - pxState->lPrevTime;
+	uint32_t lWord;
+
+	if(pxState->cCount == 1)
+		cLen += CodecPutVarint(&cCoded[cLen], lDelta);
+	else if(pxState->cCount > 1)
+		cLen += CodecPutVarint(&cCoded[cLen], CodecZigZag((int32_t)(lDelta - pxState->lPrevDelta)));
+
+	if(pxState->cCount == 0)
+		lWord = lLux;
+	else
+		lWord = CodecZigZag((int32_t)(lLux - pxState->lPrevLux));
+	cLen += CodecPutVarint(&cCoded[cLen], (lWord << CODEC_REASON_BITS) | (cReason & CODEC_REASON_MASK));
+
+	if(cLen > cSize)
+		return 0;
+
+	memcpy(pcBuffer, cCoded, cLen);
+
+	pxState->lPrevDelta = (pxState->cCount == 0) ? 0 : lDelta;
+	pxState->lPrevTime = lTime;
+	pxState->lPrevLux = lLux;
+	if(pxState->cCount < 0xFF)
+		pxState->cCount++;
+
+	return cLen;
+}
+
+/** ***************************************************************************
+*   \brief      Read the next reading, done by the receiver.
+*   \details    The state must start with CodecInit() and the first time
+*               must be set to the stream base in lPrevTime, as the encoder
+*               saw it.
+*   \param      pxState      coder state
+*   \param      pcBuffer     rest of the stream
+*   \param      cLen         bytes left in the stream
+*   \param      plTime       reading time
+*   \param      plLux        reading
+*   \param      pcReason     reason
+*   \return     bytes read, 0 if the stream ends or is malformed
+******************************************************************************/
+uint8_t CodecDecode(SCodecState *pxState, const uint8_t *pcBuffer, uint8_t cLen, uint32_t *plTime, uint32_t *plLux, uint8_t *pcReason)
+{
+	uint8_t cUsed = 0, cStep;
+	uint32_t lValue, lDelta = 0;
+
+	if(pxState->cCount > 0)
+	{
+		cStep = CodecGetVarint(pcBuffer, cLen, &lValue);
+		if(cStep == 0)
+			return 0;
+		cUsed += cStep;
+
+		lDelta = (pxState->cCount == 1) ? lValue : (pxState->lPrevDelta + (uint32_t)CodecUnZigZag(lValue));
+	}
+
+	cStep = CodecGetVarint(&pcBuffer[cUsed], cLen - cUsed, &lValue);
+	if(cStep == 0)
+		return 0;
+	cUsed += cStep;
+
+	*pcReason = (uint8_t)(lValue & CODEC_REASON_MASK);
+	lValue >>= CODEC_REASON_BITS;
+	if(pxState->cCount == 0)
+		*plLux = lValue;
+	else
+		*plLux = pxState->lPrevLux + (uint32_t)CodecUnZigZag(lValue);
+	*plTime = pxState->lPrevTime + lDelta;
+
+	pxState->lPrevDelta = lDelta;
+	pxState->lPrevTime = *plTime;
+	pxState->lPrevLux = *plLux;
+	if(pxState->cCount < 0xFF)
+		pxState->cCount++;
+
+	return cUsed;
+}
+
+/** ***************************************************************************
+*   \brief      Map a signed value so that small magnitudes stay small.
+*   \param      iValue     0, -1, 1, -2 ...
+*   \return     0, 1, 2, 3 ...
+******************************************************************************/
+static uint32_t CodecZigZag(int32_t iValue)
+{
+	return ((uint32_t)iValue << 1) ^ (uint32_t)(iValue >> 31);
+}
+
+/** ***************************************************************************
+*   \brief      Inverse of CodecZigZag().
+*   \param      lValue     0, 1, 2, 3 ...
+*   \return     0, -1, 1, -2 ...
+******************************************************************************/
+static int32_t CodecUnZigZag(uint32_t lValue)
+{
+	return (int32_t)(lValue >> 1) ^ -(int32_t)(lValue & 1);
+}
+
+/** ***************************************************************************
+*   \brief      Write a varint, least significant group first.
+*   \param      pcBuffer     destination, room for CODEC_VARINT_MAX_BYTES
+*   \param      lValue       value
+*   \return     bytes written, 1 to CODEC_VARINT_MAX_BYTES
+******************************************************************************/
+static uint8_t CodecPutVarint(uint8_t *pcBuffer, uint32_t lValue)
+{
+	uint8_t cLen = 0;
+
+	while(lValue > CODEC_VARINT_BITS)
+	{
+		pcBuffer[cLen++] = (uint8_t)(lValue & CODEC_VARINT_BITS) | CODEC_VARINT_MORE;
+		lValue >>= 7;
+	}
+	pcBuffer[cLen++] = (uint8_t)lValue;
+
+	return cLen;
+}
+
+/** ***************************************************************************
+*   \brief      Read a varint.
+*   \param      pcBuffer     source
+*   \param      cLen         bytes available
+*   \param      plValue      value
+*   \return     bytes read, 0 if truncated or longer than a 32 bit value
+******************************************************************************/
+static uint8_t CodecGetVarint(const uint8_t *pcBuffer, uint8_t cLen, uint32_t *plValue)
+{
+	uint32_t lValue = 0;
+	uint8_t i;
+
+	for(i = 0; (i < cLen) && (i < CODEC_VARINT_MAX_BYTES); i++)
+	{
+		lValue |= (uint32_t)(pcBuffer[i] & CODEC_VARINT_BITS) << (7 * i);
+		if(!(pcBuffer[i] & CODEC_VARINT_MORE))
+		{
+			*plValue = lValue;
+			return i + 1;
+		}
+	}
+
+	return 0;
+}
+
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
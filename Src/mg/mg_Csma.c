@@ -0,0 +1,227 @@
+/** ***************************************************************************
+*   \file        mg_Csma.c
+*   \brief       Channel access with the S2LP CSMA/CA engine. The radio
+*                listens before each transmission and backs off on its own
+*                while the channel is busy; when it gives up the packet is
+*                rescheduled with a random, growing delay. The back-off
+*                sequence is seeded from the MCU unique ID so that nodes
+*                sharing the channel do not back off in step.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+/*****************************************************************************/
+// standard libraries
+#include <string.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "mg_Csma.h"
+
+// user headers from other components
+#include "stm32l0xx_hal.h"
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* 96 bit unique ID, the third word is not contiguous on the L0 */
+#define CSMA_UID_WORD0              (*(const uint32_t *)(UID_BASE))
+#define CSMA_UID_WORD1              (*(const uint32_t *)(UID_BASE + 0x04U))
+#define CSMA_UID_WORD2              (*(const uint32_t *)(UID_BASE + 0x14U))
+
+/* register field limits */
+#define CSMA_CCA_LENGTH_MAX         15
+#define CSMA_BACKOFFS_MAX           7
+#define CSMA_BU_PRESCALER_MAX       63
+
+/* reschedule delay doublings, beyond which the delay stays put */
+#define CSMA_RESCHEDULE_SHIFT_MAX   6
+
+/*****************************************************************************/
+// static function declarations
+static uint16_t CsmaRandom(void);
+
+/*****************************************************************************/
+// static variable declarations
+static SCsmaConfig xCsmaConfig;
+static SCsmaStats xCsmaStats;
+static uint16_t nCsmaSeed;                    // radio back-off counter seed, never 0
+static uint16_t nCsmaLfsr;                    // reschedule jitter, same seed
+static volatile uint8_t cCsmaBusy;
+
+/*****************************************************************************/
+// functions
+
+/** ***************************************************************************
+*   \brief      Keep the configuration, derive the seed and clear the counters.
+*   \details    The unique ID words are folded to 16 bits, the radio takes
+*               any seed but 0.
+*   \param      pxConfig     thresholds, back-off and reschedule parameters
+******************************************************************************/
+void CsmaInit(const SCsmaConfig *pxConfig)
+{
+	uint32_t lUid = CSMA_UID_WORD0 ^ CSMA_UID_WORD1 ^ CSMA_UID_WORD2;
+
+	xCsmaConfig = *pxConfig;
+	if(xCsmaConfig.cCcaLength > CSMA_CCA_LENGTH_MAX)
+		xCsmaConfig.cCcaLength = CSMA_CCA_LENGTH_MAX;
+	if(xCsmaConfig.cMaxBackoffs > CSMA_BACKOFFS_MAX)
+		xCsmaConfig.cMaxBackoffs = CSMA_BACKOFFS_MAX;
+	if(xCsmaConfig.cBuPrescaler > CSMA_BU_PRESCALER_MAX)
+		xCsmaConfig.cBuPrescaler = CSMA_BU_PRESCALER_MAX;
+
+	nCsmaSeed = (uint16_t)(lUid ^ (lUid >> 16));
+	if(nCsmaSeed == 0)
+		nCsmaSeed = 1;
+	nCsmaLfsr = nCsmaSeed;
+
+	memset(&xCsmaStats, 0, sizeof(xCsmaStats));
+	cCsmaBusy = 0;
+}
+
+/** ***************************************************************************
+*   \brief      Enable CSMA on the radio, with the rest of its configuration.
+*   \details    Non persistent mode, so that the radio gives up with
+*               IRQ_MAX_BO_CCA_REACH instead of listening until the channel
+*               clears. The seed is not reloaded before each transmission,
+*               the back-off counter keeps running through its sequence.
+******************************************************************************/
+void CsmaConfigure(void)
+{
+	SCsmaInit xInit;
+
+	xInit.xCsmaPersistentMode = S_DISABLE;
+	xInit.xMultiplierTbit = xCsmaConfig.xCcaPeriod;
+	xInit.xCcaLength = xCsmaConfig.cCcaLength;
+	xInit.cMaxNb = xCsmaConfig.cMaxBackoffs;
+	xInit.nBuCounterSeed = nCsmaSeed;
+	xInit.cBuPrescaler = xCsmaConfig.cBuPrescaler;
+
+	S2LPRadioSetRssiThreshdBm(xCsmaConfig.fRssiThreshDbm);
+	S2LPCsmaInit(&xInit);
+	S2LPCsmaSeedReloadMode(S_DISABLE);
+	S2LPCsma(S_ENABLE);
+}
+
+/** ***************************************************************************
+*   \brief      Count a transmission, right before the TX strobe.
+******************************************************************************/
+void CsmaTxStart(void)
+{
+	cCsmaBusy = 0;
+	xCsmaStats.lAttempts++;
+}
+
+/** ***************************************************************************
+*   \brief      Account for radio interrupts while sending. Called from the
+*               GPIO IRQ handler.
+*   \param      pxIrqStatus     IRQ status read from the radio
+*   \return     1 if the radio gave up on a busy channel and is back in READY
+******************************************************************************/
+uint8_t CsmaIrq(const S2LPIrqs *pxIrqStatus)
+{
+	if(!pxIrqStatus->IRQ_MAX_BO_CCA_REACH)
+		return 0;
+
+	cCsmaBusy = 1;
+	xCsmaStats.lBusy++;
+	xCsmaStats.lBackoffs += xCsmaConfig.cMaxBackoffs;
+
+	return 1;
+}
+
+/** ***************************************************************************
+*   \brief      Whether the last transmission was given up on a busy channel.
+*   \return     1 if busy, the packet was not sent
+******************************************************************************/
+uint8_t CsmaTxBusy(void)
+{
+	return cCsmaBusy;
+}
+
+/** ***************************************************************************
+*   \brief      Report the delivery of a packet sent on a clear channel.
+*   \details    A packet that got on air but was not acked most likely
+*               collided with a hidden node or one that assessed the channel
+*               at the same time.
+*   \param      cDelivered     1 if acked
+******************************************************************************/
+void CsmaTxDelivered(uint8_t cDelivered)
+{
+	if(!cDelivered && !cCsmaBusy)
+		xCsmaStats.lCollisions++;
+}
+
+/** ***************************************************************************
+*   \brief      Delay before retrying a packet given up on a busy channel.
+*   \details    Binary exponential: the delay is drawn between 1 and 2 times
+*               lRescheduleMs doubled for each retry already made, so that
+*               the nodes that found the channel busy spread out.
+*   \param      cRetry     retries already made for the packet
+*   \return     ms, 0 to drop the packet after cMaxReschedules
+******************************************************************************/
+uint32_t CsmaRescheduleMs(uint8_t cRetry)
+{
+	uint32_t lBaseMs;
+
+	if(cRetry >= xCsmaConfig.cMaxReschedules)
+	{
+		xCsmaStats.lDropped++;
+		return 0;
+	}
+
+	lBaseMs = xCsmaConfig.lRescheduleMs << ((cRetry > CSMA_RESCHEDULE_SHIFT_MAX) ? CSMA_RESCHEDULE_SHIFT_MAX : cRetry);
+	xCsmaStats.lReschedules++;
+
+	return lBaseMs + (((uint32_t)CsmaRandom() * lBaseMs) >> 16) + 1;
+}
+
+/** ***************************************************************************
+*   \brief      Back-off counter seed in use.
+*   \return     seed, from the unique ID
+******************************************************************************/
+uint16_t CsmaGetSeed(void)
+{
+	return nCsmaSeed;
+}
+
+/** ***************************************************************************
+*   \brief      Copy out the counters.
+*   \param      pxStats     destination
+******************************************************************************/
+void CsmaGetStats(SCsmaStats *pxStats)
+{
+	*pxStats = xCsmaStats;
+}
+
+/** ***************************************************************************
+*   \brief      16 bit Galois LFSR, maximal length.
+*   \return     next value, never 0
+******************************************************************************/
+static uint16_t CsmaRandom(void)
+{
+	nCsmaLfsr = (nCsmaLfsr >> 1) ^ (uint16_t)(-(int16_t)(nCsmaLfsr & 1U) & 0xB400U);
+
+	return nCsmaLfsr;
+}
+
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
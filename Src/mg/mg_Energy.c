@@ -0,0 +1,509 @@
+/** ***************************************************************************
+*   \file        mg_Energy.c
+*   \brief       Energy accounting. On-time counters for the MCU power modes,
+*                each radio state with TX split by PA level, and the ADC,
+*                exported over the radio and UART and turned into an average
+*                current with a datasheet current table.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+/*****************************************************************************/
+// standard libraries
+#include <stdio.h>
+#include <string.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "mg_Energy.h"
+#include "S2LP_Config.h"
+
+// user headers from other components
+#include "mg_Scheduler.h"
+#include "mg_ClockGov.h"
+#include "mg_RadioPower.h"
+#include "mg_LdcRx.h"
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/**
+* @brief S2LP TX supply current at one PA level
+*/
+typedef struct {
+  int8_t cDbm;                  /*!< PA output power, dBm */
+  uint32_t lNa;                 /*!< Supply current, nA */
+} SEnergyTxPoint;
+
+/*****************************************************************************/
+// constants
+
+/**
+* @brief MCU supply current per power mode, nA
+*/
+static const uint32_t lEnergyMcuNa[ENERGY_MCU_NB_STATES] = {
+  ENERGY_I_RUN_HIGH_NA,
+  ENERGY_I_RUN_LOW_NA,
+  ENERGY_I_SLEEP_NA,
+  ENERGY_I_STOP_NA
+};
+
+/**
+* @brief Radio supply current per state, nA. TX is taken from lEnergyTxNa
+*/
+static const uint32_t lEnergyRadioNa[ENERGY_RADIO_NB_STATES] = {
+  RADIO_PS_I_SHUTDOWN_NA,
+  RADIO_PS_I_STANDBY_NA,
+  RADIO_PS_I_SLEEP_NA,
+  RADIO_PS_I_READY_NA,
+  LDCRX_I_RX_UA * 1000UL,
+  ENERGY_I_LDC_NA,
+  0
+};
+
+/**
+* @brief ADC supply current per state, nA
+*/
+static const uint32_t lEnergyAdcNa[ENERGY_ADC_NB_STATES] = {
+  0,
+  ENERGY_I_ADC_ON_NA,
+  ENERGY_I_ADC_WATCH_NA
+};
+
+/**
+* @brief S2LP TX current at 868 MHz, 3 V, in increasing PA level. Levels in
+*        between are interpolated
+*/
+static const SEnergyTxPoint xEnergyTxNa[] = {
+  {-10, 5000000},
+  {  0, 6500000},
+  {  7, 8500000},
+  { 10, 10000000},
+  { 12, 12500000},
+  { 14, 15000000},
+  { 16, 20000000}
+};
+
+/*****************************************************************************/
+// macros
+
+/* Counter id of an unused frame entry */
+#define ENERGY_ID_NONE              0x7F
+
+/*****************************************************************************/
+// static function declarations
+static void EnergyAccount(uint32_t lNowMs);
+static uint8_t EnergyEntry(const SEnergyStats *pxStats, uint8_t cIndex, uint32_t *plValue);
+
+/*****************************************************************************/
+// static variable declarations
+static SEnergyStats xEnergyStats;
+static uint32_t lEnergyStartMs;
+static EnergyRadioState xEnergyRadio;
+static uint32_t lEnergyRadioMs;               // HAL tick when the radio state was entered
+static uint8_t cEnergyTxSlot;
+static EnergyAdcState xEnergyAdc;
+static uint32_t lEnergyAdcMs;                 // HAL tick when the ADC state was entered
+
+/*****************************************************************************/
+// functions
+
+/** ***************************************************************************
+*   \brief      Restart the counters, radio in READY and ADC off.
+******************************************************************************/
+void EnergyInit(void)
+{
+	memset(&xEnergyStats, 0, sizeof(xEnergyStats));
+
+	lEnergyStartMs = HAL_GetTick();
+	xEnergyRadio = ENERGY_RADIO_READY;
+	lEnergyRadioMs = lEnergyStartMs;
+	cEnergyTxSlot = 0;
+	xEnergyAdc = ENERGY_ADC_OFF;
+	lEnergyAdcMs = lEnergyStartMs;
+}
+
+/** ***************************************************************************
+*   \brief      Account a radio state change.
+*   \details    Called from the SPI command strobe and the shutdown pin
+*               functions, and where the radio changes state on its own: the
+*               TX done interrupt and the start of low duty cycle reception.
+*               Safe from interrupts.
+*   \param      xState     state being entered
+******************************************************************************/
+void EnergyRadioSet(EnergyRadioState xState)
+{
+	uint32_t lPrimask = __get_PRIMASK();
+
+	__disable_irq();
+	EnergyAccount(HAL_GetTick());
+	xEnergyRadio = xState;
+	__set_PRIMASK(lPrimask);
+}
+
+/** ***************************************************************************
+*   \brief      Follow the radio state from a command strobe.
+*   \details    TX and RX end in READY when the packet is sent or received,
+*               which the caller reports with EnergyRadioSet(). FIFO and
+*               calibration commands leave the state unchanged.
+*   \param      cCommandCode     S2LP command
+******************************************************************************/
+void EnergyRadioCommand(uint8_t cCommandCode)
+{
+	switch(cCommandCode)
+	{
+		case CMD_TX:
+			EnergyRadioSet(ENERGY_RADIO_TX);
+			break;
+
+		case CMD_RX:
+			EnergyRadioSet(ENERGY_RADIO_RX);
+			break;
+
+		case CMD_READY:
+		case CMD_LOCKRX:
+		case CMD_LOCKTX:
+		case CMD_SABORT:
+		case CMD_SRES:
+			EnergyRadioSet(ENERGY_RADIO_READY);
+			break;
+
+		case CMD_STANDBY:
+			EnergyRadioSet(ENERGY_RADIO_STANDBY);
+			break;
+
+		case CMD_SLEEP:
+			EnergyRadioSet(ENERGY_RADIO_SLEEP);
+			break;
+
+		default:
+			break;
+	}
+}
+
+/** ***************************************************************************
+*   \brief      Select the TX slot for a new PA level.
+*   \details    Each distinct level gets its own slot, up to ENERGY_PA_SLOTS;
+*               further levels share the last one. Call whenever the PA level
+*               is programmed.
+*   \param      fDbm     PA output power, dBm
+******************************************************************************/
+void EnergyTxPower(float fDbm)
+{
+	int8_t cDbm = (int8_t)((fDbm >= 0.0f) ? (fDbm + 0.5f) : (fDbm - 0.5f));
+	uint32_t lPrimask = __get_PRIMASK();
+	uint8_t i;
+
+	__disable_irq();
+	EnergyAccount(HAL_GetTick());
+
+	for(i = 0; i < xEnergyStats.cTxSlots; i++)
+	{
+		if(xEnergyStats.cTxDbm[i] == cDbm)
+			break;
+	}
+
+	if(i == xEnergyStats.cTxSlots)
+	{
+		if(xEnergyStats.cTxSlots < ENERGY_PA_SLOTS)
+		{
+			xEnergyStats.cTxDbm[i] = cDbm;
+			xEnergyStats.cTxSlots++;
+		}
+		else
+		{
+			i = ENERGY_PA_SLOTS - 1;
+		}
+	}
+
+	cEnergyTxSlot = i;
+	__set_PRIMASK(lPrimask);
+}
+
+/** ***************************************************************************
+*   \brief      TX current at a PA level, interpolated in xEnergyTxNa.
+*   \param      cDbm     PA output power, dBm
+*   \return     current, nA
+******************************************************************************/
+uint32_t EnergyTxNa(int8_t cDbm)
+{
+	const uint8_t cPoints = sizeof(xEnergyTxNa) / sizeof(xEnergyTxNa[0]);
+	const SEnergyTxPoint *pxLow, *pxHigh;
+	uint8_t i;
+
+	if(cDbm <= xEnergyTxNa[0].cDbm)
+		return xEnergyTxNa[0].lNa;
+
+	for(i = 1; i < cPoints; i++)
+	{
+		if(cDbm <= xEnergyTxNa[i].cDbm)
+		{
+			pxLow = &xEnergyTxNa[i - 1];
+			pxHigh = &xEnergyTxNa[i];
+			return pxLow->lNa + (uint32_t)(((uint64_t)(pxHigh->lNa - pxLow->lNa) * (uint32_t)(cDbm - pxLow->cDbm))
+			                                / (uint32_t)(pxHigh->cDbm - pxLow->cDbm));
+		}
+	}
+
+	return xEnergyTxNa[cPoints - 1].lNa;
+}
+
+/** ***************************************************************************
+*   \brief      Account an ADC state change.
+*   \param      xState     state being entered
+******************************************************************************/
+void EnergyAdcSet(EnergyAdcState xState)
+{
+	uint32_t lNowMs = HAL_GetTick();
+
+	xEnergyStats.lAdcMs[xEnergyAdc] += lNowMs - lEnergyAdcMs;
+	lEnergyAdcMs = lNowMs;
+	xEnergyAdc = xState;
+}
+
+/** ***************************************************************************
+*   \brief      Copy out the counters, including the current periods.
+*   \details    The MCU modes come from the scheduler; Run mode is split with
+*               the clock governor, whose CLOCK_HIGH periods are all spent
+*               running. The waits for TX done in Sleep mode outside the
+*               scheduler count as Run mode. Radio interrupts taken in STOP
+*               mode run before the HAL tick is advanced, the part of the STOP
+*               period before them is accounted to the state they enter.
+*   \param      pxStats     destination
+******************************************************************************/
+void EnergyGetStats(SEnergyStats *pxStats)
+{
+	SSchedStats xSched;
+	SClockGovStats xClock;
+	uint32_t lNowMs = HAL_GetTick();
+	uint32_t lPrimask = __get_PRIMASK();
+
+	__disable_irq();
+	EnergyAccount(lNowMs);
+	*pxStats = xEnergyStats;
+	__set_PRIMASK(lPrimask);
+
+	pxStats->lAdcMs[xEnergyAdc] += lNowMs - lEnergyAdcMs;
+	pxStats->lElapsedMs = lNowMs - lEnergyStartMs;
+
+	SchedGetStats(&xSched);
+	ClockGovGetStats(&xClock);
+
+	pxStats->lMcuMs[ENERGY_MCU_RUN_HIGH] = xClock.lPointMs[CLOCK_HIGH];
+	pxStats->lMcuMs[ENERGY_MCU_RUN_LOW] = (xSched.lRunMs > xClock.lPointMs[CLOCK_HIGH]) ?
+	                                      (xSched.lRunMs - xClock.lPointMs[CLOCK_HIGH]) : 0;
+	pxStats->lMcuMs[ENERGY_MCU_SLEEP] = xSched.lSleepMs;
+	pxStats->lMcuMs[ENERGY_MCU_STOP] = xSched.lStopMs;
+}
+
+/** ***************************************************************************
+*   \brief      Average supply current from the counters.
+*   \details    Each on-time is weighted with its datasheet current. One day
+*               at the average current is lAvgNa * 24 / 1000 uAh.
+*   \param      pxStats     counters from EnergyGetStats()
+*   \return     average current, nA
+******************************************************************************/
+uint32_t EnergyAverageNa(const SEnergyStats *pxStats)
+{
+	uint64_t llCharge = 0;                    // nA ms
+	uint32_t lTxSlottedMs = 0;
+	uint8_t i;
+
+	if(pxStats->lElapsedMs == 0)
+		return 0;
+
+	for(i = 0; i < ENERGY_MCU_NB_STATES; i++)
+		llCharge += (uint64_t)pxStats->lMcuMs[i] * lEnergyMcuNa[i];
+
+	for(i = 0; i < ENERGY_RADIO_NB_STATES; i++)
+		llCharge += (uint64_t)pxStats->lRadioMs[i] * lEnergyRadioNa[i];
+
+	for(i = 0; i < pxStats->cTxSlots; i++)
+	{
+		llCharge += (uint64_t)pxStats->lTxMs[i] * EnergyTxNa(pxStats->cTxDbm[i]);
+		lTxSlottedMs += pxStats->lTxMs[i];
+	}
+
+	/* TX before any PA level was reported, at the highest current */
+	if(pxStats->lRadioMs[ENERGY_RADIO_TX] > lTxSlottedMs)
+		llCharge += (uint64_t)(pxStats->lRadioMs[ENERGY_RADIO_TX] - lTxSlottedMs)
+		          * xEnergyTxNa[(sizeof(xEnergyTxNa) / sizeof(xEnergyTxNa[0])) - 1].lNa;
+
+	for(i = 0; i < ENERGY_ADC_NB_STATES; i++)
+		llCharge += (uint64_t)pxStats->lAdcMs[i] * lEnergyAdcNa[i];
+
+	return (uint32_t)(llCharge / pxStats->lElapsedMs);
+}
+
+/** ***************************************************************************
+*   \brief      Number of export frames holding all the counters.
+*   \return     frames
+******************************************************************************/
+uint8_t EnergyFrameCount(void)
+{
+	uint8_t cEntries = ENERGY_ID_ADC + ENERGY_ADC_NB_STATES + xEnergyStats.cTxSlots;
+
+	return (cEntries + ENERGY_FRAME_ENTRIES - 1) / ENERGY_FRAME_ENTRIES;
+}
+
+/** ***************************************************************************
+*   \brief      Pack a share of the counters for the radio or UART.
+*   \details    Counters are cumulative, so frames can be sent one at a time,
+*               e.g. one per heartbeat, and the receiver keeps the latest
+*               value of each. Unused entries of the last frame carry the id
+*               ENERGY_ID_NONE.
+*   \param      cFrame      frame index, below EnergyFrameCount()
+*   \param      pcBuffer    destination
+*   \param      cSize       destination size
+*   \return     bytes written, 0 if the index or size is invalid
+******************************************************************************/
+uint8_t EnergyExportFrame(uint8_t cFrame, uint8_t *pcBuffer, uint8_t cSize)
+{
+	SEnergyStats xStats;
+	uint8_t cCount = EnergyFrameCount();
+	uint8_t cEntries, cIndex, i;
+	uint32_t lValue;
+
+	if((cFrame >= cCount) || (cSize < ENERGY_FRAME_BYTES))
+		return 0;
+
+	EnergyGetStats(&xStats);
+	cEntries = ENERGY_ID_ADC + ENERGY_ADC_NB_STATES + xStats.cTxSlots;
+
+	pcBuffer[0] = ENERGY_FRAME_MARKER;
+	pcBuffer[1] = (uint8_t)((cFrame << 4) | (cCount & 0x0F));
+
+	for(i = 0; i < ENERGY_FRAME_ENTRIES; i++)
+	{
+		cIndex = cFrame * ENERGY_FRAME_ENTRIES + i;
+		if(cIndex < cEntries)
+		{
+			pcBuffer[2 + i * 5] = EnergyEntry(&xStats, cIndex, &lValue);
+		}
+		else
+		{
+			pcBuffer[2 + i * 5] = ENERGY_ID_NONE;
+			lValue = 0;
+		}
+
+		pcBuffer[3 + i * 5] = (uint8_t)lValue;
+		pcBuffer[4 + i * 5] = (uint8_t)(lValue >> 8);
+		pcBuffer[5 + i * 5] = (uint8_t)(lValue >> 16);
+		pcBuffer[6 + i * 5] = (uint8_t)(lValue >> 24);
+	}
+
+	return ENERGY_FRAME_BYTES;
+}
+
+/** ***************************************************************************
+*   \brief      Print an export frame as one UART line.
+*   \details    Used for the local dump and by the receiver, so both give the
+*               same "Energy i/n id=ms ..." lines, TX slots as txDBM=ms.
+*   \param      pcFrame     frame from EnergyExportFrame()
+*   \param      cLen        frame length
+*   \param      pcText      destination
+*   \param      nSize       destination size
+*   \return     text length, 0 if the frame is not an energy frame
+******************************************************************************/
+int EnergyFormatFrame(const uint8_t *pcFrame, uint8_t cLen, char *pcText, uint16_t nSize)
+{
+	int iLen, iAdd;
+	uint8_t cId, i;
+	uint32_t lValue;
+
+	if((cLen < ENERGY_FRAME_BYTES) || (pcFrame[0] != ENERGY_FRAME_MARKER) || (nSize == 0))
+		return 0;
+
+	iLen = snprintf(pcText, nSize, "\r\nEnergy %u/%u", (unsigned)(pcFrame[1] >> 4), (unsigned)(pcFrame[1] & 0x0F));
+
+	for(i = 0; (i < ENERGY_FRAME_ENTRIES) && (iLen > 0) && (iLen < nSize); i++)
+	{
+		cId = pcFrame[2 + i * 5];
+		if(cId == ENERGY_ID_NONE)
+			break;
+
+		lValue = (uint32_t)pcFrame[3 + i * 5] | ((uint32_t)pcFrame[4 + i * 5] << 8)
+		       | ((uint32_t)pcFrame[5 + i * 5] << 16) | ((uint32_t)pcFrame[6 + i * 5] << 24);
+
+		if(cId & ENERGY_ID_TX)
+			iAdd = snprintf(pcText + iLen, nSize - iLen, " tx%d=%lu",
+			                (int)(int8_t)(cId << 1) / 2, (unsigned long)lValue);
+		else
+			iAdd = snprintf(pcText + iLen, nSize - iLen, " %u=%lu", (unsigned)cId, (unsigned long)lValue);
+
+		if(iAdd < 0)
+			break;
+		iLen += iAdd;
+	}
+
+	return (iLen < nSize) ? iLen : (nSize - 1);
+}
+
+/** ***************************************************************************
+*   \brief      Close the radio time accounting, interrupts masked.
+*   \param      lNowMs     HAL tick
+******************************************************************************/
+static void EnergyAccount(uint32_t lNowMs)
+{
+	uint32_t lDeltaMs = lNowMs - lEnergyRadioMs;
+
+	xEnergyStats.lRadioMs[xEnergyRadio] += lDeltaMs;
+	if((xEnergyRadio == ENERGY_RADIO_TX) && (xEnergyStats.cTxSlots > 0))
+		xEnergyStats.lTxMs[cEnergyTxSlot] += lDeltaMs;
+
+	lEnergyRadioMs = lNowMs;
+}
+
+/** ***************************************************************************
+*   \brief      Counter id and value of an export entry.
+*   \param      pxStats     counters
+*   \param      cIndex      entry, below the number of counters
+*   \param      plValue     counter value, ms
+*   \return     counter id
+******************************************************************************/
+static uint8_t EnergyEntry(const SEnergyStats *pxStats, uint8_t cIndex, uint32_t *plValue)
+{
+	if(cIndex == ENERGY_ID_ELAPSED)
+	{
+		*plValue = pxStats->lElapsedMs;
+		return ENERGY_ID_ELAPSED;
+	}
+
+	if(cIndex < ENERGY_ID_RADIO)
+	{
+		*plValue = pxStats->lMcuMs[cIndex - ENERGY_ID_MCU];
+		return cIndex;
+	}
+
+	if(cIndex < ENERGY_ID_ADC)
+	{
+		*plValue = pxStats->lRadioMs[cIndex - ENERGY_ID_RADIO];
+		return cIndex;
+	}
+
+	if(cIndex < ENERGY_ID_ADC + ENERGY_ADC_NB_STATES)
+	{
+		*plValue = pxStats->lAdcMs[cIndex - ENERGY_ID_ADC];
+		return cIndex;
+	}
+
+	cIndex -= ENERGY_ID_ADC + ENERGY_ADC_NB_STATES;
+	*plValue = pxStats->lTxMs[cIndex];
+
+	return (uint8_t)(ENERGY_ID_TX | ((uint8_t)pxStats->cTxDbm[cIndex] & 0x7F));
+}
+
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -0,0 +1,362 @@
+/** ***************************************************************************
+*   \file        mg_Flicker.c
+*   \brief       Mains flicker detection and rejection for the light front end.
+*                Timer triggered ADC bursts over whole ripple periods, with an
+*                integer Goertzel detector at 100 Hz and 120 Hz.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+/*****************************************************************************/
+// standard libraries
+
+// user headers directly related to this component, ensures no dependency
+#include "mg_Flicker.h"
+#include "stm32l0xx_hal.h"
+#include "main.h"
+
+// user headers from other components
+#include "mg_LightSensor.h"
+#include "mg_ClockGov.h"
+#include "mg_Timestamp.h"
+#include "mg_Energy.h"
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/*****************************************************************************/
+// constants
+
+/* Goertzel coefficients 2*cos(2*pi*k/N) in Q14 for N = 120 at 2400 Hz */
+#define GOERTZEL_Q                  14
+#define GOERTZEL_COEFF_100HZ        31651       // k = 5
+#define GOERTZEL_COEFF_120HZ        31164       // k = 6
+
+/*****************************************************************************/
+// macros
+
+/* Margin added to the nominal burst duration before giving up */
+#define FLICKER_TIMEOUT_MARGIN_MS   10
+
+/*****************************************************************************/
+// static function declarations
+static HAL_StatusTypeDef FlickerBurst(uint32_t lRateHz, uint16_t nSamples);
+static uint16_t FlickerAverage(uint16_t nSamples);
+static uint16_t FlickerGoertzel(int32_t lCoeff, uint16_t nMean);
+static uint32_t FlickerSqrt(uint64_t llValue);
+
+/*****************************************************************************/
+// static variable declarations
+extern ADC_HandleTypeDef hadc;
+
+static DMA_HandleTypeDef hdma_adc;
+
+static uint16_t anFlickerBuf[FLICKER_DETECT_SAMPLES];
+static volatile uint8_t cFlickerDone;
+static uint32_t lFlickerStamp;                // timestamp of the middle of the last burst
+static FlickerMains xFlickerMains = FLICKER_MAINS_UNKNOWN;
+
+/*****************************************************************************/
+// functions
+
+/** ***************************************************************************
+*   \brief      Set up the DMA used for burst acquisitions.
+*   \details    The TIM2 trigger set up by LightSensorInit() starts the
+*               conversions and DMA1 channel 1 moves the results to RAM, so the
+*               core can sleep for the duration of the burst.
+******************************************************************************/
+void FlickerInit(void)
+{
+	/* DMA: ADC -> RAM, half words, one shot */
+	__HAL_RCC_DMA1_CLK_ENABLE();
+	hdma_adc.Instance = DMA1_Channel1;
+	hdma_adc.Init.Request = DMA_REQUEST_0;
+	hdma_adc.Init.Direction = DMA_PERIPH_TO_MEMORY;
+	hdma_adc.Init.PeriphInc = DMA_PINC_DISABLE;
+	hdma_adc.Init.MemInc = DMA_MINC_ENABLE;
+	hdma_adc.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+	hdma_adc.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+	hdma_adc.Init.Mode = DMA_NORMAL;
+	hdma_adc.Init.Priority = DMA_PRIORITY_LOW;
+	if (HAL_DMA_Init(&hdma_adc) != HAL_OK)
+	{
+		Error_Handler();
+	}
+	__HAL_LINKDMA(&hadc, DMA_Handle, hdma_adc);
+	HAL_NVIC_SetPriority(DMA1_Channel1_IRQn, 0, 0);
+	HAL_NVIC_EnableIRQ(DMA1_Channel1_IRQn);
+}
+
+/** ***************************************************************************
+*   \brief      Full detection burst.
+*   \details    Samples 50 ms at 2400 Hz and runs a Goertzel filter at 100 Hz
+*               and 120 Hz. The stronger bin above FLICKER_MIN_AMPLITUDE selects
+*               the mains frequency used by later FlickerMean() bursts. The
+*               mean over the window is ripple free for either mains frequency.
+*               The acquisition runs at the current clock, the filters at
+*               CLOCK_HIGH.
+*   \param      pxResult     mean, ripple amplitude and frequency
+*   \return     HAL status of the acquisition
+******************************************************************************/
+HAL_StatusTypeDef FlickerDetect(SFlickerResult *pxResult)
+{
+	HAL_StatusTypeDef xStatus;
+	ClockPoint xClock;
+	uint16_t nAmp100, nAmp120;
+
+	xStatus = FlickerBurst(FLICKER_DETECT_RATE_HZ, FLICKER_DETECT_SAMPLES);
+	if(xStatus != HAL_OK)
+		return xStatus;
+
+	xClock = ClockGovSet(CLOCK_HIGH);
+
+	pxResult->nMean = FlickerAverage(FLICKER_DETECT_SAMPLES);
+	pxResult->cNbConversions = FLICKER_DETECT_SAMPLES;
+	pxResult->lTimestamp = lFlickerStamp;
+
+	nAmp100 = FlickerGoertzel(GOERTZEL_COEFF_100HZ, pxResult->nMean);
+	nAmp120 = FlickerGoertzel(GOERTZEL_COEFF_120HZ, pxResult->nMean);
+
+	ClockGovSet(xClock);
+
+	if((nAmp100 >= nAmp120) && (nAmp100 >= FLICKER_MIN_AMPLITUDE))
+	{
+		xFlickerMains = FLICKER_MAINS_50HZ;
+		pxResult->nAmplitude = nAmp100;
+		pxResult->cRippleHz = 100;
+	}
+	else if(nAmp120 >= FLICKER_MIN_AMPLITUDE)
+	{
+		xFlickerMains = FLICKER_MAINS_60HZ;
+		pxResult->nAmplitude = nAmp120;
+		pxResult->cRippleHz = 120;
+	}
+	else
+	{
+		/* Keep the last mains lock, the lamps may just be off */
+		pxResult->nAmplitude = (nAmp100 > nAmp120) ? nAmp100 : nAmp120;
+		pxResult->cRippleHz = 0;
+	}
+
+	return HAL_OK;
+}
+
+/** ***************************************************************************
+*   \brief      Ripple free mean with the minimum number of conversions.
+*   \details    Once the mains frequency is known, FLICKER_MEAN_SAMPLES evenly
+*               spaced conversions over a single ripple period are enough. With
+*               unknown mains a 50 ms window covers both 100 Hz and 120 Hz.
+*   \param      pxResult     mean and number of conversions used
+*   \return     HAL status of the acquisition
+******************************************************************************/
+HAL_StatusTypeDef FlickerMean(SFlickerResult *pxResult)
+{
+	HAL_StatusTypeDef xStatus;
+	uint32_t lRateHz;
+	uint16_t nSamples;
+
+	switch(xFlickerMains)
+	{
+		case FLICKER_MAINS_50HZ:
+			lRateHz = 100 * FLICKER_MEAN_SAMPLES;
+			nSamples = FLICKER_MEAN_SAMPLES;
+			break;
+		case FLICKER_MAINS_60HZ:
+			lRateHz = 120 * FLICKER_MEAN_SAMPLES;
+			nSamples = FLICKER_MEAN_SAMPLES;
+			break;
+		default:
+			lRateHz = FLICKER_UNKNOWN_RATE_HZ;
+			nSamples = FLICKER_UNKNOWN_SAMPLES;
+			break;
+	}
+
+	xStatus = FlickerBurst(lRateHz, nSamples);
+	if(xStatus != HAL_OK)
+		return xStatus;
+
+	pxResult->nMean = FlickerAverage(nSamples);
+	pxResult->nAmplitude = 0;
+	pxResult->cRippleHz = 0;
+	pxResult->cNbConversions = (uint8_t)nSamples;
+	pxResult->lTimestamp = lFlickerStamp;
+
+	return HAL_OK;
+}
+
+/** ***************************************************************************
+*   \brief      Mains frequency found by the last successful detection.
+*   \return     mains frequency
+******************************************************************************/
+FlickerMains FlickerGetMains(void)
+{
+	return xFlickerMains;
+}
+
+/** ***************************************************************************
+*   \brief      DMA1 channel 1 interrupt, called from stm32l0xx_it.c
+******************************************************************************/
+void FlickerDmaIrqHandler(void)
+{
+	HAL_DMA_IRQHandler(&hdma_adc);
+}
+
+/** ***************************************************************************
+*   \brief      End of DMA transfer, all burst conversions are in RAM.
+*   \param      pxAdc     ADC handle, the only ADC
+******************************************************************************/
+void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* pxAdc)
+{
+	(void)pxAdc;
+	cFlickerDone = 1;
+}
+
+/** ***************************************************************************
+*   \brief      Timer triggered burst of ADC_IN10 conversions into anFlickerBuf.
+*   \details    The ADC is temporarily switched to TIM2 triggered ADC_IN10
+*               conversions, then restored to the software triggered scan used
+*               by LightSensorSample(). The core sleeps between conversions.
+*   \param      lRateHz      conversion rate
+*   \param      nSamples     number of conversions, at most FLICKER_DETECT_SAMPLES
+*   \return     HAL status of the burst
+******************************************************************************/
+static HAL_StatusTypeDef FlickerBurst(uint32_t lRateHz, uint16_t nSamples)
+{
+	HAL_StatusTypeDef xStatus;
+	uint32_t lTimeoutMs, lStartMs;
+
+	if(nSamples > FLICKER_DETECT_SAMPLES)
+		return HAL_ERROR;
+
+	/* Light sensor only, triggered by TIM2 */
+	LightSensorTriggeredEnter(DISABLE);
+
+	HAL_GPIO_WritePin(SENSE_EN_GPIO_Port, SENSE_EN_Pin, GPIO_PIN_SET);
+	HAL_Delay(LIGHT_SETTLE_MS);
+
+	cFlickerDone = 0;
+	EnergyAdcSet(ENERGY_ADC_ON);
+	xStatus = HAL_ADC_Start_DMA(&hadc, (uint32_t*)anFlickerBuf, nSamples);
+	if(xStatus == HAL_OK)
+	{
+		LightSensorTriggerStart(lRateHz);
+
+		/* Sleep until the DMA completes, the SysTick bounds the wait */
+		lTimeoutMs = ((uint32_t)nSamples * 1000UL) / lRateHz + FLICKER_TIMEOUT_MARGIN_MS;
+		lStartMs = HAL_GetTick();
+		while(!cFlickerDone)
+		{
+			if((HAL_GetTick() - lStartMs) > lTimeoutMs)
+			{
+				xStatus = HAL_TIMEOUT;
+				break;
+			}
+			__WFI();
+		}
+
+		LightSensorTriggerStop();
+		HAL_ADC_Stop_DMA(&hadc);
+
+		/* the result stands for the middle of the window */
+		lFlickerStamp = TimestampNow() - ((nSamples * TIMESTAMP_ONE_S) / lRateHz) / 2;
+	}
+
+	EnergyAdcSet(ENERGY_ADC_OFF);
+	HAL_GPIO_WritePin(SENSE_EN_GPIO_Port, SENSE_EN_Pin, GPIO_PIN_RESET);
+
+	/* Back to the software triggered scan */
+	LightSensorTriggeredExit();
+
+	return xStatus;
+}
+
+/** ***************************************************************************
+*   \brief      Rounded mean of the first nSamples burst conversions.
+*   \param      nSamples     number of conversions
+*   \return     mean, raw counts
+******************************************************************************/
+static uint16_t FlickerAverage(uint16_t nSamples)
+{
+	uint32_t lSum = 0;
+
+	for(uint16_t i = 0; i < nSamples; i++)
+	{
+		lSum += anFlickerBuf[i];
+	}
+
+	return (uint16_t)((lSum + nSamples / 2) / nSamples);
+}
+
+/** ***************************************************************************
+*   \brief      Integer Goertzel filter over the detection burst.
+*   \details    The mean is removed first so the state stays small. Returns
+*               the peak amplitude 2*|X(k)|/N of the selected bin.
+*   \param      lCoeff     2*cos(2*pi*k/N) in Q14
+*   \param      nMean      mean of the burst
+*   \return     peak amplitude, raw counts
+******************************************************************************/
+static uint16_t FlickerGoertzel(int32_t lCoeff, uint16_t nMean)
+{
+	int32_t s0, s1 = 0, s2 = 0;
+	int64_t llPower;
+
+	for(uint16_t i = 0; i < FLICKER_DETECT_SAMPLES; i++)
+	{
+		s0 = ((int32_t)anFlickerBuf[i] - (int32_t)nMean)
+		   + (int32_t)(((int64_t)lCoeff * s1) >> GOERTZEL_Q) - s2;
+		s2 = s1;
+		s1 = s0;
+	}
+
+	llPower = (int64_t)s1 * s1 + (int64_t)s2 * s2 - ((((int64_t)lCoeff * s1) >> GOERTZEL_Q) * s2);
+	if(llPower < 0)
+		llPower = 0;
+
+	return (uint16_t)((2UL * FlickerSqrt((uint64_t)llPower)) / FLICKER_DETECT_SAMPLES);
+}
+
+/** ***************************************************************************
+*   \brief      Integer square root.
+*   \param      llValue     radicand
+*   \return     floor(sqrt(llValue))
+******************************************************************************/
+static uint32_t FlickerSqrt(uint64_t llValue)
+{
+	uint64_t llResult = 0;
+	uint64_t llBit = (uint64_t)1 << 62;
+
+	while(llBit > llValue)
+		llBit >>= 2;
+
+	while(llBit != 0)
+	{
+		if(llValue >= llResult + llBit)
+		{
+			llValue -= llResult + llBit;
+			llResult = (llResult >> 1) + llBit;
+		}
+		else
+		{
+			llResult >>= 1;
+		}
+		llBit >>= 2;
+	}
+
+	return (uint32_t)llResult;
+}
+
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -0,0 +1,282 @@
+/** ***************************************************************************
+*   \file        mg_LdcRx.c
+*   \brief       S2LP low duty cycle receiver. The radio wakes itself on its
+*                LDC timer, sniffs for a short window and sleeps again, so the
+*                MCU is only interrupted when a packet arrives.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+/*****************************************************************************/
+// standard libraries
+#include <string.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "mg_LdcRx.h"
+#include "stm32l0xx_hal.h"
+
+// user headers from other components
+#include "mg_Energy.h"
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* SPI status polls allowed for the radio to reach READY */
+#define LDCRX_READY_POLLS           100
+
+/*****************************************************************************/
+// static function declarations
+static void LdcRxReady(void);
+
+/*****************************************************************************/
+// static variable declarations
+static SLdcRxConfig xLdcRxConfig;
+static SLdcRxStats xLdcRxStats;
+static uint8_t cLdcRxActive;
+static uint8_t cLdcRxSuspended;
+static uint32_t lLdcRxStartMs;
+static uint16_t nLdcRxLastSeq;
+static uint8_t cLdcRxSeqValid;
+
+/*****************************************************************************/
+// functions
+
+/** ***************************************************************************
+*   \brief      Switch the receiver to low duty cycle mode.
+*   \details    The S2LP wakes every fPeriodMs on its RCO, listens for
+*               fWindowMs and goes back to sleep. The RX timer is stopped on
+*               preamble quality, so a packet that starts within the window is
+*               received in full. On sync detection the LDC timer is reloaded,
+*               which keeps the wake-ups aligned to a periodic transmitter.
+*               SLEEP_B retains the FIFO so the packet can be read after the
+*               radio went back to sleep. The RCO is calibrated on each
+*               READY to SLEEP transition for timer accuracy.
+*   \param      pxConfig     configuration, copied
+******************************************************************************/
+void LdcRxStart(const SLdcRxConfig *pxConfig)
+{
+	xLdcRxConfig = *pxConfig;
+
+	LdcRxReady();
+	S2LPCmdStrobeFlushRxFifo();
+
+	S2LPTimerCalibrationRco(S_ENABLE);
+	S2LPTimerSleepB(S_ENABLE);
+
+	S2LPTimerSetWakeUpTimerMs(xLdcRxConfig.fPeriodMs);
+	S2LPTimerSetWakeUpTimerReloadMs(xLdcRxConfig.fPeriodMs);
+	S2LPTimerLdcrAutoReload(S_ENABLE);
+
+	S2LPTimerSetRxTimerMs(xLdcRxConfig.fWindowMs);
+	S2LPRadioSetPqiCheck(xLdcRxConfig.cPqiLevel);
+	S2LPTimerSetRxTimerStopCondition(PQI_ABOVE_THRESHOLD);
+
+	S2LPGpioIrqConfig(WKUP_TOUT_LDC, xLdcRxConfig.xWakeIrq);
+	S2LPGpioIrqConfig(RX_TIMEOUT, xLdcRxConfig.xWakeIrq);
+	S2LPGpioIrqClearStatus();
+
+	LdcRxResetStats();
+	cLdcRxActive = 1;
+
+	S2LPTimerLdcrMode(S_ENABLE);
+	S2LPCmdStrobeRx();
+	EnergyRadioSet(ENERGY_RADIO_LDC);
+}
+
+/** ***************************************************************************
+*   \brief      Leave low duty cycle mode, the radio is left in READY.
+*   \details    The RX timer stop condition is restored to its default. The
+*               caller restarts reception as needed.
+******************************************************************************/
+void LdcRxStop(void)
+{
+	S2LPTimerLdcrMode(S_DISABLE);
+	LdcRxReady();
+
+	S2LPGpioIrqConfig(WKUP_TOUT_LDC, S_DISABLE);
+	S2LPGpioIrqConfig(RX_TIMEOUT, S_DISABLE);
+	S2LPTimerSetRxTimerStopCondition(TIMEOUT_ALWAYS_STOPPED);
+	S2LPTimerSleepB(S_DISABLE);
+
+	xLdcRxStats.lElapsedMs = HAL_GetTick() - lLdcRxStartMs;
+	cLdcRxActive = 0;
+	cLdcRxSuspended = 0;
+}
+
+/** ***************************************************************************
+*   \brief      Pause low duty cycle mode to transmit, the radio is left in READY.
+*   \details    Unlike LdcRxStop() the configuration and statistics are kept,
+*               LdcRxResume() restarts the wake-ups. Does nothing when not
+*               active.
+******************************************************************************/
+void LdcRxSuspend(void)
+{
+	if(!cLdcRxActive)
+		return;
+
+	S2LPTimerLdcrMode(S_DISABLE);
+	LdcRxReady();
+
+	cLdcRxActive = 0;
+	cLdcRxSuspended = 1;
+}
+
+/** ***************************************************************************
+*   \brief      Restart low duty cycle mode after LdcRxSuspend().
+******************************************************************************/
+void LdcRxResume(void)
+{
+	if(!cLdcRxSuspended)
+		return;
+
+	cLdcRxSuspended = 0;
+	cLdcRxActive = 1;
+
+	S2LPGpioIrqClearStatus();
+	S2LPTimerLdcrMode(S_ENABLE);
+	S2LPCmdStrobeRx();
+	EnergyRadioSet(ENERGY_RADIO_LDC);
+}
+
+/** ***************************************************************************
+*   \brief      Whether low duty cycle mode is suspended for a transmission.
+*   \return     1 if suspended
+******************************************************************************/
+uint8_t LdcRxIsSuspended(void)
+{
+	return cLdcRxSuspended;
+}
+
+/** ***************************************************************************
+*   \brief      Whether low duty cycle mode is running.
+*   \details    In LDC mode the radio returns to SLEEP on its own after each
+*               reception, RX must not be strobed again.
+*   \return     1 if active
+******************************************************************************/
+uint8_t LdcRxIsActive(void)
+{
+	return cLdcRxActive;
+}
+
+/** ***************************************************************************
+*   \brief      Account for radio interrupts. Called from the GPIO IRQ handler.
+*   \param      pxIrqStatus     IRQ status read from the radio
+******************************************************************************/
+void LdcRxIrq(const S2LPIrqs *pxIrqStatus)
+{
+	if(!cLdcRxActive)
+		return;
+
+	if(pxIrqStatus->IRQ_RX_DATA_READY)
+		xLdcRxStats.lPackets++;
+	if(pxIrqStatus->IRQ_RX_DATA_DISC)
+		xLdcRxStats.lDiscarded++;
+	if(pxIrqStatus->IRQ_WKUP_TOUT_LDC)
+		xLdcRxStats.lWakes++;
+	if(pxIrqStatus->IRQ_RX_TIMEOUT)
+		xLdcRxStats.lEmptySniffs++;
+}
+
+/** ***************************************************************************
+*   \brief      Track the transmitter sequence number to count lost packets.
+*   \param      nSeq     sequence number carried by the received packet
+******************************************************************************/
+void LdcRxLogSequence(uint16_t nSeq)
+{
+	uint16_t nGap;
+
+	if(cLdcRxSeqValid)
+	{
+		nGap = (uint16_t)(nSeq - nLdcRxLastSeq);
+
+		/* anything else is a transmitter reset, not a loss */
+		if((nGap > 1) && (nGap < 0x8000))
+			xLdcRxStats.lMissed += nGap - 1;
+	}
+
+	nLdcRxLastSeq = nSeq;
+	cLdcRxSeqValid = 1;
+}
+
+/** ***************************************************************************
+*   \brief      Restart the statistics, e.g. when the window length changes.
+******************************************************************************/
+void LdcRxResetStats(void)
+{
+	memset(&xLdcRxStats, 0, sizeof(xLdcRxStats));
+	lLdcRxStartMs = HAL_GetTick();
+	cLdcRxSeqValid = 0;
+}
+
+/** ***************************************************************************
+*   \brief      Copy out the statistics with the derived figures.
+*   \details    The radio is taken to be in RX for one window per wake-up plus
+*               one packet air time per reception, and in SLEEP_B otherwise.
+*               When the wake-ups are not counted they are derived from the
+*               elapsed time.
+*   \param      pxStats     destination
+******************************************************************************/
+void LdcRxGetStats(SLdcRxStats *pxStats)
+{
+	uint32_t lRxMs, lSent;
+
+	*pxStats = xLdcRxStats;
+
+	if(cLdcRxActive || cLdcRxSuspended)
+		pxStats->lElapsedMs = HAL_GetTick() - lLdcRxStartMs;
+
+	if((xLdcRxConfig.xWakeIrq == S_DISABLE) && (xLdcRxConfig.fPeriodMs > 0))
+		pxStats->lWakes = (uint32_t)((float)pxStats->lElapsedMs / xLdcRxConfig.fPeriodMs);
+
+	lRxMs = (uint32_t)((float)pxStats->lWakes * xLdcRxConfig.fWindowMs
+	                 + (float)pxStats->lPackets * xLdcRxConfig.fPacketMs);
+
+	if(pxStats->lElapsedMs == 0)
+		pxStats->lAvgCurrentUa = 0;
+	else if(lRxMs >= pxStats->lElapsedMs)
+		pxStats->lAvgCurrentUa = LDCRX_I_RX_UA;
+	else
+		pxStats->lAvgCurrentUa = (uint32_t)(((uint64_t)lRxMs * LDCRX_I_RX_UA
+		                         + (uint64_t)(pxStats->lElapsedMs - lRxMs) * LDCRX_I_SLEEP_UA) / pxStats->lElapsedMs);
+
+	lSent = pxStats->lPackets + pxStats->lMissed;
+	pxStats->nDetectPermille = (lSent == 0) ? 0 : (uint16_t)((pxStats->lPackets * 1000UL) / lSent);
+}
+
+/** ***************************************************************************
+*   \brief      Bring the radio to READY from RX or SLEEP.
+******************************************************************************/
+static void LdcRxReady(void)
+{
+	S2LPCmdStrobeSabort();
+	S2LPCmdStrobeReady();
+
+	for(uint8_t i = 0; i < LDCRX_READY_POLLS; i++)
+	{
+		S2LPRefreshStatus();
+		if(g_xStatus.MC_STATE == MC_STATE_READY)
+			break;
+	}
+}
+
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -0,0 +1,311 @@
+/** ***************************************************************************
+*   \file        mg_LightSensor.c
+*   \brief       Light sensor front end: ADC acquisition of ADC_IN10, the
+*                temperature sensor and VREFINT, plus conversion to lux. Also
+*                owns the TIM2 conversion trigger used by timed acquisitions.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+/*****************************************************************************/
+// standard libraries
+
+// user headers directly related to this component, ensures no dependency
+#include "mg_LightSensor.h"
+#include "stm32l0xx_hal.h"
+#include "main.h"
+
+// user headers from other components
+#include "mg_Energy.h"
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* Per-conversion poll timeout */
+#define LIGHT_ADC_TIMEOUT_MS        10
+
+/*****************************************************************************/
+// static function declarations
+static HAL_StatusTypeDef LightSensorConvert(SLightSample *pxSample);
+
+/*****************************************************************************/
+// static variable declarations
+extern ADC_HandleTypeDef hadc;
+
+static TIM_HandleTypeDef htim2;
+static ADC_InitTypeDef xSavedAdcInit;
+
+/*****************************************************************************/
+// functions
+
+/** ***************************************************************************
+*   \brief      Prepare the ADC for light sensor acquisitions.
+*   \details    The Cube generated init uses a 1.5 cycle sampling time, which is
+*               too short for the temperature sensor and VREFINT (10 us minimum).
+*               It is lengthened here to 39.5 cycles, about 38 us at the
+*               CLOCK_LOW ADC clock, so the generated code can be regenerated
+*               without losing the setting. The low frequency mode that clock
+*               needs is set by the clock governor.
+******************************************************************************/
+void LightSensorInit(void)
+{
+	TIM_MasterConfigTypeDef sMasterConfig;
+
+	hadc.Init.SamplingTime = ADC_SAMPLETIME_39CYCLES_5;
+	if (HAL_ADC_Init(&hadc) != HAL_OK)
+	{
+		Error_Handler();
+	}
+
+	/* TIM2: update event on TRGO, rate set by LightSensorTriggerStart() */
+	__HAL_RCC_TIM2_CLK_ENABLE();
+	htim2.Instance = TIM2;
+	htim2.Init.Prescaler = 0;
+	htim2.Init.CounterMode = TIM_COUNTERMODE_UP;
+	htim2.Init.Period = 0xFFFF;
+	htim2.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+	if (HAL_TIM_Base_Init(&htim2) != HAL_OK)
+	{
+		Error_Handler();
+	}
+	sMasterConfig.MasterOutputTrigger = TIM_TRGO_UPDATE;
+	sMasterConfig.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+	if (HAL_TIMEx_MasterConfigSynchronization(&htim2, &sMasterConfig) != HAL_OK)
+	{
+		Error_Handler();
+	}
+}
+
+/** ***************************************************************************
+*   \brief      Take one acquisition of the regular sequence.
+*   \details    Powers the sensor through SENSE_EN, waits for it to settle, then
+*               converts the scan sequence (ADC_IN10, VREFINT, TEMPSENSOR in
+*               forward channel order). The sensor is powered down again before
+*               returning.
+*   \param      pxSample     destination for the raw conversions
+*   \return     HAL status of the acquisition
+******************************************************************************/
+HAL_StatusTypeDef LightSensorSample(SLightSample *pxSample)
+{
+	HAL_StatusTypeDef xStatus;
+
+	/* Power the sensor and let it settle */
+	HAL_GPIO_WritePin(SENSE_EN_GPIO_Port, SENSE_EN_Pin, GPIO_PIN_SET);
+	HAL_Delay(LIGHT_SETTLE_MS);
+
+	xStatus = LightSensorConvert(pxSample);
+
+	/* Sensor off between samples */
+	HAL_GPIO_WritePin(SENSE_EN_GPIO_Port, SENSE_EN_Pin, GPIO_PIN_RESET);
+
+	return xStatus;
+}
+
+/** ***************************************************************************
+*   \brief      Take one acquisition with the sensor unpowered.
+*   \details    Used by the self-test: with SENSE_EN low the sensor output must
+*               sit near zero whatever the illumination.
+*   \param      pxSample     destination for the raw conversions
+*   \return     HAL status of the acquisition
+******************************************************************************/
+HAL_StatusTypeDef LightSensorSampleDark(SLightSample *pxSample)
+{
+	HAL_GPIO_WritePin(SENSE_EN_GPIO_Port, SENSE_EN_Pin, GPIO_PIN_RESET);
+	HAL_Delay(LIGHT_SETTLE_MS);
+
+	return LightSensorConvert(pxSample);
+}
+
+/** ***************************************************************************
+*   \brief      Convert a raw ADC_IN10 reading to lux.
+*   \param      nRaw     raw 12 bit conversion
+*   \return     illuminance in lux
+******************************************************************************/
+uint32_t LightSensorToLux(uint16_t nRaw)
+{
+	return ((uint32_t)nRaw * LIGHT_LUX_SCALE_NUM) / LIGHT_LUX_SCALE_DEN;
+}
+
+/** ***************************************************************************
+*   \brief      Convert lux back to raw ADC_IN10 counts, saturating at 12 bits.
+*   \param      lLux     illuminance in lux
+*   \return     raw 12 bit value
+******************************************************************************/
+uint16_t LightSensorFromLux(uint32_t lLux)
+{
+	uint32_t lRaw = (lLux * LIGHT_LUX_SCALE_DEN) / LIGHT_LUX_SCALE_NUM;
+
+	return (lRaw > 0x0FFF) ? 0x0FFF : (uint16_t)lRaw;
+}
+
+/** ***************************************************************************
+*   \brief      Supply voltage from a VREFINT conversion.
+*   \param      nVrefint     raw VREFINT conversion
+*   \return     VDDA in mV, 0 if the conversion is invalid
+******************************************************************************/
+uint16_t LightSensorVddMv(uint16_t nVrefint)
+{
+	if(nVrefint == 0)
+		return 0;
+
+	return (uint16_t)(((uint32_t)LIGHT_CAL_VDD_MV * LIGHT_VREFINT_CAL) / nVrefint);
+}
+
+/** ***************************************************************************
+*   \brief      Die temperature from a temperature sensor conversion.
+*   \details    The conversion is rescaled to the 3.0 V factory conditions and
+*               interpolated between the 30 degC and 130 degC calibration points.
+*   \param      nTemp      raw temperature sensor conversion
+*   \param      nVddMv     VDDA at the time of the conversion
+*   \return     temperature in degC
+******************************************************************************/
+int16_t LightSensorTempC(uint16_t nTemp, uint16_t nVddMv)
+{
+	int32_t lScaled = ((int32_t)nTemp * nVddMv) / LIGHT_CAL_VDD_MV;
+
+	return (int16_t)(((lScaled - (int32_t)LIGHT_TS_CAL1) * (130 - 30))
+	                 / ((int32_t)LIGHT_TS_CAL2 - (int32_t)LIGHT_TS_CAL1) + 30);
+}
+
+/** ***************************************************************************
+*   \brief      Switch the ADC to timer triggered ADC_IN10 conversions.
+*   \details    The temperature and VREFINT channels are removed from the
+*               sequence and conversions are started by TIM2 TRGO. With
+*               xAutoOff the ADC powers down between conversions and overruns
+*               simply overwrite the data register, for long unattended runs.
+*               LightSensorTriggeredExit() restores the software triggered scan.
+*   \param      xAutoOff     ENABLE to power the ADC down between conversions
+******************************************************************************/
+void LightSensorTriggeredEnter(FunctionalState xAutoOff)
+{
+	ADC_ChannelConfTypeDef sConfig;
+
+	xSavedAdcInit = hadc.Init;
+
+	hadc.Init.ExternalTrigConv = ADC_EXTERNALTRIGCONV_T2_TRGO;
+	hadc.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_RISING;
+	hadc.Init.EOCSelection = ADC_EOC_SINGLE_CONV;
+	hadc.Init.DMAContinuousRequests = DISABLE;
+	if(xAutoOff == ENABLE)
+	{
+		hadc.Init.LowPowerAutoPowerOff = ENABLE;
+		hadc.Init.Overrun = ADC_OVR_DATA_OVERWRITTEN;
+	}
+	if(HAL_ADC_Init(&hadc) != HAL_OK)
+	{
+		Error_Handler();
+	}
+
+	sConfig.Rank = ADC_RANK_NONE;
+	sConfig.Channel = ADC_CHANNEL_TEMPSENSOR;
+	HAL_ADC_ConfigChannel(&hadc, &sConfig);
+	sConfig.Channel = ADC_CHANNEL_VREFINT;
+	HAL_ADC_ConfigChannel(&hadc, &sConfig);
+}
+
+/** ***************************************************************************
+*   \brief      Restore the software triggered three channel scan.
+******************************************************************************/
+void LightSensorTriggeredExit(void)
+{
+	ADC_ChannelConfTypeDef sConfig;
+
+	hadc.Init = xSavedAdcInit;
+	if(HAL_ADC_Init(&hadc) != HAL_OK)
+	{
+		Error_Handler();
+	}
+
+	sConfig.Rank = ADC_RANK_CHANNEL_NUMBER;
+	sConfig.Channel = ADC_CHANNEL_TEMPSENSOR;
+	HAL_ADC_ConfigChannel(&hadc, &sConfig);
+	sConfig.Channel = ADC_CHANNEL_VREFINT;
+	HAL_ADC_ConfigChannel(&hadc, &sConfig);
+}
+
+/** ***************************************************************************
+*   \brief      Start the TIM2 conversion trigger.
+*   \details    The prescaler is chosen so the period fits the 16 bit counter,
+*               and the period is rounded to the nearest timer tick.
+*   \param      lRateHz     trigger rate
+******************************************************************************/
+void LightSensorTriggerStart(uint32_t lRateHz)
+{
+	uint32_t lTicks = (HAL_RCC_GetPCLK1Freq() + lRateHz / 2) / lRateHz;
+	uint32_t lPrescaler = lTicks / 0x10000;
+
+	__HAL_TIM_SET_PRESCALER(&htim2, lPrescaler);
+	__HAL_TIM_SET_AUTORELOAD(&htim2, (lTicks / (lPrescaler + 1)) - 1);
+	__HAL_TIM_SET_COUNTER(&htim2, 0);
+
+	/* Load the prescaler now rather than at the first update */
+	htim2.Instance->EGR = TIM_EGR_UG;
+
+	HAL_TIM_Base_Start(&htim2);
+}
+
+/** ***************************************************************************
+*   \brief      Stop the TIM2 conversion trigger.
+******************************************************************************/
+void LightSensorTriggerStop(void)
+{
+	HAL_TIM_Base_Stop(&htim2);
+}
+
+/** ***************************************************************************
+*   \brief      Convert the regular scan sequence.
+*   \param      pxSample     destination for the raw conversions
+*   \return     HAL status of the conversions
+******************************************************************************/
+static HAL_StatusTypeDef LightSensorConvert(SLightSample *pxSample)
+{
+	HAL_StatusTypeDef xStatus;
+
+	EnergyAdcSet(ENERGY_ADC_ON);
+	xStatus = HAL_ADC_Start(&hadc);
+
+	/* Scan direction is forward: channel 10, then 17 (VREFINT), then 18 (TEMP) */
+	if(xStatus == HAL_OK)
+		xStatus = HAL_ADC_PollForConversion(&hadc, LIGHT_ADC_TIMEOUT_MS);
+	if(xStatus == HAL_OK)
+	{
+		pxSample->nLight = (uint16_t)HAL_ADC_GetValue(&hadc);
+		xStatus = HAL_ADC_PollForConversion(&hadc, LIGHT_ADC_TIMEOUT_MS);
+	}
+	if(xStatus == HAL_OK)
+	{
+		pxSample->nVrefint = (uint16_t)HAL_ADC_GetValue(&hadc);
+		xStatus = HAL_ADC_PollForConversion(&hadc, LIGHT_ADC_TIMEOUT_MS);
+	}
+	if(xStatus == HAL_OK)
+	{
+		pxSample->nTemp = (uint16_t)HAL_ADC_GetValue(&hadc);
+	}
+
+	HAL_ADC_Stop(&hadc);
+	EnergyAdcSet(ENERGY_ADC_OFF);
+
+	return xStatus;
+}
+
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -0,0 +1,282 @@
+/** ***************************************************************************
+*   \file        mg_Link.c
+*   \brief       Reliable link on the S2LP STack packet format. The radio
+*                requests, sends and waits for acks and retransmits on its
+*                own, the MCU only hears the outcome. Delivery counters are
+*                kept per peer address.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+/*****************************************************************************/
+// standard libraries
+#include <string.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "mg_Link.h"
+
+// user headers from other components
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/*****************************************************************************/
+// static function declarations
+static SLinkStats *LinkPeer(uint8_t cAddress);
+
+/*****************************************************************************/
+// static variable declarations
+static SLinkConfig xLinkConfig;
+static SLinkStats xLinkPeers[LINK_MAX_PEERS];
+static uint8_t cLinkPeers;
+static uint8_t cLinkLastSeq[LINK_MAX_PEERS];      // sequence number last received from each peer
+static uint32_t lLinkLastMs[LINK_MAX_PEERS];      // HAL tick of the last new packet from each peer
+static volatile LinkTxResult xLinkTxResult;
+
+/*****************************************************************************/
+// functions
+
+/** ***************************************************************************
+*   \brief      Keep the configuration and clear the counters.
+*   \param      pxConfig     addresses, retransmissions and ack roles
+******************************************************************************/
+void LinkInit(const SLinkConfig *pxConfig)
+{
+	xLinkConfig = *pxConfig;
+	if(xLinkConfig.cMaxRetx > LINK_MAX_RETX)
+		xLinkConfig.cMaxRetx = LINK_MAX_RETX;
+
+	memset(xLinkPeers, 0, sizeof(xLinkPeers));
+	cLinkPeers = 0;
+	xLinkTxResult = LINK_TX_PENDING;
+}
+
+/** ***************************************************************************
+*   \brief      Set the STack packet format up, in place of S2LPPktBasicInit().
+*   \details    Called with the rest of the radio configuration. The address
+*               field is always present in STack packets; no address
+*               filtering is set, only the source and destination written.
+*               S2LPPktStackAddressesInit() is not used as it writes MY_ADDRESS
+*               to the destination register.
+*   \param      pxPktInit     packet format
+******************************************************************************/
+void LinkConfigure(PktStackInit *pxPktInit)
+{
+	S2LPPktStackInit(pxPktInit);
+
+	S2LPSetMyAddress(xLinkConfig.cMyAddress);
+	S2LPSetRxSourceReferenceAddress(xLinkConfig.cPeerAddress);
+
+	S2LPPktStackNRetx(xLinkConfig.cMaxRetx);
+	S2LPPktStackAckRequest(xLinkConfig.xAckRequest);
+	S2LPPktStackAutoAck(xLinkConfig.xAutoAck);
+	S2LPPktStackPiggybacking(xLinkConfig.xPiggyback);
+}
+
+/** ***************************************************************************
+*   \brief      Set the length of the next payload.
+*   \details    Unlike S2LPPktBasicSetPayloadLength(), accounts for the
+*               address and control bytes.
+*   \param      cLen     payload bytes
+******************************************************************************/
+void LinkSetPayloadLength(uint8_t cLen)
+{
+	S2LPPktStackSetPayloadLength(cLen);
+}
+
+/** ***************************************************************************
+*   \brief      Load the payload the next ack carries, done by the receiver.
+*   \details    With piggybacking the radio sends the TX FIFO content with the
+*               ack, so it must be loaded before the packet to ack arrives,
+*               and again after each ack. The radio must not be transmitting.
+*   \param      pcPayload     payload
+*   \param      cLen          payload length
+******************************************************************************/
+void LinkSetAckPayload(const uint8_t *pcPayload, uint8_t cLen)
+{
+	S2LPCmdStrobeFlushTxFifo();
+	S2LPPktStackSetPayloadLength(cLen);
+	S2LPSpiWriteFifo(cLen, (uint8_t*)pcPayload);
+}
+
+/** ***************************************************************************
+*   \brief      Count a packet to the peer, right before the TX strobe.
+******************************************************************************/
+void LinkTxStart(void)
+{
+	SLinkStats *pxPeer = LinkPeer(xLinkConfig.cPeerAddress);
+
+	xLinkTxResult = LINK_TX_PENDING;
+	if(pxPeer != NULL)
+		pxPeer->lSent++;
+}
+
+/** ***************************************************************************
+*   \brief      Take back LinkTxStart() for a packet that never got on air,
+*               e.g. given up by CSMA on a busy channel.
+******************************************************************************/
+void LinkTxAbort(void)
+{
+	SLinkStats *pxPeer = LinkPeer(xLinkConfig.cPeerAddress);
+
+	xLinkTxResult = LINK_TX_PENDING;
+	if((pxPeer != NULL) && (pxPeer->lSent > 0))
+		pxPeer->lSent--;
+}
+
+/** ***************************************************************************
+*   \brief      Account for radio interrupts while sending. Called from the
+*               GPIO IRQ handler.
+*   \details    Only the final outcome interrupts the MCU: RX_DATA_READY for
+*               the ack, MAX_RE_TX_REACH when the radio gave up. The
+*               retransmissions in between are read back from TX_PCKT_INFO.
+*   \param      pxIrqStatus     IRQ status read from the radio
+*   \return     outcome, LINK_TX_PENDING if the interrupt was for neither
+******************************************************************************/
+LinkTxResult LinkTxIrq(const S2LPIrqs *pxIrqStatus)
+{
+	SLinkStats *pxPeer;
+	uint8_t cRetx;
+
+	if(xLinkTxResult != LINK_TX_PENDING)
+		return LINK_TX_PENDING;
+
+	if(pxIrqStatus->IRQ_MAX_RE_TX_REACH)
+	{
+		xLinkTxResult = LINK_TX_FAILED;
+		cRetx = xLinkConfig.cMaxRetx;
+	}
+	else if(pxIrqStatus->IRQ_RX_DATA_READY)
+	{
+		xLinkTxResult = LINK_TX_ACKED;
+		cRetx = S2LPPktStackGetNReTx();
+	}
+	else
+	{
+		return LINK_TX_PENDING;
+	}
+
+	pxPeer = LinkPeer(xLinkConfig.cPeerAddress);
+	if(pxPeer != NULL)
+	{
+		if(xLinkTxResult == LINK_TX_ACKED)
+			pxPeer->lAcked++;
+		else
+			pxPeer->lFailed++;
+		pxPeer->lRetx += cRetx;
+		if(cRetx > pxPeer->cRetxMax)
+			pxPeer->cRetxMax = cRetx;
+	}
+
+	return xLinkTxResult;
+}
+
+/** ***************************************************************************
+*   \brief      Outcome of the last packet sent.
+*   \return     LINK_TX_PENDING until LinkTxIrq() saw the ack or the give up
+******************************************************************************/
+LinkTxResult LinkTxGetResult(void)
+{
+	return xLinkTxResult;
+}
+
+/** ***************************************************************************
+*   \brief      Account for a received packet. Called from the GPIO IRQ
+*               handler on RX_DATA_READY.
+*   \details    A packet with the sequence number of the previous one from the
+*               same peer, within the retransmission window of it, is a
+*               retransmission whose ack was lost; the radio acks it again,
+*               the caller should drop it. The 2 bit sequence number wraps
+*               after four packets, so a later match is a new packet.
+*   \param      pxRx     source, sequence number and ack state
+******************************************************************************/
+void LinkRxIrq(SLinkRx *pxRx)
+{
+	SLinkStats *pxPeer;
+	uint8_t cInfo, i;
+
+	S2LPSpiReadRegisters(RX_PCKT_INFO_ADDR, 1, &cInfo);
+	pxRx->cSource = S2LPGetReceivedSourceAddress();
+	pxRx->cSeq = cInfo & RX_SEQ_NUM_REGMASK;
+	pxRx->cAcked = ((xLinkConfig.xAutoAck == S_ENABLE) && !(cInfo & NACK_RX_REGMASK)) ? 1 : 0;
+	pxRx->cDuplicate = 0;
+
+	pxPeer = LinkPeer(pxRx->cSource);
+	if(pxPeer == NULL)
+		return;
+
+	i = (uint8_t)(pxPeer - xLinkPeers);
+	if((pxPeer->lReceived > 0) && (cLinkLastSeq[i] == pxRx->cSeq) &&
+	   ((HAL_GetTick() - lLinkLastMs[i]) <= xLinkConfig.nRetxWindowMs))
+	{
+		pxRx->cDuplicate = 1;
+		pxPeer->lDuplicates++;
+	}
+	else
+	{
+		cLinkLastSeq[i] = pxRx->cSeq;
+		lLinkLastMs[i] = HAL_GetTick();
+	}
+	pxPeer->lReceived++;
+}
+
+/** ***************************************************************************
+*   \brief      Copy out the counters of a peer.
+*   \param      cIndex      peer, in order of first contact
+*   \param      pxStats     destination
+*   \return     1 if there is such a peer
+******************************************************************************/
+uint8_t LinkGetStats(uint8_t cIndex, SLinkStats *pxStats)
+{
+	if(cIndex >= cLinkPeers)
+		return 0;
+
+	*pxStats = xLinkPeers[cIndex];
+
+	return 1;
+}
+
+/** ***************************************************************************
+*   \brief      Counters of a peer, added on first contact.
+*   \param      cAddress     peer address
+*   \return     counters, NULL once LINK_MAX_PEERS are known
+******************************************************************************/
+static SLinkStats *LinkPeer(uint8_t cAddress)
+{
+	uint8_t i;
+
+	for(i = 0; i < cLinkPeers; i++)
+	{
+		if(xLinkPeers[i].cAddress == cAddress)
+			return &xLinkPeers[i];
+	}
+
+	if(cLinkPeers >= LINK_MAX_PEERS)
+		return NULL;
+
+	xLinkPeers[cLinkPeers].cAddress = cAddress;
+
+	return &xLinkPeers[cLinkPeers++];
+}
+
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -0,0 +1,410 @@
+/** ***************************************************************************
+*   \file        mg_NodeTable.c
+*   \brief       Gateway receive state per node. A fixed open addressing
+*                table keyed by node address keeps the report sequence, the
+*                gaps and duplicates, and RSSI and sync quality histograms,
+*                updated from the RX interrupt. Received frames go out as
+*                compact records through a queue drained by a task, so the
+*                UART never holds up reception.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+/*****************************************************************************/
+// standard libraries
+#include <stdio.h>
+#include <string.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "mg_NodeTable.h"
+
+// user headers from other components
+#include "mg_Timestamp.h"
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/**
+* @brief Table slot
+*/
+typedef struct {
+  SNodeStats xStats;            /*!< Counters of the node */
+  uint32_t lSeen;               /*!< Reports received behind the latest one, bit n for n + 1 behind */
+  uint8_t cUsed;                /*!< Slot taken */
+} SNodeEntry;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+#if (NODE_TABLE_SIZE & (NODE_TABLE_SIZE - 1)) || (NODE_QUEUE_RECORDS & (NODE_QUEUE_RECORDS - 1))
+#error "The table and the queue are indexed with a mask"
+#endif
+
+#if NODE_SEQ_WINDOW > 32
+#error "The window of reports received is one word"
+#endif
+
+/* First slot of an address, low and high nibbles folded as node addresses
+   often share one */
+#define NODE_HASH(a)                ((((a) >> 4) ^ (a)) & (NODE_TABLE_SIZE - 1))
+
+/*****************************************************************************/
+// static function declarations
+static SNodeEntry *NodeLookup(uint8_t cAddress);
+static void NodeCount(uint16_t *pnBin);
+
+/*****************************************************************************/
+// static variable declarations
+static SNodeEntry xNodeTable[NODE_TABLE_SIZE];
+static SNodeTableStats xNodeStats;
+static SNodeRecord xNodeQueue[NODE_QUEUE_RECORDS];
+static volatile uint8_t cNodeQueueHead;
+static volatile uint8_t cNodeQueueTail;
+
+/*****************************************************************************/
+// functions
+
+/** ***************************************************************************
+*   \brief      Empty the table and the queue.
+******************************************************************************/
+void NodeTableInit(void)
+{
+	memset(xNodeTable, 0, sizeof(xNodeTable));
+	memset(&xNodeStats, 0, sizeof(xNodeStats));
+	cNodeQueueHead = 0;
+	cNodeQueueTail = 0;
+}
+
+/** ***************************************************************************
+*   \brief      Account a frame received from a node.
+*   \details    Called from the RX interrupt, a few probes at most. Reports
+*               carry a 16 bit sequence number: ahead of the latest one the
+*               reports in between are missed, up to NODE_SEQ_WINDOW behind
+*               it a window of bits tells a duplicate from a late report,
+*               further behind the node restarted.
+*   \param      cAddress       node address
+*   \param      pnSeq          report sequence number, NULL if not a report
+*   \param      cDuplicate     already known as a retransmission by the link
+*   \param      cRssiDbm       RSSI at the sync word
+*   \param      cSyncErrors    sync word bits in error
+*   \param      lNowMs         HAL tick
+*   \param      pnMissed       reports missed just before this one, may be NULL
+*   \return     what the frame was to its node
+******************************************************************************/
+NodeRxResult NodeTableRx(uint8_t cAddress, const uint16_t *pnSeq, uint8_t cDuplicate, int8_t cRssiDbm, uint8_t cSyncErrors, uint32_t lNowMs, uint16_t *pnMissed)
+{
+	SNodeEntry *pxEntry = NodeLookup(cAddress);
+	SNodeStats *pxStats;
+	NodeRxResult xResult;
+	uint16_t nDelta, nMissed = 0;
+	int16_t iBin;
+
+	if(pnMissed != NULL)
+		*pnMissed = 0;
+
+	if(pxEntry == NULL)
+	{
+		xNodeStats.lTableFull++;
+		return NODE_RX_FULL;
+	}
+
+	pxStats = &pxEntry->xStats;
+	pxStats->lFrames++;
+	pxStats->lLastMs = lNowMs;
+	pxStats->cLastRssiDbm = cRssiDbm;
+
+	/* link quality of every frame, duplicates included */
+	iBin = (cRssiDbm - NODE_RSSI_FLOOR_DBM) / NODE_RSSI_STEP_DB;
+	if(iBin < 0)
+		iBin = 0;
+	if(iBin >= NODE_RSSI_BINS)
+		iBin = NODE_RSSI_BINS - 1;
+	NodeCount(&pxStats->nRssiHist[iBin]);
+	NodeCount(&pxStats->nSqiHist[(cSyncErrors < NODE_SQI_BINS) ? cSyncErrors : (NODE_SQI_BINS - 1)]);
+
+	if(pnSeq == NULL)
+	{
+		xResult = cDuplicate ? NODE_RX_DUPLICATE : NODE_RX_OTHER;
+	}
+	else if(pxStats->lReports == 0)
+	{
+		pxStats->nLastSeq = *pnSeq;
+		pxEntry->lSeen = 0;
+		xResult = NODE_RX_NEW;
+	}
+	else
+	{
+		nDelta = (uint16_t)(*pnSeq - pxStats->nLastSeq);
+
+		if((nDelta != 0) && (nDelta < 0x8000))
+		{
+			/* ahead: the latest one moves into the window */
+			nMissed = nDelta - 1;
+			pxEntry->lSeen = (nDelta > NODE_SEQ_WINDOW) ? 0 : ((pxEntry->lSeen << 1) | 1UL) << (nDelta - 1);
+			pxStats->nLastSeq = *pnSeq;
+			xResult = NODE_RX_NEW;
+		}
+		else if(nDelta == 0)
+		{
+			xResult = NODE_RX_DUPLICATE;
+		}
+		else
+		{
+			nDelta = (uint16_t)(pxStats->nLastSeq - *pnSeq);
+			if(nDelta <= NODE_SEQ_WINDOW)
+			{
+				/* behind: counted as missed when its successor came */
+				if(pxEntry->lSeen & (1UL << (nDelta - 1)))
+				{
+					xResult = NODE_RX_DUPLICATE;
+				}
+				else
+				{
+					pxEntry->lSeen |= 1UL << (nDelta - 1);
+					if(pxStats->lMissed > 0)
+						pxStats->lMissed--;
+					xResult = NODE_RX_LATE;
+				}
+			}
+			else
+			{
+				pxStats->nLastSeq = *pnSeq;
+				pxEntry->lSeen = 0;
+				xResult = NODE_RX_RESTART;
+			}
+		}
+	}
+
+	switch(xResult)
+	{
+		case NODE_RX_DUPLICATE:
+			pxStats->lDuplicates++;
+			break;
+		case NODE_RX_LATE:
+			pxStats->lLate++;
+			pxStats->lReports++;
+			break;
+		case NODE_RX_RESTART:
+			pxStats->lRestarts++;
+			pxStats->lReports++;
+			break;
+		case NODE_RX_NEW:
+			pxStats->lMissed += nMissed;
+			pxStats->lReports++;
+			break;
+		default:
+			break;
+	}
+
+	if(pnMissed != NULL)
+		*pnMissed = nMissed;
+
+	return xResult;
+}
+
+/** ***************************************************************************
+*   \brief      Copy the counters of a node.
+*   \details    Taken with interrupts masked, the RX interrupt updates them.
+*   \param      cIndex     table slot, from 0 to NODE_TABLE_SIZE - 1
+*   \param      pxStats    filled with the counters
+*   \return     1 if the slot holds a node, 0 if it is empty or out of range
+******************************************************************************/
+uint8_t NodeTableGet(uint8_t cIndex, SNodeStats *pxStats)
+{
+	uint32_t lPrimask;
+	uint8_t cUsed;
+
+	if(cIndex >= NODE_TABLE_SIZE)
+		return 0;
+
+	lPrimask = __get_PRIMASK();
+	__disable_irq();
+	cUsed = xNodeTable[cIndex].cUsed;
+	if(cUsed)
+		*pxStats = xNodeTable[cIndex].xStats;
+	__set_PRIMASK(lPrimask);
+
+	return cUsed;
+}
+
+/** ***************************************************************************
+*   \brief      Table and queue counters.
+*   \param      pxStats     filled with the counters
+******************************************************************************/
+void NodeTableGetStats(SNodeTableStats *pxStats)
+{
+	uint32_t lPrimask = __get_PRIMASK();
+
+	__disable_irq();
+	*pxStats = xNodeStats;
+	__set_PRIMASK(lPrimask);
+}
+
+/** ***************************************************************************
+*   \brief      Record to fill with a received frame.
+*   \details    Called from the RX interrupt, the only producer. The record
+*               is output once NodeRecordCommit() is called.
+*   \return     free record, NULL if the queue is full, counted as dropped
+******************************************************************************/
+SNodeRecord *NodeRecordSlot(void)
+{
+	if((uint8_t)(cNodeQueueHead - cNodeQueueTail) >= NODE_QUEUE_RECORDS)
+	{
+		xNodeStats.lQueueFull++;
+		return NULL;
+	}
+
+	return &xNodeQueue[cNodeQueueHead & (NODE_QUEUE_RECORDS - 1)];
+}
+
+/** ***************************************************************************
+*   \brief      Queue the record given by NodeRecordSlot().
+******************************************************************************/
+void NodeRecordCommit(void)
+{
+	uint8_t cDepth;
+
+	cNodeQueueHead++;
+	xNodeStats.lQueued++;
+
+	cDepth = (uint8_t)(cNodeQueueHead - cNodeQueueTail);
+	if(cDepth > xNodeStats.cQueueMax)
+		xNodeStats.cQueueMax = cDepth;
+}
+
+/** ***************************************************************************
+*   \brief      Oldest record waiting.
+*   \details    The task side, the only consumer. The record stays valid
+*               until NodeRecordRelease().
+*   \return     oldest record, NULL if the queue is empty
+******************************************************************************/
+const SNodeRecord *NodeRecordPeek(void)
+{
+	if(cNodeQueueHead == cNodeQueueTail)
+		return NULL;
+
+	return &xNodeQueue[cNodeQueueTail & (NODE_QUEUE_RECORDS - 1)];
+}
+
+/** ***************************************************************************
+*   \brief      Free the record given by NodeRecordPeek().
+******************************************************************************/
+void NodeRecordRelease(void)
+{
+	if(cNodeQueueHead != cNodeQueueTail)
+		cNodeQueueTail++;
+}
+
+/** ***************************************************************************
+*   \brief      One line of text of a record.
+*   \details    Comma separated for a host to parse, each line first a tag:
+*               line 0 of a report is R (or O when late, S after a restart)
+*               with the node, sequence number, reading count, RSSI, sync
+*               bits in error and the reports missed before it; then one V
+*               line per reading with the node, timestamp in s, lux and
+*               reason. Frames other than reports give a single X line with
+*               the node, length, RSSI and sync bits in error.
+*   \param      pxRecord     record
+*   \param      cLine        line, from 0
+*   \param      pcText       filled with the line, starting with a line break
+*   \param      nSize        size of pcText
+*   \return     line length, 0 past the last line
+******************************************************************************/
+int NodeRecordFormat(const SNodeRecord *pxRecord, uint8_t cLine, char *pcText, uint16_t nSize)
+{
+	SAggHeader xHeader;
+	SAggReading xReading;
+	int iLen;
+
+	if(AggParse(pxRecord->cFrame, pxRecord->cLen, &xHeader) != HAL_OK)
+	{
+		if(cLine > 0)
+			return 0;
+
+		iLen = snprintf(pcText, nSize, "\r\nX,%02X,%u,%d,%u",
+		                (unsigned)pxRecord->cSource, (unsigned)pxRecord->cLen,
+		                (int)pxRecord->cRssiDbm, (unsigned)pxRecord->cSyncErrors);
+	}
+	else if(cLine == 0)
+	{
+		iLen = snprintf(pcText, nSize, "\r\n%c,%02X,%u,%u,%d,%u,%u",
+		                (pxRecord->xResult == NODE_RX_LATE) ? 'O' : ((pxRecord->xResult == NODE_RX_RESTART) ? 'S' : 'R'),
+		                (unsigned)pxRecord->cSource, (unsigned)xHeader.nSeq, (unsigned)xHeader.cCount,
+		                (int)pxRecord->cRssiDbm, (unsigned)pxRecord->cSyncErrors, (unsigned)pxRecord->nMissed);
+	}
+	else if(AggGetReading(pxRecord->cFrame, pxRecord->cLen, cLine - 1, &xReading) == HAL_OK)
+	{
+		iLen = snprintf(pcText, nSize, "\r\nV,%02X,%lu.%02lu,%lu,%u",
+		                (unsigned)pxRecord->cSource,
+		                (unsigned long)(xReading.lTimestamp >> TIMESTAMP_FRAC_BITS),
+		                (unsigned long)(TimestampToMs(xReading.lTimestamp & (TIMESTAMP_ONE_S - 1)) / 10),
+		                (unsigned long)xReading.lLux, (unsigned)xReading.cReason);
+	}
+	else
+	{
+		return 0;
+	}
+
+	return ((iLen < 0) || (iLen >= nSize)) ? 0 : iLen;
+}
+
+/** ***************************************************************************
+*   \brief      Slot of a node, taken on its first frame.
+*   \details    Linear probing from its hash; nodes are never removed, so
+*               the first empty slot ends the search.
+*   \param      cAddress     node address
+*   \return     slot, NULL if the node is new and the table full
+******************************************************************************/
+static SNodeEntry *NodeLookup(uint8_t cAddress)
+{
+	uint8_t cSlot = NODE_HASH(cAddress);
+	uint8_t i;
+
+	for(i = 0; i < NODE_TABLE_SIZE; i++)
+	{
+		SNodeEntry *pxEntry = &xNodeTable[cSlot];
+
+		if(!pxEntry->cUsed)
+		{
+			pxEntry->cUsed = 1;
+			pxEntry->xStats.cAddress = cAddress;
+			xNodeStats.cNodes++;
+			return pxEntry;
+		}
+		if(pxEntry->xStats.cAddress == cAddress)
+			return pxEntry;
+
+		cSlot = (cSlot + 1) & (NODE_TABLE_SIZE - 1);
+	}
+
+	return NULL;
+}
+
+/** ***************************************************************************
+*   \brief      Count in a histogram bin, saturating.
+*   \param      pnBin     bin
+******************************************************************************/
+static void NodeCount(uint16_t *pnBin)
+{
+	if(*pnBin < 0xFFFF)
+		(*pnBin)++;
+}
+
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
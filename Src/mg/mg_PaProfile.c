@@ -0,0 +1,174 @@
+/** ***************************************************************************
+*   \file        mg_PaProfile.c
+*   \brief       S2LP PA profile. Programs the eight PA_POWER slots and the
+*                ramping mode once, so that changing the output power only
+*                rewrites the slot index in PA_POWER0.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+/*****************************************************************************/
+// standard libraries
+
+// user headers directly related to this component, ensures no dependency
+#include "mg_PaProfile.h"
+
+// user headers from other components
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* PA_LEVEL code: 1 is +14 dBm, each step 0.5 dB lower, as in S2LPRadioSetPALeveldBm() */
+#define PA_PROFILE_MAX_DBM          14.0f
+#define PA_PROFILE_STEP_DB          0.5f
+#define PA_PROFILE_MAX_CODE         0x7F
+
+/* PA_CONFIG1 FIR_CFG value selecting ramping */
+#define PA_PROFILE_FIR_RAMPING      0x04
+
+/*****************************************************************************/
+// static function declarations
+static uint8_t PaProfileCode(float fDbm);
+
+/*****************************************************************************/
+// static variable declarations
+static float fPaProfileDbm[PA_PROFILE_SLOTS];
+static uint8_t cPaProfilePower0;              // PA_POWER0 as written, the index bits aside
+
+/*****************************************************************************/
+// functions
+
+/** ***************************************************************************
+*   \brief      Program the slots and ramping, and select a slot.
+*   \details    The eight levels go out in one burst, PA_POWER8 holding slot 7
+*               down to PA_POWER1 for slot 0. PA_POWER0 is read once here and
+*               kept, so PaProfileSelect() needs no read-back. The maximum
+*               power override is cleared as it bypasses the slots. Called
+*               with the rest of the radio configuration.
+*   \param      pxProfile     profile, levels ascending
+*   \param      fDbm          output power to transmit with, see PaProfileIndexFor()
+*   \return     slot selected
+******************************************************************************/
+uint8_t PaProfileApply(const SPaProfile *pxProfile, float fDbm)
+{
+	uint8_t cCodes[PA_PROFILE_SLOTS];
+	uint8_t cConfig1, cIndex, i;
+
+	for(i = 0; i < PA_PROFILE_SLOTS; i++)
+	{
+		fPaProfileDbm[i] = pxProfile->fLevelDbm[i];
+		cCodes[PA_PROFILE_SLOTS - 1 - i] = PaProfileCode(pxProfile->fLevelDbm[i]);
+	}
+	S2LPSpiWriteRegisters(PA_POWER8_ADDR, PA_PROFILE_SLOTS, cCodes);
+
+	switch(pxProfile->xRamp)
+	{
+		case PA_RAMP_AUTO:
+			S2LPRadioSetManualRampingMode(S_DISABLE);
+			S2LPRadioSetAutoRampingMode(S_ENABLE);
+			S2LPSpiReadRegisters(PA_CONFIG1_ADDR, 1, &cConfig1);
+			cConfig1 = (cConfig1 & ~FIR_CFG_REGMASK) | PA_PROFILE_FIR_RAMPING;
+			S2LPSpiWriteRegisters(PA_CONFIG1_ADDR, 1, &cConfig1);
+			break;
+
+		case PA_RAMP_MANUAL:
+			S2LPRadioSetAutoRampingMode(S_DISABLE);
+			S2LPRadioSetManualRampingMode(S_ENABLE);
+			break;
+
+		default:
+			S2LPRadioSetAutoRampingMode(S_DISABLE);
+			S2LPRadioSetManualRampingMode(S_DISABLE);
+			break;
+	}
+
+	S2LPSpiReadRegisters(PA_POWER0_ADDR, 1, &cPaProfilePower0);
+	cPaProfilePower0 &= ~(PA_MAXDBM_REGMASK | PA_RAMP_STEP_LEN_REGMASK | PA_LEVEL_MAX_IDX_REGMASK);
+	cPaProfilePower0 |= (uint8_t)((pxProfile->cStepLen << 3) & PA_RAMP_STEP_LEN_REGMASK);
+
+	cIndex = PaProfileIndexFor(fDbm);
+	PaProfileSelect(cIndex);
+
+	return cIndex;
+}
+
+/** ***************************************************************************
+*   \brief      Transmit with another slot, a single register write.
+*   \details    Must not be called while transmitting, nor in SHUTDOWN.
+*   \param      cIndex     slot, 0 to 7
+******************************************************************************/
+void PaProfileSelect(uint8_t cIndex)
+{
+	uint8_t cPower0 = cPaProfilePower0 | (cIndex & PA_LEVEL_MAX_IDX_REGMASK);
+
+	S2LPSpiWriteRegisters(PA_POWER0_ADDR, 1, &cPower0);
+}
+
+/** ***************************************************************************
+*   \brief      Lowest slot giving at least the requested power.
+*   \param      fDbm     requested output power
+*   \return     slot, the highest one if none reaches the request
+******************************************************************************/
+uint8_t PaProfileIndexFor(float fDbm)
+{
+	uint8_t i;
+
+	for(i = 0; i < PA_PROFILE_SLOTS - 1; i++)
+	{
+		if(fPaProfileDbm[i] >= fDbm)
+			break;
+	}
+
+	return i;
+}
+
+/** ***************************************************************************
+*   \brief      Output power of a slot.
+*   \param      cIndex     slot, 0 to 7
+*   \return     dBm
+******************************************************************************/
+float PaProfileLevel(uint8_t cIndex)
+{
+	return fPaProfileDbm[cIndex & PA_LEVEL_MAX_IDX_REGMASK];
+}
+
+/** ***************************************************************************
+*   \brief      PA_LEVEL code of an output power.
+*   \param      fDbm     output power
+*   \return     register code
+******************************************************************************/
+static uint8_t PaProfileCode(float fDbm)
+{
+	float fCode;
+
+	if(fDbm > PA_PROFILE_MAX_DBM - PA_PROFILE_STEP_DB)
+		return 1;
+
+	fCode = (PA_PROFILE_MAX_DBM - fDbm) / PA_PROFILE_STEP_DB + 1.0f;
+	if(fCode > PA_PROFILE_MAX_CODE)
+		return PA_PROFILE_MAX_CODE;
+
+	return (uint8_t)fCode;
+}
+
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
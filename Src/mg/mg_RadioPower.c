@@ -0,0 +1,503 @@
+/** ***************************************************************************
+*   \file        mg_RadioPower.c
+*   \brief       S2LP power state manager. Parks the radio in SHUTDOWN, SLEEP
+*                or STANDBY between transmissions, whichever costs the least
+*                charge over the expected idle time including the wake-up.
+*                SHUTDOWN is left through a warm restore of a captured
+*                register image and VCO calibration.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+/*****************************************************************************/
+// standard libraries
+#include <string.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "mg_RadioPower.h"
+#include "main.h"
+
+// user headers from other components
+#include "mg_S2lpMcuInterface.h"
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/**
+* @brief Contiguous block of configuration registers
+*/
+typedef struct {
+  uint8_t cAddr;                /*!< First register */
+  uint8_t cCount;               /*!< Number of registers */
+} SRadioPowerBlock;
+
+/*****************************************************************************/
+// constants
+
+/**
+* @brief Leakage per state, nA
+*/
+static const uint32_t lRadioPowerLeakNa[RADIO_PS_NB_STATES] = {
+  RADIO_PS_I_READY_NA,
+  RADIO_PS_I_SLEEP_NA,
+  RADIO_PS_I_STANDBY_NA,
+  RADIO_PS_I_SHUTDOWN_NA
+};
+
+/**
+* @brief Configuration registers kept in the image, GPIO0_CONF to PM_CONF0.
+*        Reserved addresses are skipped, they hold analog trimming.
+*        PA_CONFIG0 (0x64), missing from the register header, follows
+*        PA_CONFIG1: S2LPRadioInit() sets its PA filter from the data rate.
+*/
+static const SRadioPowerBlock xRadioPowerBlocks[] = {
+  {GPIO0_CONF_ADDR,       11},  // GPIO, clock output, synthesiser, IF
+  {CH_SPACE_ADDR,         13},  // channel, modulation, filter, AFC, RSSI
+  {ANT_SELECT_CONF_ADDR,  3},   // antenna switch, clock recovery
+  {PCKTCTRL6_ADDR,        42},  // packet, sync, protocol, FIFO, filters, timers, CSMA, IRQ masks
+  {PA_POWER8_ADDR,        11},  // PA level table, PA_CONFIG1 and PA_CONFIG0
+  {SYNTH_CONFIG2_ADDR,    1},
+  {VCO_CONFIG_ADDR,       8},   // VCO, XO and RCO configuration
+  {PM_CONF4_ADDR,         5}    // SMPS and battery level detector
+};
+
+/*****************************************************************************/
+// macros
+
+/* Sum of the block lengths */
+#define RADIO_PS_IMAGE_SIZE         94
+
+/*****************************************************************************/
+// static function declarations
+static void RadioPowerAccount(RadioPowerState xNext);
+static uint32_t RadioPowerLatencyUs(RadioPowerState xState);
+static HAL_StatusTypeDef RadioPowerReady(void);
+static void RadioPowerCapture(void);
+static void RadioPowerRestore(void);
+static uint32_t RadioPowerMicros(void);
+
+/*****************************************************************************/
+// static variable declarations
+static RadioPowerConfigFn pfRadioPowerConfig;
+static RadioPowerState xRadioPowerState;
+static SRadioPowerStats xRadioPowerStats;
+static uint32_t lRadioPowerStateMs;           // HAL tick when the current state was entered
+
+static uint8_t cRadioPowerImage[RADIO_PS_IMAGE_SIZE];
+static uint8_t cRadioPowerImageValid;
+
+static uint8_t cRadioPowerVcoAmp;             // TX calibration words from the last calibrating TX
+static uint8_t cRadioPowerVcoFreq;
+static uint8_t cRadioPowerVcoValid;
+static uint8_t cRadioPowerVcoForced;          // words forced on the current wake-up
+static uint8_t cRadioPowerVcoUses;
+
+static RadioPowerState xRadioPowerWokeFrom;   // state left by the last wake-up, until its TX
+static uint32_t lRadioPowerWakeUs;
+
+/*****************************************************************************/
+// functions
+
+/** ***************************************************************************
+*   \brief      Initialise the manager, the radio must be configured and READY.
+*   \param      pfConfig     full radio configuration, called after SHUTDOWN
+*                            when no valid register image is held
+******************************************************************************/
+void RadioPowerInit(RadioPowerConfigFn pfConfig)
+{
+	pfRadioPowerConfig = pfConfig;
+	xRadioPowerState = RADIO_PS_READY;
+	xRadioPowerWokeFrom = RADIO_PS_READY;
+	cRadioPowerImageValid = 0;
+	cRadioPowerVcoValid = 0;
+	cRadioPowerVcoForced = 0;
+
+	memset(&xRadioPowerStats, 0, sizeof(xRadioPowerStats));
+	xRadioPowerStats.lPorUs = RADIO_PS_POR_US;
+	xRadioPowerStats.lColdUs = RADIO_PS_COLD_US;
+	xRadioPowerStats.lWarmUs = RADIO_PS_WARM_US;
+	lRadioPowerStateMs = HAL_GetTick();
+}
+
+/** ***************************************************************************
+*   \brief      Park the radio until the next transmission.
+*   \details    The idle period is the larger of the caller's bound and the
+*               learned average. Each state costs its leakage over the period
+*               plus the wake-up current over its latency; the cheapest state
+*               that can wake up in time is entered. With the default figures
+*               STANDBY wins for idle periods of a few seconds and SHUTDOWN
+*               beyond that, sooner once the warm restore has been measured.
+*               SLEEP only pays off when the FIFO content must survive,
+*               SLEEP_B is then used.
+*               The register image is captured before SHUTDOWN if the
+*               configuration changed since the last capture. The GPIO IRQ line
+*               floats in SHUTDOWN, so its EXTI is masked.
+*   \param      lMinIdleMs      shortest time before the radio is needed again
+*   \param      xRetainFifo     S_ENABLE to keep the FIFO content
+*   \return     state entered
+******************************************************************************/
+RadioPowerState RadioPowerIdle(uint32_t lMinIdleMs, SFunctionalState xRetainFifo)
+{
+	RadioPowerState xBest = RADIO_PS_READY;
+	uint64_t llBestQ = UINT64_MAX;
+	uint64_t llIdleUs, llQ;
+	uint32_t lLatencyUs;
+
+	if(xRadioPowerState != RADIO_PS_READY)
+		return xRadioPowerState;
+
+	llIdleUs = 1000ULL * ((lMinIdleMs > xRadioPowerStats.lIdleAvgMs) ? lMinIdleMs : xRadioPowerStats.lIdleAvgMs);
+
+	for(uint8_t i = RADIO_PS_READY; i < RADIO_PS_NB_STATES; i++)
+	{
+		if((xRetainFifo == S_ENABLE) && (i != RADIO_PS_READY) && (i != RADIO_PS_SLEEP))
+			continue;
+
+		lLatencyUs = RadioPowerLatencyUs((RadioPowerState)i);
+		if(lLatencyUs > llIdleUs)
+			continue;
+
+		/* nA.us */
+		llQ = (uint64_t)lRadioPowerLeakNa[i] * (llIdleUs - lLatencyUs) + (uint64_t)RADIO_PS_I_WAKE_NA * lLatencyUs;
+		if(llQ < llBestQ)
+		{
+			llBestQ = llQ;
+			xBest = (RadioPowerState)i;
+		}
+	}
+
+	RadioPowerAccount(xBest);
+	xRadioPowerStats.lEntries[xBest]++;
+
+	switch(xBest)
+	{
+		case RADIO_PS_SLEEP:
+			S2LPTimerSleepB(xRetainFifo);
+			S2LPCmdStrobeSleep();
+			break;
+
+		case RADIO_PS_STANDBY:
+			S2LPCmdStrobeStandby();
+			break;
+
+		case RADIO_PS_SHUTDOWN:
+			if(!cRadioPowerImageValid)
+				RadioPowerCapture();
+			HAL_NVIC_DisableIRQ(INT_S2LP_GPIO3_EXTI_IRQn);
+			S2LPEnterShutdown();
+			break;
+
+		default:
+			break;
+	}
+
+	return xBest;
+}
+
+/** ***************************************************************************
+*   \brief      Bring the radio back to READY.
+*   \details    From SLEEP and STANDBY the configuration is intact and only the
+*               XO has to start. From SHUTDOWN the end of the power-on reset is
+*               awaited, then the register image is written back in a few SPI
+*               bursts, or the full configuration is applied if no image is
+*               held. The VCO calibration words of an earlier TX are forced so
+*               the next TX skips its calibration, up to RADIO_PS_VCO_REUSE
+*               times in a row to follow temperature drift. The measured times
+*               feed back into the SHUTDOWN latency.
+*   \return     HAL_OK, or HAL_TIMEOUT if READY was not reached
+******************************************************************************/
+HAL_StatusTypeDef RadioPowerWake(void)
+{
+	RadioPowerState xFrom = xRadioPowerState;
+	uint32_t lIdleMs, lStartUs;
+
+	if(xFrom == RADIO_PS_READY)
+		return HAL_OK;
+
+	lRadioPowerWakeUs = RadioPowerMicros();
+	xRadioPowerWokeFrom = xFrom;
+
+	lIdleMs = HAL_GetTick() - lRadioPowerStateMs;
+	xRadioPowerStats.lIdleAvgMs += ((int32_t)(lIdleMs - xRadioPowerStats.lIdleAvgMs)) >> RADIO_PS_IDLE_SHIFT;
+	RadioPowerAccount(RADIO_PS_READY);
+
+	if(xFrom != RADIO_PS_SHUTDOWN)
+		return RadioPowerReady();
+
+	S2LPExitShutdown();
+	RadioPowerWaitPor();
+
+	lStartUs = RadioPowerMicros();
+	xRadioPowerStats.lPorUs = lStartUs - lRadioPowerWakeUs;
+
+	if(cRadioPowerImageValid)
+	{
+		RadioPowerRestore();
+
+		cRadioPowerVcoForced = cRadioPowerVcoValid && (cRadioPowerVcoUses < RADIO_PS_VCO_REUSE);
+		if(cRadioPowerVcoForced)
+		{
+			S2LPRadioSetTxCalibVcoAmpWord(cRadioPowerVcoAmp);
+			S2LPRadioSetTxCalibVcoFreqWord(cRadioPowerVcoFreq);
+			S2LPRadioCalibrationVco(S_ENABLE, S_ENABLE);
+			cRadioPowerVcoUses++;
+			xRadioPowerStats.lVcoSkips++;
+		}
+		else
+		{
+			S2LPRadioCalibrationVco(S_DISABLE, S_DISABLE);
+		}
+
+		S2LPGpioIrqClearStatus();
+		xRadioPowerStats.lWarmUs = RadioPowerMicros() - lStartUs;
+		xRadioPowerStats.lWarmRestores++;
+	}
+	else
+	{
+		if(pfRadioPowerConfig != NULL)
+			pfRadioPowerConfig();
+		cRadioPowerVcoForced = 0;
+		xRadioPowerStats.lColdUs = RadioPowerMicros() - lStartUs;
+		xRadioPowerStats.lColdConfigs++;
+	}
+
+	/* edges seen while the line floated */
+	__HAL_GPIO_EXTI_CLEAR_IT(INT_S2LP_GPIO3_Pin);
+	HAL_NVIC_ClearPendingIRQ(INT_S2LP_GPIO3_EXTI_IRQn);
+	HAL_NVIC_EnableIRQ(INT_S2LP_GPIO3_EXTI_IRQn);
+
+	return RadioPowerReady();
+}
+
+/** ***************************************************************************
+*   \brief      Wait for the end of the power-on reset after SDN release.
+*   \details    The radio is ready for SPI access once IRQ_POR is raised and
+*               the state machine reports READY. Requiring both rejects a MISO
+*               line stuck at either level while the digital supply ramps.
+*   \return     HAL_OK, or HAL_TIMEOUT after RADIO_PS_POR_TIMEOUT_MS
+******************************************************************************/
+HAL_StatusTypeDef RadioPowerWaitPor(void)
+{
+	S2LPIrqs xIrq;
+	uint32_t lStartMs = HAL_GetTick();
+
+	do
+	{
+		S2LPGpioIrqGetStatus(&xIrq);
+		if(xIrq.IRQ_POR && (g_xStatus.MC_STATE == MC_STATE_READY))
+			return HAL_OK;
+	} while((HAL_GetTick() - lStartMs) < RADIO_PS_POR_TIMEOUT_MS);
+
+	return HAL_TIMEOUT;
+}
+
+/** ***************************************************************************
+*   \brief      Note a change to the radio configuration.
+*   \details    The register image is captured again before the next SHUTDOWN.
+*               Changes made while in SHUTDOWN are not written to the radio,
+*               the full configuration is then applied on wake-up instead.
+******************************************************************************/
+void RadioPowerConfigChanged(void)
+{
+	cRadioPowerImageValid = 0;
+}
+
+/** ***************************************************************************
+*   \brief      Note the TX strobe, for the wake-up to TX time.
+******************************************************************************/
+void RadioPowerTxStart(void)
+{
+	if(xRadioPowerWokeFrom == RADIO_PS_READY)
+		return;
+
+	xRadioPowerStats.lWakeToTxUs[xRadioPowerWokeFrom] = RadioPowerMicros() - lRadioPowerWakeUs;
+	xRadioPowerWokeFrom = RADIO_PS_READY;
+}
+
+/** ***************************************************************************
+*   \brief      Note the end of a transmission.
+*   \details    When the VCO was calibrated for this TX, its result words are
+*               kept for the following warm restores.
+******************************************************************************/
+void RadioPowerTxDone(void)
+{
+	uint8_t tmp[2];
+
+	if(cRadioPowerVcoForced)
+		return;
+
+	S2LPSpiReadRegisters(VCO_CALIBR_OUT1_ADDR, 2, tmp);
+	cRadioPowerVcoAmp = tmp[0] & VCO_CAL_AMP_OUT_REGMASK;
+	cRadioPowerVcoFreq = tmp[1] & VCO_CALFREQ_TX_REGMASK;
+	cRadioPowerVcoValid = 1;
+	cRadioPowerVcoUses = 0;
+}
+
+/** ***************************************************************************
+*   \brief      Note the start of a reception.
+*   \details    Forced VCO words are those of the TX frequency, the automatic
+*               calibration is turned back on for RX and the following TX.
+******************************************************************************/
+void RadioPowerRxStart(void)
+{
+	if(!cRadioPowerVcoForced)
+		return;
+
+	S2LPRadioCalibrationVco(S_DISABLE, S_DISABLE);
+	cRadioPowerVcoForced = 0;
+}
+
+/** ***************************************************************************
+*   \brief      Note a change of carrier frequency, e.g. a channel hop.
+*   \details    The kept VCO words belong to the previous frequency. The
+*               automatic calibration is turned back on and the words are
+*               captured again on the next TX.
+******************************************************************************/
+void RadioPowerRetuned(void)
+{
+	RadioPowerRxStart();
+	cRadioPowerVcoValid = 0;
+}
+
+/** ***************************************************************************
+*   \brief      Current radio power state.
+*   \details    Radio registers must not be written while in SHUTDOWN, see
+*               RadioPowerConfigChanged().
+*   \return     state
+******************************************************************************/
+RadioPowerState RadioPowerGetState(void)
+{
+	return xRadioPowerState;
+}
+
+/** ***************************************************************************
+*   \brief      Copy out the state accounting, including the current period.
+*   \param      pxStats     destination
+******************************************************************************/
+void RadioPowerGetStats(SRadioPowerStats *pxStats)
+{
+	*pxStats = xRadioPowerStats;
+	pxStats->lStateMs[xRadioPowerState] += HAL_GetTick() - lRadioPowerStateMs;
+}
+
+/** ***************************************************************************
+*   \brief      Close the time accounting of the current state.
+*   \param      xNext     state being entered
+******************************************************************************/
+static void RadioPowerAccount(RadioPowerState xNext)
+{
+	uint32_t lNowMs = HAL_GetTick();
+
+	xRadioPowerStats.lStateMs[xRadioPowerState] += lNowMs - lRadioPowerStateMs;
+	lRadioPowerStateMs = lNowMs;
+	xRadioPowerState = xNext;
+}
+
+/** ***************************************************************************
+*   \brief      Time from a state back to READY.
+*   \param      xState     power state
+*   \return     latency, us
+******************************************************************************/
+static uint32_t RadioPowerLatencyUs(RadioPowerState xState)
+{
+	switch(xState)
+	{
+		case RADIO_PS_SLEEP:
+			return RADIO_PS_WAKE_SLEEP_US;
+
+		case RADIO_PS_STANDBY:
+			return RADIO_PS_WAKE_STANDBY_US;
+
+		case RADIO_PS_SHUTDOWN:
+			return xRadioPowerStats.lPorUs
+			     + (cRadioPowerImageValid ? xRadioPowerStats.lWarmUs : xRadioPowerStats.lColdUs);
+
+		default:
+			return 0;
+	}
+}
+
+/** ***************************************************************************
+*   \brief      Strobe READY and wait for the state machine to get there.
+*   \return     HAL_OK, or HAL_TIMEOUT
+******************************************************************************/
+static HAL_StatusTypeDef RadioPowerReady(void)
+{
+	S2LPCmdStrobeReady();
+
+	for(uint8_t i = 0; i < RADIO_PS_READY_POLLS; i++)
+	{
+		S2LPRefreshStatus();
+		if(g_xStatus.MC_STATE == MC_STATE_READY)
+			return HAL_OK;
+	}
+
+	return HAL_TIMEOUT;
+}
+
+/** ***************************************************************************
+*   \brief      Read the configuration registers into the image.
+******************************************************************************/
+static void RadioPowerCapture(void)
+{
+	uint8_t *pcImage = cRadioPowerImage;
+
+	for(uint8_t i = 0; i < sizeof(xRadioPowerBlocks) / sizeof(xRadioPowerBlocks[0]); i++)
+	{
+		S2LPSpiReadRegisters(xRadioPowerBlocks[i].cAddr, xRadioPowerBlocks[i].cCount, pcImage);
+		pcImage += xRadioPowerBlocks[i].cCount;
+	}
+
+	cRadioPowerImageValid = 1;
+}
+
+/** ***************************************************************************
+*   \brief      Write the image back, one SPI burst per block.
+*   \details    The digital clock divider in XO_RCO_CONF0 is restored with the
+*               value S2LPRadioInit() left, which is its POR value for the
+*               crystal in use, so no STANDBY round trip is needed.
+******************************************************************************/
+static void RadioPowerRestore(void)
+{
+	uint8_t *pcImage = cRadioPowerImage;
+
+	for(uint8_t i = 0; i < sizeof(xRadioPowerBlocks) / sizeof(xRadioPowerBlocks[0]); i++)
+	{
+		S2LPSpiWriteRegisters(xRadioPowerBlocks[i].cAddr, xRadioPowerBlocks[i].cCount, pcImage);
+		pcImage += xRadioPowerBlocks[i].cCount;
+	}
+}
+
+/** ***************************************************************************
+*   \brief      Microsecond time from the HAL tick and the SysTick counter.
+*   \details    Only differences are meaningful, they wrap after 71 minutes.
+*   \return     time, us
+******************************************************************************/
+static uint32_t RadioPowerMicros(void)
+{
+	uint32_t lMs, lVal;
+
+	do
+	{
+		lMs = HAL_GetTick();
+		lVal = SysTick->VAL;
+	} while(lMs != HAL_GetTick());
+
+	return (lMs * 1000UL) + ((SysTick->LOAD - lVal) * 1000UL) / (SysTick->LOAD + 1);
+}
+
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -0,0 +1,231 @@
+/** ***************************************************************************
+*   \file        mg_RadioProfile.c
+*   \brief       S2LP board power profiles. Reference clock, digital divider
+*                and SMPS voltage and switching frequency applied as one
+*                preset with the rest of the radio configuration.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+/*****************************************************************************/
+// standard libraries
+
+// user headers directly related to this component, ensures no dependency
+#include "mg_RadioProfile.h"
+
+// user headers from other components
+#include "stm32l0xx_hal.h"
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* SMPS switching frequency with the rate multiplier, FSW = KRM * FOSC / 2^15 */
+#define RADIO_PROFILE_KRM_SHIFT     15
+#define RADIO_PROFILE_KRM_MAX       0x7FFF
+
+/* Status polls for READY after a benchmark step */
+#define RADIO_PROFILE_READY_POLLS   20
+
+/*****************************************************************************/
+// static function declarations
+static uint16_t RadioProfileKrm(uint32_t lSmpsHz, uint16_t nDefault);
+static void RadioProfileReady(void);
+
+/*****************************************************************************/
+// static variable declarations
+static uint32_t lRadioProfileXtalHz = 50000000;   // library default
+static uint16_t nRadioProfileKrmTx = RADIO_SMPS_KRM_TX;
+static uint16_t nRadioProfileKrmRx = RADIO_SMPS_KRM_RX;
+static uint8_t cRadioProfileSmpsOwn;              // switching frequencies set by the profile
+
+/*****************************************************************************/
+// functions
+
+/** ***************************************************************************
+*   \brief      Apply a profile, before S2LPRadioInit().
+*   \details    The reference frequency is given to the library, whose
+*               S2LPRadioInit() then sets the digital divider from it and
+*               computes the data rate, deviation and filter words with the
+*               divided clock. The divider therefore follows the crystal and
+*               is not set here. The SMPS voltage is written at once; the
+*               switching frequencies are written by RadioProfileCommand() on
+*               each TX and RX strobe, as the library strobe macros overwrite
+*               PM_CONF3 with their own value.
+*   \param      pxProfile     profile matching the board fitting
+******************************************************************************/
+void RadioProfileApply(const SRadioProfile *pxProfile)
+{
+	uint8_t tmp;
+
+	lRadioProfileXtalHz = pxProfile->lXtalHz;
+	S2LPRadioSetXtalFrequency(pxProfile->lXtalHz);
+	S2LPGeneralSetExtRef(pxProfile->xRef);
+	S2LPRadioSetExternalSmpsMode(pxProfile->xExtSmps);
+
+	S2LPSpiReadRegisters(PM_CONF0_ADDR, 1, &tmp);
+	tmp = (tmp & ~SET_SMPS_LVL_REGMASK) | (uint8_t)((pxProfile->xSmpsLevel << 4) & SET_SMPS_LVL_REGMASK);
+	S2LPSpiWriteRegisters(PM_CONF0_ADDR, 1, &tmp);
+
+	/* both words are written once either direction differs, the strobe macros
+	   only set the upper byte */
+	nRadioProfileKrmTx = RadioProfileKrm(pxProfile->lSmpsTxHz, RADIO_SMPS_KRM_TX);
+	nRadioProfileKrmRx = RadioProfileKrm(pxProfile->lSmpsRxHz, RADIO_SMPS_KRM_RX);
+	cRadioProfileSmpsOwn = ((pxProfile->lSmpsTxHz != 0) || (pxProfile->lSmpsRxHz != 0)) ? 1 : 0;
+}
+
+/** ***************************************************************************
+*   \brief      Set the SMPS switching frequency for a command strobe.
+*   \details    Called by S2LPSpiCommandStrobes() before the strobe is sent,
+*               after the PM_CONF3 write of S2LPCmdStrobeTx() or
+*               S2LPCmdStrobeRx(). Nothing is written with the library
+*               frequencies.
+*   \param      cCommand     command about to be strobed
+******************************************************************************/
+void RadioProfileCommand(uint8_t cCommand)
+{
+	uint8_t cKrm[2];
+	uint16_t nKrm;
+
+	if(!cRadioProfileSmpsOwn)
+		return;
+
+	if(cCommand == CMD_TX)
+		nKrm = nRadioProfileKrmTx;
+	else if(cCommand == CMD_RX)
+		nKrm = nRadioProfileKrmRx;
+	else
+		return;
+
+	/* PM_CONF3 then PM_CONF2 */
+	cKrm[0] = KRM_EN_REGMASK | (uint8_t)((nKrm >> 8) & KRM_14_8_REGMASK);
+	cKrm[1] = (uint8_t)nKrm;
+	S2LPSpiWriteRegisters(PM_CONF3_ADDR, 2, cKrm);
+}
+
+/** ***************************************************************************
+*   \brief      SMPS switching frequency in use for TX or RX.
+*   \param      cCommand     CMD_TX or CMD_RX
+*   \return     Hz
+******************************************************************************/
+uint32_t RadioProfileSmpsHz(uint8_t cCommand)
+{
+	uint16_t nKrm = (cCommand == CMD_TX) ? nRadioProfileKrmTx : nRadioProfileKrmRx;
+
+	return (uint32_t)(((uint64_t)nKrm * lRadioProfileXtalHz) >> RADIO_PROFILE_KRM_SHIFT);
+}
+
+/** ***************************************************************************
+*   \brief      Digital domain divider state.
+*   \return     1 if the digital domain runs at half the reference frequency
+******************************************************************************/
+uint8_t RadioProfileDigDiv(void)
+{
+	return (lRadioProfileXtalHz > DIG_DOMAIN_XTAL_THRESH) ? 1 : 0;
+}
+
+/** ***************************************************************************
+*   \brief      Hold the radio in TX or RX for a current measurement.
+*   \details    The current is read externally on the supply, the caller
+*               marks the steps on the UART. TX sends a PN9 sequence without
+*               packet handling, RX listens without timeout. All radio IRQs
+*               are masked, the configuration must be re-applied afterwards.
+*               The radio must be READY and is left READY.
+*   \param      xMode        TX or RX
+*   \param      lDwellMs     time held in the state
+******************************************************************************/
+void RadioProfileBench(RadioBenchMode xMode, uint32_t lDwellMs)
+{
+	S2LPGpioIrqDeInit(NULL);
+	S2LPGpioIrqClearStatus();
+
+	if(xMode == RADIO_BENCH_TX)
+	{
+		S2LPPacketHandlerSetTxMode(PN9_TX_MODE);
+		S2LPCmdStrobeTx();
+	}
+	else
+	{
+		S2LPTimerSetRxTimerCounter(0);
+		S2LPCmdStrobeRx();
+	}
+
+	HAL_Delay(lDwellMs);
+
+	RadioProfileReady();
+
+	if(xMode == RADIO_BENCH_TX)
+		S2LPPacketHandlerSetTxMode(NORMAL_TX_MODE);
+	S2LPGpioIrqClearStatus();
+}
+
+/** ***************************************************************************
+*   \brief      Air time of a frame, to turn a measured current into charge
+*               per packet.
+*   \param      lDatarate     bit/s
+*   \param      nBits         preamble, sync, header, payload and CRC bits
+*   \return     us
+******************************************************************************/
+uint32_t RadioProfileAirTimeUs(uint32_t lDatarate, uint16_t nBits)
+{
+	return (uint32_t)(((uint64_t)nBits * 1000000UL + lDatarate / 2) / lDatarate);
+}
+
+/** ***************************************************************************
+*   \brief      Rate multiplier word of a switching frequency.
+*   \param      lSmpsHz      switching frequency, 0 for the library default
+*   \param      nDefault     library word
+*   \return     KRM
+******************************************************************************/
+static uint16_t RadioProfileKrm(uint32_t lSmpsHz, uint16_t nDefault)
+{
+	uint64_t llKrm;
+
+	if(lSmpsHz == 0)
+		return nDefault;
+
+	llKrm = (((uint64_t)lSmpsHz << RADIO_PROFILE_KRM_SHIFT) + lRadioProfileXtalHz / 2) / lRadioProfileXtalHz;
+	if(llKrm == 0)
+		llKrm = 1;
+	if(llKrm > RADIO_PROFILE_KRM_MAX)
+		llKrm = RADIO_PROFILE_KRM_MAX;
+
+	return (uint16_t)llKrm;
+}
+
+/** ***************************************************************************
+*   \brief      Bring the radio to READY from TX or RX.
+******************************************************************************/
+static void RadioProfileReady(void)
+{
+	S2LPCmdStrobeSabort();
+	S2LPCmdStrobeReady();
+
+	for(uint8_t i = 0; i < RADIO_PROFILE_READY_POLLS; i++)
+	{
+		S2LPRefreshStatus();
+		if(g_xStatus.MC_STATE == MC_STATE_READY)
+			break;
+	}
+}
+
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -0,0 +1,275 @@
+/** ***************************************************************************
+*   \file        mg_Rbe.c
+*   \brief       Report-by-exception engine. Filters the light readings and
+*                decides when a change is worth a radio transmission.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+/*****************************************************************************/
+// standard libraries
+#include <string.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "mg_Rbe.h"
+
+// user headers from other components
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* Fractional bits kept in the filter state */
+#define RBE_FILTER_FRAC_BITS        4
+
+/*****************************************************************************/
+// static function declarations
+static uint8_t RbeRegion(uint32_t lLux, uint8_t cPrevRegion);
+static void RbeDayRollover(uint32_t lNowMs);
+
+/*****************************************************************************/
+// static variable declarations
+static SRbeConfig xRbeConfig;
+static SRbeStats xRbeStats;
+
+static int32_t lFilterState;          // filtered value, RBE_FILTER_FRAC_BITS fractional bits
+static uint8_t cFilterPrimed;
+static uint32_t lLastReported;
+static uint32_t lLastReportMs;
+static uint8_t cLastRegion;
+static uint32_t lDayStartMs;
+
+/*****************************************************************************/
+// functions
+
+/** ***************************************************************************
+*   \brief      Initialise the engine.
+*   \param      pxConfig     configuration, copied by the engine
+******************************************************************************/
+void RbeInit(const SRbeConfig *pxConfig)
+{
+	xRbeConfig = *pxConfig;
+	memset(&xRbeStats, 0, sizeof(xRbeStats));
+	cFilterPrimed = 0;
+	lFilterState = 0;
+	lLastReported = 0;
+	lLastReportMs = 0;
+	cLastRegion = 0;
+	lDayStartMs = 0;
+}
+
+/** ***************************************************************************
+*   \brief      Feed a reading and decide whether it must be reported.
+*   \details    The reading goes through an integer EMA filter. The filtered
+*               value is reported when it leaves the deadband around the last
+*               report (the larger of the absolute and relative bands), when
+*               it moves to another threshold region, or when the heartbeat
+*               interval elapses. Nothing is reported within lMinIntervalMs of
+*               the previous report. A non-RBE_NONE result means the caller
+*               must transmit RbeGetFiltered().
+*   \param      lLux       new reading in lux
+*   \param      lNowMs     current time in ms
+*   \return     reason for reporting, RBE_NONE if the reading is suppressed
+******************************************************************************/
+RbeReason RbeProcess(uint32_t lLux, uint32_t lNowMs)
+{
+	RbeReason xReason = RBE_NONE;
+	uint32_t lFiltered, lDelta, lBand, lRelBand;
+	uint8_t cRegion;
+
+	RbeDayRollover(lNowMs);
+	xRbeStats.lSamplesToday++;
+
+	/* EMA filter, alpha = 1/2^shift */
+	if(!cFilterPrimed)
+	{
+		lFilterState = (int32_t)(lLux << RBE_FILTER_FRAC_BITS);
+	}
+	else
+	{
+		lFilterState += (((int32_t)(lLux << RBE_FILTER_FRAC_BITS)) - lFilterState) >> xRbeConfig.cFilterShift;
+	}
+	lFiltered = (uint32_t)(lFilterState + (1 << (RBE_FILTER_FRAC_BITS - 1))) >> RBE_FILTER_FRAC_BITS;
+
+	cRegion = RbeRegion(lFiltered, cLastRegion);
+
+	if(!cFilterPrimed)
+	{
+		cFilterPrimed = 1;
+		xReason = RBE_FIRST;
+	}
+	else if((lNowMs - lLastReportMs) < xRbeConfig.lMinIntervalMs)
+	{
+		xReason = RBE_NONE;
+	}
+	else
+	{
+		lDelta = (lFiltered > lLastReported) ? (lFiltered - lLastReported) : (lLastReported - lFiltered);
+		lRelBand = (lLastReported * xRbeConfig.nRelDeadbandPermille) / 1000;
+		lBand = (xRbeConfig.lAbsDeadband > lRelBand) ? xRbeConfig.lAbsDeadband : lRelBand;
+
+		if(cRegion != cLastRegion)
+			xReason = RBE_THRESHOLD;
+		else if((lBand != 0) && (lDelta > lBand))
+			xReason = RBE_DEADBAND;
+		else if((xRbeConfig.lHeartbeatMs != 0) && ((lNowMs - lLastReportMs) >= xRbeConfig.lHeartbeatMs))
+			xReason = RBE_HEARTBEAT;
+	}
+
+	xRbeStats.lReasons[xReason]++;
+
+	if(xReason != RBE_NONE)
+	{
+		lLastReported = lFiltered;
+		lLastReportMs = lNowMs;
+		cLastRegion = cRegion;
+	}
+
+	return xReason;
+}
+
+/** ***************************************************************************
+*   \brief      Current filtered value.
+*   \return     filtered reading in lux
+******************************************************************************/
+uint32_t RbeGetFiltered(void)
+{
+	return (uint32_t)(lFilterState + (1 << (RBE_FILTER_FRAC_BITS - 1))) >> RBE_FILTER_FRAC_BITS;
+}
+
+/** ***************************************************************************
+*   \brief      Range of values that would not trigger a deadband or threshold
+*               report.
+*   \details    The deadband around the last report, narrowed so that it never
+*               straddles a threshold. Used to arm hardware change detection.
+*   \param      plLow      lowest value inside the window, lux
+*   \param      plHigh     highest value inside the window, lux
+******************************************************************************/
+void RbeGetWindow(uint32_t *plLow, uint32_t *plHigh)
+{
+	uint32_t lRelBand = (lLastReported * xRbeConfig.nRelDeadbandPermille) / 1000;
+	uint32_t lBand = (xRbeConfig.lAbsDeadband > lRelBand) ? xRbeConfig.lAbsDeadband : lRelBand;
+	uint32_t lLow, lHigh;
+
+	lLow = (lLastReported > lBand) ? (lLastReported - lBand) : 0;
+	lHigh = lLastReported + lBand;
+
+	if(xRbeConfig.plThresholds != NULL)
+	{
+		if((cLastRegion > 0) &&
+		   (lLow + xRbeConfig.lThresholdHyst < xRbeConfig.plThresholds[cLastRegion - 1]))
+		{
+			lLow = xRbeConfig.plThresholds[cLastRegion - 1] - xRbeConfig.lThresholdHyst;
+		}
+		if((cLastRegion < xRbeConfig.cNbThresholds) &&
+		   (lHigh >= xRbeConfig.plThresholds[cLastRegion] + xRbeConfig.lThresholdHyst))
+		{
+			lHigh = xRbeConfig.plThresholds[cLastRegion] + xRbeConfig.lThresholdHyst - 1;
+		}
+	}
+
+	*plLow = lLow;
+	*plHigh = lHigh;
+}
+
+/** ***************************************************************************
+*   \brief      Change the reporting intervals at run time.
+*   \details    Used to stretch the reporting when energy is scarce. The
+*               deadbands and thresholds are unchanged.
+*   \param      lMinIntervalMs     minimum time between two reports
+*   \param      lHeartbeatMs       maximum time between two reports
+******************************************************************************/
+void RbeSetIntervals(uint32_t lMinIntervalMs, uint32_t lHeartbeatMs)
+{
+	xRbeConfig.lMinIntervalMs = lMinIntervalMs;
+	xRbeConfig.lHeartbeatMs = lHeartbeatMs;
+}
+
+/** ***************************************************************************
+*   \brief      Account for a completed transmission.
+*   \param      lRadioOnMs     time the radio spent transmitting, ms
+******************************************************************************/
+void RbeLogTx(uint32_t lRadioOnMs)
+{
+	xRbeStats.lTxToday++;
+	xRbeStats.lTxTotal++;
+	xRbeStats.lRadioOnMsToday += lRadioOnMs;
+	xRbeStats.lRadioOnMsTotal += lRadioOnMs;
+}
+
+/** ***************************************************************************
+*   \brief      Copy out the engine statistics.
+*   \param      pxStats     destination
+******************************************************************************/
+void RbeGetStats(SRbeStats *pxStats)
+{
+	*pxStats = xRbeStats;
+}
+
+/** ***************************************************************************
+*   \brief      Threshold region of a value, with hysteresis.
+*   \details    Region n means n thresholds lie below the value. A region is
+*               only left once the value passes the threshold by more than the
+*               configured hysteresis.
+*   \param      lLux            filtered value
+*   \param      cPrevRegion     region of the last report
+*   \return     new region
+******************************************************************************/
+static uint8_t RbeRegion(uint32_t lLux, uint8_t cPrevRegion)
+{
+	uint8_t cRegion = cPrevRegion;
+
+	if(xRbeConfig.plThresholds == NULL)
+		return 0;
+
+	while((cRegion < xRbeConfig.cNbThresholds) &&
+	      (lLux >= xRbeConfig.plThresholds[cRegion] + xRbeConfig.lThresholdHyst))
+	{
+		cRegion++;
+	}
+	while((cRegion > 0) &&
+	      (lLux + xRbeConfig.lThresholdHyst < xRbeConfig.plThresholds[cRegion - 1]))
+	{
+		cRegion--;
+	}
+
+	return cRegion;
+}
+
+/** ***************************************************************************
+*   \brief      Move the daily counters to "yesterday" once a day has elapsed.
+*   \param      lNowMs     current time in ms
+******************************************************************************/
+static void RbeDayRollover(uint32_t lNowMs)
+{
+	if((lNowMs - lDayStartMs) >= RBE_DAY_MS)
+	{
+		xRbeStats.lTxYesterday = xRbeStats.lTxToday;
+		xRbeStats.lRadioOnMsYesterday = xRbeStats.lRadioOnMsToday;
+		xRbeStats.lTxToday = 0;
+		xRbeStats.lRadioOnMsToday = 0;
+		xRbeStats.lSamplesToday = 0;
+		lDayStartMs += RBE_DAY_MS;
+	}
+}
+
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -17,6 +17,8 @@
 #include "main.h"
    
 // user headers from other components
+#include "mg_Energy.h"
+#include "mg_RadioProfile.h"
   
 /*****************************************************************************/
 // enumerations
@@ -100,12 +102,14 @@ void S2LPEnterShutdown(void)
 {
 	/* Set high the GPIO connected to shutdown pin */
   HAL_GPIO_WritePin(nS2LP_EN_GPIO_Port, nS2LP_EN_Pin, GPIO_PIN_SET);
+	EnergyRadioSet(ENERGY_RADIO_SHUTDOWN);
 }
 
 void S2LPExitShutdown(void)
 {
 	/* Set low the GPIO connected to shutdown pin */
   HAL_GPIO_WritePin(nS2LP_EN_GPIO_Port, nS2LP_EN_Pin, GPIO_PIN_RESET);
+	EnergyRadioSet(ENERGY_RADIO_READY);
 }
 
 GPIO_PinState S2LPCheckShutdown(void)
@@ -212,6 +216,9 @@ StatusBytes S2LPSpiReadRegisters(uint8_t cRegAddress, uint8_t cNbBytes, uint8_t
 */
 StatusBytes S2LPSpiCommandStrobes(uint8_t cCommandCode)
 {
+	/* SMPS switching frequency of the board profile, over the strobe macro's */
+	RadioProfileCommand(cCommandCode);
+	
 	tx_buff[0]=COMMAND_HEADER;
   tx_buff[1]=cCommandCode;
   
@@ -230,6 +237,9 @@ StatusBytes S2LPSpiCommandStrobes(uint8_t cCommandCode)
   S2LP_CS_HIGH();
   SPI_EXIT_CRITICAL();
   
+	/* on-time accounting follows the radio state */
+	EnergyRadioCommand(cCommandCode);
+  
   ((uint8_t*)&status)[1]=rx_buff[0];
   ((uint8_t*)&status)[0]=rx_buff[1];
   
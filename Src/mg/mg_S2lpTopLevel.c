@@ -10,6 +10,9 @@
  
 /*****************************************************************************/
 // standard libraries
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
  
 // user headers directly related to this component, ensures no dependency
 #include "mg_S2lpTopLevel.h"
@@ -17,6 +20,29 @@
 #include "S2LP_Config.h"
    
 // user headers from other components
+#include "mg_LightSensor.h"
+#include "mg_Rbe.h"
+#include "mg_Flicker.h"
+#include "mg_AdcCal.h"
+#include "mg_AwdWake.h"
+#include "mg_Supply.h"
+#include "mg_Scheduler.h"
+#include "mg_LdcRx.h"
+#include "mg_RadioPower.h"
+#include "mg_ClockGov.h"
+#include "mg_Timestamp.h"
+#include "mg_Energy.h"
+#include "mg_Tpc.h"
+#include "mg_PaProfile.h"
+#include "mg_RadioProfile.h"
+#include "mg_Aggregate.h"
+#include "mg_Link.h"
+#include "mg_Csma.h"
+#include "mg_ChanPlan.h"
+#include "mg_Tdma.h"
+#include "mg_Adr.h"
+#include "mg_WMbus.h"
+#include "mg_NodeTable.h"
   
 /*****************************************************************************/
 // enumerations
@@ -28,6 +54,26 @@ S2LPIrqs xIrqStatus;
   
 /*****************************************************************************/
 // structures
+
+/**
+* @brief Modem settings stepped through by the radio benchmark
+*/
+typedef struct {
+  uint32_t lDatarate;           /*!< bit/s */
+  uint32_t lFreqDev;            /*!< Hz */
+  uint32_t lBandwidth;          /*!< Channel filter, Hz */
+} SRadioBenchRate;
+
+/**
+* @brief Node whose hops the gateway follows in its TDMA slot
+*/
+typedef struct {
+  uint8_t cAddress;             /*!< Node address */
+  uint8_t cUsed;                /*!< Entry in use */
+  uint8_t cProfile;             /*!< Profile announced by its last report */
+  uint16_t nMask;               /*!< Channels announced by the last ack sent to it */
+  uint32_t lRxMs;               /*!< HAL tick of its last acked frame */
+} SChanFollow;
   
 /*****************************************************************************/
 // constants
@@ -45,25 +91,302 @@ S2LPIrqs xIrqStatus;
 #define BANDWIDTH                   100E3
 #define POWER_DBM                   12.0
 
+/*  Radio board power profile. The reference and external SMPS settings
+    follow the board fitting, the rest is chosen with the benchmark  */
+#define RADIO_XTAL_HZ               50000000
+#define RADIO_REF                   MODE_EXT_XO // MODE_EXT_XIN on boards fitted with a TCXO
+#define RADIO_EXT_SMPS              S_DISABLE   // S_ENABLE on boards supplying the core from outside
+#define RADIO_PROFILE               0           // entry of xRadioProfiles used
+#define RADIO_BENCH                 0           // step through profiles and data rates at boot, for a current measurement
+#define RADIO_BENCH_DWELL_MS        3000        // time held in TX and in RX per step
 
+/*  Low duty cycle reception. The Tx preamble must then outlast the Rx
+    wake-up period so that a sniff window always falls inside it  */
+#define LDC_MODE                    1
+#define LDC_PERIOD_MS               40.0
+#define LDC_WINDOW_MS               2.0
+#define LDC_PQI_LEVEL               2           // 8 preamble bit pairs keep the receiver on
+#define LDC_REPORT_MS               60000       // statistics print interval
+#define LDC_SWEEP                   1           // step through nLdcWindowsUs to measure detection
+#define LDC_SWEEP_PACKETS           50          // packets sent per window step
+
+/*  Gateway output: one record per report as it is received, the table of
+    nodes every RX_REPORT_MS. Any number of nodes up to NODE_TABLE_SIZE is
+    tracked, with CHAN_HOPPING each in its TDMA slot; hopping without
+    TDMA_MODE follows LINK_NODE_ADDRESS only  */
+#define RX_REPORT_MS                60000
 
 /*  Packet configuration parameters  */
 #define PREAMBLE_BYTE(v)        (4*v)
 #define SYNC_BYTE(v)            (8*v)
 
+#if LDC_MODE
+#define PREAMBLE_LENGTH             PREAMBLE_BYTE(200)  // 41.7 ms at 38.4 kbps
+#else
 #define PREAMBLE_LENGTH             PREAMBLE_BYTE(4)
+#endif
 #define SYNC_LENGTH                 SYNC_BYTE(4)
 #define SYNC_WORD                   0x88888888
 #define VARIABLE_LENGTH             S_ENABLE
 #define EXTENDED_LENGTH_FIELD       S_DISABLE
 #define CRC_MODE                    PKT_CRC_MODE_8BITS
 #define EN_ADDRESS                  S_DISABLE
-#define EN_FEC                      S_DISABLE
+#define EN_FEC                      ((FEC_MODE && !ADR_MODE) ? S_ENABLE : S_DISABLE)
 #define EN_WHITENING                S_ENABLE
 
+/* reliable link, acks and retransmissions done by the radio */
+#define LINK_RELIABLE               1
+#define LINK_NODE_ADDRESS           0x10
+#define LINK_GATEWAY_ADDRESS        0x01
+#define LINK_RETX                   3           // retransmissions before a report counts as not delivered
+#define LINK_RETX_WINDOW_MS         ((LINK_RETX + 1) * (PACKET_MS(LINK_SLOW_BITRATE) + (uint32_t)TPC_FEEDBACK_WINDOW_MS))
+
+/* listen before talk, busy channel retried later */
+#define CSMA_MODE                   1
+#define CSMA_RSSI_THRESH_DBM        (-90.0)
+#define CSMA_CCA_PERIOD             CSMA_PERIOD_64TBIT  // 1.7 ms at 38.4 kbps
+#define CSMA_CCA_LENGTH             3                   // listen 5 ms, longer than a back-off unit gap
+#define CSMA_MAX_BACKOFFS           5
+#define CSMA_BU_PRESCALER           32
+#define CSMA_RESCHEDULE_MS          250
+#define CSMA_MAX_RESCHEDULES        4
+
+/*  Channel hopping from the base frequency, the home channel, upwards.
+    The plan spans several sub-bands, each with its own duty cycle limit.
+    With TDMA_MODE the hop epoch is the frame number of the beacons and
+    the gateway tunes each slot to the hop of its node, so every node is
+    followed. Without it the epoch is the report sequence and the gateway
+    moves to the next report's channel once the retransmissions and the
+    energy frame of the last one are over, CHAN_SETTLE_MS; it then follows
+    LINK_NODE_ADDRESS only, others being heard when they share its channel  */
+#define CHAN_HOPPING                1
+#define CHAN_SPACING_HZ             200000
+#define CHAN_COUNT                  8
+#define CHAN_BLACKLIST_DBM          (-100)
+#define CHAN_TASK_MS                250         // without TDMA_MODE, else every slot
+#define CHAN_SETTLE_MS              1000
+#define CHAN_RESYNC_MS              (2 * AGG_DEADLINE_MS)   // both ends back to the home channel after this silence
+#define CHAN_SURVEY_MS              600000                  // idle RSSI survey interval
+#define CHAN_SURVEY_DWELL_MS        2
+
+#if CHAN_HOPPING && !LINK_RELIABLE
+#error "Channel hopping follows the acks of the reliable link"
+#endif
+
+#if CHAN_HOPPING
+#define CHAN_ACK_BYTES              CHAN_MASK_BYTES
+#else
+#define CHAN_ACK_BYTES              0
+#endif
+
+/*  Adaptive data rate among modem profiles, slowest first. The node
+    announces after each report the fastest profile its margin at full
+    power allows, both ends move to it with the next hop and fall back to
+    the slowest one when the link goes silent. With LDC the preamble keeps
+    its duration for the sniff period, so only the payload gets shorter
+    and the fast profile is capped by the preamble field  */
+#define ADR_MODE                    1
+#define ADR_MARGIN_DB               15          // above sensitivity at full power, the TPC target with it
+#define ADR_HYST_DB                 3
+#define ADR_SLOW_DATARATE           9600
+#if LDC_MODE
+#define ADR_FAST_DATARATE           48000       // 1000 preamble bit pairs in 41.7 ms
+#define ADR_FAST_FREQ_DEVIATION     24000
+#define ADR_FAST_BANDWIDTH          120000
+#define ADR_FAST_SENSITIVITY_DBM    (-109)
+#else
+#define ADR_FAST_DATARATE           100000
+#define ADR_FAST_FREQ_DEVIATION     50000
+#define ADR_FAST_BANDWIDTH          250000
+#define ADR_FAST_SENSITIVITY_DBM    (-105)
+#endif
+
+#if ADR_MODE && !CHAN_HOPPING
+#error "The profile changes with the channel hopping retune"
+#endif
+
+#if ADR_MODE && RADIO_BENCH
+#error "The radio benchmark steps the modem settings itself"
+#endif
+
+#if ADR_MODE
+#define ADR_REPORT_BYTES            ADR_TRAILER_BYTES
+#define LINK_SLOW_DATARATE          ADR_SLOW_DATARATE   // beacons, fallback and slot sizing
+#else
+#define ADR_REPORT_BYTES            0
+#define LINK_SLOW_DATARATE          DATARATE
+#endif
+
+/*  Forward error correction by the radio: everything after the sync word
+    is rate 1/2 convolutional coded, interleaved and Viterbi decoded, a few
+    dB of link budget for twice the payload air time. With ADR it is a
+    long range profile below the slowest one, the fallback of every node,
+    else the whole link is coded. The benchmark alternates the coded and
+    the uncoded slow profile report by report, for the packet error rate
+    and the TX charge per delivered byte of each  */
+#define FEC_MODE                    1
+#define FEC_GAIN_DB                 3
+#define FEC_BENCH                   0
+
+#if FEC_BENCH && !(FEC_MODE && ADR_MODE)
+#error "The benchmark compares the coded and uncoded profiles of the data rate selection"
+#endif
+
+#if FEC_MODE
+#define LINK_SLOW_BITRATE           (LINK_SLOW_DATARATE / 2)    // after the sync word
+#else
+#define LINK_SLOW_BITRATE           LINK_SLOW_DATARATE
+#endif
+
+/*  Time slotted uplink. The gateway beacons its time on the home channel
+    at each frame start, the node reports once per frame in the slot of its
+    address and only listens to the beacons it needs to keep its guard in
+    bounds. A slot holds a report with all its retransmissions; with the
+    long LDC preamble that makes about 130 slots a minute, a shorter
+    preamble or a longer frame fits several hundred  */
+#define TDMA_MODE                   1
+#define TDMA_FRAME_MS               AGG_DEADLINE_MS     // one report per frame, a reading waits at most a frame
+#define TDMA_GUARD_MIN_MS           12                  // timestamp resolution and beacon latency
+#define TDMA_GUARD_MAX_MS           40
+#define TDMA_DRIFT_PPM              50                  // until measured, LSE crystal over temperature
+#define TDMA_ACCESS_MS              40                  // CSMA listening and back-offs
+#define TDMA_SLOT_MS                (2 * TDMA_GUARD_MAX_MS + TDMA_ACCESS_MS + LINK_RETX_WINDOW_MS)
+#define TDMA_WAKE_MS                10                  // radio wake-up ahead of a beacon window
+#define TDMA_JITTER_MS              10                  // beacon sent late by the gateway scheduler
+#define TDMA_ROUND_MS               4                   // a timestamp step, tasks run after the time they wait for
+#define TDMA_SCAN_MS                (TDMA_FRAME_MS + 1000)
+#define TDMA_SCAN_RETRY_MS          600000              // unsynchronised, doubled up to TDMA_SCAN_RETRY_MAX_MS
+#define TDMA_SCAN_RETRY_MAX_MS      3600000
+#define TDMA_BEACON_TIMEOUT_MS      50
+
+#if TDMA_MODE
+#define TX_SCHEDULED()              TdmaIsSynced()
+#define TDMA_LISTENING()            cTdmaListening
+#else
+#define TX_SCHEDULED()              0
+#define TDMA_LISTENING()            0
+#endif
+
+/*  Wireless M-Bus reports, for meter collectors to take the readings
+    directly in place of the gateway. The radio codes and frames them, the
+    telegrams are one way: no ack, no link quality answer, the transmit
+    power stays where it starts and the energy counters stay local  */
+#define WMBUS_MODE                  0
+#define WMBUS_TX_MODE               WMBUS_C1                    // WMBUS_T1 for collectors only listening to T mode
+#define WMBUS_MANUFACTURER          WMBUS_FLAG('M', 'G', 'L')   // FLAG association code of the maker
+#define WMBUS_ID                    0x00000010                  // BCD, on the node label
+#define WMBUS_VERSION               0x01
+#define WMBUS_PREAMBLE              4                           // bit pairs beyond the minimum
+#define WMBUS_POSTAMBLE             2
+
+#if WMBUS_MODE && defined(RX)
+#error "Wireless M-Bus reports go to a collector, not to the gateway"
+#endif
+
+#if WMBUS_MODE && (LINK_RELIABLE || TDMA_MODE || RADIO_BENCH)
+#error "Wireless M-Bus reports are neither acked nor slotted, and keep their modem"
+#endif
+
+#if LINK_RELIABLE
+#define LINK_OVERHEAD_BITS          (8 * LINK_HEADER_BYTES)
+#else
+#define LINK_OVERHEAD_BITS          0
+#endif
+
+/* Air time of a packet beyond its payload: preamble and sync, length and CRC */
+#define PACKET_OVERHEAD_BITS        ((2 * PREAMBLE_LENGTH) + SYNC_LENGTH + 8 + 8 + LINK_OVERHEAD_BITS)
+
+/* Beacon air time, sent with the short answer preamble, coded after the sync word */
+#define TDMA_BEACON_HEADER_BITS     ((2 * PREAMBLE_BYTE(TPC_FEEDBACK_PREAMBLE_BYTES)) + SYNC_LENGTH)
+#define TDMA_BEACON_BITS            (TDMA_BEACON_HEADER_BITS + 8 + 8 + LINK_OVERHEAD_BITS + 8 * TDMA_BEACON_BYTES)
+#define TDMA_BEACON_US              ((TDMA_BEACON_HEADER_BITS * 1000000UL) / LINK_SLOW_DATARATE \
+                                     + ((TDMA_BEACON_BITS - TDMA_BEACON_HEADER_BITS) * 1000000UL) / LINK_SLOW_BITRATE)
+
+/*  Report-by-exception parameters  */
+#define SAMPLE_PERIOD_MS            500
+#define RBE_FILTER_SHIFT            2           // alpha = 1/4
+#define RBE_ABS_DEADBAND_LUX        20
+#define RBE_REL_DEADBAND_PERMILLE   100         // 10 %
+#define RBE_THRESHOLD_HYST_LUX      5
+#define RBE_MIN_INTERVAL_MS         2000
+#define RBE_HEARTBEAT_MS            (15UL*60UL*1000UL)
+
+/*  Reading aggregation parameters  */
+#define AGG_BUDGET_BYTES            56          // 8 readings per report
+#define AGG_DEADLINE_MS             60000       // longest a reading is held back
+#if WMBUS_MODE
+#define AGG_READINGS_MAX            WMBUS_READINGS_MAX  // all in one telegram
+#else
+#define AGG_READINGS_MAX            0                   // the byte budget only
+#endif
+
+/* Air time of the largest report */
+#define PACKET_BITS                 (PACKET_OVERHEAD_BITS + 8 * AGG_BUDGET_BYTES)
+
+/* Largest report at another data rate, the preamble keeping its duration */
+#define PACKET_MS(rate)             ((2UL * PREAMBLE_LENGTH * 1000UL) / DATARATE + ((PACKET_BITS - 2UL * PREAMBLE_LENGTH) * 1000UL) / (rate) + 1)
+
+/*  Flicker rejection parameters  */
+#define FLICKER_DETECT_EVERY        120         // full detection burst every N samples (1 min)
+#define FLICKER_REPORT              1           // print flicker amplitude/frequency with the statistics
+
+/*  Wake-on-light-change parameters  */
+#define AWD_WAKE_MODE               1           // sleep on the ADC analog watchdog instead of polling
+
+/*  Supply monitoring parameters  */
+#define SUPPLY_CHECK_MS             60000       // idle VDD and ADC drift check interval
+#define SUPPLY_BLD_THRESHOLD        SUPPLY_BLD_2V3
   
 /*****************************************************************************/
 // static function declarations
+static void RadioConfigure(void);
+#if RADIO_BENCH
+static void RadioBench(void);
+#endif
+#if defined(RX) && LDC_MODE
+static void LdcTask(void);
+#endif
+#ifdef RX
+static void RxQuality(int8_t *pcRssiDbm, uint8_t *pcSyncErrors);
+static void TpcAnswer(uint16_t nSeq, int8_t cRssiDbm, uint8_t cSyncErrors);
+static void RxTask(void);
+#if CHAN_HOPPING
+static void ChanTask(void);
+#if TDMA_MODE
+static SChanFollow *ChanFollow(uint8_t cAddress);
+#endif
+#endif
+#if LINK_RELIABLE
+static void AckReload(void);
+#endif
+#if TDMA_MODE
+static void TdmaBeaconTask(void);
+#endif
+#endif
+#ifndef RX
+static void LightTask(void);
+static uint32_t RadioSend(uint8_t *pcPayload, uint8_t cLen);
+#if !LINK_RELIABLE && !WMBUS_MODE
+static uint32_t TpcListen(uint16_t nSeq);
+#endif
+static void TpcApply(void);
+static void SupplyPolicyApply(SupplyLevel xLevel);
+static void TxBuild(AggFlushReason xFlush);
+static void TxLinkSelect(void);
+static void TxReport(void);
+static uint32_t TxEnergy(void);
+#if CSMA_MODE || TDMA_MODE
+static void TxPendingTask(void);
+#endif
+#if CSMA_MODE
+static uint32_t TxReschedule(void);
+#endif
+#if TDMA_MODE
+static void TdmaTask(void);
+static void TdmaRxStart(uint32_t lWindowMs);
+static uint8_t TdmaRxEnd(void);
+#endif
+#endif
   
 /*****************************************************************************/
 // static variable declarations
@@ -80,6 +403,47 @@ SRadioInit xRadioInit = {
   BANDWIDTH
 };
 
+#if LINK_RELIABLE
+/**
+* @brief Packet STack structure fitting
+*/
+PktStackInit xStackInit={
+  PREAMBLE_LENGTH,
+  SYNC_LENGTH,
+  SYNC_WORD,
+  VARIABLE_LENGTH,
+  EXTENDED_LENGTH_FIELD,
+  CRC_MODE,
+  EN_FEC,
+  EN_WHITENING
+};
+
+/**
+* @brief Link roles: the node asks for acks, the gateway sends them with the
+*        link quality answer piggybacked
+*/
+#ifndef RX
+static const SLinkConfig xLinkConfig = {
+  LINK_NODE_ADDRESS,
+  LINK_GATEWAY_ADDRESS,
+  LINK_RETX,
+  S_ENABLE,
+  S_DISABLE,
+  S_DISABLE,
+  LINK_RETX_WINDOW_MS
+};
+#else
+static const SLinkConfig xLinkConfig = {
+  LINK_GATEWAY_ADDRESS,
+  LINK_NODE_ADDRESS,
+  0,
+  S_DISABLE,
+  S_ENABLE,
+  S_ENABLE,
+  LINK_RETX_WINDOW_MS
+};
+#endif
+#else
 /**
 * @brief Packet Basic structure fitting
 */
@@ -94,6 +458,7 @@ PktBasicInit xBasicInit={
   EN_FEC,
   EN_WHITENING
 };
+#endif
 
 /**
 * @brief GPIO structure fitting
@@ -104,6 +469,163 @@ SGpioInit xGpioIRQ={
   S2LP_GPIO_DIG_OUT_IRQ
 };
 
+/**
+* @brief PA slots, dBm. The supply grade ceilings are slot levels so that
+*        rounding a power request up to a slot never exceeds them
+*/
+static const SPaProfile xPaProfile = {
+  {-9.0, -6.0, -3.0, 0.0, 3.0, 7.0, 10.0, POWER_DBM},
+  PA_RAMP_MANUAL,
+  0
+};
+
+/**
+* @brief Board power profiles. A lower SMPS voltage must still let the
+*        highest PA slot reach its level, check it on the bench
+*/
+static const SRadioProfile xRadioProfiles[] = {
+  {RADIO_XTAL_HZ, RADIO_REF, RADIO_EXT_SMPS, RADIO_SMPS_1V5, 0, 0},              // reset values
+  {RADIO_XTAL_HZ, RADIO_REF, RADIO_EXT_SMPS, RADIO_SMPS_1V2, 0, 0},              // lower core voltage
+  {RADIO_XTAL_HZ, RADIO_REF, RADIO_EXT_SMPS, RADIO_SMPS_1V2, 3000000, 3000000}   // and lower switching losses
+};
+
+/**
+* @brief Power profile applied by RadioConfigure()
+*/
+static uint8_t cRadioProfile = RADIO_PROFILE;
+
+#if CHAN_HOPPING
+/**
+* @brief Channel plan, the home channel on the base frequency
+*/
+static const SChanPlanConfig xChanPlanConfig = {
+  (uint32_t)BASE_FREQUENCY,
+  CHAN_SPACING_HZ,
+  CHAN_COUNT,
+  CHAN_BLACKLIST_DBM
+};
+#endif
+
+#if ADR_MODE
+/**
+* @brief Modem profiles, slowest first, with the sensitivity of each
+*/
+static const SAdrProfile xAdrProfiles[] = {
+#if FEC_MODE
+  {ADR_SLOW_DATARATE, MOD_2FSK,          10000,                   50000,              -117 - FEC_GAIN_DB,       S_ENABLE},
+#endif
+  {ADR_SLOW_DATARATE, MOD_2FSK,          10000,                   50000,              -117,                     S_DISABLE},
+  {DATARATE,          MODULATION_SELECT, FREQ_DEVIATION,          BANDWIDTH,          -110,                     S_DISABLE},
+  {ADR_FAST_DATARATE, MOD_2FSK,          ADR_FAST_FREQ_DEVIATION, ADR_FAST_BANDWIDTH, ADR_FAST_SENSITIVITY_DBM, S_DISABLE}
+};
+
+/**
+* @brief Data rate selection. The node's preamble keeps the duration the
+*        receiver sniffs for, the gateway keeps its short one
+*/
+static const SAdrConfig xAdrConfig = {
+  xAdrProfiles,
+  sizeof(xAdrProfiles)/sizeof(xAdrProfiles[0]),
+  (uint32_t)BASE_FREQUENCY,
+#ifdef RX
+  0,
+#else
+  (2UL * PREAMBLE_LENGTH * 1000000UL) / DATARATE,
+#endif
+  PACKET_OVERHEAD_BITS - 2 * PREAMBLE_LENGTH,
+  ADR_MARGIN_DB,
+  ADR_HYST_DB,
+  SYNC_LENGTH
+};
+#endif
+
+#if TDMA_MODE
+/**
+* @brief Frame layout, the beacon in slot 0
+*/
+static const STdmaConfig xTdmaConfig = {
+  TDMA_FRAME_MS,
+  TDMA_SLOT_MS,
+  TDMA_GUARD_MIN_MS,
+  TDMA_GUARD_MAX_MS,
+  TDMA_DRIFT_PPM,
+  TDMA_BEACON_US
+};
+#endif
+
+#if RADIO_BENCH
+/**
+* @brief Modem settings benchmarked, the deployed one included
+*/
+static const SRadioBenchRate xRadioBenchRates[] = {
+  {9600,      10000,          50000},
+  {DATARATE,  FREQ_DEVIATION, BANDWIDTH},
+  {100000,    50000,          250000}
+};
+#endif
+
+#ifndef RX
+/**
+* @brief Report-by-exception thresholds (lux), ascending
+*/
+static const uint32_t lRbeThresholds[] = {50, 500};
+
+/**
+* @brief Report-by-exception configuration
+*/
+static const SRbeConfig xRbeConfig = {
+  RBE_FILTER_SHIFT,
+  RBE_ABS_DEADBAND_LUX,
+  RBE_REL_DEADBAND_PERMILLE,
+  lRbeThresholds,
+  sizeof(lRbeThresholds)/sizeof(lRbeThresholds[0]),
+  RBE_THRESHOLD_HYST_LUX,
+  RBE_MIN_INTERVAL_MS,
+  RBE_HEARTBEAT_MS
+};
+
+#if CSMA_MODE
+/**
+* @brief Channel access, the back-off seed comes from the unique ID
+*/
+static const SCsmaConfig xCsmaConfig = {
+  CSMA_RSSI_THRESH_DBM,
+  CSMA_CCA_PERIOD,
+  CSMA_CCA_LENGTH,
+  CSMA_MAX_BACKOFFS,
+  CSMA_BU_PRESCALER,
+  CSMA_RESCHEDULE_MS,
+  CSMA_MAX_RESCHEDULES
+};
+#endif
+
+/**
+* @brief Reading aggregation configuration
+*/
+static const SAggConfig xAggConfig = {
+  AGG_BUDGET_BYTES,
+  AGG_DEADLINE_MS,
+  PACKET_OVERHEAD_BITS,
+  DATARATE,
+  AGG_READINGS_MAX
+};
+
+#if WMBUS_MODE
+/**
+* @brief Wireless M-Bus identity of the node
+*/
+static const SWMbusConfig xWMbusConfig = {
+  WMBUS_TX_MODE,
+  WMBUS_MANUFACTURER,
+  WMBUS_ID,
+  WMBUS_VERSION,
+  WMBUS_DEVICE_OTHER,
+  WMBUS_PREAMBLE,
+  WMBUS_POSTAMBLE
+};
+#endif
+#endif
+
 /**
  * @brief IRQ status struct declaration
  */
@@ -114,15 +636,315 @@ S2LPIrqs xIrqStatus;
  */
 uint8_t vectcRxBuff[128], cRxData;
 
+#if defined(RX) && LDC_MODE
+/**
+* @brief Low duty cycle receiver configuration. The packet air time is the
+*        one of the largest report
+*/
+static SLdcRxConfig xLdcRxConfig = {
+  LDC_PERIOD_MS,
+  LDC_WINDOW_MS,
+  PACKET_BITS * 1000.0 / DATARATE,
+  LDC_PQI_LEVEL,
+  (LDC_SWEEP ? S_ENABLE : S_DISABLE)
+};
+
+/**
+* @brief Sniff window lengths stepped through when sweeping, us
+*/
+static const uint16_t nLdcWindowsUs[] = {500, 1000, 2000, 4000};
+
+/**
+* @brief Current window step
+*/
+static uint8_t cLdcWindowStep;
+#endif
+
 /**
 * @brief Declare the Tx done flag
 */
 volatile FlagStatus xTxDoneFlag = RESET;
 
+/**
+* @brief Reception ended, with a packet, a discard or a timeout
+*/
+volatile FlagStatus xRxDoneFlag = RESET;
+
 /**
 * @brief Tx buffer declaration: data to transmit
 */
-char transmitString[20] = {'H', 'e', 'l', 'l', 'o', ' ', 'w', 'o', 'r', 'l', 'd'};
+#if WMBUS_MODE
+uint8_t vectcTxBuff[WMBUS_FRAME_MAX];
+#else
+uint8_t vectcTxBuff[AGG_FRAME_MAX];
+#endif
+
+#ifndef RX
+/**
+* @brief Tx sequence number, carried in each report
+*/
+static uint16_t nTxSeq;
+
+/**
+* @brief Sample counter, schedules the flicker detection bursts
+*/
+static uint32_t lSampleCount;
+
+/**
+* @brief Result of the last flicker detection burst
+*/
+static SFlickerResult xFlickerDetected;
+
+/**
+* @brief Scheduler id of the light sampling task
+*/
+static uint8_t cLightTask;
+
+/**
+* @brief Time of the last idle supply check
+*/
+static uint32_t lSupplyCheckMs;
+
+/**
+* @brief Supply grade the duty cycle and PA power are currently set for
+*/
+static SupplyLevel xSupplyApplied = SUPPLY_NORMAL;
+
+/**
+* @brief Sampling and reporting interval multiplier per supply grade
+*/
+static const uint8_t cSupplyStretch[SUPPLY_NB_LEVELS] = {1, 4, 16};
+
+/**
+* @brief PA output power per supply grade, dBm
+*/
+static const float fSupplyPaDbm[SUPPLY_NB_LEVELS] = {POWER_DBM, 7.0, 0.0};
+
+/**
+* @brief Energy counter frame sent with the next heartbeat
+*/
+static uint8_t cEnergyFrameNext;
+
+/**
+* @brief PA slot transmitted with
+*/
+static uint8_t cPaIndex;
+
+#if LINK_RELIABLE
+/**
+* @brief Sequence number of the last link quality answer applied, acks repeat
+*        it until a newer report was answered
+*/
+static uint16_t nTpcAnsweredSeq = 0xFFFF;
+#endif
+
+/**
+* @brief Report built and not sent yet, in vectcTxBuff: given up on a busy
+*        channel, or waiting for the slot
+*/
+static uint8_t cTxPendingLen;
+
+/**
+* @brief Energy counters due with the heartbeat
+*/
+static uint8_t cTxEnergyPending;
+
+#if CSMA_MODE
+/**
+* @brief Retries already made for the pending report
+*/
+static uint8_t cTxRetries;
+#endif
+
+#if CSMA_MODE || TDMA_MODE
+/**
+* @brief Scheduler id of the task sending the pending report
+*/
+static uint8_t cTxPendingTask;
+#endif
+
+#if TDMA_MODE
+/**
+* @brief Scheduler id of the beacon task
+*/
+static uint8_t cTdmaTask;
+
+/**
+* @brief Listening for a beacon, the radio interrupts are not the link's
+*/
+static volatile uint8_t cTdmaListening;
+
+/**
+* @brief TimestampRaw() at the last packet received while listening
+*/
+static volatile uint32_t lTdmaRxTs;
+
+/**
+* @brief Listening for a whole frame to acquire the beacons
+*/
+static uint8_t cTdmaScanning;
+
+/**
+* @brief Start of the scan
+*/
+static uint32_t lTdmaScanStartMs;
+
+/**
+* @brief Delay before the next scan after a failed one
+*/
+static uint32_t lTdmaScanRetryMs = TDMA_SCAN_RETRY_MS;
+
+/**
+* @brief Beacon the next window is opened for
+*/
+static uint32_t lTdmaBeaconTs;
+#endif
+
+#if CHAN_HOPPING
+/**
+* @brief Channel of the report being sent, kept for its retries and the
+*        energy frame after it
+*/
+static uint8_t cTxChannel = CHAN_HOME;
+
+#if !TDMA_MODE
+/**
+* @brief Hop epoch, the sequence number after the last acked report; on a
+*        schedule the frame number is the epoch
+*/
+static uint16_t nChanEpoch;
+#endif
+
+/**
+* @brief Channels announced by the last ack
+*/
+static uint16_t nChanMask;
+
+/**
+* @brief Time of the last acked report
+*/
+static uint32_t lChanAckMs;
+
+/**
+* @brief A report was acked, the gateway hops with the node
+*/
+static uint8_t cChanSynced;
+#endif
+
+#if ADR_MODE
+/**
+* @brief Profile of the report being sent, kept for its retries and the
+*        energy frame after it
+*/
+static uint8_t cTxProfile = ADR_FALLBACK;
+
+/**
+* @brief Profile announced by the last acked report, the gateway moves to it
+*/
+static uint8_t cAdrAgreed = ADR_FALLBACK;
+#endif
+#endif
+
+#ifdef RX
+/**
+* @brief A link quality answer is being sent, reception restarts after it
+*/
+static volatile uint8_t cAnswerPending;
+
+/**
+* @brief Scheduler id of the task outputting the received frames
+*/
+static uint8_t cRxTask;
+
+/**
+* @brief Time the table of nodes was last output
+*/
+static uint32_t lRxReportMs;
+
+/**
+* @brief Packets discarded by the radio filters
+*/
+static volatile uint32_t lRxDiscarded;
+
+#if LINK_RELIABLE
+/**
+* @brief Link quality answer carried by the next ack, none until a report
+*        was received, then the channels the node may hop to
+*/
+static uint8_t cAckPayload[TPC_FEEDBACK_BYTES + CHAN_ACK_BYTES];
+#endif
+
+#if CHAN_HOPPING
+/**
+* @brief Channel mask in the ack loaded in the radio, and in the last ack
+*        sent to the node
+*/
+static uint16_t nChanLoadedMask;
+
+#if TDMA_MODE
+/**
+* @brief Nodes followed in their slots, written from the RX interrupt
+*/
+static SChanFollow xChanFollow[NODE_TABLE_SIZE];
+
+/**
+* @brief Scheduler id of the task retuning at each slot
+*/
+static uint8_t cChanTask;
+#else
+static volatile uint16_t nChanAckedMask;
+
+/**
+* @brief Hop epoch, the sequence number after the last report received
+*/
+static volatile uint16_t nChanEpoch;
+
+/**
+* @brief Time of the last report received
+*/
+static volatile uint32_t lChanRxMs;
+
+/**
+* @brief The next report comes on another channel, once this one settled
+*/
+static volatile uint8_t cChanRetune;
+
+/**
+* @brief A report was received, hopping with the node
+*/
+static volatile uint8_t cChanSynced;
+#endif
+
+/**
+* @brief Time of the last idle RSSI survey
+*/
+static uint32_t lChanSurveyMs;
+#endif
+
+#if ADR_MODE && !TDMA_MODE
+/**
+* @brief Profile announced by the last report, tuned with the next hop
+*/
+static volatile uint8_t cAdrNext = ADR_FALLBACK;
+#endif
+
+#if TDMA_MODE
+/**
+* @brief Scheduler id of the beacon task
+*/
+static uint8_t cTdmaTask;
+
+/**
+* @brief A beacon is going out, reception is restarted by the beacon task
+*/
+static volatile uint8_t cTdmaBeaconSending;
+
+/**
+* @brief Beacons sent
+*/
+static uint32_t lTdmaBeacons;
+#endif
+#endif
   
 /*****************************************************************************/
 // functions
@@ -137,6 +959,15 @@ char transmitString[20] = {'H', 'e', 'l', 'l', 'o', ' ', 'w', 'o', 'r', 'l', 'd'
 ******************************************************************************/
 void TopLevel()
 {
+	/* low MSI range and voltage scale, bursts to HSI16 on demand */
+	ClockGovInit();
+	
+	/* RTC timestamps, local time until a network beacon is received */
+	TimestampInit();
+	
+	/* on-time counters, fed by the radio, ADC and scheduler */
+	EnergyInit();
+	
 	/* Tx startup string */
 	#ifndef RX
 		uint8_t mystring[] = "\r\nLight Sensor Node - Tx";
@@ -153,78 +984,1830 @@ void TopLevel()
   S2LPEnterShutdown();
   S2LPExitShutdown();
 	
-	/* Allow time for S2LP to power up */
-	HAL_Delay(10);
+	/* Wait for the S2LP power-on reset */
+	RadioPowerWaitPor();
 	
-	/* S2LP IRQ config */
-  S2LPGpioInit(&xGpioIRQ);
+	#ifndef RX
+		/* transmit power control, from the supply grade ceiling down */
+		TpcInit(fSupplyPaDbm[xSupplyApplied]);
+	#endif
+	
+	#if LINK_RELIABLE
+		/* addresses and ack roles, applied with the packet format */
+		LinkInit(&xLinkConfig);
+	#endif
+	
+	#if !defined(RX) && CSMA_MODE
+		/* listen before talk, seeded from the unique ID */
+		CsmaInit(&xCsmaConfig);
+	#endif
+	
+	#if TDMA_MODE
+		/* frame layout and the slot of the node */
+		#ifdef RX
+			TdmaInit(&xTdmaConfig, LINK_GATEWAY_ADDRESS);
+		#else
+			TdmaInit(&xTdmaConfig, LINK_NODE_ADDRESS);
+		#endif
+	#endif
+	
+	#if WMBUS_MODE
+		/* identity and header lengths, the modem set with the radio configuration */
+		WMbusInit(&xWMbusConfig);
+	#endif
+	
+	#if ADR_MODE
+		/* modem register images computed with the radio configuration,
+		   the slowest profile until the node announced another */
+		AdrInit(&xAdrConfig);
+		#ifndef RX
+			TpcSetTarget(AdrGetProfile(ADR_FALLBACK)->cSensitivityDbm + ADR_MARGIN_DB);
+		#endif
+	#endif
+	
+	#if CHAN_HOPPING
+		/* synthesizer words computed with the radio configuration, every
+		   channel allowed until the gateway surveyed them */
+		ChanPlanInit(&xChanPlanConfig);
+		#ifdef RX
+			nChanLoadedMask = ChanPlanAllMask();
+			ChanPlanMaskBuild(&cAckPayload[TPC_FEEDBACK_BYTES], nChanLoadedMask);
+		#else
+			nChanMask = ChanPlanAllMask();
+		#endif
+	#endif
+	
+	/* full radio configuration, re-applied after SHUTDOWN */
+	RadioConfigure();
+	
+	#if RADIO_BENCH
+		/* TX and RX current per power profile and data rate, measured on the supply */
+		RadioBench();
+	#endif
+	
+	#ifdef RX
+		/* per node sequence and link quality, filled from the RX interrupt */
+		NodeTableInit();
+		
+		#if CHAN_HOPPING
+			/* first idle RSSI survey, announced from the second ack */
+			ChanPlanSurvey(CHAN_SURVEY_DWELL_MS);
+			lChanSurveyMs = HAL_GetTick();
+			ChanPlanMaskBuild(&cAckPayload[TPC_FEEDBACK_BYTES], ChanPlanGetMask());
+		#endif
+		
+		#if LDC_MODE
+			/* the radio wakes itself and only interrupts on reception */
+			#if LDC_SWEEP
+				xLdcRxConfig.fWindowMs = nLdcWindowsUs[0] / 1000.0;
+			#endif
+			LdcRxStart(&xLdcRxConfig);
+		#else
+			/* RX command */
+			S2LPCmdStrobeRx();
+		#endif
+	#endif
+	
+	#ifndef RX
+		/* Light sensor and report-by-exception engine */
+		LightSensorInit();
+		
+		/* ADC calibration and sensor self-test, reused from EEPROM when still valid */
+		{
+			SAdcCalRecord xCal;
+			char calString[48];
+			int iLen;
+			AdcCalReason xCalReason = AdcCalBoot();
+			
+			AdcCalGetRecord(&xCal);
+			iLen = snprintf(calString, sizeof(calString), "\r\nADC cal %u, self-test %u",
+			                    (unsigned)xCalReason, (unsigned)xCal.lSelfTest);
+			HAL_UART_Transmit(&huart1, (uint8_t*)calString, (uint16_t)iLen, 500);
+		}
+		
+		FlickerInit();
+		RbeInit(&xRbeConfig);
+		AggInit(&xAggConfig);
+		
+		/* supply monitoring, the S2LP battery level detector is set up with the radio */
+		SupplyInit();
+		#if AWD_WAKE_MODE
+			AwdWakeInit();
+		#endif
+		
+		/* radio parked between reports, no report before the minimum interval */
+		RadioPowerInit(RadioConfigure);
+		RadioPowerIdle(RBE_MIN_INTERVAL_MS, S_DISABLE);
+	#endif
+	
+	/* scheduler, stops the core between tasks and while waiting for radio IRQs */
+	SchedInit();
+	
+	#ifndef RX
+		cLightTask = SchedAdd(LightTask, 0, 0);
+		#if CSMA_MODE || TDMA_MODE
+			cTxPendingTask = SchedAdd(TxPendingTask, 0, 0);
+		#endif
+		#if TDMA_MODE
+			/* beacon scan at once, reports wait for it */
+			cTdmaTask = SchedAdd(TdmaTask, 0, 0);
+		#endif
+	#endif
+	#if defined(RX) && LDC_MODE
+		SchedAdd(LdcTask, LDC_REPORT_MS, LDC_REPORT_MS);
+	#endif
+	#if defined(RX) && CHAN_HOPPING && TDMA_MODE
+		/* at each slot, retuned to the node whose slot it is */
+		cChanTask = SchedAdd(ChanTask, TdmaMsUntil(TdmaNextSlotStart(TimestampNow()), TimestampNow()) + TDMA_ROUND_MS, 0);
+	#elif defined(RX) && CHAN_HOPPING
+		SchedAdd(ChanTask, CHAN_TASK_MS, CHAN_TASK_MS);
+	#endif
+	#ifdef RX
+		/* run by each reception, and at least every RX_REPORT_MS for the table */
+		cRxTask = SchedAdd(RxTask, RX_REPORT_MS, RX_REPORT_MS);
+	#endif
+	#if defined(RX) && TDMA_MODE
+		cTdmaTask = SchedAdd(TdmaBeaconTask, TdmaMsUntil(TdmaFrameStart(TimestampNow()), TimestampNow()) + TDMA_ROUND_MS, 0);
+	#endif
+	
+	SchedRun();
+}
+
+/** ***************************************************************************
+*   \brief      Full S2LP configuration.
+*   \details    Called at boot and by the power state manager whenever the
+*               radio comes back from SHUTDOWN, which loses every register.
+*               The PA level follows the current supply grade.
+******************************************************************************/
+static void RadioConfigure(void)
+{
+	/* S2LP IRQ config */
+  S2LPGpioInit(&xGpioIRQ);
+	
+	/* S2LP reference and SMPS, the radio config depends on the reference */
+	RadioProfileApply(&xRadioProfiles[cRadioProfile]);
+	
+	/* S2LP Radio config, with the packet format in Wireless M-Bus mode */
+	#if WMBUS_MODE
+		WMbusConfigure();
+	#else
+  S2LPRadioInit(&xRadioInit);
+	#endif
+	
+	/* modem registers of every profile, computed once, the current one tuned */
+	#if ADR_MODE
+		AdrConfigure();
+	#endif
+	
+	/* channel synthesizer words, the current channel tuned again */
+	#if CHAN_HOPPING
+		ChanPlanConfigure();
+	#endif
+	
+	/* S2LP Radio set power, all slots programmed and the one in use selected */
+	#ifndef RX
+		cPaIndex = PaProfileApply(&xPaProfile, TpcGetDbm());
+		EnergyTxPower(PaProfileLevel(cPaIndex));
+	#else
+		EnergyTxPower(PaProfileLevel(PaProfileApply(&xPaProfile, POWER_DBM)));
+	#endif
+	
+	/* S2LP Packet config */
+	#if WMBUS_MODE
+	#elif LINK_RELIABLE
+		LinkConfigure(&xStackInit);
+	#else
+  S2LPPktBasicInit(&xBasicInit);
+	#endif
+	
+	/* Tx initialisation */
+	#ifndef RX
+		/* S2LP IRQs enable */
+		S2LPGpioIrqDeInit(NULL);										// Reset IRQ register bits to 0
+		#if LINK_RELIABLE
+			/* only the ack or the give up, retransmissions do not wake the MCU */
+			S2LPGpioIrqConfig(RX_DATA_READY, S_ENABLE);
+			S2LPGpioIrqConfig(MAX_RE_TX_REACH, S_ENABLE);
+		#else
+		S2LPGpioIrqConfig(TX_DATA_SENT , S_ENABLE);	// Set IRQ to interrupt when data has been transmitted
+		#endif
+		
+		/* S2LP battery level detector, a backstop to the supply monitoring */
+		SupplyRadioBldInit(SUPPLY_BLD_THRESHOLD);
+		S2LPGpioIrqConfig(LOW_BATT_LVL, S_ENABLE);
+		S2LPGpioIrqConfig(BOR, S_ENABLE);
+		
+		#if CSMA_MODE
+			/* channel access, the radio only interrupts when it gives up */
+			CsmaConfigure();
+			S2LPGpioIrqConfig(MAX_BO_CCA_REACH, S_ENABLE);
+		#endif
+		
+		/* link quality answer window after each report, the ack wait of
+		   the reliable link */
+		#if !LINK_RELIABLE
+			S2LPGpioIrqConfig(RX_DATA_READY, S_ENABLE);
+			S2LPGpioIrqConfig(RX_DATA_DISC, S_ENABLE);
+			S2LPGpioIrqConfig(RX_TIMEOUT, S_ENABLE);
+		#endif
+		S2LPTimerSetRxTimerMs(TPC_FEEDBACK_WINDOW_MS);
+		S2LPTimerSetRxTimerStopCondition(NO_TIMEOUT_STOP);
+	#endif
+	
+	/* Rx initialisation */
+	#ifdef RX
+		/* S2LP IRQs enable */
+		S2LPGpioIrqDeInit(&xIrqStatus);	  					// Reset IRQ register bits to 0
+		S2LPGpioIrqConfig(RX_DATA_DISC,S_ENABLE);	  // Set IRQ to interrupt if Rx data has been discarded upon filtering
+		S2LPGpioIrqConfig(RX_DATA_READY,S_ENABLE);	// Set IRQ to interrupt if Rx data is ready
+		S2LPGpioIrqConfig(TX_DATA_SENT,S_ENABLE);		// Set IRQ to interrupt when a link quality answer or an ack is sent
+		/* RX timeout config */
+		S2LPTimerSetRxTimerMs(700.0);
+		/* answers go to a node already listening, no long preamble */
+		S2LPPktBasicSetPreambleLength(PREAMBLE_BYTE(TPC_FEEDBACK_PREAMBLE_BYTES));
+	#endif
+	
+	/* payload length config */
+	#if LINK_RELIABLE
+		#ifdef RX
+			/* acks carry the link quality answer, loaded before the first report */
+			LinkSetAckPayload(cAckPayload, sizeof(cAckPayload));
+		#else
+			LinkSetPayloadLength(20);
+		#endif
+	#elif WMBUS_MODE
+		WMbusSetPayloadLength(20);
+	#else
+  S2LPPktBasicSetPayloadLength(20);						// Set the payload length to 20 bytes
+	#endif
+	
+	/* preamble of the current profile, over the one of the packet format */
+	#if ADR_MODE
+		AdrApply(AdrCurrent());
+	#endif
+	
+	/* IRQ registers blanking */
+  S2LPGpioIrqClearStatus();
+}
+
+#if RADIO_BENCH
+/** ***************************************************************************
+*   \brief      Radio current benchmark.
+*   \details    Every power profile is tried at every modem setting, the radio
+*               held in TX then in RX for RADIO_BENCH_DWELL_MS while the
+*               supply current is logged externally. Each step is announced
+*               on the UART with the report air time at its data rate, the
+*               charge per report being the TX current times that time. The
+*               deployed profile and modem setting are restored at the end.
+******************************************************************************/
+static void RadioBench(void)
+{
+	SRadioInit xDeployed = xRadioInit;
+	char benchString[80];
+	int iLen;
+	uint8_t p, r, m;
+	
+	for(p = 0; p < sizeof(xRadioProfiles)/sizeof(xRadioProfiles[0]); p++)
+	{
+		cRadioProfile = p;
+		
+		for(r = 0; r < sizeof(xRadioBenchRates)/sizeof(xRadioBenchRates[0]); r++)
+		{
+			xRadioInit.lDatarate = xRadioBenchRates[r].lDatarate;
+			xRadioInit.lFreqDev = xRadioBenchRates[r].lFreqDev;
+			xRadioInit.lBandwidth = xRadioBenchRates[r].lBandwidth;
+			RadioConfigure();
+			
+			for(m = 0; m < RADIO_BENCH_NB_MODES; m++)
+			{
+				iLen = snprintf(benchString, sizeof(benchString), "\r\nBench profile %u, %lu bps, %s, SMPS %lu kHz, report %lu us",
+				                    (unsigned)p, (unsigned long)xRadioInit.lDatarate, (m == RADIO_BENCH_TX) ? "TX" : "RX",
+				                    (unsigned long)(RadioProfileSmpsHz((m == RADIO_BENCH_TX) ? CMD_TX : CMD_RX) / 1000),
+				                    (unsigned long)RadioProfileAirTimeUs(xRadioInit.lDatarate, PACKET_BITS));
+				HAL_UART_Transmit(&huart1, (uint8_t*)benchString, (uint16_t)iLen, 500);
+				
+				RadioProfileBench((RadioBenchMode)m, RADIO_BENCH_DWELL_MS);
+			}
+		}
+	}
+	
+	iLen = snprintf(benchString, sizeof(benchString), "\r\nBench end");
+	HAL_UART_Transmit(&huart1, (uint8_t*)benchString, (uint16_t)iLen, 500);
+	
+	xRadioInit = xDeployed;
+	cRadioProfile = RADIO_PROFILE;
+	RadioConfigure();
+}
+#endif
+
+#ifndef RX
+/** ***************************************************************************
+*   \brief      Light sampling and reporting task.
+*   \details    Takes one ripple free reading, reports it if significant, and
+*               reschedules itself after the sample period, stretched with the
+*               supply grade, or right after a watchdog sleep.
+******************************************************************************/
+static void LightTask(void)
+{
+	SFlickerResult xFlicker;
+	HAL_StatusTypeDef xAcqStatus;
+	RbeReason xReason = RBE_NONE;
+	AggFlushReason xFlush = AGG_FLUSH_NONE;
+	
+	/* idle supply check, recalibrate the ADC if the supply or temperature drifted */
+	if((lSampleCount == 0) || ((HAL_GetTick() - lSupplyCheckMs) >= SUPPLY_CHECK_MS))
+	{
+		SLightSample xLightSample;
+		
+		lSupplyCheckMs = HAL_GetTick();
+		if(LightSensorSample(&xLightSample) == HAL_OK)
+		{
+			AdcCalService(&xLightSample);
+			SupplyPolicyApply(SupplyUpdate(xLightSample.nVrefint, SUPPLY_IDLE, lSupplyCheckMs));
+		}
+	}
+	
+	/* ripple free light reading, with a periodic full flicker detection */
+	if((lSampleCount++ % FLICKER_DETECT_EVERY) == 0)
+	{
+		xAcqStatus = FlickerDetect(&xFlicker);
+		if(xAcqStatus == HAL_OK)
+			xFlickerDetected = xFlicker;
+	}
+	else
+	{
+		xAcqStatus = FlickerMean(&xFlicker);
+	}
+	
+	/* only queue significant changes */
+	if(xAcqStatus == HAL_OK)
+	{
+		xReason = RbeProcess(LightSensorToLux(xFlicker.nMean), HAL_GetTick());
+		
+		if(xReason != RBE_NONE)
+			xFlush = AggAdd(TimestampNow(), RbeGetFiltered(), (uint8_t)xReason, HAL_GetTick());
+	}
+	
+	/* transmit once the report is full or its oldest reading is due, at
+	   once with a heartbeat */
+	if(xFlush == AGG_FLUSH_NONE)
+		xFlush = AggDue(HAL_GetTick());
+	if((xReason == RBE_HEARTBEAT) && (xFlush == AGG_FLUSH_NONE))
+		xFlush = AGG_FLUSH_FORCED;
+	
+	/* a report waiting for a busy channel goes first, readings keep queuing;
+	   on a schedule they go with the next slot, and while the beacons
+	   are searched for */
+	if(cTxPendingLen > 0)
+		xFlush = AGG_FLUSH_NONE;
+	#if TDMA_MODE
+		if(TdmaIsSynced() || cTdmaScanning)
+			xFlush = AGG_FLUSH_NONE;
+	#endif
+	
+	/* one share of the energy counters with each heartbeat */
+	if(xReason == RBE_HEARTBEAT)
+		cTxEnergyPending = 1;
+	
+	if(xFlush != AGG_FLUSH_NONE)
+	{
+		TxBuild(xFlush);
+		TxReport();
+	}
+	
+	/* report the transmission statistics with each heartbeat */
+	if(xReason == RBE_HEARTBEAT)
+	{
+		SRbeStats xStats;
+		char statsString[64];
+		int iLen;
+		
+		RbeGetStats(&xStats);
+		iLen = snprintf(statsString, sizeof(statsString), "\r\nTx/day %lu/%lu, on-time ms %lu/%lu",
+		                (unsigned long)xStats.lTxToday, (unsigned long)xStats.lTxYesterday,
+		                (unsigned long)xStats.lRadioOnMsToday, (unsigned long)xStats.lRadioOnMsYesterday);
+		HAL_UART_Transmit(&huart1, (uint8_t*)statsString, (uint16_t)iLen, 500);
+		
+		#if FLICKER_REPORT
+			iLen = snprintf(statsString, sizeof(statsString), "\r\nFlicker %u Hz, amplitude %u",
+			                (unsigned)xFlickerDetected.cRippleHz, (unsigned)xFlickerDetected.nAmplitude);
+			HAL_UART_Transmit(&huart1, (uint8_t*)statsString, (uint16_t)iLen, 500);
+		#endif
+		
+		{
+			SSupplyStatus xSupply;
+			
+			SupplyGetStatus(&xSupply);
+			iLen = snprintf(statsString, sizeof(statsString), "\r\nVDD %u/%u mV, level %u, %d mV/day, %lu h",
+			                (unsigned)xSupply.nIdleMv, (unsigned)xSupply.nLoadedMv, (unsigned)xSupply.xLevel,
+			                (int)xSupply.iSlopeMvPerDay, (unsigned long)xSupply.lHoursLeft);
+			HAL_UART_Transmit(&huart1, (uint8_t*)statsString, (uint16_t)iLen, 500);
+		}
+		
+		{
+			SSchedStats xSched;
+			
+			SchedGetStats(&xSched);
+			iLen = snprintf(statsString, sizeof(statsString), "\r\nRun/sleep/stop s %lu/%lu/%lu",
+			                (unsigned long)(xSched.lRunMs / 1000), (unsigned long)(xSched.lSleepMs / 1000),
+			                (unsigned long)(xSched.lStopMs / 1000));
+			HAL_UART_Transmit(&huart1, (uint8_t*)statsString, (uint16_t)iLen, 500);
+		}
+		
+		{
+			STimestampStatus xTime;
+			uint32_t lNow = TimestampNow();
+			
+			TimestampGetStatus(&xTime);
+			iLen = snprintf(statsString, sizeof(statsString), "\r\nTime %lu.%03lu, syncs %lu, trim %d",
+			                (unsigned long)(lNow >> TIMESTAMP_FRAC_BITS),
+			                (unsigned long)TimestampToMs(lNow & (TIMESTAMP_ONE_S - 1)),
+			                (unsigned long)xTime.lSyncs, (int)xTime.iTrimPulses);
+			HAL_UART_Transmit(&huart1, (uint8_t*)statsString, (uint16_t)iLen, 500);
+		}
+		
+		{
+			SClockGovStats xClockStats;
+			
+			ClockGovGetStats(&xClockStats);
+			iLen = snprintf(statsString, sizeof(statsString), "\r\nClock low/high s %lu/%lu, switches %lu",
+			                (unsigned long)(xClockStats.lPointMs[CLOCK_LOW] / 1000),
+			                (unsigned long)(xClockStats.lPointMs[CLOCK_HIGH] / 1000),
+			                (unsigned long)xClockStats.lSwitches);
+			HAL_UART_Transmit(&huart1, (uint8_t*)statsString, (uint16_t)iLen, 500);
+		}
+		
+		{
+			SRadioPowerStats xRadio;
+			
+			RadioPowerGetStats(&xRadio);
+			iLen = snprintf(statsString, sizeof(statsString), "\r\nRadio stby/sdn s %lu/%lu, cold/warm %lu/%lu",
+			                (unsigned long)(xRadio.lStateMs[RADIO_PS_STANDBY] / 1000),
+			                (unsigned long)(xRadio.lStateMs[RADIO_PS_SHUTDOWN] / 1000),
+			                (unsigned long)xRadio.lColdConfigs, (unsigned long)xRadio.lWarmRestores);
+			HAL_UART_Transmit(&huart1, (uint8_t*)statsString, (uint16_t)iLen, 500);
+			
+			iLen = snprintf(statsString, sizeof(statsString), "\r\nWake us por/warm %lu/%lu, to TX %lu/%lu",
+			                (unsigned long)xRadio.lPorUs, (unsigned long)xRadio.lWarmUs,
+			                (unsigned long)xRadio.lWakeToTxUs[RADIO_PS_STANDBY],
+			                (unsigned long)xRadio.lWakeToTxUs[RADIO_PS_SHUTDOWN]);
+			HAL_UART_Transmit(&huart1, (uint8_t*)statsString, (uint16_t)iLen, 500);
+		}
+		
+		{
+			SAggStats xAgg;
+			
+			AggGetStats(&xAgg);
+			iLen = snprintf(statsString, sizeof(statsString), "\r\nAgg %lu readings/%lu reports, air %lu ms, %lu us/reading",
+			                (unsigned long)xAgg.lReadings, (unsigned long)xAgg.lPackets,
+			                (unsigned long)(xAgg.llAirUs / 1000),
+			                (unsigned long)((xAgg.lReadings == 0) ? 0 : (xAgg.llAirUs / xAgg.lReadings)));
+			HAL_UART_Transmit(&huart1, (uint8_t*)statsString, (uint16_t)iLen, 500);
+			
+			/* codec against fixed size readings, and its cost in core cycles */
+			iLen = snprintf(statsString, sizeof(statsString), "\r\nCodec bytes %lu/%lu, cycles %lu/%u, saved %lu ms",
+			                (unsigned long)xAgg.lPayloadBytes, (unsigned long)xAgg.lRawBytes,
+			                (unsigned long)((xAgg.lReadings == 0) ? 0 : (xAgg.lEncodeCycles / xAgg.lReadings)),
+			                (unsigned)xAgg.nEncodeCyclesMax, (unsigned long)(xAgg.llAirSavedUs / 1000));
+			HAL_UART_Transmit(&huart1, (uint8_t*)statsString, (uint16_t)iLen, 500);
+		}
+		
+		{
+			STpcStatus xTpc;
+			
+			TpcGetStatus(&xTpc);
+			iLen = snprintf(statsString, sizeof(statsString), "\r\nTPC %d dBm, answers %lu/%lu, RSSI %d dBm",
+			                (int)xTpc.fDbm, (unsigned long)xTpc.lFeedbacks,
+			                (unsigned long)(xTpc.lFeedbacks + xTpc.lLost), (int)xTpc.cLastRssiDbm);
+			HAL_UART_Transmit(&huart1, (uint8_t*)statsString, (uint16_t)iLen, 500);
+		}
+		
+		#if CSMA_MODE
+		{
+			SCsmaStats xCsma;
+			
+			CsmaGetStats(&xCsma);
+			iLen = snprintf(statsString, sizeof(statsString), "\r\nCSMA %lu tx, busy %lu, resched %lu, drop %lu, coll %lu",
+			                (unsigned long)xCsma.lAttempts, (unsigned long)xCsma.lBusy,
+			                (unsigned long)xCsma.lReschedules, (unsigned long)xCsma.lDropped,
+			                (unsigned long)xCsma.lCollisions);
+			HAL_UART_Transmit(&huart1, (uint8_t*)statsString, (uint16_t)iLen, 500);
+		}
+		#endif
+		
+		#if LINK_RELIABLE
+		{
+			SLinkStats xLink;
+			
+			if(LinkGetStats(0, &xLink))
+			{
+				iLen = snprintf(statsString, sizeof(statsString), "\r\nLink %lu/%lu acked, %lu failed, retx %lu/%u",
+				                (unsigned long)xLink.lAcked, (unsigned long)xLink.lSent, (unsigned long)xLink.lFailed,
+				                (unsigned long)xLink.lRetx, (unsigned)xLink.cRetxMax);
+				HAL_UART_Transmit(&huart1, (uint8_t*)statsString, (uint16_t)iLen, 500);
+			}
+		}
+		#endif
+		
+		#if CHAN_HOPPING
+		{
+			SChanPlanStats xChan;
+			
+			ChanPlanGetStats(&xChan);
+			iLen = snprintf(statsString, sizeof(statsString), "\r\nChan %u, hops %lu, mask %04X",
+			                (unsigned)cTxChannel, (unsigned long)xChan.lHops, (unsigned)nChanMask);
+			HAL_UART_Transmit(&huart1, (uint8_t*)statsString, (uint16_t)iLen, 500);
+		}
+		#endif
+		
+		#if TDMA_MODE
+		{
+			STdmaStats xTdma;
+			
+			TdmaGetStats(&xTdma);
+			iLen = snprintf(statsString, sizeof(statsString), "\r\nTDMA slot %u/%u, %s, used %lu, guard %u ms",
+			                (unsigned)TdmaSlot(), (unsigned)TdmaSlots(), xTdma.cSynced ? "synced" : "scan",
+			                (unsigned long)xTdma.lSlots, (unsigned)xTdma.nGuardMs);
+			HAL_UART_Transmit(&huart1, (uint8_t*)statsString, (uint16_t)iLen, 500);
+			
+			iLen = snprintf(statsString, sizeof(statsString), "\r\nBeacons %lu, missed %lu, lost %lu, %ld ms, %u ppm",
+			                (unsigned long)xTdma.lBeacons, (unsigned long)xTdma.lMissed, (unsigned long)xTdma.lLost,
+			                (long)xTdma.iLastErrorMs, (unsigned)xTdma.nDriftPpm);
+			HAL_UART_Transmit(&huart1, (uint8_t*)statsString, (uint16_t)iLen, 500);
+		}
+		#endif
+		
+		#if WMBUS_MODE
+		{
+			SWMbusStats xWMbus;
+			
+			WMbusGetStats(&xWMbus);
+			iLen = snprintf(statsString, sizeof(statsString), "\r\nWMBus %lu, readings %lu, dropped %lu",
+			                (unsigned long)xWMbus.lTelegrams, (unsigned long)xWMbus.lReadings, (unsigned long)xWMbus.lDropped);
+			HAL_UART_Transmit(&huart1, (uint8_t*)statsString, (uint16_t)iLen, 500);
+			
+			if(xWMbus.lReadings > 0)
+			{
+				iLen = snprintf(statsString, sizeof(statsString), "\r\n%lu bytes/reading, %lu us/reading",
+				                (unsigned long)(xWMbus.lBytes / xWMbus.lReadings), (unsigned long)(xWMbus.llAirUs / xWMbus.lReadings));
+				HAL_UART_Transmit(&huart1, (uint8_t*)statsString, (uint16_t)iLen, 500);
+			}
+		}
+		#endif
+		
+		#if ADR_MODE
+		{
+			SAdrStats xAdr;
+			uint8_t i;
+			
+			AdrGetStats(&xAdr);
+			iLen = snprintf(statsString, sizeof(statsString), "\r\nADR %lu bit/s, wanted %lu",
+			                (unsigned long)AdrGetProfile(cTxProfile)->lDatarate,
+			                (unsigned long)AdrGetProfile(xAdr.cWanted)->lDatarate);
+			HAL_UART_Transmit(&huart1, (uint8_t*)statsString, (uint16_t)iLen, 500);
+			
+			iLen = snprintf(statsString, sizeof(statsString), "\r\nSwitches %lu, up %lu, down %lu",
+			                (unsigned long)xAdr.lSwitches, (unsigned long)xAdr.lStepsUp, (unsigned long)xAdr.lStepsDown);
+			HAL_UART_Transmit(&huart1, (uint8_t*)statsString, (uint16_t)iLen, 500);
+			
+			/* the air time a reading costs at each rate, the packet error
+			   rate per mille and the TX charge of a delivered byte */
+			for(i = 0; i < AdrProfiles(); i++)
+			{
+				iLen = snprintf(statsString, sizeof(statsString), "\r\n%lu bit/s%s: reports %lu, %lu us/reading",
+				                (unsigned long)AdrGetProfile(i)->lDatarate, (AdrGetProfile(i)->xFec == S_ENABLE) ? " FEC" : "",
+				                (unsigned long)xAdr.lReports[i],
+				                xAdr.lReadings[i] ? (unsigned long)(xAdr.llAirUs[i] / xAdr.lReadings[i]) : 0UL);
+				HAL_UART_Transmit(&huart1, (uint8_t*)statsString, (uint16_t)iLen, 500);
+				
+				if(xAdr.lAttempts[i] > 0)
+				{
+					iLen = snprintf(statsString, sizeof(statsString), "\r\n  PER %lu/1000, %lu nC/byte",
+					                (unsigned long)((1000ULL * (xAdr.lAttempts[i] - xAdr.lDelivered[i])) / xAdr.lAttempts[i]),
+					                xAdr.lDeliveredBytes[i] ? (unsigned long)(xAdr.llChargeNc[i] / xAdr.lDeliveredBytes[i]) : 0UL);
+					HAL_UART_Transmit(&huart1, (uint8_t*)statsString, (uint16_t)iLen, 500);
+				}
+			}
+		}
+		#endif
+		
+		{
+			SEnergyStats xEnergy;
+			uint8_t cEnergyFrame[ENERGY_FRAME_BYTES];
+			char energyString[80];
+			uint32_t lAvgNa;
+			uint8_t i;
+			
+			EnergyGetStats(&xEnergy);
+			lAvgNa = EnergyAverageNa(&xEnergy);
+			iLen = snprintf(statsString, sizeof(statsString), "\r\nEnergy avg %lu uA, %lu uAh/day",
+			                (unsigned long)(lAvgNa / 1000), (unsigned long)((lAvgNa * 24UL) / 1000));
+			HAL_UART_Transmit(&huart1, (uint8_t*)statsString, (uint16_t)iLen, 500);
+			
+			/* raw counters, in the format the receiver prints the radio frames */
+			for(i = 0; i < EnergyFrameCount(); i++)
+			{
+				EnergyExportFrame(i, cEnergyFrame, sizeof(cEnergyFrame));
+				iLen = EnergyFormatFrame(cEnergyFrame, sizeof(cEnergyFrame), energyString, sizeof(energyString));
+				HAL_UART_Transmit(&huart1, (uint8_t*)energyString, (uint16_t)iLen, 500);
+			}
+		}
+		
+		#if AWD_WAKE_MODE
+		{
+			SAwdWakeStats xAwdStats;
+			
+			AwdWakeGetStats(&xAwdStats);
+			iLen = snprintf(statsString, sizeof(statsString), "\r\nWakes %lu/%lu, awake/asleep s %lu/%lu",
+			                (unsigned long)xAwdStats.lLightWakes, (unsigned long)xAwdStats.lTimeoutWakes,
+			                (unsigned long)(xAwdStats.lAwakeMs / 1000), (unsigned long)(xAwdStats.lAsleepMs / 1000));
+			HAL_UART_Transmit(&huart1, (uint8_t*)statsString, (uint16_t)iLen, 500);
+		}
+		#endif
+	}
+	
+	/* next sample, the scheduler stops the core in between */
+	#if AWD_WAKE_MODE
+		/* Once the reading is back inside the report window, let the ADC
+		   watch it and sleep until it leaves. Until then keep polling so
+		   the filter can settle and the change gets reported. */
+		if(xAcqStatus == HAL_OK)
+		{
+			uint32_t lLowLux, lHighLux, lMaxS, lDueMs;
+			uint16_t nLow, nHigh;
+			
+			RbeGetWindow(&lLowLux, &lHighLux);
+			nLow = LightSensorFromLux(lLowLux);
+			nHigh = LightSensorFromLux(lHighLux);
+			
+			if((xFlicker.nMean >= nLow) && (xFlicker.nMean <= nHigh))
+			{
+				/* single conversions carry the mains ripple, widen by its amplitude */
+				nLow = (nLow > xFlickerDetected.nAmplitude) ? (nLow - xFlickerDetected.nAmplitude) : 0;
+				nHigh += xFlickerDetected.nAmplitude;
+				
+				/* wake up for the heartbeat, or for the oldest queued reading */
+				lMaxS = (RBE_HEARTBEAT_MS / 1000) * cSupplyStretch[xSupplyApplied];
+				lDueMs = AggMsToDeadline(HAL_GetTick());
+				if((lDueMs / 1000 + 1) < lMaxS)
+					lMaxS = lDueMs / 1000 + 1;
+				
+				/* the other tasks only run once this one returns: beacon
+				   windows, slots and the retry of a report left pending.
+				   Keep polling if one is under a second away */
+				lDueMs = SchedMsToOthers(cLightTask);
+				if((lDueMs / 1000) < lMaxS)
+					lMaxS = lDueMs / 1000;
+				
+				if((lMaxS > 0) && (AwdWakeSleep(nLow, nHigh, (uint16_t)lMaxS) != AWD_WAKE_ERROR))
+				{
+					SchedSetNext(cLightTask, 0);
+					return;
+				}
+			}
+		}
+	#endif
+	SchedSetNext(cLightTask, SAMPLE_PERIOD_MS * cSupplyStretch[xSupplyApplied]);
+}
+
+/** ***************************************************************************
+*   \brief      Send one packet and wait for it to leave.
+*   \details    The radio is woken from its power state and left in READY.
+*               The supply is read under the transmit load meanwhile. On a
+*               reliable link the wait lasts until the ack or the last
+*               retransmission; the ack carries the link quality answer to
+*               an earlier report, a delivery failure counts as a lost answer.
+*               With CSMA the radio may give up on a busy channel without
+*               sending, see CsmaTxBusy(). With channel hopping the packet
+*               goes out on cTxChannel, and the ack of a report moves the
+*               hop epoch on.
+*   \param      pcPayload     payload
+*   \param      cLen          payload length, at most the 128 byte FIFO
+*   \return     radio on-time, ms
+******************************************************************************/
+static uint32_t RadioSend(uint8_t *pcPayload, uint8_t cLen)
+{
+	ClockPoint xClock;
+	uint32_t lTxStartMs;
+	#if LINK_RELIABLE
+		STpcFeedback xFeedback;
+	#endif
+	#if ADR_MODE
+		SLinkStats xLink;
+		uint32_t lRetx = 0;
+	#endif
+	
+	/* SPI bursts at HSI16, the radio is in READY meanwhile */
+	xClock = ClockGovSet(CLOCK_HIGH);
+	
+	/* radio back to READY, reconfigured if it was shut down */
+	RadioPowerWake();
+	
+	/* one SPI burst, the VCO words kept for a warm wake-up are those of
+	   the previous channel */
+	#if CHAN_HOPPING
+		if(cTxChannel != ChanPlanCurrent())
+			RadioPowerRetuned();
+		ChanPlanTune(cTxChannel);
+	#endif
+	#if ADR_MODE
+		AdrApply(cTxProfile);
+	#endif
+	
+	/* fit the TX FIFO */
+	S2LPCmdStrobeFlushTxFifo();														// Flush Tx FIFO
+	#if LINK_RELIABLE
+		LinkSetPayloadLength(cLen);
+	#elif WMBUS_MODE
+		WMbusSetPayloadLength(cLen);
+	#else
+	S2LPPktBasicSetPayloadLength(cLen);												// Variable length packet
+	#endif
+	S2LPSpiWriteFifo(cLen, pcPayload);														// Write to Tx FIFO
+
+	/* send the TX command */
+	lTxStartMs = HAL_GetTick();
+	RadioPowerTxStart();
+	#if LINK_RELIABLE
+		cRxData = 0;
+		LinkTxStart();
+	#endif
+	#if ADR_MODE
+		if(LinkGetStats(0, &xLink))
+			lRetx = xLink.lRetx;
+	#endif
+	#if CSMA_MODE
+		CsmaTxStart();
+	#endif
+	S2LPCmdStrobeTx();
+	ClockGovSet(xClock);
+	
+	/* supply reading under the transmit load */
+	{
+		SLightSample xLoadSample;
+		
+		if(LightSensorSample(&xLoadSample) == HAL_OK)
+			SupplyUpdate(xLoadSample.nVrefint, SUPPLY_LOADED, HAL_GetTick());
+	}
+
+	/* wait for TX done, in Sleep mode */
+	while(!xTxDoneFlag)
+	{
+		HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+	}
+	xTxDoneFlag = RESET;
+	RadioPowerTxDone();
+	
+	#if CSMA_MODE
+		/* never got on air, the caller reschedules */
+		if(CsmaTxBusy())
+		{
+			#if LINK_RELIABLE
+				LinkTxAbort();
+			#endif
+			return HAL_GetTick() - lTxStartMs;
+		}
+	#endif
+	
+	#if LINK_RELIABLE
+		#if CSMA_MODE
+			CsmaTxDelivered((LinkTxGetResult() == LINK_TX_ACKED) ? 1 : 0);
+		#endif
+		
+		/* attempts and charge per profile, for the cost of a delivered byte */
+		#if ADR_MODE
+		{
+			float fDbm = PaProfileLevel(cPaIndex);
+			
+			if(LinkGetStats(0, &xLink))
+				lRetx = xLink.lRetx - lRetx;
+			AdrLogDelivery(cTxProfile, cLen, (uint8_t)(1 + lRetx), (LinkTxGetResult() == LINK_TX_ACKED) ? 1 : 0,
+			               EnergyTxNa((int8_t)((fDbm >= 0.0f) ? (fDbm + 0.5f) : (fDbm - 0.5f))));
+		}
+		#endif
+		if(LinkTxGetResult() == LINK_TX_ACKED)
+		{
+			if((TpcFeedbackParse(vectcRxBuff, cRxData, &xFeedback) == HAL_OK) && (xFeedback.nSeq != nTpcAnsweredSeq))
+			{
+				nTpcAnsweredSeq = xFeedback.nSeq;
+				
+				/* the margin at full power, from the headroom the power
+				   control has left */
+				#if ADR_MODE
+				{
+					STpcStatus xTpc;
+					
+					TpcGetStatus(&xTpc);
+					AdrFeedback(xFeedback.cRssiDbm, xFeedback.cSyncErrors, TPC_SYNC_ERRORS_MAX, xTpc.fCeilingDbm - xTpc.fDbm);
+				}
+				#endif
+				TpcFeedback(&xFeedback);
+			}
+			
+			/* the gateway moves on to the channel of the next report, hopped
+			   with the mask this ack announced; on a schedule in the next
+			   slot of the node, on the hop of that frame */
+			#if CHAN_HOPPING
+			{
+				SAggHeader xAggHeader;
+				
+				if(AggParse(pcPayload, cLen, &xAggHeader) == HAL_OK)
+				{
+					#if !TDMA_MODE
+						nChanEpoch = xAggHeader.nSeq + 1;
+					#endif
+					lChanAckMs = HAL_GetTick();
+					cChanSynced = 1;
+					if(cRxData > TPC_FEEDBACK_BYTES)
+						ChanPlanMaskParse(&vectcRxBuff[TPC_FEEDBACK_BYTES], cRxData - TPC_FEEDBACK_BYTES, &nChanMask);
+					#if ADR_MODE
+						AdrTrailerParse(pcPayload, cLen, &cAdrAgreed);
+					#endif
+				}
+			}
+			#endif
+		}
+		else
+		{
+			char linkString[40];
+			int iLen;
+			
+			TpcLoss();
+			iLen = snprintf(linkString, sizeof(linkString), "\r\nNot delivered, %u retx", (unsigned)LINK_RETX);
+			HAL_UART_Transmit(&huart1, (uint8_t*)linkString, (uint16_t)iLen, 500);
+		}
+	#endif
+	
+	return HAL_GetTick() - lTxStartMs;
+}
+
+#if !LINK_RELIABLE && !WMBUS_MODE
+/** ***************************************************************************
+*   \brief      Listen for the link quality answer to a report.
+*   \details    Right after the report the radio receives for at most
+*               TPC_FEEDBACK_WINDOW_MS. An answer for the report steps the
+*               transmit power control, anything else counts as a loss.
+*   \param      nSeq     sequence number of the report
+*   \return     radio on-time, ms
+******************************************************************************/
+static uint32_t TpcListen(uint16_t nSeq)
+{
+	STpcFeedback xFeedback;
+	uint32_t lStartMs = HAL_GetTick();
+	
+	cRxData = 0;
+	xRxDoneFlag = RESET;
+	
+	RadioPowerRxStart();
+	S2LPCmdStrobeFlushRxFifo();
+	S2LPCmdStrobeRx();
+	
+	/* the RX timer ends the window, the tick bound is a backstop */
+	while(!xRxDoneFlag && ((HAL_GetTick() - lStartMs) < (uint32_t)(2 * TPC_FEEDBACK_WINDOW_MS)))
+	{
+		HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+	}
+	if(!xRxDoneFlag)
+		S2LPCmdStrobeSabort();
+	xRxDoneFlag = RESET;
+	
+	if((TpcFeedbackParse(vectcRxBuff, cRxData, &xFeedback) == HAL_OK) && (xFeedback.nSeq == nSeq))
+		TpcFeedback(&xFeedback);
+	else
+		TpcLoss();
+	
+	return HAL_GetTick() - lStartMs;
+}
+#endif
+
+/** ***************************************************************************
+*   \brief      Pack the queued readings into the pending report.
+*   \details    With channel hopping the report goes out on the next channel
+*               while acks keep coming, else it meets the gateway on the
+*               home channel.
+*   \param      xFlush     why the report is sent
+******************************************************************************/
+static void TxBuild(AggFlushReason xFlush)
+{
+	/* the report only carries the readings into the telegram */
+	#if WMBUS_MODE
+	{
+		uint8_t cReport[AGG_FRAME_MAX];
+		uint8_t cReportLen = AggBuild(cReport, sizeof(cReport), nTxSeq++, xFlush);
+		
+		cTxPendingLen = (cReportLen > 0) ? WMbusBuild(vectcTxBuff, sizeof(vectcTxBuff), cReport, cReportLen, TimestampNow()) : 0;
+	}
+	#else
+		cTxPendingLen = AggBuild(vectcTxBuff, sizeof(vectcTxBuff) - ADR_REPORT_BYTES, nTxSeq++, xFlush);
+	#endif
+	TxLinkSelect();
+	
+	/* the profile wanted follows the report, whose air time counts
+	   against the profile it goes out with */
+	#if ADR_MODE
+		if(cTxPendingLen > 0)
+		{
+			SAggHeader xAggHeader;
+			
+			AggParse(vectcTxBuff, cTxPendingLen, &xAggHeader);
+			#if FEC_BENCH
+				AdrSetWanted((cTxProfile == ADR_FALLBACK) ? ADR_FALLBACK + 1 : ADR_FALLBACK);
+			#endif
+			cTxPendingLen += AdrTrailerBuild(&vectcTxBuff[cTxPendingLen]);
+			AdrLogReport(cTxProfile, xAggHeader.cCount, cTxPendingLen);
+		}
+	#endif
+}
+
+/** ***************************************************************************
+*   \brief      Channel and profile of the next packet.
+*   \details    While acks keep coming the node hops with the gateway and
+*               uses the profile its last acked report announced, else it
+*               meets the gateway on the home channel with the slowest
+*               profile. On a schedule the hop epoch is the frame number,
+*               which the gateway knows for every slot, so it is only used
+*               while synchronised to the beacons. The transmit power
+*               control aims for the sensitivity of the profile.
+******************************************************************************/
+static void TxLinkSelect(void)
+{
+	#if CHAN_HOPPING
+		uint8_t cSynced = (cChanSynced && ((HAL_GetTick() - lChanAckMs) < CHAN_RESYNC_MS)) ? 1 : 0;
+		#if TDMA_MODE
+			uint16_t nFrame;
+			
+			TdmaSlotAt(TimestampNow(), &nFrame);
+			cSynced = (cSynced && TdmaIsSynced()) ? 1 : 0;
+			cTxChannel = cSynced ? ChanPlanHop(LINK_NODE_ADDRESS, nFrame, nChanMask) : CHAN_HOME;
+		#else
+			cTxChannel = cSynced ? ChanPlanHop(LINK_NODE_ADDRESS, nChanEpoch, nChanMask) : CHAN_HOME;
+		#endif
+	#endif
+	
+	#if ADR_MODE
+	{
+		uint8_t cProfile = cSynced ? cAdrAgreed : ADR_FALLBACK;
+		
+		if(cProfile != cTxProfile)
+		{
+			TpcSetTarget(AdrGetProfile(cProfile)->cSensitivityDbm + ADR_MARGIN_DB);
+			TpcApply();
+		}
+		cTxProfile = cProfile;
+	}
+	#endif
+}
+
+/** ***************************************************************************
+*   \brief      Send the pending report and park the radio.
+*   \details    The link quality the report arrived with is heard right
+*               after it, carried by the ack on a reliable link. A report
+*               given up on a busy channel stays pending, see TxReschedule().
+*               The energy counters due go right after a report, or on a
+*               schedule in a slot of their own.
+******************************************************************************/
+static void TxReport(void)
+{
+	uint32_t lTxMs, lIdleMs = RBE_MIN_INTERVAL_MS * cSupplyStretch[xSupplyApplied];
+	
+	lTxMs = RadioSend(vectcTxBuff, cTxPendingLen);
+	#if CSMA_MODE
+		if(CsmaTxBusy())
+		{
+			lIdleMs = TxReschedule();
+		}
+		else
+		{
+			cTxPendingLen = 0;
+			cTxRetries = 0;
+		}
+	#else
+		cTxPendingLen = 0;
+	#endif
+	#if !LINK_RELIABLE && !WMBUS_MODE
+		lTxMs += TpcListen((uint16_t)(nTxSeq - 1));
+	#endif
+	
+	/* the PA level can only be changed once the radio is idle */
+	SupplyPolicyApply(SupplyGetLevel());
+	TpcApply();
 	
-	/* S2LP Radio config */
-  S2LPRadioInit(&xRadioInit);
+	/* collectors have no use for the energy frames */
+	#if !WMBUS_MODE
+		if(cTxEnergyPending && (cTxPendingLen == 0) && !TX_SCHEDULED())
+			lTxMs += TxEnergy();
+	#endif
 	
-	/* S2LP Radio set power */
-  S2LPRadioSetMaxPALevel(S_ENABLE);      // Enable transmission at maximum power
-	S2LPRadioSetPALeveldBm(7,POWER_DBM);   // Set output power level for the 7th slot
-	S2LPRadioSetPALevelMaxIndex(7);        // Set output power index to 7
+	/* account radio on-time */
+	RbeLogTx(lTxMs);
 	
-	/* S2LP Packet config */
-  S2LPPktBasicInit(&xBasicInit);
+	/* park the radio, the next report is at least one minimum interval
+	   away, a retry on a busy channel may come sooner */
+	RadioPowerIdle(lIdleMs, S_DISABLE);
+}
+
+/** ***************************************************************************
+*   \brief      Send one share of the energy counters.
+*   \details    They are cumulative, the receiver keeps the latest of each.
+*   \return     radio on-time, ms
+******************************************************************************/
+static uint32_t TxEnergy(void)
+{
+	uint8_t cEnergyFrame[20] = {0};
+	uint32_t lTxMs = 0;
 	
-	/* Tx initialisation */
-	#ifndef RX
-		/* S2LP IRQs enable */
-		S2LPGpioIrqDeInit(NULL);										// Reset IRQ register bits to 0
-		S2LPGpioIrqConfig(TX_DATA_SENT , S_ENABLE);	// Set IRQ to interrupt when data has been transmitted
+	if(EnergyExportFrame(cEnergyFrameNext, cEnergyFrame, sizeof(cEnergyFrame)) > 0)
+		lTxMs = RadioSend(cEnergyFrame, ENERGY_FRAME_BYTES);
+	cEnergyFrameNext = (cEnergyFrameNext + 1) % EnergyFrameCount();
+	cTxEnergyPending = 0;
+	
+	return lTxMs;
+}
+
+#if CSMA_MODE || TDMA_MODE
+/** ***************************************************************************
+*   \brief      Send the pending report: a retry after a busy channel, or
+*               the slot of the node.
+*   \details    On a schedule the task runs in every slot of the node and
+*               takes whatever readings are queued, so reports leave at the
+*               frame rate; a slot without readings carries the energy
+*               counters when due. The slot is only used while the guard
+*               is within the layout, else the report waits for a beacon.
+*               Unsynchronised, it runs after the delay drawn by
+*               TxReschedule().
+******************************************************************************/
+static void TxPendingTask(void)
+{
+	#if TDMA_MODE
+		uint32_t lNow = TimestampNow();
+		
+		/* the radio is receiving, the scan triggers the task once over */
+		if(cTdmaScanning)
+			return;
+		
+		if(TdmaIsSynced())
+		{
+			/* the tick may wake the task a timestamp step before its slot */
+			SchedSetNext(cTxPendingTask, TdmaMsUntil(TdmaNextSlot(lNow + TIMESTAMP_ONE_S), lNow));
+			
+			if((cTxPendingLen == 0) && !AggPending() && !cTxEnergyPending)
+				return;
+			if(!TdmaSlotTx(lNow))
+				return;
+			
+			if((cTxPendingLen == 0) && AggPending())
+				TxBuild(AGG_FLUSH_FORCED);
+			if(cTxPendingLen == 0)
+			{
+				/* where the gateway waits for the next report */
+				TxLinkSelect();
+				RbeLogTx(TxEnergy());
+				RadioPowerIdle(RBE_MIN_INTERVAL_MS * cSupplyStretch[xSupplyApplied], S_DISABLE);
+				return;
+			}
+			
+			/* on the hop of this frame, the report may have been built
+			   or given up on a busy channel in an earlier one */
+			TxLinkSelect();
+		}
 	#endif
 	
-	/* Rx initialisation */
-	#ifdef RX
-		/* S2LP IRQs enable */
-		S2LPGpioIrqDeInit(&xIrqStatus);	  					// Reset IRQ register bits to 0
-		S2LPGpioIrqConfig(RX_DATA_DISC,S_ENABLE);	  // Set IRQ to interrupt if Rx data has been discarded upon filtering
-		S2LPGpioIrqConfig(RX_DATA_READY,S_ENABLE);	// Set IRQ to interrupt if Rx data is ready
-		/* RX timeout config */
-		S2LPTimerSetRxTimerMs(700.0);
+	if(cTxPendingLen == 0)
+		return;
+	
+	TxReport();
+}
+#endif
+
+#if CSMA_MODE
+/** ***************************************************************************
+*   \brief      Keep a report given up on a busy channel for a later retry.
+*   \details    The delay grows with each retry, on a schedule the retry
+*               waits for the next slot; after CSMA_MAX_RESCHEDULES the
+*               report is dropped, counted by the CSMA layer.
+*   \return     ms until the retry, the minimum interval if dropped
+******************************************************************************/
+static uint32_t TxReschedule(void)
+{
+	uint32_t lDelayMs = CsmaRescheduleMs(cTxRetries);
+	
+	if(lDelayMs == 0)
+	{
+		cTxPendingLen = 0;
+		cTxRetries = 0;
+		return RBE_MIN_INTERVAL_MS * cSupplyStretch[xSupplyApplied];
+	}
+	
+	cTxRetries++;
+	#if TDMA_MODE
+		if(TdmaIsSynced())
+			lDelayMs = TdmaMsUntil(TdmaNextSlot(TimestampNow() + TIMESTAMP_ONE_S), TimestampNow());
 	#endif
+	SchedSetNext(cTxPendingTask, lDelayMs);
 	
-	/* payload length config */
-  S2LPPktBasicSetPayloadLength(20);						// Set the payload length to 20 bytes
+	return lDelayMs;
+}
+#endif
+
+#if TDMA_MODE
+/** ***************************************************************************
+*   \brief      Beacon acquisition and tracking.
+*   \details    Unsynchronised, the radio listens on the home channel for a
+*               whole frame, reports waiting meanwhile; a failed scan is
+*               retried later, with a growing delay, reports going out
+*               unscheduled in between. Synchronised, the task wakes ahead
+*               of the beacons TdmaNextBeacon() picks and listens for the
+*               guard either side, the RX timer closing the window.
+******************************************************************************/
+static void TdmaTask(void)
+{
+	uint32_t lNow, lWindowMs, lStartMs;
+	uint8_t cBeacon;
 	
-	/* IRQ registers blanking */
-  S2LPGpioIrqClearStatus();
+	if(cTdmaScanning)
+	{
+		/* a packet other than a beacon, or the scan still running */
+		cBeacon = xRxDoneFlag ? TdmaRxEnd() : 0;
+		if(!cBeacon && ((HAL_GetTick() - lTdmaScanStartMs) < TDMA_SCAN_MS))
+		{
+			if(xRxDoneFlag)
+				TdmaRxStart(0);
+			SchedSetNext(cTdmaTask, TDMA_SCAN_MS - (HAL_GetTick() - lTdmaScanStartMs));
+			return;
+		}
+		
+		if(!xRxDoneFlag)
+			TdmaRxEnd();
+		cTdmaScanning = 0;
+		RadioPowerIdle(RBE_MIN_INTERVAL_MS, S_DISABLE);
+		
+		if(!cBeacon)
+		{
+			SchedSetNext(cTdmaTask, lTdmaScanRetryMs);
+			lTdmaScanRetryMs = (2 * lTdmaScanRetryMs > TDMA_SCAN_RETRY_MAX_MS) ? TDMA_SCAN_RETRY_MAX_MS : 2 * lTdmaScanRetryMs;
+			SchedSetNext(cTxPendingTask, 0);
+			return;
+		}
+		lTdmaScanRetryMs = TDMA_SCAN_RETRY_MS;
+		
+		/* queued readings and a report kept from before go in the slot */
+		lNow = TimestampNow();
+		SchedSetNext(cTxPendingTask, TdmaMsUntil(TdmaNextSlot(lNow), lNow));
+	}
+	else if(TdmaIsSynced() && (lTdmaBeaconTs != 0))
+	{
+		/* until the guard after the beacon, the tick bound is a backstop */
+		lNow = TimestampNow();
+		lWindowMs = TdmaMsUntil(lTdmaBeaconTs, lNow) + TdmaGuardMs(lTdmaBeaconTs) + TDMA_JITTER_MS
+		          + TDMA_BEACON_US / 1000UL + 1;
+		
+		TdmaRxStart(lWindowMs);
+		lStartMs = HAL_GetTick();
+		while(!xRxDoneFlag && ((HAL_GetTick() - lStartMs) < 2 * lWindowMs))
+		{
+			HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+		}
+		
+		if(!TdmaRxEnd())
+			TdmaBeaconMissed(TimestampNow());
+		lNow = TimestampNow();
+		RadioPowerIdle(TdmaMsUntil(TdmaNextSlot(lNow), lNow), S_DISABLE);
+	}
 	
-	#ifdef RX
-		/* RX command */
-		S2LPCmdStrobeRx();
+	lTdmaBeaconTs = 0;
+	if(!TdmaIsSynced())
+	{
+		/* with the radio receiving meanwhile */
+		cTdmaScanning = 1;
+		lTdmaScanStartMs = HAL_GetTick();
+		TdmaRxStart(0);
+		SchedSetNext(cTdmaTask, TDMA_SCAN_MS);
+		return;
+	}
+	
+	lNow = TimestampNow();
+	lTdmaBeaconTs = TdmaNextBeacon(lNow + TIMESTAMP_ONE_S);
+	lWindowMs = TdmaGuardMs(lTdmaBeaconTs) + TDMA_WAKE_MS;
+	SchedSetNext(cTdmaTask, TdmaMsUntil(lTdmaBeaconTs - ((lWindowMs << TIMESTAMP_FRAC_BITS) / 1000), lNow));
+}
+
+/** ***************************************************************************
+*   \brief      Listen for a beacon on the home channel.
+*   \details    The radio interrupts on the end of reception, whatever
+*               the link expects; the retuned channel is not kept.
+*   \param      lWindowMs     RX timer, 0 to listen until stopped
+******************************************************************************/
+static void TdmaRxStart(uint32_t lWindowMs)
+{
+	ClockPoint xClock = ClockGovSet(CLOCK_HIGH);
+	
+	RadioPowerWake();
+	#if CHAN_HOPPING
+		if(ChanPlanCurrent() != CHAN_HOME)
+			RadioPowerRetuned();
+		ChanPlanTune(CHAN_HOME);
+	#endif
+	#if ADR_MODE
+		AdrApply(ADR_FALLBACK);
+	#endif
+	
+	if(lWindowMs > 0)
+		S2LPTimerSetRxTimerMs((float)lWindowMs);
+	else
+		S2LPTimerSetRxTimerCounter(0);
+	#if LINK_RELIABLE
+		S2LPGpioIrqConfig(RX_DATA_DISC, S_ENABLE);
+		S2LPGpioIrqConfig(RX_TIMEOUT, S_ENABLE);
+	#endif
+	
+	cRxData = 0;
+	xRxDoneFlag = RESET;
+	cTdmaListening = 1;
+	RadioPowerRxStart();
+	S2LPCmdStrobeFlushRxFifo();
+	S2LPCmdStrobeRx();
+	ClockGovSet(xClock);
+}
+
+/** ***************************************************************************
+*   \brief      Stop listening and synchronise on a beacon received.
+*   \details    The link quality window of the reports is restored, the
+*               radio is left in READY.
+*   \return     1 if a beacon was received
+******************************************************************************/
+static uint8_t TdmaRxEnd(void)
+{
+	uint32_t lNetworkTs;
+	uint8_t cBeacon = 0;
+	
+	if(!xRxDoneFlag)
+		S2LPCmdStrobeSabort();
+	cTdmaListening = 0;
+	
+	S2LPTimerSetRxTimerMs(TPC_FEEDBACK_WINDOW_MS);
+	#if LINK_RELIABLE
+		S2LPGpioIrqConfig(RX_DATA_DISC, S_DISABLE);
+		S2LPGpioIrqConfig(RX_TIMEOUT, S_DISABLE);
 	#endif
+	S2LPGpioIrqClearStatus();
 	
-	/* infinite loop */
-  while (1)
+	if(xRxDoneFlag && (TdmaBeaconParse(vectcRxBuff, cRxData, &lNetworkTs) == HAL_OK))
 	{
-		/* -------------------- Tx -------------------- */
-		#ifndef RX
-			/* fit the TX FIFO */
-			S2LPCmdStrobeFlushTxFifo();														// Flush Tx FIFO
-			S2LPSpiWriteFifo(20, (uint8_t*)transmitString);				// Write to Tx FIFO
+		TdmaBeaconReceived(lNetworkTs, lTdmaRxTs);
+		cBeacon = 1;
+	}
+	
+	return cBeacon;
+}
+#endif
+
+/** ***************************************************************************
+*   \brief      Select the PA slot for the transmit power control level.
+*   \details    The level is rounded up to a slot, which only costs a write
+*               of PA_POWER0 when it changes. Must not be called while
+*               transmitting; a radio in SHUTDOWN gets the slot when it is
+*               reconfigured, else the register image is captured again
+*               before its next SHUTDOWN.
+******************************************************************************/
+static void TpcApply(void)
+{
+	uint8_t cIndex = PaProfileIndexFor(TpcGetDbm());
+	
+	if(cIndex == cPaIndex)
+		return;
+	
+	cPaIndex = cIndex;
+	if(RadioPowerGetState() != RADIO_PS_SHUTDOWN)
+		PaProfileSelect(cIndex);
+	EnergyTxPower(PaProfileLevel(cIndex));
+	RadioPowerConfigChanged();
+}
+
+/** ***************************************************************************
+*   \brief      Adapt the duty cycle and PA power to the supply grade.
+*   \details    Sampling and reporting intervals are multiplied by
+*               cSupplyStretch and the transmit power control ceiling is set,
+*               only when the grade changes. Must not be called while
+*               transmitting.
+*   \param      xLevel     supply grade
+******************************************************************************/
+static void SupplyPolicyApply(SupplyLevel xLevel)
+{
+	char supplyString[32];
+	int iLen;
+	
+	if(xLevel == xSupplyApplied)
+		return;
+	
+	xSupplyApplied = xLevel;
+	
+	RbeSetIntervals(RBE_MIN_INTERVAL_MS * cSupplyStretch[xLevel], RBE_HEARTBEAT_MS * cSupplyStretch[xLevel]);
+	AggSetDeadline(AGG_DEADLINE_MS * cSupplyStretch[xLevel]);
+	TpcSetCeiling(fSupplyPaDbm[xLevel]);
+	TpcApply();
+	
+	iLen = snprintf(supplyString, sizeof(supplyString), "\r\nSupply level %u", (unsigned)xLevel);
+	HAL_UART_Transmit(&huart1, (uint8_t*)supplyString, (uint16_t)iLen, 500);
+}
+#endif
+
+#if defined(RX) && LDC_MODE
+/** ***************************************************************************
+*   \brief      Low duty cycle receiver report task.
+*   \details    Prints the detection ratio and estimated radio current. When
+*               sweeping, moves to the next sniff window once enough packets
+*               were sent by the transmitter for the ratio to be meaningful.
+******************************************************************************/
+static void LdcTask(void)
+{
+	SLdcRxStats xStats;
+	char ldcString[64];
+	int iLen;
+	
+	LdcRxGetStats(&xStats);
+	iLen = snprintf(ldcString, sizeof(ldcString), "\r\nLDC %u us: rx %lu/%lu, %u permille, %lu uA",
+	                (unsigned)(xLdcRxConfig.fWindowMs * 1000.0), (unsigned long)xStats.lPackets,
+	                (unsigned long)(xStats.lPackets + xStats.lMissed), (unsigned)xStats.nDetectPermille,
+	                (unsigned long)xStats.lAvgCurrentUa);
+	HAL_UART_Transmit(&huart1, (uint8_t*)ldcString, (uint16_t)iLen, 500);
+	
+	#if LINK_RELIABLE
+	{
+		SLinkStats xLink;
+		uint8_t i;
 		
-			/* send the TX command */
-			S2LPCmdStrobeTx();
+		/* retransmissions whose ack was lost, per node */
+		for(i = 0; LinkGetStats(i, &xLink); i++)
+		{
+			iLen = snprintf(ldcString, sizeof(ldcString), "\r\nLink %02X: rx %lu, duplicates %lu",
+			                (unsigned)xLink.cAddress, (unsigned long)xLink.lReceived, (unsigned long)xLink.lDuplicates);
+			HAL_UART_Transmit(&huart1, (uint8_t*)ldcString, (uint16_t)iLen, 500);
+		}
+	}
+	#endif
+	
+	#if CHAN_HOPPING
+	{
+		SChanPlanStats xChan;
+		uint8_t i;
 		
-			/* wait for TX done */
-			while(!xTxDoneFlag);
-			xTxDoneFlag = RESET;
+		/* idle RSSI and load per channel, '-' where blacklisted */
+		ChanPlanGetStats(&xChan);
+		iLen = snprintf(ldcString, sizeof(ldcString), "\r\nChan %u, hops %lu, surveys %lu, mask %04X",
+		                (unsigned)ChanPlanCurrent(), (unsigned long)xChan.lHops,
+		                (unsigned long)xChan.lSurveys, (unsigned)xChan.nMask);
+		HAL_UART_Transmit(&huart1, (uint8_t*)ldcString, (uint16_t)iLen, 500);
+		
+		for(i = 0; i < CHAN_COUNT; i++)
+		{
+			iLen = snprintf(ldcString, sizeof(ldcString), "\r\nChan %u%c %d dBm, used %lu",
+			                (unsigned)i, (xChan.nMask & (1U << i)) ? ':' : '-',
+			                (int)xChan.cNoiseDbm[i], (unsigned long)xChan.lUse[i]);
+			HAL_UART_Transmit(&huart1, (uint8_t*)ldcString, (uint16_t)iLen, 500);
+		}
+	}
+	#endif
+	
+	#if TDMA_MODE
+		iLen = snprintf(ldcString, sizeof(ldcString), "\r\nTDMA %u slots of %lu ms, beacons %lu",
+		                (unsigned)TdmaSlots(), (unsigned long)TDMA_SLOT_MS, (unsigned long)lTdmaBeacons);
+		HAL_UART_Transmit(&huart1, (uint8_t*)ldcString, (uint16_t)iLen, 500);
+	#endif
+	
+	#if ADR_MODE
+		iLen = snprintf(ldcString, sizeof(ldcString), "\r\nADR %lu bit/s",
+		                (unsigned long)AdrGetProfile(AdrCurrent())->lDatarate);
+		HAL_UART_Transmit(&huart1, (uint8_t*)ldcString, (uint16_t)iLen, 500);
+	#endif
+	
+	#if LDC_SWEEP
+		if((xStats.lPackets + xStats.lMissed) >= LDC_SWEEP_PACKETS)
+		{
+			cLdcWindowStep = (cLdcWindowStep + 1) % (sizeof(nLdcWindowsUs) / sizeof(nLdcWindowsUs[0]));
+			xLdcRxConfig.fWindowMs = nLdcWindowsUs[cLdcWindowStep] / 1000.0;
+			LdcRxStop();
+			LdcRxStart(&xLdcRxConfig);
+		}
+	#endif
+}
+#endif
+
+#ifdef RX
+/** ***************************************************************************
+*   \brief      Link quality of the packet just received.
+*   \details    Called from the interrupt handler right after reception, the
+*               RSSI and SQI registers still hold the values latched at the
+*               sync word.
+*   \param      pcRssiDbm       filled with the RSSI
+*   \param      pcSyncErrors    filled with the sync word bits in error
+******************************************************************************/
+static void RxQuality(int8_t *pcRssiDbm, uint8_t *pcSyncErrors)
+{
+	uint8_t cSqi;
+	
+	*pcRssiDbm = (int8_t)S2LPRadioGetRssidBm();
+	S2LPSpiReadRegisters(LINK_QUALIF1_ADDR, 1, &cSqi);
+	cSqi &= SQI_REGMASK;
+	*pcSyncErrors = (cSqi < SYNC_LENGTH) ? (uint8_t)(SYNC_LENGTH - cSqi) : 0;
+}
+
+/** ***************************************************************************
+*   \brief      Answer a report with the link quality it arrived with.
+*   \details    Called from the interrupt handler right after reception. Low
+*               duty cycle mode is suspended for the answer and reception
+*               restarts on its TX_DATA_SENT interrupt. On a reliable link
+*               the radio is sending the ack meanwhile; the answer is kept
+*               for the next ack and loaded once this one is out.
+*   \param      nSeq           sequence number of the report
+*   \param      cRssiDbm       RSSI at the sync word
+*   \param      cSyncErrors    sync word bits in error
+******************************************************************************/
+static void TpcAnswer(uint16_t nSeq, int8_t cRssiDbm, uint8_t cSyncErrors)
+{
+	STpcFeedback xFeedback;
+	uint8_t cAnswer[20] = {0};
+	
+	xFeedback.nSeq = nSeq;
+	xFeedback.cRssiDbm = cRssiDbm;
+	xFeedback.cSyncErrors = cSyncErrors;
+	TpcFeedbackBuild(cAnswer, &xFeedback);
+	
+	#if LINK_RELIABLE
+		memcpy(cAckPayload, cAnswer, TPC_FEEDBACK_BYTES);
+	#else
+		LdcRxSuspend();
+		cAnswerPending = 1;
 		
-			/* pause between two transmissions */
-			HAL_Delay(500);
+		S2LPCmdStrobeFlushTxFifo();
+		S2LPSpiWriteFifo(20, cAnswer);
+		S2LPCmdStrobeTx();
+	#endif
+}
+
+/** ***************************************************************************
+*   \brief      Output the frames received, and the table of nodes.
+*   \details    Triggered by the RX interrupt for each frame queued, so the
+*               UART only runs outside of it; frames arriving while it prints
+*               wait in the queue, those beyond it are counted as dropped.
+*               Energy frames keep the sender's text dump. Every
+*               RX_REPORT_MS the counters of each node follow, with its
+*               RSSI histogram from NODE_RSSI_FLOOR_DBM upwards and its
+*               histogram of sync word bits in error.
+******************************************************************************/
+static void RxTask(void)
+{
+	const SNodeRecord *pxRecord;
+	SNodeTableStats xTable;
+	SNodeStats xNode;
+	char rxString[64];
+	int iLen;
+	uint8_t i;
+	
+	while((pxRecord = NodeRecordPeek()) != NULL)
+	{
+		if((pxRecord->cLen > 0) && (pxRecord->cFrame[0] == ENERGY_FRAME_MARKER))
+		{
+			char energyString[80];
+			
+			iLen = EnergyFormatFrame(pxRecord->cFrame, pxRecord->cLen, energyString, sizeof(energyString));
+			HAL_UART_Transmit(&huart1, (uint8_t*)energyString, (uint16_t)iLen, 500);
+		}
+		else
+		{
+			for(i = 0; (iLen = NodeRecordFormat(pxRecord, i, rxString, sizeof(rxString))) > 0; i++)
+				HAL_UART_Transmit(&huart1, (uint8_t*)rxString, (uint16_t)iLen, 500);
+		}
+		NodeRecordRelease();
+	}
+	
+	if((HAL_GetTick() - lRxReportMs) < RX_REPORT_MS)
+		return;
+	lRxReportMs = HAL_GetTick();
+	
+	NodeTableGetStats(&xTable);
+	iLen = snprintf(rxString, sizeof(rxString), "\r\nNodes %u, full %lu, dropped %lu/%lu, queue %u",
+	                (unsigned)xTable.cNodes, (unsigned long)xTable.lTableFull, (unsigned long)xTable.lQueueFull,
+	                (unsigned long)xTable.lQueued, (unsigned)xTable.cQueueMax);
+	HAL_UART_Transmit(&huart1, (uint8_t*)rxString, (uint16_t)iLen, 500);
+	iLen = snprintf(rxString, sizeof(rxString), "\r\nDiscarded %lu", (unsigned long)lRxDiscarded);
+	HAL_UART_Transmit(&huart1, (uint8_t*)rxString, (uint16_t)iLen, 500);
+	
+	for(i = 0; i < NODE_TABLE_SIZE; i++)
+	{
+		if(!NodeTableGet(i, &xNode))
+			continue;
 		
+		iLen = snprintf(rxString, sizeof(rxString), "\r\nNode %02X: rx %lu, rep %lu, dup %lu, seq %u",
+		                (unsigned)xNode.cAddress, (unsigned long)xNode.lFrames, (unsigned long)xNode.lReports,
+		                (unsigned long)xNode.lDuplicates, (unsigned)xNode.nLastSeq);
+		HAL_UART_Transmit(&huart1, (uint8_t*)rxString, (uint16_t)iLen, 500);
+		iLen = snprintf(rxString, sizeof(rxString), "\r\nNode %02X: miss %lu, late %lu, rst %lu, age %lu s",
+		                (unsigned)xNode.cAddress, (unsigned long)xNode.lMissed, (unsigned long)xNode.lLate,
+		                (unsigned long)xNode.lRestarts, (unsigned long)((HAL_GetTick() - xNode.lLastMs) / 1000));
+		HAL_UART_Transmit(&huart1, (uint8_t*)rxString, (uint16_t)iLen, 500);
+		iLen = snprintf(rxString, sizeof(rxString), "\r\nRSSI %02X: %u %u %u %u %u %u %u %u",
+		                (unsigned)xNode.cAddress, (unsigned)xNode.nRssiHist[0], (unsigned)xNode.nRssiHist[1],
+		                (unsigned)xNode.nRssiHist[2], (unsigned)xNode.nRssiHist[3], (unsigned)xNode.nRssiHist[4],
+		                (unsigned)xNode.nRssiHist[5], (unsigned)xNode.nRssiHist[6], (unsigned)xNode.nRssiHist[7]);
+		HAL_UART_Transmit(&huart1, (uint8_t*)rxString, (uint16_t)iLen, 500);
+		iLen = snprintf(rxString, sizeof(rxString), "\r\nSync %02X: %u %u %u %u %u",
+		                (unsigned)xNode.cAddress, (unsigned)xNode.nSqiHist[0], (unsigned)xNode.nSqiHist[1],
+		                (unsigned)xNode.nSqiHist[2], (unsigned)xNode.nSqiHist[3], (unsigned)xNode.nSqiHist[4]);
+		HAL_UART_Transmit(&huart1, (uint8_t*)rxString, (uint16_t)iLen, 500);
+	}
+}
+
+#if CHAN_HOPPING
+/** ***************************************************************************
+*   \brief      Follow the nodes across the channels.
+*   \details    On a schedule the task runs at the start of every slot and
+*               tunes the hop of the node the slot belongs to, from its
+*               address, the frame number and the mask of the last ack it
+*               was sent, with the profile its last report announced; so
+*               any number of nodes is followed, each in its own slot. The
+*               beacon slot, the end of the frame and the slots of nodes
+*               not heard from for CHAN_RESYNC_MS are on the home channel,
+*               where a node without acks meets the gateway.
+*               Without a schedule only LINK_NODE_ADDRESS is followed: once
+*               a report settled, its retransmissions and the energy frame
+*               after it being over, reception moves to the channel of the
+*               next report, hopped with the mask its ack announced, and
+*               after CHAN_RESYNC_MS without a report back to the home
+*               channel, as the node does after that long without an ack.
+*               The idle RSSI survey runs when no node is expected; its
+*               mask goes out with the following acks.
+******************************************************************************/
+static void ChanTask(void)
+{
+	uint32_t lNow = HAL_GetTick();
+	uint32_t lPrimask;
+	uint8_t cChannel = ChanPlanCurrent();
+	uint8_t cSurvey;
+	#if ADR_MODE
+		uint8_t cProfile = AdrCurrent();
+	#endif
+	#if TDMA_MODE
+		SChanFollow xFollow;
+		uint16_t nFrame, nSlot;
+		uint8_t i;
+	#else
+		uint32_t lRxMs;
+		uint16_t nEpoch, nMask;
+		uint8_t cRetune;
+		#if ADR_MODE
+			uint8_t cNext;
 		#endif
+	#endif
+	
+	/* never while an ack is going out */
+	if(cAnswerPending)
+	{
+		#if TDMA_MODE
+			SchedSetNext(cChanTask, 1);
+		#endif
+		return;
+	}
+	
+	#if TDMA_MODE
+		/* the node of this slot, if it is being heard */
+		nSlot = TdmaSlotAt(TimestampNow(), &nFrame);
+		cChannel = CHAN_HOME;
+		#if ADR_MODE
+			cProfile = ADR_FALLBACK;
+		#endif
+		cSurvey = ((nSlot != TDMA_BEACON_SLOT) && ((lNow - lChanSurveyMs) >= CHAN_SURVEY_MS)) ? 1 : 0;
+		for(i = 0; (nSlot != TDMA_NO_SLOT) && (i < NODE_TABLE_SIZE); i++)
+		{
+			lPrimask = __get_PRIMASK();
+			__disable_irq();
+			xFollow = xChanFollow[i];
+			__set_PRIMASK(lPrimask);
+			
+			if(!xFollow.cUsed || (TdmaSlotOf(xFollow.cAddress) != nSlot) || ((lNow - xFollow.lRxMs) >= CHAN_RESYNC_MS))
+				continue;
+			
+			cChannel = ChanPlanHop(xFollow.cAddress, nFrame, xFollow.nMask);
+			#if ADR_MODE
+				cProfile = xFollow.cProfile;
+			#endif
+			cSurvey = 0;
+			break;
+		}
+	#else
+		lPrimask = __get_PRIMASK();
+		__disable_irq();
+		lRxMs = lChanRxMs;
+		nEpoch = nChanEpoch;
+		nMask = nChanAckedMask;
+		cRetune = cChanRetune;
+		#if ADR_MODE
+			cNext = cAdrNext;
+		#endif
+		__set_PRIMASK(lPrimask);
 		
-		/* -------------------- Rx -------------------- */
-		#ifdef RX
+		if(cRetune)
+		{
+			if((lNow - lRxMs) < CHAN_SETTLE_MS)
+				return;
+			cChanRetune = 0;
+			cChannel = ChanPlanHop(LINK_NODE_ADDRESS, nEpoch, nMask);
+			#if ADR_MODE
+				cProfile = cNext;
+			#endif
+		}
+		else if(cChanSynced && ((lNow - lRxMs) >= CHAN_RESYNC_MS))
+		{
+			cChanSynced = 0;
+			cChannel = CHAN_HOME;
+			#if ADR_MODE
+				cProfile = ADR_FALLBACK;
+			#endif
+		}
+		cSurvey = ((cRetune || !cChanSynced) && ((lNow - lChanSurveyMs) >= CHAN_SURVEY_MS)) ? 1 : 0;
+	#endif
+	
+	#if ADR_MODE
+		if((cChannel != ChanPlanCurrent()) || (cProfile != AdrCurrent()) || cSurvey)
+	#else
+		if((cChannel != ChanPlanCurrent()) || cSurvey)
+	#endif
+	{
+		/* the radio in READY meanwhile */
+		if(LdcRxIsActive())
+			LdcRxSuspend();
+		else
+			S2LPCmdStrobeSabort();
+		
+		if(cSurvey)
+		{
+			ChanPlanSurvey(CHAN_SURVEY_DWELL_MS);
+			lChanSurveyMs = lNow;
 			
+			lPrimask = __get_PRIMASK();
+			__disable_irq();
+			ChanPlanMaskBuild(&cAckPayload[TPC_FEEDBACK_BYTES], ChanPlanGetMask());
+			__set_PRIMASK(lPrimask);
+		}
+		ChanPlanTune(cChannel);
+		#if ADR_MODE
+			AdrApply(cProfile);
 		#endif
-	}		
+		
+		if(LdcRxIsSuspended())
+			LdcRxResume();
+		else
+			S2LPCmdStrobeRx();
+	}
+	
+	#if TDMA_MODE
+	{
+		uint32_t lNowTs = TimestampNow();
+		
+		SchedSetNext(cChanTask, TdmaMsUntil(TdmaNextSlotStart(lNowTs), lNowTs) + TDMA_ROUND_MS);
+	}
+	#endif
+}
+
+#if TDMA_MODE
+/** ***************************************************************************
+*   \brief      Entry of a node in the table of followed nodes, added if
+*               missing. Called from the RX interrupt.
+*   \details    A full table takes the place of the node heard least
+*               recently, once it is no longer followed.
+*   \param      cAddress     node address
+*   \return     entry, NULL if every node is still followed
+******************************************************************************/
+static SChanFollow *ChanFollow(uint8_t cAddress)
+{
+	uint32_t lNow = HAL_GetTick();
+	SChanFollow *pxOldest = NULL;
+	uint8_t i;
+	
+	for(i = 0; i < NODE_TABLE_SIZE; i++)
+	{
+		if(xChanFollow[i].cUsed && (xChanFollow[i].cAddress == cAddress))
+			return &xChanFollow[i];
+		if(!xChanFollow[i].cUsed)
+		{
+			if((pxOldest == NULL) || pxOldest->cUsed)
+				pxOldest = &xChanFollow[i];
+		}
+		else if(((lNow - xChanFollow[i].lRxMs) >= CHAN_RESYNC_MS) &&
+		        ((pxOldest == NULL) || (pxOldest->cUsed && ((lNow - xChanFollow[i].lRxMs) > (lNow - pxOldest->lRxMs)))))
+			pxOldest = &xChanFollow[i];
+	}
+	
+	if(pxOldest != NULL)
+	{
+		pxOldest->cAddress = cAddress;
+		pxOldest->cUsed = 1;
+		pxOldest->cProfile = ADR_FALLBACK;
+		pxOldest->nMask = ChanPlanAllMask();
+		pxOldest->lRxMs = lNow;
+	}
+	
+	return pxOldest;
+}
+#endif
+#endif
+
+#if LINK_RELIABLE
+/** ***************************************************************************
+*   \brief      Load the ack payload again, after an ack or a beacon used
+*               the TX FIFO. The radio must not be transmitting.
+******************************************************************************/
+static void AckReload(void)
+{
+	LinkSetAckPayload(cAckPayload, sizeof(cAckPayload));
+	#if CHAN_HOPPING
+		ChanPlanMaskParse(&cAckPayload[TPC_FEEDBACK_BYTES], CHAN_MASK_BYTES, &nChanLoadedMask);
+	#endif
+}
+#endif
+
+#if TDMA_MODE
+/** ***************************************************************************
+*   \brief      Beacon the network time at the start of each frame.
+*   \details    Sent on the home channel with the short answer preamble,
+*               the nodes listening for it. The timestamp is read right
+*               before the TX strobe, the nodes add the air time. Never
+*               while an ack is going out, the beacon is then a little late
+*               within the nodes' jitter allowance. Reception resumes on
+*               the channel it was on, with the ack payload loaded again.
+******************************************************************************/
+static void TdmaBeaconTask(void)
+{
+	uint8_t cBeacon[TDMA_BEACON_BYTES];
+	uint32_t lStartMs, lNow;
+	#if CHAN_HOPPING
+		uint8_t cChannel = ChanPlanCurrent();
+	#endif
+	#if ADR_MODE
+		uint8_t cProfile = AdrCurrent();
+	#endif
+	
+	if(cAnswerPending)
+	{
+		SchedSetNext(cTdmaTask, 1);
+		return;
+	}
+	
+	/* the radio in READY meanwhile */
+	if(LdcRxIsActive())
+		LdcRxSuspend();
+	else
+		S2LPCmdStrobeSabort();
+	#if CHAN_HOPPING
+		ChanPlanTune(CHAN_HOME);
+	#endif
+	#if ADR_MODE
+		AdrApply(ADR_FALLBACK);
+	#endif
+	
+	cTdmaBeaconSending = 1;
+	S2LPCmdStrobeFlushTxFifo();
+	#if LINK_RELIABLE
+		LinkSetPayloadLength(TDMA_BEACON_BYTES);
+	#else
+		S2LPPktBasicSetPayloadLength(TDMA_BEACON_BYTES);
+	#endif
+	TdmaBeaconBuild(cBeacon, TimestampNow());
+	S2LPSpiWriteFifo(TDMA_BEACON_BYTES, cBeacon);
+	S2LPCmdStrobeTx();
+	lTdmaBeacons++;
+	
+	/* TX_DATA_SENT clears the flag, the tick bound is a backstop */
+	lStartMs = HAL_GetTick();
+	while(cTdmaBeaconSending && ((HAL_GetTick() - lStartMs) < TDMA_BEACON_TIMEOUT_MS))
+	{
+		HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+	}
+	if(cTdmaBeaconSending)
+	{
+		cTdmaBeaconSending = 0;
+		S2LPCmdStrobeSabort();
+	}
+	
+	#if CHAN_HOPPING
+		ChanPlanTune(cChannel);
+	#endif
+	#if ADR_MODE
+		AdrApply(cProfile);
+	#endif
+	#if LINK_RELIABLE
+		AckReload();
+	#endif
+	
+	if(LdcRxIsSuspended())
+		LdcRxResume();
+	else
+		S2LPCmdStrobeRx();
+	
+	lNow = TimestampNow();
+	SchedSetNext(cTdmaTask, TdmaMsUntil(TdmaFrameStart(lNow), lNow) + TDMA_ROUND_MS);
 }
+#endif
+#endif
 
 void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 {
@@ -245,9 +2828,63 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 				// set the tx_done_flag to manage the event in the main()
 				xTxDoneFlag = SET;
 				
+				// the radio went back to READY on its own
+				EnergyRadioSet(ENERGY_RADIO_READY);
+				
 				// toggle LED1
 				HAL_GPIO_TogglePin(LED_GRN_GPIO_Port, LED_GRN_Pin);
 			}
+			
+			// link quality answer, or the end of the window for it
+			if(xIrqStatus.IRQ_RX_DATA_READY)
+			{
+				cRxData = S2LPFifoReadNumberBytesRxFifo();
+				if(cRxData > sizeof(vectcRxBuff))
+					cRxData = sizeof(vectcRxBuff);
+				S2LPSpiReadFifo(cRxData, vectcRxBuff);
+				S2LPCmdStrobeFlushRxFifo();
+			}
+			#if CSMA_MODE
+				// channel busy through every back-off, the radio is back in READY
+				if(CsmaIrq(&xIrqStatus))
+				{
+					xTxDoneFlag = SET;
+					EnergyRadioSet(ENERGY_RADIO_READY);
+				}
+			#endif
+			#if TDMA_MODE
+				// beacon, another packet or the end of the window, the radio is back in READY
+				if(cTdmaListening && (xIrqStatus.IRQ_RX_DATA_READY || xIrqStatus.IRQ_RX_DATA_DISC || xIrqStatus.IRQ_RX_TIMEOUT))
+				{
+					if(xIrqStatus.IRQ_RX_DATA_READY)
+						lTdmaRxTs = TimestampRaw();
+					xRxDoneFlag = SET;
+					EnergyRadioSet(ENERGY_RADIO_READY);
+					if(cTdmaScanning)
+						SchedTrigger(cTdmaTask);
+				}
+			#endif
+			#if LINK_RELIABLE
+				// ack received or retransmissions exhausted, the radio is back in READY
+				if(!TDMA_LISTENING() && (LinkTxIrq(&xIrqStatus) != LINK_TX_PENDING))
+				{
+					xTxDoneFlag = SET;
+					EnergyRadioSet(ENERGY_RADIO_READY);
+					HAL_GPIO_TogglePin(LED_GRN_GPIO_Port, LED_GRN_Pin);
+				}
+			#else
+			if(!TDMA_LISTENING() && (xIrqStatus.IRQ_RX_DATA_READY || xIrqStatus.IRQ_RX_DATA_DISC || xIrqStatus.IRQ_RX_TIMEOUT))
+			{
+				xRxDoneFlag = SET;
+				EnergyRadioSet(ENERGY_RADIO_READY);
+			}
+			#endif
+			
+			// battery level detector and brown-out
+			if(xIrqStatus.IRQ_LOW_BATT_LVL || xIrqStatus.IRQ_BOR)
+			{
+				SupplyRadioEvent(xIrqStatus.IRQ_LOW_BATT_LVL, xIrqStatus.IRQ_BOR);
+			}
 		}
 	#endif
 	
@@ -260,22 +2897,42 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 			/* Get the IRQ status */
 			S2LPGpioIrqGetStatus(&xIrqStatus);
 			
+			#if LDC_MODE
+				LdcRxIrq(&xIrqStatus);
+			#endif
+			
 			/* Check the S2LP RX_DATA_DISC IRQ flag */
 			if(xIrqStatus.IRQ_RX_DATA_DISC)
 			{
-				/* error - data discarded */
-				uint8_t debugString[] = {"\r\nRx data discarded"};
-				HAL_UART_Transmit(&huart1, debugString, sizeof(debugString), 500);
+				/* error - data discarded, output with the table of nodes */
+				lRxDiscarded++;
 				
-				/* RX command - to ensure the device will be ready for the next reception */
-				S2LPCmdStrobeRx();
+				/* RX command - to ensure the device will be ready for the next reception,
+				   in LDC mode the radio goes back to sleep and wakes itself */
+				if(!LdcRxIsActive())
+					S2LPCmdStrobeRx();
 			}
 				
 			/* Check the S2LP RX_DATA_READY IRQ flag */
 			else if(xIrqStatus.IRQ_RX_DATA_READY)
 			{
+				SAggHeader xAggHeader;
+				SNodeRecord *pxRecord;
+				NodeRxResult xNodeRx;
+				uint16_t nMissed;
+				uint8_t cSource = LINK_NODE_ADDRESS, cDuplicate = 0, cSyncErrors;
+				int8_t cRssiDbm;
+				#if LINK_RELIABLE
+					SLinkRx xLinkRx;
+				#endif
+				#if CHAN_HOPPING && TDMA_MODE
+					SChanFollow *pxFollow = NULL;
+				#endif
+				
 				/* Get the RX FIFO size */
 				cRxData = S2LPFifoReadNumberBytesRxFifo();
+				if(cRxData > sizeof(vectcRxBuff))
+					cRxData = sizeof(vectcRxBuff);
 				
 				/* Read the RX FIFO */
 				S2LPSpiReadFifo(cRxData, vectcRxBuff);
@@ -283,13 +2940,130 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 				/* Flush the RX FIFO */
 				S2LPCmdStrobeFlushRxFifo();
 				
-				/* Output Rx data to UART */
-				uint8_t debugString[] = {"\r\nRx data:\r\n"};
-				HAL_UART_Transmit(&huart1, debugString, sizeof(debugString), 500);
-				HAL_UART_Transmit(&huart1, vectcRxBuff, cRxData, 500);
+				/* latched at the sync word, before an ack or answer goes out */
+				RxQuality(&cRssiDbm, &cSyncErrors);
+				
+				#if LINK_RELIABLE
+					/* while the radio acks, reception restarts once the ack is out */
+					LinkRxIrq(&xLinkRx);
+					cAnswerPending = xLinkRx.cAcked;
+					cSource = xLinkRx.cSource;
+					cDuplicate = xLinkRx.cDuplicate;
+				#endif
+				
+				/* sequence and link quality per node, duplicates included; the
+				   frame is output by RxTask() unless already received or longer
+				   than a record */
+				xNodeRx = NodeTableRx(cSource, (AggParse(vectcRxBuff, cRxData, &xAggHeader) == HAL_OK) ? &xAggHeader.nSeq : NULL,
+				                      cDuplicate, cRssiDbm, cSyncErrors, HAL_GetTick(), &nMissed);
+				if((xNodeRx != NODE_RX_DUPLICATE) && (cRxData > 0) && (cRxData <= NODE_FRAME_MAX) && ((pxRecord = NodeRecordSlot()) != NULL))
+				{
+					pxRecord->cSource = cSource;
+					pxRecord->cRssiDbm = cRssiDbm;
+					pxRecord->cSyncErrors = cSyncErrors;
+					pxRecord->xResult = xNodeRx;
+					pxRecord->nMissed = nMissed;
+					pxRecord->cLen = cRxData;
+					memcpy(pxRecord->cFrame, vectcRxBuff, cRxData);
+					NodeRecordCommit();
+					SchedTrigger(cRxTask);
+				}
+				
+				/* a retransmission already handled is dropped */
+				if(cDuplicate)
+					cRxData = 0;
+				
+				/* the node hops with the mask of the last ack it got, the one
+				   going out now */
+				#if CHAN_HOPPING && TDMA_MODE
+					if(xLinkRx.cAcked && ((pxFollow = ChanFollow(xLinkRx.cSource)) != NULL))
+					{
+						pxFollow->nMask = nChanLoadedMask;
+						pxFollow->lRxMs = HAL_GetTick();
+					}
+				#elif CHAN_HOPPING
+					if(xLinkRx.cAcked && (xLinkRx.cSource == LINK_NODE_ADDRESS))
+						nChanAckedMask = nChanLoadedMask;
+				#endif
+				
+				/* answer reports with the link quality first, the sender only
+				   listens for a short window */
+				if(AggParse(vectcRxBuff, cRxData, &xAggHeader) == HAL_OK)
+				{
+					TpcAnswer(xAggHeader.nSeq, cRssiDbm, cSyncErrors);
+					
+					/* next report on the next channel, retuned by ChanTask():
+					   on a schedule in the slot of each node, else only the
+					   hops of one node can be followed */
+					#if CHAN_HOPPING && TDMA_MODE && ADR_MODE
+						if(pxFollow != NULL)
+							AdrTrailerParse(vectcRxBuff, cRxData, &pxFollow->cProfile);
+					#elif CHAN_HOPPING && !TDMA_MODE
+						if(xLinkRx.cSource == LINK_NODE_ADDRESS)
+						{
+							nChanEpoch = xAggHeader.nSeq + 1;
+							lChanRxMs = HAL_GetTick();
+							cChanRetune = 1;
+							cChanSynced = 1;
+							#if ADR_MODE
+							{
+								uint8_t cProfile;
+								
+								if(AdrTrailerParse(vectcRxBuff, cRxData, &cProfile) == HAL_OK)
+									cAdrNext = cProfile;
+							}
+							#endif
+						}
+					#endif
+					
+					#if LDC_MODE
+						/* to count lost packets, from the node the sniff
+						   windows are measured with; sequences of different
+						   nodes are unrelated */
+						if(cSource == LINK_NODE_ADDRESS)
+							LdcRxLogSequence(xAggHeader.nSeq);
+					#endif
+				}
+				
+				/* RX command - to ensure the device will be ready for the next reception,
+				   in LDC mode the radio goes back to sleep and wakes itself. While an
+				   answer is sent, reception restarts once it is out */
+				if(!LdcRxIsActive() && !cAnswerPending)
+					S2LPCmdStrobeRx();
+			}
+			
+			/* Link quality answer or ack sent, back to reception */
+			else if(xIrqStatus.IRQ_TX_DATA_SENT)
+			{
+				EnergyRadioSet(ENERGY_RADIO_READY);
+				
+				#if TDMA_MODE
+					/* the beacon task restarts reception itself */
+					if(cTdmaBeaconSending)
+					{
+						cTdmaBeaconSending = 0;
+						return;
+					}
+				#endif
+				
+				cAnswerPending = 0;
 				
-				/* RX command - to ensure the device will be ready for the next reception */
-				S2LPCmdStrobeRx();
+				#if LINK_RELIABLE
+					/* the next ack carries the latest link quality answer */
+					LdcRxSuspend();
+					AckReload();
+				#endif
+				
+				if(LdcRxIsSuspended())
+					LdcRxResume();
+				else
+					S2LPCmdStrobeRx();
+			}
+			
+			/* LDC wake-up and empty sniff, only enabled for measurement */
+			else if(xIrqStatus.IRQ_WKUP_TOUT_LDC || xIrqStatus.IRQ_RX_TIMEOUT)
+			{
+				/* counted by LdcRxIrq() */
 			}
 			
 			/* If IRQ status is anything else */
@@ -0,0 +1,438 @@
+/** ***************************************************************************
+*   \file        mg_Scheduler.c
+*   \brief       Tickless cooperative scheduler. Runs due tasks, then stops the
+*                core until the next one on the RTC wake-up timer, keeping the
+*                HAL tick consistent across the low power periods.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+/*****************************************************************************/
+// standard libraries
+#include <string.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "mg_Scheduler.h"
+
+// user headers from other components
+#include "mg_Timestamp.h"
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/**
+* @brief Task table entry
+*/
+typedef struct {
+  SchedTaskFn pfTask;           /*!< Task body, NULL when the slot is free */
+  uint32_t lNextRunMs;          /*!< HAL tick of the next run */
+  uint32_t lPeriodMs;           /*!< Reload period, 0 for a one-shot */
+  uint8_t  cActive;             /*!< Scheduled */
+} SSchedTask;
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+#define SCHED_WUT_FINE_HZ           2048        // LSE / 16
+#define SCHED_WUT_MAX_S             0x10000UL
+
+/*****************************************************************************/
+// static function declarations
+static void SchedIdle(uint32_t lIdleMs);
+
+/*****************************************************************************/
+// static variable declarations
+extern RTC_HandleTypeDef hrtc;
+extern __IO uint32_t uwTick;
+
+static SSchedTask axSchedTasks[SCHED_MAX_TASKS];
+static SSchedStats xSchedStats;
+static uint32_t lSchedStartMs;
+static volatile uint8_t acSchedTriggered[SCHED_MAX_TASKS];
+static volatile uint8_t cSchedTriggerPending;
+static volatile uint8_t cSchedWakeupFired;
+
+/*****************************************************************************/
+// functions
+
+/** ***************************************************************************
+*   \brief      Initialise the scheduler and the low power configuration.
+*   \details    VREFINT is switched off in STOP (ultra low power) without
+*               waiting for it to restart on wake-up (fast wake-up). The core
+*               restarts on MSI, which is the system clock, so no clock
+*               reconfiguration is needed after STOP.
+******************************************************************************/
+void SchedInit(void)
+{
+	memset(axSchedTasks, 0, sizeof(axSchedTasks));
+	memset(&xSchedStats, 0, sizeof(xSchedStats));
+	memset((void *)acSchedTriggered, 0, sizeof(acSchedTriggered));
+	cSchedTriggerPending = 0;
+	cSchedWakeupFired = 0;
+	lSchedStartMs = HAL_GetTick();
+
+	HAL_PWREx_EnableUltraLowPower();
+	HAL_PWREx_EnableFastWakeUp();
+	__HAL_RCC_WAKEUPSTOP_CLK_CONFIG(RCC_STOP_WAKEUPCLOCK_MSI);
+
+	HAL_NVIC_SetPriority(RTC_IRQn, 0, 0);
+	HAL_NVIC_EnableIRQ(RTC_IRQn);
+}
+
+/** ***************************************************************************
+*   \brief      Register a task.
+*   \param      pfTask            task body
+*   \param      lFirstDelayMs     delay before the first run
+*   \param      lPeriodMs         reload period, 0 for a task that reschedules
+*                                 itself with SchedSetNext()
+*   \return     task id, SCHED_NO_TASK if the table is full
+******************************************************************************/
+uint8_t SchedAdd(SchedTaskFn pfTask, uint32_t lFirstDelayMs, uint32_t lPeriodMs)
+{
+	for(uint8_t i = 0; i < SCHED_MAX_TASKS; i++)
+	{
+		if(axSchedTasks[i].pfTask == NULL)
+		{
+			axSchedTasks[i].pfTask = pfTask;
+			axSchedTasks[i].lPeriodMs = lPeriodMs;
+			axSchedTasks[i].lNextRunMs = HAL_GetTick() + lFirstDelayMs;
+			axSchedTasks[i].cActive = 1;
+			return i;
+		}
+	}
+
+	return SCHED_NO_TASK;
+}
+
+/** ***************************************************************************
+*   \brief      Schedule the next run of a task, relative to now.
+*   \details    May be called by the task itself, it then overrides the period.
+*   \param      cTask        task id
+*   \param      lDelayMs     delay before the next run
+******************************************************************************/
+void SchedSetNext(uint8_t cTask, uint32_t lDelayMs)
+{
+	if(cTask >= SCHED_MAX_TASKS)
+		return;
+
+	axSchedTasks[cTask].lNextRunMs = HAL_GetTick() + lDelayMs;
+	axSchedTasks[cTask].cActive = 1;
+}
+
+/** ***************************************************************************
+*   \brief      Run a task as soon as possible. Safe to call from interrupts.
+*   \param      cTask     task id
+******************************************************************************/
+void SchedTrigger(uint8_t cTask)
+{
+	if(cTask >= SCHED_MAX_TASKS)
+		return;
+
+	acSchedTriggered[cTask] = 1;
+	cSchedTriggerPending = 1;
+}
+
+/** ***************************************************************************
+*   \brief      Next run time of a task.
+*   \param      cTask     task id
+*   \return     HAL tick of the next run
+******************************************************************************/
+uint32_t SchedGetNextRun(uint8_t cTask)
+{
+	if(cTask >= SCHED_MAX_TASKS)
+		return 0;
+
+	return axSchedTasks[cTask].lNextRunMs;
+}
+
+/** ***************************************************************************
+*   \brief      Time left before a task runs.
+*   \details    For code that holds the core for long, e.g. a sleep of its
+*               own, to hand back in time.
+*   \param      cTask     task id
+*   \return     ms until the next run, 0 if due or triggered, 0xFFFFFFFF
+*               if the task is not scheduled
+******************************************************************************/
+uint32_t SchedMsToNext(uint8_t cTask)
+{
+	int32_t lDueMs;
+
+	if((cTask >= SCHED_MAX_TASKS) || (axSchedTasks[cTask].pfTask == NULL))
+		return 0xFFFFFFFFUL;
+	if(acSchedTriggered[cTask])
+		return 0;
+	if(!axSchedTasks[cTask].cActive)
+		return 0xFFFFFFFFUL;
+
+	lDueMs = (int32_t)(axSchedTasks[cTask].lNextRunMs - HAL_GetTick());
+
+	return (lDueMs <= 0) ? 0 : (uint32_t)lDueMs;
+}
+
+/** ***************************************************************************
+*   \brief      Time left before any other task runs.
+*   \details    For a task that holds the core for long, the others only
+*               run once it returns.
+*   \param      cTask     task id of the caller
+*   \return     ms until the earliest run of another task, 0xFFFFFFFF if
+*               none is scheduled
+******************************************************************************/
+uint32_t SchedMsToOthers(uint8_t cTask)
+{
+	uint32_t lMinMs = 0xFFFFFFFFUL, lDueMs;
+
+	for(uint8_t i = 0; i < SCHED_MAX_TASKS; i++)
+	{
+		if(i == cTask)
+			continue;
+
+		lDueMs = SchedMsToNext(i);
+		if(lDueMs < lMinMs)
+			lMinMs = lDueMs;
+	}
+
+	return lMinMs;
+}
+
+/** ***************************************************************************
+*   \brief      Scheduler loop, never returns.
+*   \details    Runs every task that is due or triggered, then idles until the
+*               earliest next run. Periodic tasks are reloaded before they run
+*               and keep their phase unless they fell more than a period behind.
+******************************************************************************/
+void SchedRun(void)
+{
+	while(1)
+	{
+		uint32_t lNowMs, lIdleMs;
+		int32_t lDueMs;
+
+		cSchedTriggerPending = 0;
+
+		for(uint8_t i = 0; i < SCHED_MAX_TASKS; i++)
+		{
+			SSchedTask *pxTask = &axSchedTasks[i];
+
+			if(pxTask->pfTask == NULL)
+				continue;
+
+			lNowMs = HAL_GetTick();
+			if(acSchedTriggered[i] || (pxTask->cActive && ((int32_t)(pxTask->lNextRunMs - lNowMs) <= 0)))
+			{
+				acSchedTriggered[i] = 0;
+
+				if(pxTask->lPeriodMs != 0)
+				{
+					pxTask->lNextRunMs += pxTask->lPeriodMs;
+					if((int32_t)(pxTask->lNextRunMs - lNowMs) <= 0)
+						pxTask->lNextRunMs = lNowMs + pxTask->lPeriodMs;
+				}
+				else
+				{
+					pxTask->cActive = 0;
+				}
+
+				pxTask->pfTask();
+				xSchedStats.lTaskRuns++;
+			}
+		}
+
+		/* earliest next run, forever if nothing is scheduled */
+		lNowMs = HAL_GetTick();
+		lIdleMs = 0xFFFFFFFFUL;
+		for(uint8_t i = 0; i < SCHED_MAX_TASKS; i++)
+		{
+			if((axSchedTasks[i].pfTask == NULL) || !axSchedTasks[i].cActive)
+				continue;
+
+			lDueMs = (int32_t)(axSchedTasks[i].lNextRunMs - lNowMs);
+			if(lDueMs <= 0)
+				lIdleMs = 0;
+			else if((uint32_t)lDueMs < lIdleMs)
+				lIdleMs = (uint32_t)lDueMs;
+		}
+
+		SchedIdle(lIdleMs);
+	}
+}
+
+/** ***************************************************************************
+*   \brief      Copy out the time accounting.
+*   \param      pxStats     destination
+******************************************************************************/
+void SchedGetStats(SSchedStats *pxStats)
+{
+	*pxStats = xSchedStats;
+	pxStats->lRunMs = (HAL_GetTick() - lSchedStartMs) - xSchedStats.lSleepMs - xSchedStats.lStopMs;
+}
+
+/** ***************************************************************************
+*   \brief      Arm the RTC wake-up timer.
+*   \details    Periods up to SCHED_WUT_FINE_MAX_MS use the 2048 Hz LSE/16
+*               clock, longer ones the 1 Hz calendar clock. Needs the HAL tick,
+*               call it before SchedTickSuspend().
+*   \param      lMs     period, ms
+*   \return     HAL status
+******************************************************************************/
+HAL_StatusTypeDef SchedWakeupStart(uint32_t lMs)
+{
+	uint32_t lCounter;
+
+	cSchedWakeupFired = 0;
+
+	if(lMs <= SCHED_WUT_FINE_MAX_MS)
+	{
+		lCounter = (lMs * SCHED_WUT_FINE_HZ) / 1000;
+		if(lCounter == 0)
+			lCounter = 1;
+		return HAL_RTCEx_SetWakeUpTimer_IT(&hrtc, lCounter - 1, RTC_WAKEUPCLOCK_RTCCLK_DIV16);
+	}
+
+	lCounter = lMs / 1000;
+	if(lCounter > SCHED_WUT_MAX_S)
+		lCounter = SCHED_WUT_MAX_S;
+	return HAL_RTCEx_SetWakeUpTimer_IT(&hrtc, lCounter - 1, RTC_WAKEUPCLOCK_CK_SPRE_16BITS);
+}
+
+/** ***************************************************************************
+*   \brief      Disarm the RTC wake-up timer.
+******************************************************************************/
+void SchedWakeupStop(void)
+{
+	HAL_RTCEx_DeactivateWakeUpTimer(&hrtc);
+}
+
+/** ***************************************************************************
+*   \brief      Whether the wake-up timer expired since SchedWakeupStart().
+*   \return     1 if expired
+******************************************************************************/
+uint8_t SchedWakeupFired(void)
+{
+	return cSchedWakeupFired;
+}
+
+/** ***************************************************************************
+*   \brief      Stop the HAL tick before a low power period.
+*   \return     local RTC timestamp to give back to SchedTickResume()
+******************************************************************************/
+uint32_t SchedTickSuspend(void)
+{
+	uint32_t lStamp = TimestampRaw();
+
+	HAL_SuspendTick();
+
+	return lStamp;
+}
+
+/** ***************************************************************************
+*   \brief      Restart the HAL tick after a low power period.
+*   \details    The HAL tick is advanced by the time elapsed on the RTC, so
+*               HAL_GetTick() keeps counting real time, and the period is
+*               accounted to the given power state. After STOP the calendar
+*               shadow registers are stale until resynchronised.
+*   \param      lStamp       value returned by SchedTickSuspend()
+*   \param      xMode        power state the core was in
+*   \return     length of the low power period, ms
+******************************************************************************/
+uint32_t SchedTickResume(uint32_t lStamp, SchedPower xMode)
+{
+	uint32_t lElapsedMs;
+
+	HAL_ResumeTick();
+
+	if(xMode == SCHED_STOP)
+	{
+		__HAL_RTC_WRITEPROTECTION_DISABLE(&hrtc);
+		HAL_RTC_WaitForSynchro(&hrtc);
+		__HAL_RTC_WRITEPROTECTION_ENABLE(&hrtc);
+	}
+
+	lElapsedMs = TimestampToMs(TimestampRaw() - lStamp);
+	uwTick += lElapsedMs;
+
+	if(xMode == SCHED_STOP)
+	{
+		xSchedStats.lStopMs += lElapsedMs;
+		xSchedStats.lStopEntries++;
+	}
+	else if(xMode == SCHED_SLEEP)
+	{
+		xSchedStats.lSleepMs += lElapsedMs;
+	}
+
+	return lElapsedMs;
+}
+
+/** ***************************************************************************
+*   \brief      RTC wake-up timer callback, from HAL_RTCEx_WakeUpTimerIRQHandler().
+*   \param      pxRtc     RTC handle
+******************************************************************************/
+void HAL_RTCEx_WakeUpTimerEventCallback(RTC_HandleTypeDef *pxRtc)
+{
+	(void)pxRtc;
+	cSchedWakeupFired = 1;
+}
+
+/** ***************************************************************************
+*   \brief      Idle until the next task is due or an interrupt needs service.
+*   \details    Short waits use Sleep mode with the tick running. Longer ones
+*               use STOP with the wake-up timer; any EXTI interrupt (radio
+*               IRQ) also ends STOP early. The check for pending work and the
+*               STOP entry are done with interrupts masked so that a trigger
+*               just before WFI is not lost; the pending interrupt still ends
+*               WFI and is serviced once unmasked.
+*   \param      lIdleMs     time to the next task, 0xFFFFFFFF for none
+******************************************************************************/
+static void SchedIdle(uint32_t lIdleMs)
+{
+	uint32_t lStamp;
+
+	if(lIdleMs == 0)
+		return;
+
+	if(lIdleMs < SCHED_MIN_STOP_MS)
+	{
+		HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+		return;
+	}
+
+	if(lIdleMs != 0xFFFFFFFFUL)
+	{
+		if(SchedWakeupStart(lIdleMs) != HAL_OK)
+		{
+			HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+			return;
+		}
+	}
+
+	lStamp = SchedTickSuspend();
+
+	__disable_irq();
+	if(!cSchedTriggerPending)
+		HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI);
+	__enable_irq();
+
+	SchedTickResume(lStamp, SCHED_STOP);
+
+	if(lIdleMs != 0xFFFFFFFFUL)
+		SchedWakeupStop();
+}
+
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -0,0 +1,264 @@
+/** ***************************************************************************
+*   \file        mg_Supply.c
+*   \brief       Supply monitoring. Derives VDD from VREFINT, tracks the
+*                battery discharge and grades the supply so the application
+*                can stretch its intervals and lower the PA power as it sags.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+/*****************************************************************************/
+// standard libraries
+#include <string.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "mg_Supply.h"
+#include "S2LP_Config.h"
+
+// user headers from other components
+#include "mg_LightSensor.h"
+#include "mg_S2lpMcuInterface.h"
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/*****************************************************************************/
+// constants
+
+/**
+* @brief Threshold below which each level is entered
+*/
+static const uint16_t anSupplyThresholdMv[SUPPLY_NB_LEVELS] = {
+  0xFFFF,
+  SUPPLY_LOW_MV,
+  SUPPLY_CRITICAL_MV
+};
+
+/*****************************************************************************/
+// macros
+
+/* Filter weight 1/8, 4 fractional bits kept in the state */
+#define SUPPLY_FILTER_SHIFT         3
+#define SUPPLY_FILTER_FRAC_BITS     4
+
+#define SUPPLY_DAY_MS               86400000UL
+
+/*****************************************************************************/
+// static function declarations
+static uint16_t SupplyFilter(uint32_t *plState, uint16_t nMv);
+static void SupplyCurve(uint32_t lNowMs);
+static void SupplyGrade(void);
+
+/*****************************************************************************/
+// static variable declarations
+static SSupplyStatus xSupplyStatus;
+
+static uint32_t lIdleState;             // filter states, SUPPLY_FILTER_FRAC_BITS fractional bits
+static uint32_t lLoadedState;
+static uint16_t anCurveMv[SUPPLY_CURVE_POINTS];
+static uint8_t cCurveCount;             // valid points, oldest at cCurveHead when full
+static uint8_t cCurveHead;              // next point to write
+static uint32_t lCurveLastMs;
+
+/*****************************************************************************/
+// functions
+
+/** ***************************************************************************
+*   \brief      Initialise the supply monitor.
+******************************************************************************/
+void SupplyInit(void)
+{
+	memset(&xSupplyStatus, 0, sizeof(xSupplyStatus));
+	xSupplyStatus.xLevel = SUPPLY_NORMAL;
+	xSupplyStatus.nMinMv = 0xFFFF;
+	xSupplyStatus.lHoursLeft = SUPPLY_HOURS_UNKNOWN;
+	lIdleState = 0;
+	lLoadedState = 0;
+	cCurveCount = 0;
+	cCurveHead = 0;
+	lCurveLastMs = 0;
+}
+
+/** ***************************************************************************
+*   \brief      Enable the S2LP battery level detector.
+*   \details    The S2LP library has no accessor for PM_CONF1, the register is
+*               written directly. LOW_BATT_LVL and BOR must also be enabled in
+*               the GPIO IRQ mask for the events to reach SupplyRadioEvent().
+*   \param      cThreshold     one of the SUPPLY_BLD_x thresholds
+******************************************************************************/
+void SupplyRadioBldInit(uint8_t cThreshold)
+{
+	uint8_t tmp;
+
+	S2LPSpiReadRegisters(PM_CONF1_ADDR, 1, &tmp);
+	tmp &= ~SET_BLD_TH_REGMASK;
+	tmp |= BATTERY_LVL_EN_REGMASK | (cThreshold & SET_BLD_TH_REGMASK);
+	S2LPSpiWriteRegisters(PM_CONF1_ADDR, 1, &tmp);
+}
+
+/** ***************************************************************************
+*   \brief      Feed a VREFINT conversion.
+*   \details    Idle and loaded readings are filtered separately: the loaded
+*               one shows the internal resistance of an ageing battery long
+*               before the idle voltage drops. The worst of the two sets the
+*               grade. Idle readings also build the discharge curve.
+*   \param      nVrefint     raw VREFINT conversion
+*   \param      xLoad        conditions of the conversion
+*   \param      lNowMs       current time in ms
+*   \return     supply grade
+******************************************************************************/
+SupplyLevel SupplyUpdate(uint16_t nVrefint, SupplyLoad xLoad, uint32_t lNowMs)
+{
+	uint16_t nMv = LightSensorVddMv(nVrefint);
+
+	if(nMv < xSupplyStatus.nMinMv)
+		xSupplyStatus.nMinMv = nMv;
+
+	if(xLoad == SUPPLY_LOADED)
+	{
+		xSupplyStatus.nLoadedMv = SupplyFilter(&lLoadedState, nMv);
+	}
+	else
+	{
+		xSupplyStatus.nIdleMv = SupplyFilter(&lIdleState, nMv);
+		SupplyCurve(lNowMs);
+	}
+
+	SupplyGrade();
+
+	return xSupplyStatus.xLevel;
+}
+
+/** ***************************************************************************
+*   \brief      Account for S2LP supply events.
+*   \details    Called from the radio IRQ handler. The grade is raised at once;
+*               it only recovers once measurements are back above the level
+*               threshold plus hysteresis.
+*   \param      cLowBatt     IRQ_LOW_BATT_LVL seen
+*   \param      cBor         IRQ_BOR seen
+******************************************************************************/
+void SupplyRadioEvent(uint8_t cLowBatt, uint8_t cBor)
+{
+	if(cBor)
+	{
+		xSupplyStatus.nBorIrqs++;
+		xSupplyStatus.xLevel = SUPPLY_CRITICAL;
+	}
+	if(cLowBatt)
+	{
+		xSupplyStatus.nLowBattIrqs++;
+		if(xSupplyStatus.xLevel < SUPPLY_LOW)
+			xSupplyStatus.xLevel = SUPPLY_LOW;
+	}
+}
+
+/** ***************************************************************************
+*   \brief      Current supply grade.
+*   \return     grade
+******************************************************************************/
+SupplyLevel SupplyGetLevel(void)
+{
+	return xSupplyStatus.xLevel;
+}
+
+/** ***************************************************************************
+*   \brief      Copy out the supply state.
+*   \param      pxStatus     destination
+******************************************************************************/
+void SupplyGetStatus(SSupplyStatus *pxStatus)
+{
+	*pxStatus = xSupplyStatus;
+}
+
+/** ***************************************************************************
+*   \brief      EMA filter, primed by the first reading.
+*   \param      plState     filter state, 0 before the first reading
+*   \param      nMv         new reading
+*   \return     filtered value
+******************************************************************************/
+static uint16_t SupplyFilter(uint32_t *plState, uint16_t nMv)
+{
+	int32_t lState = (int32_t)*plState;
+	int32_t lNew = (int32_t)nMv << SUPPLY_FILTER_FRAC_BITS;
+
+	if(lState == 0)
+		lState = lNew;
+	else
+		lState += (lNew - lState) >> SUPPLY_FILTER_SHIFT;
+
+	*plState = (uint32_t)lState;
+
+	return (uint16_t)(((uint32_t)lState + (1 << (SUPPLY_FILTER_FRAC_BITS - 1))) >> SUPPLY_FILTER_FRAC_BITS);
+}
+
+/** ***************************************************************************
+*   \brief      Record the discharge curve and extrapolate the time left.
+*   \param      lNowMs     current time in ms
+******************************************************************************/
+static void SupplyCurve(uint32_t lNowMs)
+{
+	uint16_t nOldest, nNewest;
+	int32_t lSlope;
+
+	if((cCurveCount != 0) && ((lNowMs - lCurveLastMs) < SUPPLY_CURVE_PERIOD_MS))
+		return;
+
+	lCurveLastMs = lNowMs;
+	anCurveMv[cCurveHead] = xSupplyStatus.nIdleMv;
+	cCurveHead = (cCurveHead + 1) % SUPPLY_CURVE_POINTS;
+	if(cCurveCount < SUPPLY_CURVE_POINTS)
+		cCurveCount++;
+
+	if(cCurveCount < 2)
+		return;
+
+	nNewest = xSupplyStatus.nIdleMv;
+	nOldest = anCurveMv[(cCurveHead + SUPPLY_CURVE_POINTS - cCurveCount) % SUPPLY_CURVE_POINTS];
+
+	/* mV per day over the recorded span */
+	lSlope = (((int32_t)nNewest - (int32_t)nOldest) * (int32_t)(SUPPLY_DAY_MS / SUPPLY_CURVE_PERIOD_MS))
+	       / (int32_t)(cCurveCount - 1);
+	xSupplyStatus.iSlopeMvPerDay = (int16_t)lSlope;
+
+	if((lSlope < 0) && (nNewest > SUPPLY_CRITICAL_MV))
+		xSupplyStatus.lHoursLeft = ((uint32_t)(nNewest - SUPPLY_CRITICAL_MV) * 24UL) / (uint32_t)(-lSlope);
+	else
+		xSupplyStatus.lHoursLeft = SUPPLY_HOURS_UNKNOWN;
+}
+
+/** ***************************************************************************
+*   \brief      Grade the supply with hysteresis.
+*   \details    Degrades as soon as a threshold is crossed, recovers one level
+*               at a time once SUPPLY_HYST_MV above it.
+******************************************************************************/
+static void SupplyGrade(void)
+{
+	uint16_t nWorst = xSupplyStatus.nIdleMv;
+	SupplyLevel xLevel = xSupplyStatus.xLevel;
+
+	if((xSupplyStatus.nLoadedMv != 0) && ((nWorst == 0) || (xSupplyStatus.nLoadedMv < nWorst)))
+		nWorst = xSupplyStatus.nLoadedMv;
+
+	while((xLevel > SUPPLY_NORMAL) && (nWorst >= anSupplyThresholdMv[xLevel] + SUPPLY_HYST_MV))
+		xLevel--;
+	while((xLevel < SUPPLY_CRITICAL) && (nWorst < anSupplyThresholdMv[xLevel + 1]))
+		xLevel++;
+
+	xSupplyStatus.xLevel = xLevel;
+}
+
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
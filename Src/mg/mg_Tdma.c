@@ -0,0 +1,386 @@
+/** ***************************************************************************
+*   \file        mg_Tdma.c
+*   \brief       Time slotted uplink. The gateway beacons its time at the
+*                start of each frame, each node transmits once per frame in
+*                the slot of its address. Nodes only listen to the beacons
+*                they need: the guard around the slot grows with the clock
+*                drift measured at each beacon, a beacon is caught before it
+*                outgrows the slot layout.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+/*****************************************************************************/
+// standard libraries
+#include <string.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "mg_Tdma.h"
+
+// user headers from other components
+#include "mg_Timestamp.h"
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+#define TDMA_MS_TO_TS(ms)           ((uint32_t)(((uint64_t)(ms) << TIMESTAMP_FRAC_BITS) / 1000U))
+#define TDMA_US_TO_TS(us)           ((uint32_t)(((uint64_t)(us) << TIMESTAMP_FRAC_BITS) / 1000000UL))
+
+/* Clock error not attributed to drift: the beacon time and its reception
+   are both read to one timestamp step */
+#define TDMA_QUANT_TS               2
+
+/* Drift estimate floor, and the weight of a lower measurement */
+#define TDMA_DRIFT_MIN_PPM          1
+#define TDMA_DRIFT_SHIFT            3
+
+/*****************************************************************************/
+// static function declarations
+
+/*****************************************************************************/
+// static variable declarations
+static STdmaConfig xTdmaConfig;
+static STdmaStats xTdmaStats;
+static uint32_t lTdmaFrameTs;
+static uint32_t lTdmaSlotTs;
+static uint16_t nTdmaSlots;
+static uint16_t nTdmaSlot;
+static uint32_t lTdmaSyncTs;                   // network time of the last beacon
+
+/*****************************************************************************/
+// functions
+
+/** ***************************************************************************
+*   \brief      Keep the frame layout and derive the slot of the node.
+*   \details    Slot 0 is the beacon's, the others are shared out by address
+*               modulo their number, so up to that many nodes never collide.
+*   \param      pxConfig     frame layout
+*   \param      cAddress     node address, ignored by the gateway
+******************************************************************************/
+void TdmaInit(const STdmaConfig *pxConfig, uint8_t cAddress)
+{
+	xTdmaConfig = *pxConfig;
+	if(xTdmaConfig.nGuardMinMs > xTdmaConfig.nGuardMaxMs)
+		xTdmaConfig.nGuardMinMs = xTdmaConfig.nGuardMaxMs;
+	if(xTdmaConfig.nDriftPpm < TDMA_DRIFT_MIN_PPM)
+		xTdmaConfig.nDriftPpm = TDMA_DRIFT_MIN_PPM;
+
+	lTdmaFrameTs = TDMA_MS_TO_TS(xTdmaConfig.lFrameMs);
+	lTdmaSlotTs = TDMA_MS_TO_TS(xTdmaConfig.lSlotMs);
+	if(lTdmaSlotTs == 0)
+		lTdmaSlotTs = 1;
+	nTdmaSlots = (uint16_t)(lTdmaFrameTs / lTdmaSlotTs);
+	if(nTdmaSlots < 2)
+		nTdmaSlots = 2;
+	nTdmaSlot = TdmaSlotOf(cAddress);
+
+	memset(&xTdmaStats, 0, sizeof(xTdmaStats));
+	xTdmaStats.nDriftPpm = xTdmaConfig.nDriftPpm;
+}
+
+/** ***************************************************************************
+*   \brief      Slots per frame, the beacon's included.
+*   \return     slots
+******************************************************************************/
+uint16_t TdmaSlots(void)
+{
+	return nTdmaSlots;
+}
+
+/** ***************************************************************************
+*   \brief      Slot of the node.
+*   \return     slot, from 1
+******************************************************************************/
+uint16_t TdmaSlot(void)
+{
+	return nTdmaSlot;
+}
+
+/** ***************************************************************************
+*   \brief      Slot of any node, for the gateway to know whose slot is on.
+*   \param      cAddress     node address
+*   \return     slot, from 1
+******************************************************************************/
+uint16_t TdmaSlotOf(uint8_t cAddress)
+{
+	return 1 + (cAddress % (nTdmaSlots - 1));
+}
+
+/** ***************************************************************************
+*   \brief      Slot and frame at a network time.
+*   \details    The frame number is the one the beacon carries; with the
+*               slot it is shared by the gateway and every synchronised node.
+*   \param      lTs         network time
+*   \param      pnFrame     filled with the frame number, may be NULL
+*   \return     slot, TDMA_NO_SLOT past the last slot of the frame
+******************************************************************************/
+uint16_t TdmaSlotAt(uint32_t lTs, uint16_t *pnFrame)
+{
+	uint32_t lSlot = (lTs % lTdmaFrameTs) / lTdmaSlotTs;
+
+	if(pnFrame != NULL)
+		*pnFrame = (uint16_t)(lTs / lTdmaFrameTs);
+
+	return (lSlot < nTdmaSlots) ? (uint16_t)lSlot : TDMA_NO_SLOT;
+}
+
+/** ***************************************************************************
+*   \brief      Start of the next slot, or of the next frame after the last.
+*   \param      lNowTs     network time
+*   \return     network time
+******************************************************************************/
+uint32_t TdmaNextSlotStart(uint32_t lNowTs)
+{
+	uint32_t lFrameTs = lNowTs - (lNowTs % lTdmaFrameTs);
+	uint32_t lSlot = (lNowTs - lFrameTs) / lTdmaSlotTs + 1;
+
+	if(lSlot >= nTdmaSlots)
+		return lFrameTs + lTdmaFrameTs;
+
+	return lFrameTs + lSlot * lTdmaSlotTs;
+}
+
+/** ***************************************************************************
+*   \brief      Write a beacon, done by the gateway right before the TX strobe.
+*   \param      pcBuffer     destination, TDMA_BEACON_BYTES
+*   \param      lNowTs       TimestampNow()
+*   \return     bytes written
+******************************************************************************/
+uint8_t TdmaBeaconBuild(uint8_t *pcBuffer, uint32_t lNowTs)
+{
+	uint16_t nFrame = (uint16_t)(lNowTs / lTdmaFrameTs);
+
+	pcBuffer[0] = TDMA_BEACON_MARKER;
+	pcBuffer[1] = (uint8_t)nFrame;
+	pcBuffer[2] = (uint8_t)(nFrame >> 8);
+	pcBuffer[3] = (uint8_t)lNowTs;
+	pcBuffer[4] = (uint8_t)(lNowTs >> 8);
+	pcBuffer[5] = (uint8_t)(lNowTs >> 16);
+	pcBuffer[6] = (uint8_t)(lNowTs >> 24);
+
+	return TDMA_BEACON_BYTES;
+}
+
+/** ***************************************************************************
+*   \brief      Read a beacon.
+*   \param      pcBuffer        received payload
+*   \param      cLen            payload length
+*   \param      plNetworkTs     gateway time at the TX strobe
+*   \return     HAL_OK, or HAL_ERROR if not a beacon
+******************************************************************************/
+HAL_StatusTypeDef TdmaBeaconParse(const uint8_t *pcBuffer, uint8_t cLen, uint32_t *plNetworkTs)
+{
+	if((cLen < TDMA_BEACON_BYTES) || (pcBuffer[0] != TDMA_BEACON_MARKER))
+		return HAL_ERROR;
+
+	*plNetworkTs = (uint32_t)pcBuffer[3] | ((uint32_t)pcBuffer[4] << 8)
+	             | ((uint32_t)pcBuffer[5] << 16) | ((uint32_t)pcBuffer[6] << 24);
+
+	return HAL_OK;
+}
+
+/** ***************************************************************************
+*   \brief      Synchronise on a beacon.
+*   \details    The clock error found, less the timestamp resolution, over
+*               the time since the previous beacon is the drift the guard
+*               grows with. A higher drift is taken at once, a lower one
+*               gradually, as the RTC trim learned by TimestampSync() takes
+*               most of it out over time.
+*   \param      lNetworkTs     time carried by the beacon
+*   \param      lLocalTs       TimestampRaw() at its RX_DATA_READY
+******************************************************************************/
+void TdmaBeaconReceived(uint32_t lNetworkTs, uint32_t lLocalTs)
+{
+	STimestampStatus xTime;
+	uint32_t lErrorTs, lElapsedMs, lPpm;
+	int32_t iError;
+
+	lNetworkTs += TDMA_US_TO_TS(xTdmaConfig.lBeaconAirUs);
+
+	if(xTdmaStats.cSynced)
+	{
+		TimestampGetStatus(&xTime);
+		iError = (int32_t)(lLocalTs + xTime.lOffset - lNetworkTs);
+		lErrorTs = (iError < 0) ? (uint32_t)-iError : (uint32_t)iError;
+		xTdmaStats.iLastErrorMs = (iError < 0) ? -(int32_t)TimestampToMs(lErrorTs) : (int32_t)TimestampToMs(lErrorTs);
+
+		lElapsedMs = TimestampToMs(lNetworkTs - lTdmaSyncTs);
+		if(lElapsedMs > 0)
+		{
+			lErrorTs = (lErrorTs > TDMA_QUANT_TS) ? (lErrorTs - TDMA_QUANT_TS) : 0;
+			lPpm = (uint32_t)(((uint64_t)TimestampToMs(lErrorTs) * 1000000UL) / lElapsedMs);
+
+			if(lPpm >= xTdmaStats.nDriftPpm)
+				xTdmaStats.nDriftPpm = (lPpm > 0xFFFF) ? 0xFFFF : (uint16_t)lPpm;
+			else
+				xTdmaStats.nDriftPpm -= (xTdmaStats.nDriftPpm - (uint16_t)lPpm) >> TDMA_DRIFT_SHIFT;
+			if(xTdmaStats.nDriftPpm < TDMA_DRIFT_MIN_PPM)
+				xTdmaStats.nDriftPpm = TDMA_DRIFT_MIN_PPM;
+		}
+	}
+
+	TimestampSync(lNetworkTs, lLocalTs);
+
+	lTdmaSyncTs = lNetworkTs;
+	xTdmaStats.cSynced = 1;
+	xTdmaStats.lBeacons++;
+}
+
+/** ***************************************************************************
+*   \brief      Account for a beacon window without a beacon.
+*   \details    Synchronisation is lost once the guard at the next beacon
+*               would exceed the slot layout.
+*   \param      lNowTs     TimestampNow()
+******************************************************************************/
+void TdmaBeaconMissed(uint32_t lNowTs)
+{
+	xTdmaStats.lMissed++;
+
+	if(xTdmaStats.cSynced && (TdmaGuardMs(TdmaFrameStart(lNowTs)) > xTdmaConfig.nGuardMaxMs))
+	{
+		xTdmaStats.cSynced = 0;
+		xTdmaStats.lLost++;
+	}
+}
+
+/** ***************************************************************************
+*   \brief      Whether the node follows the frames.
+*   \return     1 if synchronised
+******************************************************************************/
+uint8_t TdmaIsSynced(void)
+{
+	return xTdmaStats.cSynced;
+}
+
+/** ***************************************************************************
+*   \brief      Start of the next frame. Frames are aligned on the network
+*               time, which only gets an irregular frame at its wrap.
+*   \param      lNowTs     TimestampNow()
+*   \return     network time of the next beacon
+******************************************************************************/
+uint32_t TdmaFrameStart(uint32_t lNowTs)
+{
+	return lNowTs - (lNowTs % lTdmaFrameTs) + lTdmaFrameTs;
+}
+
+/** ***************************************************************************
+*   \brief      Next beacon to listen to.
+*   \details    Beacons are skipped while the guard one frame after them
+*               stays within half the laid out guard, so that a missed
+*               beacon still leaves room for the next one.
+*   \param      lNowTs     TimestampNow()
+*   \return     network time of the beacon
+******************************************************************************/
+uint32_t TdmaNextBeacon(uint32_t lNowTs)
+{
+	uint32_t lHalfMs = xTdmaConfig.nGuardMaxMs / 2;
+	uint32_t lHoldMs, lDueTs;
+
+	if(!xTdmaStats.cSynced || (lHalfMs <= xTdmaConfig.nGuardMinMs))
+		return TdmaFrameStart(lNowTs);
+
+	/* time after the last beacon the guard reaches half its maximum */
+	lHoldMs = (uint32_t)(((uint64_t)(lHalfMs - xTdmaConfig.nGuardMinMs) * 1000000UL) / (2UL * xTdmaStats.nDriftPpm));
+	lDueTs = lTdmaSyncTs + TDMA_MS_TO_TS(lHoldMs) - 2 * lTdmaFrameTs;
+
+	if((int32_t)(lDueTs - lNowTs) <= 0)
+		return TdmaFrameStart(lNowTs);
+
+	return TdmaFrameStart(lDueTs);
+}
+
+/** ***************************************************************************
+*   \brief      Transmit time in the next slot of the node: the slot start
+*               plus the laid out guard, so that the clock error stays
+*               within the slot either way.
+*   \param      lNowTs     TimestampNow()
+*   \return     network time
+******************************************************************************/
+uint32_t TdmaNextSlot(uint32_t lNowTs)
+{
+	uint32_t lTxTs = lNowTs - (lNowTs % lTdmaFrameTs) + nTdmaSlot * lTdmaSlotTs
+	               + TDMA_MS_TO_TS(xTdmaConfig.nGuardMaxMs);
+
+	if((int32_t)(lTxTs - lNowTs) <= 0)
+		lTxTs += lTdmaFrameTs;
+
+	return lTxTs;
+}
+
+/** ***************************************************************************
+*   \brief      Clock error bound at a given time: the minimum guard, plus
+*               twice the drift estimate since the last beacon.
+*   \param      lAtTs     network time
+*   \return     ms
+******************************************************************************/
+uint16_t TdmaGuardMs(uint32_t lAtTs)
+{
+	uint32_t lElapsedMs = TimestampToMs(lAtTs - lTdmaSyncTs);
+	uint32_t lGuardMs = xTdmaConfig.nGuardMinMs
+	                  + (uint32_t)(((uint64_t)lElapsedMs * 2UL * xTdmaStats.nDriftPpm) / 1000000UL);
+
+	return (lGuardMs > 0xFFFF) ? 0xFFFF : (uint16_t)lGuardMs;
+}
+
+/** ***************************************************************************
+*   \brief      Whether the slot may be used, counted if so.
+*   \param      lNowTs     TimestampNow()
+*   \return     1 if synchronised and within the laid out guard
+******************************************************************************/
+uint8_t TdmaSlotTx(uint32_t lNowTs)
+{
+	uint16_t nGuardMs = TdmaGuardMs(lNowTs);
+
+	if(!xTdmaStats.cSynced || (nGuardMs > xTdmaConfig.nGuardMaxMs))
+		return 0;
+
+	xTdmaStats.nGuardMs = nGuardMs;
+	xTdmaStats.lSlots++;
+
+	return 1;
+}
+
+/** ***************************************************************************
+*   \brief      Time until a network time, to schedule on.
+*   \param      lTs        network time
+*   \param      lNowTs     TimestampNow()
+*   \return     ms, 0 if past
+******************************************************************************/
+uint32_t TdmaMsUntil(uint32_t lTs, uint32_t lNowTs)
+{
+	if((int32_t)(lTs - lNowTs) <= 0)
+		return 0;
+
+	return TimestampToMs(lTs - lNowTs);
+}
+
+/** ***************************************************************************
+*   \brief      Copy out the state and counters.
+*   \param      pxStats     destination
+******************************************************************************/
+void TdmaGetStats(STdmaStats *pxStats)
+{
+	*pxStats = xTdmaStats;
+}
+
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
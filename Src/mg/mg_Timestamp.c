@@ -0,0 +1,234 @@
+/** ***************************************************************************
+*   \file        mg_Timestamp.c
+*   \brief       RTC timestamps. Atomic calendar and sub-second reads packed
+*                into 32 bits, with an offset and a frequency trim learned
+*                from network time beacons.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+/*****************************************************************************/
+// standard libraries
+#include <string.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "mg_Timestamp.h"
+
+// user headers from other components
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/*****************************************************************************/
+// static function declarations
+static uint32_t TimestampRead(uint32_t *plSeconds);
+static void TimestampApplyTrim(void);
+
+/*****************************************************************************/
+// static variable declarations
+extern RTC_HandleTypeDef hrtc;
+
+static STimestampStatus xTimestampStatus;
+static uint32_t lTimestampTrimLocal;           // local time and offset the trim is measured from
+static uint32_t lTimestampTrimOffset;
+
+/*****************************************************************************/
+// functions
+
+/** ***************************************************************************
+*   \brief      Start unsynchronised, TimestampNow() is local RTC time.
+******************************************************************************/
+void TimestampInit(void)
+{
+	memset(&xTimestampStatus, 0, sizeof(xTimestampStatus));
+}
+
+/** ***************************************************************************
+*   \brief      Local RTC time, not corrected by the beacons.
+*   \details    Differences are valid across calendar roll-overs and wrap
+*               safe; the scheduler uses them to measure low power periods.
+*   \return     timestamp
+******************************************************************************/
+uint32_t TimestampRaw(void)
+{
+	uint32_t lSeconds, lFrac;
+
+	lFrac = TimestampRead(&lSeconds);
+
+	return (lSeconds << TIMESTAMP_FRAC_BITS) | lFrac;
+}
+
+/** ***************************************************************************
+*   \brief      Network time once a beacon was received, else local time.
+*   \return     timestamp
+******************************************************************************/
+uint32_t TimestampNow(void)
+{
+	return TimestampRaw() + xTimestampStatus.lOffset;
+}
+
+/** ***************************************************************************
+*   \brief      Local RTC calendar as whole seconds, without the 24 bit wrap.
+*   \return     seconds since 01/01/00 00:00:00
+******************************************************************************/
+uint32_t TimestampRawSeconds(void)
+{
+	uint32_t lSeconds;
+
+	(void)TimestampRead(&lSeconds);
+
+	return lSeconds;
+}
+
+/** ***************************************************************************
+*   \brief      Convert a timestamp difference to milliseconds.
+*   \param      lDelta     difference of two timestamps
+*   \return     ms
+******************************************************************************/
+uint32_t TimestampToMs(uint32_t lDelta)
+{
+	return (uint32_t)(((uint64_t)lDelta * 1000UL) >> TIMESTAMP_FRAC_BITS);
+}
+
+/** ***************************************************************************
+*   \brief      Apply a network time beacon.
+*   \details    The offset is stepped to the beacon at once. Over beacons at
+*               least TIMESTAMP_TRIM_MIN_S apart, the offset drift is the
+*               relative frequency error of the LSE, which is taken out with
+*               the RTC smooth calibration so the offset stays put between
+*               beacons and local intervals are right too.
+*   \param      lNetworkTs     time carried by the beacon
+*   \param      lLocalTs       TimestampRaw() when the beacon was received
+******************************************************************************/
+void TimestampSync(uint32_t lNetworkTs, uint32_t lLocalTs)
+{
+	uint32_t lOffset = lNetworkTs - lLocalTs;
+	uint32_t lSpan;
+	int32_t iDrift, iTrim;
+
+	if(!xTimestampStatus.cSynced)
+	{
+		lTimestampTrimLocal = lLocalTs;
+		lTimestampTrimOffset = lOffset;
+		xTimestampStatus.iLastStep = 0;
+		xTimestampStatus.cSynced = 1;
+	}
+	else
+	{
+		xTimestampStatus.iLastStep = (int32_t)(lOffset - xTimestampStatus.lOffset);
+
+		lSpan = lLocalTs - lTimestampTrimLocal;
+		if(lSpan >= TIMESTAMP_TRIM_MIN_S * TIMESTAMP_ONE_S)
+		{
+			/* RTCCLK pulses per 2^20 */
+			iDrift = (int32_t)(((int64_t)(int32_t)(lOffset - lTimestampTrimOffset) << 20) / (int64_t)lSpan);
+
+			iTrim = xTimestampStatus.iTrimPulses + iDrift;
+			if(iTrim < TIMESTAMP_TRIM_MIN)
+				iTrim = TIMESTAMP_TRIM_MIN;
+			if(iTrim > TIMESTAMP_TRIM_MAX)
+				iTrim = TIMESTAMP_TRIM_MAX;
+
+			if(iTrim != xTimestampStatus.iTrimPulses)
+			{
+				xTimestampStatus.iTrimPulses = (int16_t)iTrim;
+				TimestampApplyTrim();
+			}
+
+			lTimestampTrimLocal = lLocalTs;
+			lTimestampTrimOffset = lOffset;
+		}
+	}
+
+	xTimestampStatus.lOffset = lOffset;
+	xTimestampStatus.lSyncs++;
+}
+
+/** ***************************************************************************
+*   \brief      Copy out the correction state.
+*   \param      pxStatus     destination
+******************************************************************************/
+void TimestampGetStatus(STimestampStatus *pxStatus)
+{
+	*pxStatus = xTimestampStatus;
+}
+
+/** ***************************************************************************
+*   \brief      Read the calendar and sub-seconds as one consistent sample.
+*   \details    Reading SSR freezes the TR and DR shadow registers until DR is
+*               read, interrupts are masked so that no other reader unlocks
+*               them in between. SSR can exceed SynchPrediv right after a shift
+*               operation, the fraction is then taken as zero.
+*   \param      plSeconds     seconds since 01/01/00 00:00:00
+*   \return     fraction of the second, 1/TIMESTAMP_ONE_S units
+******************************************************************************/
+static uint32_t TimestampRead(uint32_t *plSeconds)
+{
+	static const uint16_t anDaysBeforeMonth[12] = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+	uint32_t lPrimask, lSsr, lTr, lDr, lPrediv, lDays;
+	uint8_t cYear, cMonth, cDate;
+
+	lPrimask = __get_PRIMASK();
+	__disable_irq();
+	lSsr = hrtc.Instance->SSR;
+	lTr = hrtc.Instance->TR;
+	lDr = hrtc.Instance->DR;
+	__set_PRIMASK(lPrimask);
+
+	cYear = RTC_Bcd2ToByte((uint8_t)((lDr >> 16) & 0xFF));
+	cMonth = RTC_Bcd2ToByte((uint8_t)((lDr >> 8) & 0x1F));
+	cDate = RTC_Bcd2ToByte((uint8_t)(lDr & 0x3F));
+
+	lDays = (uint32_t)cYear * 365 + ((uint32_t)cYear + 3) / 4
+	      + anDaysBeforeMonth[(cMonth - 1) % 12] + cDate - 1;
+	if(((cYear % 4) == 0) && (cMonth > 2))
+		lDays++;
+
+	*plSeconds = lDays * 86400UL
+	           + (uint32_t)RTC_Bcd2ToByte((uint8_t)((lTr >> 16) & 0x3F)) * 3600UL
+	           + (uint32_t)RTC_Bcd2ToByte((uint8_t)((lTr >> 8) & 0x7F)) * 60UL
+	           + RTC_Bcd2ToByte((uint8_t)(lTr & 0x7F));
+
+	lPrediv = hrtc.Init.SynchPrediv;
+	if(lSsr > lPrediv)
+		return 0;
+
+	return ((lPrediv - lSsr) << TIMESTAMP_FRAC_BITS) / (lPrediv + 1);
+}
+
+/** ***************************************************************************
+*   \brief      Program the RTC smooth calibration from iTrimPulses.
+*   \details    Over each 32 s cycle, CALP adds 512 pulses and CALM removes up
+*               to 511, so trim = 512 * CALP - CALM.
+******************************************************************************/
+static void TimestampApplyTrim(void)
+{
+	int32_t iTrim = xTimestampStatus.iTrimPulses;
+
+	if(iTrim > 0)
+		HAL_RTCEx_SetSmoothCalib(&hrtc, RTC_SMOOTHCALIB_PERIOD_32SEC, RTC_SMOOTHCALIB_PLUSPULSES_SET, (uint32_t)(512 - iTrim));
+	else
+		HAL_RTCEx_SetSmoothCalib(&hrtc, RTC_SMOOTHCALIB_PERIOD_32SEC, RTC_SMOOTHCALIB_PLUSPULSES_RESET, (uint32_t)(-iTrim));
+}
+
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -0,0 +1,212 @@
+/** ***************************************************************************
+*   \file        mg_Tpc.c
+*   \brief       Closed-loop transmit power control. The receiver answers each
+*                report with the RSSI and sync word quality it saw, and the PA
+*                level is stepped to the lowest one keeping a target margin,
+*                backing off quickly when the answer is lost.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+/*****************************************************************************/
+// standard libraries
+#include <string.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "mg_Tpc.h"
+
+// user headers from other components
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/*****************************************************************************/
+// static function declarations
+static void TpcStep(float fDeltaDb);
+
+/*****************************************************************************/
+// static variable declarations
+static STpcStatus xTpcStatus;
+
+/*****************************************************************************/
+// functions
+
+/** ***************************************************************************
+*   \brief      Start at the ceiling until the first answer.
+*   \param      fCeilingDbm     highest PA level, dBm
+******************************************************************************/
+void TpcInit(float fCeilingDbm)
+{
+	memset(&xTpcStatus, 0, sizeof(xTpcStatus));
+
+	xTpcStatus.fCeilingDbm = fCeilingDbm;
+	xTpcStatus.fDbm = fCeilingDbm;
+	xTpcStatus.cTargetRssiDbm = TPC_TARGET_RSSI_DBM;
+}
+
+/** ***************************************************************************
+*   \brief      Change the highest PA level, e.g. with the supply grade.
+*   \details    The current level is pulled down to it, a level below is kept.
+*   \param      fCeilingDbm     highest PA level, dBm
+******************************************************************************/
+void TpcSetCeiling(float fCeilingDbm)
+{
+	xTpcStatus.fCeilingDbm = fCeilingDbm;
+	TpcStep(0.0f);
+}
+
+/** ***************************************************************************
+*   \brief      Change the RSSI aimed for, e.g. with the receiver sensitivity
+*               of another data rate.
+*   \details    The level moves with the target at once, so the margin is
+*               kept from the first report.
+*   \param      cTargetRssiDbm     RSSI at the receiver, dBm
+******************************************************************************/
+void TpcSetTarget(int8_t cTargetRssiDbm)
+{
+	TpcStep((float)((int16_t)cTargetRssiDbm - xTpcStatus.cTargetRssiDbm));
+	xTpcStatus.cTargetRssiDbm = cTargetRssiDbm;
+}
+
+/** ***************************************************************************
+*   \brief      PA level for the next report.
+*   \return     dBm
+******************************************************************************/
+float TpcGetDbm(void)
+{
+	return xTpcStatus.fDbm;
+}
+
+/** ***************************************************************************
+*   \brief      Adjust the level from an answer.
+*   \details    The path loss is known from the answer, so a shortfall below
+*               the target, TPC_TARGET_RSSI_DBM unless changed, is made up
+*               at once. An excess beyond
+*               TPC_HYST_DB is given back TPC_STEP_DOWN_DB at a time, so a
+*               single strong reading does not drop the link. Too many sync
+*               bit errors point to interference or multipath that the RSSI
+*               does not show, and count as a TPC_HYST_DB shortfall.
+*   \param      pxFeedback     answer received after the last report
+******************************************************************************/
+void TpcFeedback(const STpcFeedback *pxFeedback)
+{
+	int16_t iMarginDb = (int16_t)pxFeedback->cRssiDbm - xTpcStatus.cTargetRssiDbm;
+
+	xTpcStatus.cLastRssiDbm = pxFeedback->cRssiDbm;
+	xTpcStatus.cLastSyncErrors = pxFeedback->cSyncErrors;
+	xTpcStatus.cLosses = 0;
+	xTpcStatus.lFeedbacks++;
+
+	if(pxFeedback->cSyncErrors > TPC_SYNC_ERRORS_MAX)
+		TpcStep((float)TPC_HYST_DB);
+	else if(iMarginDb < 0)
+		TpcStep((float)-iMarginDb);
+	else if(iMarginDb > TPC_HYST_DB)
+		TpcStep(-(float)(((iMarginDb - TPC_HYST_DB) < TPC_STEP_DOWN_DB) ? (iMarginDb - TPC_HYST_DB) : TPC_STEP_DOWN_DB));
+}
+
+/** ***************************************************************************
+*   \brief      Back off after a report that got no answer.
+*   \details    Either the report or the answer was lost, the level is raised
+*               by TPC_BACKOFF_DB and goes back to the ceiling after
+*               TPC_LOSSES_TO_MAX losses in a row.
+******************************************************************************/
+void TpcLoss(void)
+{
+	xTpcStatus.lLost++;
+	if(xTpcStatus.cLosses < 0xFF)
+		xTpcStatus.cLosses++;
+
+	if(xTpcStatus.cLosses >= TPC_LOSSES_TO_MAX)
+		TpcStep(xTpcStatus.fCeilingDbm - xTpcStatus.fDbm);
+	else
+		TpcStep((float)TPC_BACKOFF_DB);
+}
+
+/** ***************************************************************************
+*   \brief      Copy out the controller state.
+*   \param      pxStatus     destination
+******************************************************************************/
+void TpcGetStatus(STpcStatus *pxStatus)
+{
+	*pxStatus = xTpcStatus;
+}
+
+/** ***************************************************************************
+*   \brief      Pack an answer, done by the receiver.
+*   \param      pcBuffer       destination, at least TPC_FEEDBACK_BYTES
+*   \param      pxFeedback     link measurement of the report answered
+*   \return     bytes written
+******************************************************************************/
+uint8_t TpcFeedbackBuild(uint8_t *pcBuffer, const STpcFeedback *pxFeedback)
+{
+	pcBuffer[0] = TPC_FEEDBACK_MARKER;
+	pcBuffer[1] = (uint8_t)pxFeedback->nSeq;
+	pcBuffer[2] = (uint8_t)(pxFeedback->nSeq >> 8);
+	pcBuffer[3] = (uint8_t)pxFeedback->cRssiDbm;
+	pcBuffer[4] = pxFeedback->cSyncErrors;
+
+	return TPC_FEEDBACK_BYTES;
+}
+
+/** ***************************************************************************
+*   \brief      Unpack an answer.
+*   \param      pcFrame        received payload
+*   \param      cLen           payload length
+*   \param      pxFeedback     destination
+*   \return     HAL_OK, or HAL_ERROR if the payload is not an answer
+******************************************************************************/
+HAL_StatusTypeDef TpcFeedbackParse(const uint8_t *pcFrame, uint8_t cLen, STpcFeedback *pxFeedback)
+{
+	if((cLen < TPC_FEEDBACK_BYTES) || (pcFrame[0] != TPC_FEEDBACK_MARKER))
+		return HAL_ERROR;
+
+	pxFeedback->nSeq = (uint16_t)(pcFrame[1] | ((uint16_t)pcFrame[2] << 8));
+	pxFeedback->cRssiDbm = (int8_t)pcFrame[3];
+	pxFeedback->cSyncErrors = pcFrame[4];
+
+	return HAL_OK;
+}
+
+/** ***************************************************************************
+*   \brief      Move the level, clamped to TPC_MIN_DBM and the ceiling.
+*   \param      fDeltaDb     change, dB
+******************************************************************************/
+static void TpcStep(float fDeltaDb)
+{
+	float fDbm = xTpcStatus.fDbm + fDeltaDb;
+
+	if(fDbm > xTpcStatus.fCeilingDbm)
+		fDbm = xTpcStatus.fCeilingDbm;
+	if(fDbm < TPC_MIN_DBM)
+		fDbm = TPC_MIN_DBM;
+
+	if(fDbm > xTpcStatus.fDbm)
+		xTpcStatus.lStepsUp++;
+	else if(fDbm < xTpcStatus.fDbm)
+		xTpcStatus.lStepsDown++;
+
+	xTpcStatus.fDbm = fDbm;
+}
+
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
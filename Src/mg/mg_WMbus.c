@@ -0,0 +1,403 @@
+/** ***************************************************************************
+*   \file        mg_WMbus.c
+*   \brief       Wireless M-Bus telegrams for meter collectors, T1 or C1
+*                meter to other. The radio does the preamble, sync word,
+*                3 out of 6 coding and postamble, the telegram is built here
+*                with its block CRCs: link layer header, short application
+*                header and one lux and age record per reading.
+*
+*   \copyright   Copyright (C) : <company name> <creation date YYYY-MM-DD>
+*
+*   \addtogroup  AddGroupsAsRequiredForTheProject
+*   \{
+******************************************************************************/
+
+/*****************************************************************************/
+// standard libraries
+#include <string.h>
+
+// user headers directly related to this component, ensures no dependency
+#include "mg_WMbus.h"
+
+// user headers from other components
+#include "S2LP_Config.h"
+#include "mg_Aggregate.h"
+#include "mg_Timestamp.h"
+
+/*****************************************************************************/
+// enumerations
+
+/*****************************************************************************/
+// typedefs
+
+/*****************************************************************************/
+// structures
+
+/*****************************************************************************/
+// constants
+
+/*****************************************************************************/
+// macros
+
+/* Modem, the same for T1 and C1 but for the deviation */
+#define WMBUS_FREQUENCY_HZ          868950000UL
+#define WMBUS_CHIPRATE              100000UL
+#define WMBUS_T1_FREQ_DEVIATION     50000UL
+#define WMBUS_C1_FREQ_DEVIATION     45000UL
+#define WMBUS_BANDWIDTH             250000UL
+
+/* Header chips the radio adds: T1 has 19 preamble bit pairs in the packet
+   handler and a 10 bit sync word, C1 at least 16 pairs and the 0x543D sync
+   word followed by 0x543D for frame format B */
+#define WMBUS_T1_PREAMBLE_PAIRS     19
+#define WMBUS_T1_SYNC_BITS          10
+#define WMBUS_C1_PREAMBLE_PAIRS     16
+#define WMBUS_C1_SYNC_BITS          32
+#define WMBUS_C1_SYNC_WORD          0x543D543DUL
+
+/* Link layer: L, C, M and A fields, the first block */
+#define WMBUS_HEADER_BYTES          10
+#define WMBUS_C_SND_NR              0x44
+#define WMBUS_CRC_BYTES             2
+#define WMBUS_BLOCK_BYTES           16          // later blocks of frame format A
+#define WMBUS_CRC_POLY              0x3D65
+
+/* Application layer: short header, no encryption */
+#define WMBUS_CI_SHORT              0x7A
+#define WMBUS_APP_HEADER_BYTES      5
+
+/* Records: 24 bit lux with a plain text unit, 16 bit age */
+#define WMBUS_DIF_INT16             0x02
+#define WMBUS_DIF_INT24             0x03
+#define WMBUS_DIF_STORAGE_LSB       0x40
+#define WMBUS_DIF_EXTENSION         0x80
+#define WMBUS_VIF_PLAIN_TEXT        0x7C
+#define WMBUS_VIF_AGE_S             0x74        // actuality duration
+#define WMBUS_VIF_AGE_MIN           0x75
+#define WMBUS_RECORD_MAX_BYTES      14
+
+/*****************************************************************************/
+// static function declarations
+static uint8_t WMbusFrameBytes(uint8_t cAppLen);
+static uint8_t WMbusDif(uint8_t *pcBuffer, uint8_t cDif, uint8_t cStorage);
+static uint8_t WMbusRecord(uint8_t *pcBuffer, uint8_t cStorage, const SAggReading *pxReading, uint32_t lNowTs);
+
+/*****************************************************************************/
+// static variable declarations
+static SWMbusConfig xWMbusConfig;
+static SWMbusStats xWMbusStats;
+static uint8_t cWMbusAccess;                  // access number, one step per telegram
+
+/* Unit of the lux records, least significant character first */
+static const uint8_t cWMbusLuxUnit[] = {'x', 'l'};
+
+/*****************************************************************************/
+// functions
+
+/** ***************************************************************************
+*   \brief      Keep the identity and clear the counters.
+*   \param      pxConfig     mode, identity and header lengths
+******************************************************************************/
+void WMbusInit(const SWMbusConfig *pxConfig)
+{
+	xWMbusConfig = *pxConfig;
+
+	memset(&xWMbusStats, 0, sizeof(xWMbusStats));
+	cWMbusAccess = 0;
+}
+
+/** ***************************************************************************
+*   \brief      Set the modem and the packet format of the mode, in place of
+*               the radio and packet configuration of the proprietary link.
+*   \details    T1 uses the WMBus packet format with the 3 out of 6 coder.
+*               C1 has no coding, its 32 bit sync word and fixed length fit
+*               the basic packet format, without CRC or whitening. The
+*               postamble register serves both formats.
+******************************************************************************/
+void WMbusConfigure(void)
+{
+	SRadioInit xRadio = {
+	  WMBUS_FREQUENCY_HZ,
+	  MOD_2FSK,
+	  WMBUS_CHIPRATE,
+	  WMBUS_T1_FREQ_DEVIATION,
+	  WMBUS_BANDWIDTH
+	};
+
+	if(xWMbusConfig.xMode == WMBUS_T1)
+	{
+		PktWMbusInit xPacket;
+
+		S2LPRadioInit(&xRadio);
+		xPacket.xWMbusSubmode = WMBUS_SUBMODE_T1_T2_METER_TO_OTHER;
+		xPacket.cPreambleLength = xWMbusConfig.cPreamble;
+		xPacket.cPostambleLength = xWMbusConfig.cPostamble;
+		S2LPPktWMbusInit(&xPacket);
+	}
+	else
+	{
+		PktBasicInit xPacket = {
+		  WMBUS_C1_PREAMBLE_PAIRS,
+		  WMBUS_C1_SYNC_BITS,
+		  WMBUS_C1_SYNC_WORD,
+		  S_DISABLE,
+		  S_DISABLE,
+		  PKT_NO_CRC,
+		  S_DISABLE,
+		  S_DISABLE,
+		  S_DISABLE
+		};
+
+		xRadio.lFreqDev = WMBUS_C1_FREQ_DEVIATION;
+		S2LPRadioInit(&xRadio);
+		xPacket.xPreambleLength += xWMbusConfig.cPreamble;
+		S2LPPktBasicInit(&xPacket);
+		S2LPPktWMbusSetPostamble(xWMbusConfig.cPostamble);
+	}
+}
+
+/** ***************************************************************************
+*   \brief      Set the length of the next telegram, CRCs included.
+*   \param      cLen     bytes in the TX FIFO
+******************************************************************************/
+void WMbusSetPayloadLength(uint8_t cLen)
+{
+	if(xWMbusConfig.xMode == WMBUS_T1)
+		S2LPPktWMbusSetPayloadLength(cLen);
+	else
+		S2LPPktBasicSetPayloadLength(cLen);
+}
+
+/** ***************************************************************************
+*   \brief      Build a telegram from an aggregated report.
+*   \details    The newest reading is the current value, storage number 0,
+*               the older ones follow with increasing storage numbers. Each
+*               has its age at lNowTs as an actuality duration, collectors
+*               date it from their reception time. Readings beyond the
+*               buffer are dropped and counted.
+*   \param      pcBuffer       telegram destination
+*   \param      cSize          buffer size, at most WMBUS_FRAME_MAX is used
+*   \param      pcReport       report from AggBuild()
+*   \param      cReportLen     report length
+*   \param      lNowTs         TimestampNow() when built
+*   \return     telegram length, 0 if the report is not valid
+******************************************************************************/
+uint8_t WMbusBuild(uint8_t *pcBuffer, uint8_t cSize, const uint8_t *pcReport, uint8_t cReportLen, uint32_t lNowTs)
+{
+	uint8_t cApp[WMBUS_FRAME_MAX];
+	uint8_t cRecord[WMBUS_RECORD_MAX_BYTES];
+	uint8_t cAppLen, cRecordLen, cLen, cBlock, cStorage = 0;
+	SAggHeader xHeader;
+	SAggReading xReading;
+	uint16_t nCrc;
+	uint8_t i;
+
+	if(cSize > WMBUS_FRAME_MAX)
+		cSize = WMBUS_FRAME_MAX;
+	if((AggParse(pcReport, cReportLen, &xHeader) != HAL_OK) || (WMbusFrameBytes(WMBUS_APP_HEADER_BYTES) > cSize))
+		return 0;
+
+	/* short application header: access number, status, configuration */
+	cApp[0] = WMBUS_CI_SHORT;
+	cApp[1] = cWMbusAccess++;
+	cApp[2] = 0x00;
+	cApp[3] = 0x00;
+	cApp[4] = 0x00;
+	cAppLen = WMBUS_APP_HEADER_BYTES;
+
+	for(i = xHeader.cCount; i > 0; i--)
+	{
+		if(AggGetReading(pcReport, cReportLen, i - 1, &xReading) != HAL_OK)
+			break;
+		cRecordLen = WMbusRecord(cRecord, cStorage, &xReading, lNowTs);
+		if(WMbusFrameBytes(cAppLen + cRecordLen) > cSize)
+		{
+			xWMbusStats.lDropped += i;
+			break;
+		}
+		memcpy(&cApp[cAppLen], cRecord, cRecordLen);
+		cAppLen += cRecordLen;
+		cStorage++;
+	}
+
+	/* link layer header, L without the CRCs in format A */
+	pcBuffer[0] = WMBUS_HEADER_BYTES - 1 + cAppLen;
+	if(xWMbusConfig.xMode == WMBUS_C1)
+		pcBuffer[0] += WMBUS_CRC_BYTES;
+	pcBuffer[1] = WMBUS_C_SND_NR;
+	pcBuffer[2] = (uint8_t)xWMbusConfig.nManufacturer;
+	pcBuffer[3] = (uint8_t)(xWMbusConfig.nManufacturer >> 8);
+	pcBuffer[4] = (uint8_t)xWMbusConfig.lId;
+	pcBuffer[5] = (uint8_t)(xWMbusConfig.lId >> 8);
+	pcBuffer[6] = (uint8_t)(xWMbusConfig.lId >> 16);
+	pcBuffer[7] = (uint8_t)(xWMbusConfig.lId >> 24);
+	pcBuffer[8] = xWMbusConfig.cVersion;
+	pcBuffer[9] = xWMbusConfig.cDeviceType;
+	cLen = WMBUS_HEADER_BYTES;
+
+	if(xWMbusConfig.xMode == WMBUS_T1)
+	{
+		/* format A: a CRC after the header and after every 16 bytes */
+		nCrc = WMbusCrc(pcBuffer, WMBUS_HEADER_BYTES);
+		pcBuffer[cLen++] = (uint8_t)(nCrc >> 8);
+		pcBuffer[cLen++] = (uint8_t)nCrc;
+		for(i = 0; i < cAppLen; i += cBlock)
+		{
+			cBlock = ((cAppLen - i) > WMBUS_BLOCK_BYTES) ? WMBUS_BLOCK_BYTES : (cAppLen - i);
+			memcpy(&pcBuffer[cLen], &cApp[i], cBlock);
+			nCrc = WMbusCrc(&pcBuffer[cLen], cBlock);
+			cLen += cBlock;
+			pcBuffer[cLen++] = (uint8_t)(nCrc >> 8);
+			pcBuffer[cLen++] = (uint8_t)nCrc;
+		}
+	}
+	else
+	{
+		/* format B: one CRC over the whole telegram, it fits the second block */
+		memcpy(&pcBuffer[cLen], cApp, cAppLen);
+		cLen += cAppLen;
+		nCrc = WMbusCrc(pcBuffer, cLen);
+		pcBuffer[cLen++] = (uint8_t)(nCrc >> 8);
+		pcBuffer[cLen++] = (uint8_t)nCrc;
+	}
+
+	xWMbusStats.lTelegrams++;
+	xWMbusStats.lReadings += cStorage;
+	xWMbusStats.lBytes += cLen;
+	xWMbusStats.llAirUs += WMbusAirUs(cLen);
+
+	return cLen;
+}
+
+/** ***************************************************************************
+*   \brief      EN 13757-4 CRC of a block, sent high byte first.
+*   \details    Bitwise, a telegram is a few dozen bytes once per report.
+*   \param      pcData     block
+*   \param      cLen       block length
+*   \return     CRC
+******************************************************************************/
+uint16_t WMbusCrc(const uint8_t *pcData, uint8_t cLen)
+{
+	uint16_t nCrc = 0;
+	uint8_t i, j;
+
+	for(i = 0; i < cLen; i++)
+	{
+		nCrc ^= (uint16_t)pcData[i] << 8;
+		for(j = 0; j < 8; j++)
+			nCrc = (nCrc & 0x8000) ? (uint16_t)((nCrc << 1) ^ WMBUS_CRC_POLY) : (uint16_t)(nCrc << 1);
+	}
+
+	return (uint16_t)~nCrc;
+}
+
+/** ***************************************************************************
+*   \brief      Air time of a telegram, 10 us per chip.
+*   \details    T1 sends 12 chips per byte, C1 8.
+*   \param      cLen     telegram length, CRCs included
+*   \return     us
+******************************************************************************/
+uint32_t WMbusAirUs(uint8_t cLen)
+{
+	uint32_t lChips;
+
+	if(xWMbusConfig.xMode == WMBUS_T1)
+		lChips = 2UL * (WMBUS_T1_PREAMBLE_PAIRS + xWMbusConfig.cPreamble) + WMBUS_T1_SYNC_BITS + 12UL * cLen;
+	else
+		lChips = 2UL * (WMBUS_C1_PREAMBLE_PAIRS + xWMbusConfig.cPreamble) + WMBUS_C1_SYNC_BITS + 8UL * cLen;
+	lChips += 2UL * xWMbusConfig.cPostamble;
+
+	return (lChips * 1000000UL) / WMBUS_CHIPRATE;
+}
+
+/** ***************************************************************************
+*   \brief      Copy out the counters.
+*   \param      pxStats     destination
+******************************************************************************/
+void WMbusGetStats(SWMbusStats *pxStats)
+{
+	*pxStats = xWMbusStats;
+}
+
+/** ***************************************************************************
+*   \brief      Telegram length for an application layer length.
+*   \param      cAppLen     application layer bytes, CI field included
+*   \return     bytes, CRCs included
+******************************************************************************/
+static uint8_t WMbusFrameBytes(uint8_t cAppLen)
+{
+	uint16_t nLen = WMBUS_HEADER_BYTES + cAppLen + WMBUS_CRC_BYTES;
+
+	if(xWMbusConfig.xMode == WMBUS_T1)
+		nLen += WMBUS_CRC_BYTES * ((cAppLen + WMBUS_BLOCK_BYTES - 1) / WMBUS_BLOCK_BYTES);
+
+	return (nLen > 0xFF) ? 0xFF : (uint8_t)nLen;
+}
+
+/** ***************************************************************************
+*   \brief      Data information field with its storage number.
+*   \details    The lowest bit of the storage number is in the DIF, the next
+*               four in an extension.
+*   \param      pcBuffer     destination
+*   \param      cDif         data field coding
+*   \param      cStorage     storage number, up to 31
+*   \return     bytes written
+******************************************************************************/
+static uint8_t WMbusDif(uint8_t *pcBuffer, uint8_t cDif, uint8_t cStorage)
+{
+	pcBuffer[0] = cDif | ((cStorage & 0x01) ? WMBUS_DIF_STORAGE_LSB : 0);
+	if(cStorage < 2)
+		return 1;
+
+	pcBuffer[0] |= WMBUS_DIF_EXTENSION;
+	pcBuffer[1] = (cStorage >> 1) & 0x0F;
+
+	return 2;
+}
+
+/** ***************************************************************************
+*   \brief      Lux and age records of a reading.
+*   \details    Lux has no unit code of its own, it goes as plain text. The
+*               age is in seconds, in minutes beyond 18 hours.
+*   \param      pcBuffer      destination, WMBUS_RECORD_MAX_BYTES
+*   \param      cStorage      storage number
+*   \param      pxReading     reading
+*   \param      lNowTs        TimestampNow() when built
+*   \return     bytes written
+******************************************************************************/
+static uint8_t WMbusRecord(uint8_t *pcBuffer, uint8_t cStorage, const SAggReading *pxReading, uint32_t lNowTs)
+{
+	uint32_t lAge = (lNowTs - pxReading->lTimestamp) / TIMESTAMP_ONE_S;
+	uint8_t cVif = WMBUS_VIF_AGE_S;
+	uint8_t cLen;
+
+	cLen = WMbusDif(pcBuffer, WMBUS_DIF_INT24, cStorage);
+	pcBuffer[cLen++] = WMBUS_VIF_PLAIN_TEXT;
+	pcBuffer[cLen++] = sizeof(cWMbusLuxUnit);
+	memcpy(&pcBuffer[cLen], cWMbusLuxUnit, sizeof(cWMbusLuxUnit));
+	cLen += sizeof(cWMbusLuxUnit);
+	pcBuffer[cLen++] = (uint8_t)pxReading->lLux;
+	pcBuffer[cLen++] = (uint8_t)(pxReading->lLux >> 8);
+	pcBuffer[cLen++] = (uint8_t)(pxReading->lLux >> 16);
+
+	if(lAge > 0xFFFF)
+	{
+		lAge /= 60;
+		cVif = WMBUS_VIF_AGE_MIN;
+		if(lAge > 0xFFFF)
+			lAge = 0xFFFF;
+	}
+	cLen += WMbusDif(&pcBuffer[cLen], WMBUS_DIF_INT16, cStorage);
+	pcBuffer[cLen++] = cVif;
+	pcBuffer[cLen++] = (uint8_t)lAge;
+	pcBuffer[cLen++] = (uint8_t)(lAge >> 8);
+
+	return cLen;
+}
+
+// close the Doxygen group
+/**
+\}
+*/
+
+/* end of file */
@@ -36,6 +36,10 @@
 #include "stm32l0xx_it.h"
 
 /* USER CODE BEGIN 0 */
+#include "mg_Flicker.h"
+
+extern ADC_HandleTypeDef hadc;
+extern RTC_HandleTypeDef hrtc;
 
 /* USER CODE END 0 */
 
@@ -153,5 +157,29 @@ void SPI1_IRQHandler(void)
 
 /* USER CODE BEGIN 1 */
 
+/**
+* @brief This function handles DMA1 channel 1 interrupt (ADC burst acquisitions).
+*/
+void DMA1_Channel1_IRQHandler(void)
+{
+  FlickerDmaIrqHandler();
+}
+
+/**
+* @brief This function handles ADC and comparator interrupts (analog watchdog wake).
+*/
+void ADC1_COMP_IRQHandler(void)
+{
+  HAL_ADC_IRQHandler(&hadc);
+}
+
+/**
+* @brief This function handles RTC interrupts (wake-up timer).
+*/
+void RTC_IRQHandler(void)
+{
+  HAL_RTCEx_WakeUpTimerIRQHandler(&hrtc);
+}
+
 /* USER CODE END 1 */
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/